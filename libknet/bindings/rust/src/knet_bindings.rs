@@ -85,6 +85,9 @@ bitflags! {
     pub struct LinkFlags: u64
     {
         const TRAFFICHIPRIO = 1;
+        const UDP_GSO = 2;
+        const UDP_GRO = 4;
+        const ZEROCOPY = 8;
 	const NONE = 0;
     }
 }
@@ -711,6 +714,66 @@ pub fn send(handle: &Handle, buf: &[u8], channel: i8) -> Result<isize>
     }
 }
 
+/// Send multiple messages to knet with one call, each (buffer, channel) pair
+/// is a message. Returns the number of bytes sent for each message that
+/// went out, messages are sent in order.
+pub fn sendmmsg(handle: &Handle, msgs: &[(&[u8], i8)]) -> Result<Vec<isize>>
+{
+    let mut c_msgs: Vec<ffi::knet_msg> = msgs.iter().map(|(buf, channel)| {
+	ffi::knet_msg {
+	    buff: buf.as_ptr() as *mut c_void,
+	    buff_len: buf.len(),
+	    channel: *channel,
+	    msg_len: 0,
+	}
+    }).collect();
+
+    let res = unsafe {
+	ffi::knet_sendmmsg(handle.knet_handle as ffi::knet_handle_t,
+			   c_msgs.as_mut_ptr(),
+			   c_msgs.len() as c_uint)
+    };
+    if res >= 0 {
+	Ok(c_msgs[0..res as usize].iter().map(|m| m.msg_len).collect())
+    } else {
+	if get_errno() == libc::EAGAIN {
+	    Err(Error::new(ErrorKind::WouldBlock, "Try again"))
+	} else {
+	    Err(Error::last_os_error())
+	}
+    }
+}
+
+/// Receive multiple messages from knet with one call, each (buffer, channel)
+/// pair is filled with a message from that channel. Returns the number of
+/// bytes received for each buffer that has been filled, in order.
+pub fn recvmmsg(handle: &Handle, msgs: &mut [(&mut [u8], i8)]) -> Result<Vec<isize>>
+{
+    let mut c_msgs: Vec<ffi::knet_msg> = msgs.iter_mut().map(|(buf, channel)| {
+	ffi::knet_msg {
+	    buff: buf.as_mut_ptr() as *mut c_void,
+	    buff_len: buf.len(),
+	    channel: *channel,
+	    msg_len: 0,
+	}
+    }).collect();
+
+    let res = unsafe {
+	ffi::knet_recvmmsg(handle.knet_handle as ffi::knet_handle_t,
+			   c_msgs.as_mut_ptr(),
+			   c_msgs.len() as c_uint)
+    };
+    if res >= 0 {
+	Ok(c_msgs[0..res as usize].iter().map(|m| m.msg_len).collect())
+    } else {
+	if get_errno() == libc::EAGAIN {
+	    Err(Error::new(ErrorKind::WouldBlock, "Try again"))
+	} else {
+	    Err(Error::last_os_error())
+	}
+    }
+}
+
 /// Send messages to knet and wait till they have gone
 pub fn send_sync(handle: &Handle, buf: &[u8], channel: i8) -> Result<()>
 {
@@ -791,6 +854,60 @@ pub fn handle_get_threads_timer_res(handle: &Handle) -> Result<u32>
     }
 }
 
+/// Set the number of TX threads
+pub fn handle_set_tx_threads(handle: &Handle, tx_threads: u8) -> Result<()>
+{
+    let res = unsafe {
+	ffi::knet_handle_set_tx_threads(handle.knet_handle as ffi::knet_handle_t, tx_threads)
+    };
+    if res == 0 {
+	Ok(())
+    } else {
+	Err(Error::last_os_error())
+    }
+}
+
+/// Get the number of TX threads
+pub fn handle_get_tx_threads(handle: &Handle) -> Result<u8>
+{
+    let mut c_tx_threads: u8 = 0;
+    let res = unsafe {
+	ffi::knet_handle_get_tx_threads(handle.knet_handle as ffi::knet_handle_t, &mut c_tx_threads)
+    };
+    if res == 0 {
+	Ok(c_tx_threads)
+    } else {
+	Err(Error::last_os_error())
+    }
+}
+
+/// Set the number of crypto threads
+pub fn handle_set_crypto_threads(handle: &Handle, crypto_threads: u8) -> Result<()>
+{
+    let res = unsafe {
+	ffi::knet_handle_set_crypto_threads(handle.knet_handle as ffi::knet_handle_t, crypto_threads)
+    };
+    if res == 0 {
+	Ok(())
+    } else {
+	Err(Error::last_os_error())
+    }
+}
+
+/// Get the number of crypto threads
+pub fn handle_get_crypto_threads(handle: &Handle) -> Result<u8>
+{
+    let mut c_crypto_threads: u8 = 0;
+    let res = unsafe {
+	ffi::knet_handle_get_crypto_threads(handle.knet_handle as ffi::knet_handle_t, &mut c_crypto_threads)
+    };
+    if res == 0 {
+	Ok(c_crypto_threads)
+    } else {
+	Err(Error::last_os_error())
+    }
+}
+
 
 
 /// Starts traffic moving. You must call this before knet will do anything.
@@ -349,6 +349,17 @@ fn configure_link(knet_handle: &knet::Handle, our_hostid: &knet::HostId, other_h
     Ok(())
 }
 
+fn print_recvd(host: &knet::HostId, buf: &[u8]) -> bool
+{
+    let s = String::from_utf8(buf.to_vec()).unwrap();
+    println!("recvd on {}: {} {:?}  {} ", host, buf.len(), buf, s);
+    if s == *"QUIT" {
+	println!("got QUIT on {host}, exitting");
+	return true;
+    }
+    false
+}
+
 fn recv_stuff(handle: &knet::Handle, host: knet::HostId) -> Result<()>
 {
     let buf = [0u8; 1024];
@@ -359,13 +370,8 @@ fn recv_stuff(handle: &knet::Handle, host: knet::HostId) -> Result<()>
 		let recv_len = len as usize;
 		if recv_len == 0 {
 		    break; // EOF??
-		} else {
-		    let s = String::from_utf8(buf[0..recv_len].to_vec()).unwrap();
-		    println!("recvd on {}: {} {:?}  {} ", host, recv_len, &buf[0..recv_len], s);
-		    if s == *"QUIT" {
-			println!("got QUIT on {host}, exitting");
-			break;
-		    }
+		} else if print_recvd(&host, &buf[0..recv_len]) {
+		    break;
 		}
 	    }
 	    Err(e) => {
@@ -381,6 +387,37 @@ fn recv_stuff(handle: &knet::Handle, host: knet::HostId) -> Result<()>
     Ok(())
 }
 
+// Same as recv_stuff but using recvmmsg to read several messages at once
+fn recvmmsg_stuff(handle: &knet::Handle, host: knet::HostId) -> Result<()>
+{
+    let mut bufs = [[0u8; 1024]; 4];
+
+    loop {
+	let mut msgs: Vec<(&mut [u8], i8)> = bufs.iter_mut().map(|b| (&mut b[..], CHANNEL)).collect();
+	match knet::recvmmsg(handle, &mut msgs) {
+	    Ok(lens) => {
+		for (i, len) in lens.iter().enumerate() {
+		    let recv_len = *len as usize;
+		    if recv_len == 0 {
+			return Ok(()); // EOF??
+		    }
+		    if print_recvd(&host, &msgs[i].0[0..recv_len]) {
+			return Ok(());
+		    }
+		}
+	    }
+	    Err(e) => {
+		if e.kind() == ErrorKind::WouldBlock {
+		    thread::sleep(get_scaled_tmo(100));
+		} else {
+		    println!("recvmmsg failed: {e}");
+		    return Err(e);
+		}
+	    }
+	}
+    }
+}
+
 
 fn close_handle(handle: &knet::Handle, remnode: u16) -> Result<()>
 {
@@ -493,6 +530,20 @@ fn send_messages(handle: &knet::Handle, send_quit: bool) -> Result<()>
 	}
     }
 
+    let b1 = String::from("BATCH 1").into_bytes();
+    let b2 = String::from("BATCH 2").into_bytes();
+    match knet::sendmmsg(handle, &[(&b1, CHANNEL), (&b2, CHANNEL)]) {
+	Ok(lens) => {
+	    if lens.len() != 2 || lens[0] as usize != b1.len() || lens[1] as usize != b2.len() {
+		println!("sendmmsg sent {lens:?} instead of [{}, {}]", b1.len(), b2.len());
+	    }
+	},
+	Err(e) => {
+	    println!("sendmmsg failed: {e}");
+	    return Err(e);
+	}
+    }
+
     let s = String::from("SYNC TEST").into_bytes();
     if let Err(e) = knet::send_sync(handle, &s, CHANNEL) {
 	println!("send_sync failed: {e}");
@@ -566,6 +617,38 @@ fn test_metadata_calls(handle: &knet::Handle, host: &knet::HostId) -> Result<()>
 	}
     }
 
+    if let Err(e) = knet::handle_set_tx_threads(handle, 2) {
+	println!("knet_handle_set_tx_threads failed: {e:?}");
+	return Err(e);
+    }
+    match knet::handle_get_tx_threads(handle) {
+	Ok(v) => {
+	    if v != 2 {
+		println!("knet_handle_get_tx_threads returned wrong value {v}");
+	    }
+	},
+	Err(e) => {
+	    println!("knet_handle_get_tx_threads failed: {e:?}");
+	    return Err(e);
+	}
+    }
+
+    if let Err(e) = knet::handle_set_crypto_threads(handle, 2) {
+	println!("knet_handle_set_crypto_threads failed: {e:?}");
+	return Err(e);
+    }
+    match knet::handle_get_crypto_threads(handle) {
+	Ok(v) => {
+	    if v != 2 {
+		println!("knet_handle_get_crypto_threads returned wrong value {v}");
+	    }
+	},
+	Err(e) => {
+	    println!("knet_handle_get_crypto_threads failed: {e:?}");
+	    return Err(e);
+	}
+    }
+
     if let Err(e) = knet::handle_pmtud_set(handle, 1000) {
 	println!("knet_handle_pmtud_set failed: {e:?}");
 	return Err(e);
@@ -914,7 +997,7 @@ fn main() -> Result<()>
     // Start recv threads for each handle
     let thread_handles = vec![
 	spawn(move || recv_stuff(&handle1_clone, host1_clone)),
-	spawn(move || recv_stuff(&handle2_clone, host2_clone))
+	spawn(move || recvmmsg_stuff(&handle2_clone, host2_clone))
     ];
 
     send_messages(&handle1, false)?;
@@ -77,6 +77,7 @@ int crypto_authenticate_and_decrypt (
 	int i, err = 0;
 	int multiple_configs = 0;
 	uint8_t log_level = KNET_LOG_ERR;
+	uint8_t first_config = knet_h->crypto_in_use_config;
 
 	for (i = 1; i <= KNET_MAX_CRYPTO_INSTANCES; i++) {
 		if (knet_h->crypto_instance[i]) {
@@ -85,16 +86,24 @@ int crypto_authenticate_and_decrypt (
 	}
 
 	/*
-	 * attempt to decrypt first with the in-use config
+	 * attempt to decrypt first with the config the sender
+	 * used (see crypto_model.h), or the in-use config,
 	 * to avoid excessive performance hit.
+	 * Older versions of knet send random data in place of the
+	 * config id, so it can only be trusted as a hint.
 	 */
 
 	if (multiple_configs > 1) {
 		log_level = KNET_LOG_DEBUG;
+		if ((buf_in_len > 0) &&
+		    (buf_in[0] > 0) && (buf_in[0] <= KNET_MAX_CRYPTO_INSTANCES) &&
+		    (knet_h->crypto_instance[buf_in[0]])) {
+			first_config = buf_in[0];
+		}
 	}
 
-	if (knet_h->crypto_in_use_config) {
-		err = crypto_modules_cmds[knet_h->crypto_instance[knet_h->crypto_in_use_config]->model].ops->decrypt(knet_h, knet_h->crypto_instance[knet_h->crypto_in_use_config], buf_in, buf_in_len, buf_out, buf_out_len, log_level);
+	if (first_config) {
+		err = crypto_modules_cmds[knet_h->crypto_instance[first_config]->model].ops->decrypt(knet_h, knet_h->crypto_instance[first_config], buf_in, buf_in_len, buf_out, buf_out_len, log_level);
 	} else {
 		err = -1;
 	}
@@ -105,9 +114,9 @@ int crypto_authenticate_and_decrypt (
 	if (err) {
 		for (i = 1; i <= KNET_MAX_CRYPTO_INSTANCES; i++) {
 			/*
-			 * in-use config was already attempted
+			 * first config was already attempted
 			 */
-			if (i == knet_h->crypto_in_use_config) {
+			if (i == first_config) {
 				continue;
 			}
 			if (knet_h->crypto_instance[i]) {
@@ -270,6 +279,7 @@ static int crypto_init(
 	 * crypto_modules_cmds.ops->fini is not invoked on error.
 	 */
 	new->model = model;
+	new->config_id = config_num;
 	if (crypto_modules_cmds[model].ops->init(knet_h, new, knet_handle_crypto_cfg)) {
 		savederrno = errno;
 		err = -1;
@@ -42,7 +42,9 @@ struct gcryptcrypto_instance {
 	size_t crypt_private_key_len;
 	size_t hash_private_key_len;
 	int crypto_cipher_type;
+	int crypto_cipher_mode;
 	int crypto_hash_type;
+	struct crypto_aead_nonce aead_nonce;
 };
 
 static int gcrypt_is_init = 0;
@@ -88,6 +90,7 @@ static int encrypt_gcrypt(
 	}
 
 	gcry_randomize(salt, SALT_SIZE, GCRY_VERY_STRONG_RANDOM);
+	salt[0] = crypto_instance->config_id; /* see crypto_model.h */
 
 	gerr = gcry_cipher_setiv(handle, salt, SALT_SIZE);
 	if (gerr) {
@@ -225,6 +228,198 @@ out_err:
 	return err;
 }
 
+/*
+ * AEAD: nonce, ciphertext and tag in one pass, no padding
+ */
+static int encrypt_gcrypt_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	const struct iovec *iov,
+	int iovcnt,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len)
+{
+	struct gcryptcrypto_instance *instance = crypto_instance->model_instance;
+	gcry_error_t	 gerr;
+	gcry_cipher_hd_t handle = NULL;
+	int		 err = 0;
+	int		 i;
+	unsigned char	 *nonce = buf_out + KNET_CRYPTO_CONFIG_ID_SIZE;
+	unsigned char	 *data = nonce + KNET_CRYPTO_AEAD_NONCE_SIZE;
+	size_t		 output_len = 0;
+
+	gerr = gcry_cipher_open(&handle, instance->crypto_cipher_type, instance->crypto_cipher_mode, GCRY_CIPHER_SECURE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to allocate gcrypt cipher context: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_setkey(handle, instance->private_key, instance->crypt_private_key_len);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to load private key: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	buf_out[0] = crypto_instance->config_id;
+	crypto_aead_nonce_next(&instance->aead_nonce, nonce); /* see crypto_model.h */
+
+	gerr = gcry_cipher_setiv(handle, nonce, KNET_CRYPTO_AEAD_NONCE_SIZE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to load nonce: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	/*
+	 * the config id travels in clear, authenticate it as AAD
+	 */
+	gerr = gcry_cipher_authenticate(handle, buf_out, KNET_CRYPTO_CONFIG_ID_SIZE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to authenticate config id: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	/*
+	 * build the data in place and encrypt it in one go,
+	 * see encrypt_gcrypt for _final
+	 */
+	for (i=0; i<iovcnt; i++) {
+		memmove(data + output_len, iov[i].iov_base, iov[i].iov_len);
+		output_len = output_len + iov[i].iov_len;
+	}
+
+	gcry_cipher_final(handle);
+
+	gerr = gcry_cipher_encrypt(handle, data, output_len, NULL, 0);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to encrypt data: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_gettag(handle, data + output_len, KNET_CRYPTO_AEAD_TAG_SIZE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to get authentication tag: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	*buf_out_len = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE + output_len + KNET_CRYPTO_AEAD_TAG_SIZE;
+
+out_err:
+	if (handle) {
+		gcry_cipher_close(handle);
+	}
+	return err;
+}
+
+static int decrypt_gcrypt_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	const unsigned char *buf_in,
+	const ssize_t buf_in_len,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len,
+	uint8_t log_level)
+{
+	struct gcryptcrypto_instance *instance = crypto_instance->model_instance;
+	gcry_error_t	 gerr;
+	gcry_cipher_hd_t handle = NULL;
+	unsigned char	*nonce = (unsigned char *)buf_in + KNET_CRYPTO_CONFIG_ID_SIZE;
+	unsigned char	*data = nonce + KNET_CRYPTO_AEAD_NONCE_SIZE;
+	ssize_t		datalen = buf_in_len - (KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE + KNET_CRYPTO_AEAD_TAG_SIZE);
+	int		err = 0;
+
+	if ((datalen <= 0) || (datalen > KNET_MAX_PACKET_SIZE)) {
+		log_debug(knet_h, KNET_SUB_GCRYPTCRYPTO, "Received incorrect packet size: %zu", buf_in_len);
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_open(&handle, instance->crypto_cipher_type, instance->crypto_cipher_mode, GCRY_CIPHER_SECURE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to allocate gcrypt cipher context: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_setkey(handle, instance->private_key, instance->crypt_private_key_len);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to load private key: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_setiv(handle, nonce, KNET_CRYPTO_AEAD_NONCE_SIZE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to load nonce: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_authenticate(handle, buf_in, KNET_CRYPTO_CONFIG_ID_SIZE);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to authenticate config id: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gcry_cipher_final(handle);
+
+	gerr = gcry_cipher_decrypt(handle,
+				   buf_out, KNET_DATABUFSIZE_CRYPT,
+				   data, datalen);
+	if (gerr) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO,
+			"Unable to decrypt data: %s/%s",
+			gcry_strsource(gerr), gcry_strerror(gerr));
+		err = -1;
+		goto out_err;
+	}
+
+	gerr = gcry_cipher_checktag(handle, data + datalen, KNET_CRYPTO_AEAD_TAG_SIZE);
+	if (gerr) {
+		if (log_level == KNET_LOG_DEBUG) {
+			log_debug(knet_h, KNET_SUB_GCRYPTCRYPTO, "Tag does not match. Check crypto key and configuration.");
+		} else {
+			log_err(knet_h, KNET_SUB_GCRYPTCRYPTO, "Tag does not match. Check crypto key and configuration.");
+		}
+		err = -1;
+		goto out_err;
+	}
+
+	*buf_out_len = datalen;
+
+out_err:
+	if (handle) {
+		gcry_cipher_close(handle);
+	}
+	return err;
+}
+
 /*
  * hash/hmac/digest functions
  */
@@ -302,6 +497,10 @@ static int gcryptcrypto_encrypt_and_signv (
 	struct gcryptcrypto_instance *instance = crypto_instance->model_instance;
 	int i;
 
+	if (instance->crypto_cipher_mode != GCRY_CIPHER_MODE_CBC) {
+		return encrypt_gcrypt_aead(knet_h, crypto_instance, iov_in, iovcnt_in, buf_out, buf_out_len);
+	}
+
 	if (instance->crypto_cipher_type) {
 		if (encrypt_gcrypt(knet_h, crypto_instance, iov_in, iovcnt_in, buf_out, buf_out_len) < 0) {
 			return -1;
@@ -353,6 +552,10 @@ static int gcryptcrypto_authenticate_and_decrypt (
 	struct gcryptcrypto_instance *instance = crypto_instance->model_instance;
 	ssize_t temp_len = buf_in_len;
 
+	if (instance->crypto_cipher_mode != GCRY_CIPHER_MODE_CBC) {
+		return decrypt_gcrypt_aead(knet_h, crypto_instance, buf_in, buf_in_len, buf_out, buf_out_len, log_level);
+	}
+
 	if (instance->crypto_hash_type) {
 		unsigned char tmp_hash[crypto_instance->sec_hash_size];
 		ssize_t temp_buf_len = buf_in_len - crypto_instance->sec_hash_size;
@@ -424,6 +627,12 @@ static int gcryptcrypto_init(
 	 * can be done transparently.
 	 */
 	char remap_hash_type[sizeof(knet_handle_crypto_cfg->crypto_hash_type) + strlen("HMAC_") + 1];
+	/*
+	 * AEAD ciphers use the nss/openssl names, <cipher>-gcm and chacha20-poly,
+	 * gcrypt wants the algo name and the mode separately.
+	 */
+	char remap_cipher_type[sizeof(knet_handle_crypto_cfg->crypto_cipher_type)];
+	size_t cipher_type_len;
 
 	log_debug(knet_h, KNET_SUB_GCRYPTCRYPTO,
 		  "Initializing gcrypt crypto module [%s/%s]",
@@ -504,10 +713,24 @@ static int gcryptcrypto_init(
 	}
 	memmove(gcryptcrypto_instance->private_key, knet_handle_crypto_cfg->private_key, knet_handle_crypto_cfg->private_key_len);
 
+	gcryptcrypto_instance->crypto_cipher_mode = GCRY_CIPHER_MODE_CBC;
+
 	if (strcmp(knet_handle_crypto_cfg->crypto_cipher_type, "none") == 0) {
 		gcryptcrypto_instance->crypto_cipher_type = 0;
 	} else {
-		gcryptcrypto_instance->crypto_cipher_type = gcry_cipher_map_name(knet_handle_crypto_cfg->crypto_cipher_type);
+		strncpy(remap_cipher_type, knet_handle_crypto_cfg->crypto_cipher_type, sizeof(remap_cipher_type) - 1);
+		remap_cipher_type[sizeof(remap_cipher_type) - 1] = 0;
+		cipher_type_len = strlen(remap_cipher_type);
+		if (!strcmp(remap_cipher_type, "chacha20-poly")) {
+			remap_cipher_type[strlen("chacha20")] = 0;
+			gcryptcrypto_instance->crypto_cipher_mode = GCRY_CIPHER_MODE_POLY1305;
+		} else if ((cipher_type_len > strlen("-gcm")) &&
+			   (!strcmp(remap_cipher_type + cipher_type_len - strlen("-gcm"), "-gcm"))) {
+			remap_cipher_type[cipher_type_len - strlen("-gcm")] = 0;
+			gcryptcrypto_instance->crypto_cipher_mode = GCRY_CIPHER_MODE_GCM;
+		}
+
+		gcryptcrypto_instance->crypto_cipher_type = gcry_cipher_map_name(remap_cipher_type);
 		if (!gcryptcrypto_instance->crypto_cipher_type) {
 			log_err(knet_h, KNET_SUB_GCRYPTCRYPTO, "unknown crypto cipher type requested");
 			savederrno = EINVAL;
@@ -549,13 +772,30 @@ static int gcryptcrypto_init(
 		gcryptcrypto_instance->hash_private_key_len = knet_handle_crypto_cfg->private_key_len;
 	}
 
+	if ((gcryptcrypto_instance->crypto_cipher_mode != GCRY_CIPHER_MODE_CBC) &&
+	    (gcryptcrypto_instance->crypto_hash_type)) {
+		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO, "AEAD ciphers do not use a hash, set hash to none");
+		savederrno = EINVAL;
+		goto out_err;
+	}
+
 	if ((gcryptcrypto_instance->crypto_cipher_type) &&
+	    (gcryptcrypto_instance->crypto_cipher_mode == GCRY_CIPHER_MODE_CBC) &&
 	    (!gcryptcrypto_instance->crypto_hash_type)) {
 		log_err(knet_h, KNET_SUB_GCRYPTCRYPTO, "crypto communication requires hash specified");
 		savederrno = EINVAL;
 		goto out_err;
 	}
 
+	if (gcryptcrypto_instance->crypto_cipher_mode != GCRY_CIPHER_MODE_CBC) {
+		gcry_create_nonce(gcryptcrypto_instance->aead_nonce.prefix, KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE);
+		gcry_create_nonce(&gcryptcrypto_instance->aead_nonce.counter, sizeof(uint64_t));
+		crypto_instance->sec_salt_size = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE;
+		crypto_instance->sec_hash_size = KNET_CRYPTO_AEAD_TAG_SIZE;
+		crypto_instance->sec_block_size = 0;
+		return 0;
+	}
+
 	if (gcryptcrypto_instance->crypto_hash_type) {
 		crypto_instance->sec_hash_size = gcry_mac_get_algo_maclen(gcryptcrypto_instance->crypto_hash_type);
 		if (!crypto_instance->sec_hash_size) {
@@ -9,6 +9,8 @@
 #ifndef __KNET_CRYPTO_MODEL_H__
 #define __KNET_CRYPTO_MODEL_H__
 
+#include <string.h>
+
 #include "internals.h"
 
 struct crypto_instance {
@@ -17,9 +19,62 @@ struct crypto_instance {
 	size_t	sec_block_size;
 	size_t	sec_hash_size;
 	size_t	sec_salt_size;
+	uint8_t	config_id;
+};
+
+#define KNET_CRYPTO_MODEL_ABI 5
+
+/*
+ * the first byte of every encrypted packet carries the config_id
+ * (1 .. KNET_MAX_CRYPTO_INSTANCES) of the instance that encrypted it,
+ * so that the receiving side can pick the matching config during key
+ * rotation instead of trying them all. CBC ciphers store it in the
+ * first byte of the salt, which older versions use as plain IV data,
+ * AEAD ciphers carry it in front of the nonce.
+ * Packets with a hash but no cipher have no room for it.
+ */
+#define KNET_CRYPTO_CONFIG_ID_SIZE 1
+
+/*
+ * AEAD ciphers (aes*-gcm, chacha20-poly) encrypt and authenticate
+ * in a single pass and don't take a hash. All models use the same
+ * packet layout for them: config id, nonce, ciphertext, tag. The config
+ * id is sent in clear and authenticated as AAD, so it cannot be altered
+ * without failing the tag check. They report
+ * sec_salt_size = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE,
+ * sec_hash_size = KNET_CRYPTO_AEAD_TAG_SIZE and no sec_block_size.
+ */
+#define KNET_CRYPTO_AEAD_NONCE_SIZE 12
+#define KNET_CRYPTO_AEAD_TAG_SIZE   16
+
+/*
+ * AEAD nonces must never repeat under the same key. Random 96 bit
+ * nonces start to collide after about 2^32 packets, which a long
+ * lived key can reach. Each instance instead builds its nonces from
+ * a random 32 bit prefix followed by a 64 bit counter (starting at
+ * a random value), both drawn by the model at init time. The counter
+ * is shared by all the threads that encrypt with the instance, so a
+ * nonce cannot repeat for the lifetime of the key. The random prefix
+ * and start keep the nodes sharing the key apart.
+ */
+#define KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE 4
+
+struct crypto_aead_nonce {
+	unsigned char	prefix[KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE];
+	uint64_t	counter;
 };
 
-#define KNET_CRYPTO_MODEL_ABI 4
+static inline void crypto_aead_nonce_next(struct crypto_aead_nonce *aead_nonce, unsigned char *nonce)
+{
+	uint64_t counter = __atomic_fetch_add(&aead_nonce->counter, 1, __ATOMIC_RELAXED);
+	int i;
+
+	memmove(nonce, aead_nonce->prefix, KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE);
+	for (i = KNET_CRYPTO_AEAD_NONCE_SIZE - 1; i >= KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE; i--) {
+		nonce[i] = counter & 0xff;
+		counter >>= 8;
+	}
+}
 
 /*
  * see compress_model.h for explanation of the various lib related functions
@@ -60,32 +60,64 @@ static void nss_atexit_handler(void)
 #define AES_128_KEY_LENGTH 16
 #endif
 
+#define CHACHA20_KEY_LENGTH 32
+
 enum nsscrypto_crypt_t {
 	CRYPTO_CIPHER_TYPE_NONE = 0,
 	CRYPTO_CIPHER_TYPE_AES256 = 1,
 	CRYPTO_CIPHER_TYPE_AES192 = 2,
-	CRYPTO_CIPHER_TYPE_AES128 = 3
+	CRYPTO_CIPHER_TYPE_AES128 = 3,
+	CRYPTO_CIPHER_TYPE_AES256_GCM = 4,
+	CRYPTO_CIPHER_TYPE_AES192_GCM = 5,
+	CRYPTO_CIPHER_TYPE_AES128_GCM = 6,
+	CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305 = 7
 };
 
 CK_MECHANISM_TYPE cipher_to_nss[] = {
 	0,				/* CRYPTO_CIPHER_TYPE_NONE */
 	CKM_AES_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_AES256 */
 	CKM_AES_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_AES192 */
-	CKM_AES_CBC_PAD			/* CRYPTO_CIPHER_TYPE_AES128 */
+	CKM_AES_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_AES128 */
+	CKM_AES_GCM,			/* CRYPTO_CIPHER_TYPE_AES256_GCM */
+	CKM_AES_GCM,			/* CRYPTO_CIPHER_TYPE_AES192_GCM */
+	CKM_AES_GCM,			/* CRYPTO_CIPHER_TYPE_AES128_GCM */
+	CKM_NSS_CHACHA20_POLY1305	/* CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305 */
 };
 
 size_t nsscipher_key_len[] = {
 	0,				/* CRYPTO_CIPHER_TYPE_NONE */
 	AES_256_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES256 */
 	AES_192_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES192 */
-	AES_128_KEY_LENGTH		/* CRYPTO_CIPHER_TYPE_AES128 */
+	AES_128_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES128 */
+	AES_256_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES256_GCM */
+	AES_192_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES192_GCM */
+	AES_128_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES128_GCM */
+	CHACHA20_KEY_LENGTH		/* CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305 */
 };
 
 size_t nsscypher_block_len[] = {
 	0,				/* CRYPTO_CIPHER_TYPE_NONE */
 	AES_BLOCK_SIZE,			/* CRYPTO_CIPHER_TYPE_AES256 */
 	AES_BLOCK_SIZE,			/* CRYPTO_CIPHER_TYPE_AES192 */
-	AES_BLOCK_SIZE			/* CRYPTO_CIPHER_TYPE_AES128 */
+	AES_BLOCK_SIZE,			/* CRYPTO_CIPHER_TYPE_AES128 */
+	0,				/* CRYPTO_CIPHER_TYPE_AES256_GCM */
+	0,				/* CRYPTO_CIPHER_TYPE_AES192_GCM */
+	0,				/* CRYPTO_CIPHER_TYPE_AES128_GCM */
+	0				/* CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305 */
+};
+
+/*
+ * AEAD ciphers, see crypto_model.h
+ */
+int nsscipher_aead[] = {
+	0,				/* CRYPTO_CIPHER_TYPE_NONE */
+	0,				/* CRYPTO_CIPHER_TYPE_AES256 */
+	0,				/* CRYPTO_CIPHER_TYPE_AES192 */
+	0,				/* CRYPTO_CIPHER_TYPE_AES128 */
+	1,				/* CRYPTO_CIPHER_TYPE_AES256_GCM */
+	1,				/* CRYPTO_CIPHER_TYPE_AES192_GCM */
+	1,				/* CRYPTO_CIPHER_TYPE_AES128_GCM */
+	1				/* CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305 */
 };
 
 /*
@@ -124,6 +156,20 @@ enum sym_key_type {
 	SYM_KEY_TYPE_HASH
 };
 
+/*
+ * PK11_Encrypt is single shot, AEAD packets made of more than one
+ * iovec are gathered in a heap buffer first. Each call claims a free
+ * slot, the buffer is allocated the first time the slot is used.
+ * There are more slots than threads that can use an instance at the
+ * same time.
+ */
+#define NSS_SCRATCH_SLOTS 64
+
+struct nsscrypto_scratch {
+	int busy;
+	unsigned char *buf;
+} __attribute__((aligned(KNET_CACHE_LINE_SIZE)));
+
 struct nsscrypto_instance {
 	PK11SymKey   *nss_sym_key;
 	PK11SymKey   *nss_sym_key_sign;
@@ -135,6 +181,10 @@ struct nsscrypto_instance {
 	int crypto_cipher_type;
 
 	int crypto_hash_type;
+
+	struct crypto_aead_nonce aead_nonce;
+
+	struct nsscrypto_scratch scratch[NSS_SCRATCH_SLOTS];
 };
 
 /*
@@ -151,6 +201,14 @@ static int nssstring_to_crypto_cipher_type(const char* crypto_cipher_type)
 		return CRYPTO_CIPHER_TYPE_AES192;
 	} else if (strcmp(crypto_cipher_type, "aes128") == 0) {
 		return CRYPTO_CIPHER_TYPE_AES128;
+	} else if (strcmp(crypto_cipher_type, "aes256-gcm") == 0) {
+		return CRYPTO_CIPHER_TYPE_AES256_GCM;
+	} else if (strcmp(crypto_cipher_type, "aes192-gcm") == 0) {
+		return CRYPTO_CIPHER_TYPE_AES192_GCM;
+	} else if (strcmp(crypto_cipher_type, "aes128-gcm") == 0) {
+		return CRYPTO_CIPHER_TYPE_AES128_GCM;
+	} else if (strcmp(crypto_cipher_type, "chacha20-poly") == 0) {
+		return CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305;
 	}
 	return -1;
 }
@@ -366,6 +424,7 @@ static int encrypt_nss(
 			PR_GetError(), PR_ErrorToString(PR_GetError(), PR_LANGUAGE_I_DEFAULT));
 		goto out;
 	}
+	salt[0] = crypto_instance->config_id; /* see crypto_model.h */
 
 	crypt_param.type = siBuffer;
 	crypt_param.data = salt;
@@ -504,6 +563,185 @@ out:
 	return err;
 }
 
+/*
+ * AEAD: nonce, ciphertext and tag in one pass. PK11_Encrypt/Decrypt
+ * are single shot, so the iovec is gathered first (see NSS_SCRATCH_SLOTS).
+ * The config id travels in clear and is authenticated as AAD.
+ */
+static SECItem *nss_aead_param(struct nsscrypto_instance *instance,
+			       unsigned char *nonce,
+			       unsigned char *config_id,
+			       CK_GCM_PARAMS *gcm_params,
+			       CK_NSS_AEAD_PARAMS *aead_params,
+			       SECItem *param)
+{
+	param->type = siBuffer;
+
+	if (instance->crypto_cipher_type == CRYPTO_CIPHER_TYPE_CHACHA20_POLY1305) {
+		memset(aead_params, 0, sizeof(CK_NSS_AEAD_PARAMS));
+		aead_params->pNonce = nonce;
+		aead_params->ulNonceLen = KNET_CRYPTO_AEAD_NONCE_SIZE;
+		aead_params->pAAD = config_id;
+		aead_params->ulAADLen = KNET_CRYPTO_CONFIG_ID_SIZE;
+		aead_params->ulTagLen = KNET_CRYPTO_AEAD_TAG_SIZE;
+		param->data = (unsigned char *)aead_params;
+		param->len = sizeof(CK_NSS_AEAD_PARAMS);
+	} else {
+		memset(gcm_params, 0, sizeof(CK_GCM_PARAMS));
+		gcm_params->pIv = nonce;
+		gcm_params->ulIvLen = KNET_CRYPTO_AEAD_NONCE_SIZE;
+#if ((NSS_VMAJOR > 3) || ((NSS_VMAJOR == 3) && (NSS_VMINOR >= 52))) && !defined(NSS_PKCS11_2_0_COMPAT)
+		gcm_params->ulIvBits = KNET_CRYPTO_AEAD_NONCE_SIZE * 8;
+#endif
+		gcm_params->pAAD = config_id;
+		gcm_params->ulAADLen = KNET_CRYPTO_CONFIG_ID_SIZE;
+		gcm_params->ulTagBits = KNET_CRYPTO_AEAD_TAG_SIZE * 8;
+		param->data = (unsigned char *)gcm_params;
+		param->len = sizeof(CK_GCM_PARAMS);
+	}
+
+	return param;
+}
+
+static void nsscrypto_scratch_put(struct nsscrypto_scratch *scratch)
+{
+	__atomic_store_n(&scratch->busy, 0, __ATOMIC_RELEASE);
+}
+
+static struct nsscrypto_scratch *nsscrypto_scratch_get(knet_handle_t knet_h, struct nsscrypto_instance *instance)
+{
+	pthread_t self = pthread_self();
+	uint64_t thread_id = 0;
+	struct nsscrypto_scratch *scratch;
+	unsigned int slot, i;
+
+	memmove(&thread_id, &self, sizeof(self) < sizeof(thread_id) ? sizeof(self) : sizeof(thread_id));
+	slot = (thread_id * 0x9E3779B97F4A7C15ULL) >> 32;
+
+	for (i = 0; i < NSS_SCRATCH_SLOTS; i++) {
+		scratch = &instance->scratch[(slot + i) % NSS_SCRATCH_SLOTS];
+		if ((__atomic_load_n(&scratch->busy, __ATOMIC_RELAXED)) ||
+		    (__atomic_exchange_n(&scratch->busy, 1, __ATOMIC_ACQUIRE))) {
+			continue;
+		}
+		if (!scratch->buf) {
+			scratch->buf = malloc(KNET_DATABUFSIZE_CRYPT);
+			if (!scratch->buf) {
+				log_err(knet_h, KNET_SUB_NSSCRYPTO, "Unable to allocate memory for nss scratch buffer");
+				nsscrypto_scratch_put(scratch);
+				return NULL;
+			}
+		}
+		return scratch;
+	}
+
+	log_err(knet_h, KNET_SUB_NSSCRYPTO, "No free nss scratch buffer");
+	return NULL;
+}
+
+static int encrypt_nss_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	const struct iovec *iov,
+	int iovcnt,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len)
+{
+	struct nsscrypto_instance *instance = crypto_instance->model_instance;
+	CK_GCM_PARAMS	gcm_params;
+	CK_NSS_AEAD_PARAMS aead_params;
+	SECItem		param;
+	struct nsscrypto_scratch *scratch = NULL;
+	const unsigned char *in;
+	unsigned int	inlen = 0, outlen = 0;
+	unsigned char	*nonce = buf_out + KNET_CRYPTO_CONFIG_ID_SIZE;
+	unsigned char	*data = nonce + KNET_CRYPTO_AEAD_NONCE_SIZE;
+	int		i, err = 0;
+
+	buf_out[0] = crypto_instance->config_id;
+	crypto_aead_nonce_next(&instance->aead_nonce, nonce); /* see crypto_model.h */
+
+	if (iovcnt == 1) {
+		in = iov[0].iov_base;
+		inlen = iov[0].iov_len;
+	} else {
+		scratch = nsscrypto_scratch_get(knet_h, instance);
+		if (!scratch) {
+			return -1;
+		}
+		for (i=0; i<iovcnt; i++) {
+			memmove(scratch->buf + inlen, iov[i].iov_base, iov[i].iov_len);
+			inlen = inlen + iov[i].iov_len;
+		}
+		in = scratch->buf;
+	}
+
+	if (PK11_Encrypt(instance->nss_sym_key, cipher_to_nss[instance->crypto_cipher_type],
+			 nss_aead_param(instance, nonce, buf_out, &gcm_params, &aead_params, &param),
+			 data, &outlen, KNET_DATABUFSIZE_CRYPT - (KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE),
+			 in, inlen) != SECSuccess) {
+		log_err(knet_h, KNET_SUB_NSSCRYPTO, "PK11_Encrypt failed (encrypt) crypt_type=%d (err %d): %s",
+			(int)cipher_to_nss[instance->crypto_cipher_type],
+			PR_GetError(), PR_ErrorToString(PR_GetError(), PR_LANGUAGE_I_DEFAULT));
+		err = -1;
+		goto out;
+	}
+
+	*buf_out_len = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE + outlen;
+
+out:
+	if (scratch) {
+		nsscrypto_scratch_put(scratch);
+	}
+	return err;
+}
+
+static int decrypt_nss_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	const unsigned char *buf_in,
+	const ssize_t buf_in_len,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len,
+	uint8_t log_level)
+{
+	struct nsscrypto_instance *instance = crypto_instance->model_instance;
+	CK_GCM_PARAMS	gcm_params;
+	CK_NSS_AEAD_PARAMS aead_params;
+	SECItem		param;
+	unsigned int	outlen = 0;
+	unsigned char	*nonce = (unsigned char *)buf_in + KNET_CRYPTO_CONFIG_ID_SIZE;
+	unsigned char	*data = nonce + KNET_CRYPTO_AEAD_NONCE_SIZE;
+	ssize_t		datalen = buf_in_len - (KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE);
+
+	if ((datalen <= KNET_CRYPTO_AEAD_TAG_SIZE) ||
+	    (datalen > KNET_MAX_PACKET_SIZE + KNET_CRYPTO_AEAD_TAG_SIZE)) {
+		log_debug(knet_h, KNET_SUB_NSSCRYPTO, "Received incorrect packet size: %zu", buf_in_len);
+		return -1;
+	}
+
+	/*
+	 * the tag is verified here
+	 */
+	if (PK11_Decrypt(instance->nss_sym_key, cipher_to_nss[instance->crypto_cipher_type],
+			 nss_aead_param(instance, nonce, (unsigned char *)buf_in, &gcm_params, &aead_params, &param),
+			 buf_out, &outlen, KNET_DATABUFSIZE_CRYPT,
+			 data, datalen) != SECSuccess) {
+		if (log_level == KNET_LOG_DEBUG) {
+			log_debug(knet_h, KNET_SUB_NSSCRYPTO, "PK11_Decrypt (decrypt) failed (err %d): %s",
+				  PR_GetError(), PR_ErrorToString(PR_GetError(), PR_LANGUAGE_I_DEFAULT));
+		} else {
+			log_err(knet_h, KNET_SUB_NSSCRYPTO, "PK11_Decrypt (decrypt) failed (err %d): %s",
+				PR_GetError(), PR_ErrorToString(PR_GetError(), PR_LANGUAGE_I_DEFAULT));
+		}
+		return -1;
+	}
+
+	*buf_out_len = outlen;
+
+	return 0;
+}
+
 /*
  * hash/hmac/digest functions
  */
@@ -672,6 +910,10 @@ static int nsscrypto_encrypt_and_signv (
 	struct nsscrypto_instance *instance = crypto_instance->model_instance;
 	int i;
 
+	if (nsscipher_aead[instance->crypto_cipher_type]) {
+		return encrypt_nss_aead(knet_h, crypto_instance, iov_in, iovcnt_in, buf_out, buf_out_len);
+	}
+
 	if (cipher_to_nss[instance->crypto_cipher_type]) {
 		if (encrypt_nss(knet_h, crypto_instance, iov_in, iovcnt_in, buf_out, buf_out_len) < 0) {
 			return -1;
@@ -723,6 +965,10 @@ static int nsscrypto_authenticate_and_decrypt (
 	struct nsscrypto_instance *instance = crypto_instance->model_instance;
 	ssize_t temp_len = buf_in_len;
 
+	if (nsscipher_aead[instance->crypto_cipher_type]) {
+		return decrypt_nss_aead(knet_h, crypto_instance, buf_in, buf_in_len, buf_out, buf_out_len, log_level);
+	}
+
 	if (hash_to_nss[instance->crypto_hash_type]) {
 		unsigned char tmp_hash[nsshash_len[instance->crypto_hash_type]];
 		ssize_t temp_buf_len = buf_in_len - nsshash_len[instance->crypto_hash_type];
@@ -766,8 +1012,12 @@ static void nsscrypto_fini(
 	struct crypto_instance *crypto_instance)
 {
 	struct nsscrypto_instance *nsscrypto_instance = crypto_instance->model_instance;
+	int i;
 
 	if (nsscrypto_instance) {
+		for (i = 0; i < NSS_SCRATCH_SLOTS; i++) {
+			free(nsscrypto_instance->scratch[i].buf);
+		}
 		if (nsscrypto_instance->nss_sym_key) {
 			PK11_FreeSymKey(nsscrypto_instance->nss_sym_key);
 			nsscrypto_instance->nss_sym_key = NULL;
@@ -821,7 +1071,15 @@ static int nsscrypto_init(
 		goto out_err;
 	}
 
+	if ((nsscipher_aead[nsscrypto_instance->crypto_cipher_type]) &&
+	    (nsscrypto_instance->crypto_hash_type > 0)) {
+		log_err(knet_h, KNET_SUB_NSSCRYPTO, "AEAD ciphers do not use a hash, set hash to none");
+		savederrno = EINVAL;
+		goto out_err;
+	}
+
 	if ((nsscrypto_instance->crypto_cipher_type > 0) &&
+	    (!nsscipher_aead[nsscrypto_instance->crypto_cipher_type]) &&
 	    (nsscrypto_instance->crypto_hash_type == 0)) {
 		log_err(knet_h, KNET_SUB_NSSCRYPTO, "crypto communication requires hash specified");
 		savederrno = EINVAL;
@@ -836,6 +1094,20 @@ static int nsscrypto_init(
 		goto out_err;
 	}
 
+	if (nsscipher_aead[nsscrypto_instance->crypto_cipher_type]) {
+		if ((PK11_GenerateRandom(nsscrypto_instance->aead_nonce.prefix, KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE) != SECSuccess) ||
+		    (PK11_GenerateRandom((unsigned char *)&nsscrypto_instance->aead_nonce.counter, sizeof(uint64_t)) != SECSuccess)) {
+			log_err(knet_h, KNET_SUB_NSSCRYPTO, "Failure to generate a random number (err %d): %s",
+				PR_GetError(), PR_ErrorToString(PR_GetError(), PR_LANGUAGE_I_DEFAULT));
+			savederrno = EIO;
+			goto out_err;
+		}
+		crypto_instance->sec_salt_size = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE;
+		crypto_instance->sec_hash_size = KNET_CRYPTO_AEAD_TAG_SIZE;
+		crypto_instance->sec_block_size = 0;
+		return 0;
+	}
+
 	if (nsscrypto_instance->crypto_hash_type > 0) {
 		crypto_instance->sec_hash_size = nsshash_len[nsscrypto_instance->crypto_hash_type];
 	}
@@ -13,6 +13,8 @@
 #include <errno.h>
 #include <dlfcn.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <openssl/conf.h>
 #include <openssl/evp.h>
 #if (OPENSSL_VERSION_NUMBER < 0x30000000L)
@@ -44,6 +46,34 @@
 static const char *hash = "digest";
 #endif
 
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+/*
+ * setting up keyed contexts (cipher key schedule, HMAC pads and
+ * provider lookups) costs more than the crypto of a packet itself.
+ * Each instance keeps a set of ready contexts and the threads pick
+ * one from their id, so that only the IV or the HMAC state need to
+ * be reset per packet. There are more slots than threads that can
+ * use an instance at the same time.
+ */
+#define OPENSSL_CTX_SLOTS 64
+
+struct opensslcrypto_ctx {
+	int busy;
+	int ready;
+	EVP_CIPHER_CTX *encrypt_ctx;
+	EVP_CIPHER_CTX *decrypt_ctx;
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+	EVP_MAC_CTX *hash_ctx;
+#else
+	HMAC_CTX *hash_ctx;
+#endif
+} __attribute__((aligned(KNET_CACHE_LINE_SIZE)));
+#else
+struct opensslcrypto_ctx {
+	int unused;
+};
+#endif
+
 struct opensslcrypto_instance {
 	void *private_key;
 
@@ -51,16 +81,163 @@ struct opensslcrypto_instance {
 
 	const EVP_CIPHER *crypto_cipher_type;
 
+	int crypto_cipher_aead;
+
+	struct crypto_aead_nonce aead_nonce;
+
 	const EVP_MD *crypto_hash_type;
 #if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
 	EVP_MAC *crypto_hash_mac;
 	OSSL_PARAM params[3];
 	char hash_type[16]; /* Need to store a copy from knet_handle_crypto_cfg for OSSL_PARAM_construct_* */
 #endif
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+	struct opensslcrypto_ctx ctx[OPENSSL_CTX_SLOTS];
+#endif
 };
 
 static int openssl_is_init = 0;
 
+/*
+ * AEAD cipher names shared with the other models,
+ * chacha20-poly1305 does not fit in crypto_cipher_type
+ */
+static const struct {
+	const char *knet_name;
+	const char *openssl_name;
+} openssl_cipher_names[] = {
+	{ "aes128-gcm", "aes-128-gcm" },
+	{ "aes192-gcm", "aes-192-gcm" },
+	{ "aes256-gcm", "aes-256-gcm" },
+	{ "chacha20-poly", "chacha20-poly1305" },
+	{ NULL, NULL }
+};
+
+static const char *openssl_cipher_name(const char *crypto_cipher_type)
+{
+	int i;
+
+	for (i = 0; openssl_cipher_names[i].knet_name; i++) {
+		if (!strcmp(crypto_cipher_type, openssl_cipher_names[i].knet_name)) {
+			return openssl_cipher_names[i].openssl_name;
+		}
+	}
+
+	return crypto_cipher_type;
+}
+
+/*
+ * per thread contexts
+ */
+
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L)
+static struct opensslcrypto_ctx *opensslcrypto_ctx_get(knet_handle_t knet_h, struct opensslcrypto_instance *instance)
+{
+	static struct opensslcrypto_ctx unused_ctx;
+
+	return &unused_ctx;
+}
+
+static void opensslcrypto_ctx_put(struct opensslcrypto_ctx *ctx)
+{
+	return;
+}
+#else
+static void opensslcrypto_ctx_free(struct opensslcrypto_ctx *ctx)
+{
+	if (ctx->encrypt_ctx) {
+		EVP_CIPHER_CTX_free(ctx->encrypt_ctx);
+		ctx->encrypt_ctx = NULL;
+	}
+	if (ctx->decrypt_ctx) {
+		EVP_CIPHER_CTX_free(ctx->decrypt_ctx);
+		ctx->decrypt_ctx = NULL;
+	}
+	if (ctx->hash_ctx) {
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+		EVP_MAC_CTX_free(ctx->hash_ctx);
+#else
+		HMAC_CTX_free(ctx->hash_ctx);
+#endif
+		ctx->hash_ctx = NULL;
+	}
+	ctx->ready = 0;
+}
+
+static int opensslcrypto_ctx_setup(knet_handle_t knet_h, struct opensslcrypto_instance *instance, struct opensslcrypto_ctx *ctx)
+{
+	char sslerr[SSLERR_BUF_SIZE];
+
+	if (instance->crypto_cipher_type) {
+		ctx->encrypt_ctx = EVP_CIPHER_CTX_new();
+		ctx->decrypt_ctx = EVP_CIPHER_CTX_new();
+		if ((!ctx->encrypt_ctx) || (!ctx->decrypt_ctx) ||
+		    (!EVP_EncryptInit_ex(ctx->encrypt_ctx, instance->crypto_cipher_type, NULL, instance->private_key, NULL)) ||
+		    (!EVP_DecryptInit_ex(ctx->decrypt_ctx, instance->crypto_cipher_type, NULL, instance->private_key, NULL))) {
+			goto out_err;
+		}
+	}
+
+	if (instance->crypto_hash_type) {
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+		ctx->hash_ctx = EVP_MAC_CTX_new(instance->crypto_hash_mac);
+		if ((!ctx->hash_ctx) ||
+		    (!EVP_MAC_init(ctx->hash_ctx, instance->private_key, instance->private_key_len, instance->params))) {
+			goto out_err;
+		}
+#else
+		ctx->hash_ctx = HMAC_CTX_new();
+		if ((!ctx->hash_ctx) ||
+		    (!HMAC_Init_ex(ctx->hash_ctx, instance->private_key, instance->private_key_len, instance->crypto_hash_type, NULL))) {
+			goto out_err;
+		}
+#endif
+	}
+
+	ctx->ready = 1;
+	return 0;
+
+out_err:
+	ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+	log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to allocate openssl context: %s", sslerr);
+	opensslcrypto_ctx_free(ctx);
+	return -1;
+}
+
+static void opensslcrypto_ctx_put(struct opensslcrypto_ctx *ctx)
+{
+	__atomic_store_n(&ctx->busy, 0, __ATOMIC_RELEASE);
+}
+
+static struct opensslcrypto_ctx *opensslcrypto_ctx_get(knet_handle_t knet_h, struct opensslcrypto_instance *instance)
+{
+	pthread_t self = pthread_self();
+	uint64_t thread_id = 0;
+	struct opensslcrypto_ctx *ctx;
+	unsigned int slot, i;
+
+	memmove(&thread_id, &self, sizeof(self) < sizeof(thread_id) ? sizeof(self) : sizeof(thread_id));
+	slot = (thread_id * 0x9E3779B97F4A7C15ULL) >> 32;
+
+	for (i = 0; i < OPENSSL_CTX_SLOTS; i++) {
+		ctx = &instance->ctx[(slot + i) % OPENSSL_CTX_SLOTS];
+		if ((__atomic_load_n(&ctx->busy, __ATOMIC_RELAXED)) ||
+		    (__atomic_exchange_n(&ctx->busy, 1, __ATOMIC_ACQUIRE))) {
+			continue;
+		}
+		if ((!ctx->ready) &&
+		    (opensslcrypto_ctx_setup(knet_h, instance, ctx) < 0)) {
+			opensslcrypto_ctx_put(ctx);
+			return NULL;
+		}
+		return ctx;
+	}
+
+	log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "No free openssl context");
+	return NULL;
+}
+#endif
+
 /*
  * crypt/decrypt functions openssl1.0
  */
@@ -69,6 +246,7 @@ static int openssl_is_init = 0;
 static int encrypt_openssl(
 	knet_handle_t knet_h,
 	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
 	const struct iovec *iov,
 	int iovcnt,
 	unsigned char *buf_out,
@@ -91,6 +269,7 @@ static int encrypt_openssl(
 		err = -1;
 		goto out;
 	}
+	salt[0] = crypto_instance->config_id; /* see crypto_model.h */
 
 	/*
 	 * add warning re keylength
@@ -126,6 +305,7 @@ out:
 static int decrypt_openssl (
 	knet_handle_t knet_h,
 	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
 	const unsigned char *buf_in,
 	const ssize_t buf_in_len,
 	unsigned char *buf_out,
@@ -176,37 +356,66 @@ out:
 	EVP_CIPHER_CTX_cleanup(&ctx);
 	return err;
 }
+
+/*
+ * AEAD ciphers are refused at init time
+ */
+static int encrypt_openssl_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
+	const struct iovec *iov,
+	int iovcnt,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len)
+{
+	return -1;
+}
+
+static int decrypt_openssl_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
+	const unsigned char *buf_in,
+	const ssize_t buf_in_len,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len,
+	uint8_t log_level)
+{
+	return -1;
+}
 #else /* (OPENSSL_VERSION_NUMBER < 0x10100000L) */
 static int encrypt_openssl(
 	knet_handle_t knet_h,
 	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
 	const struct iovec *iov,
 	int iovcnt,
 	unsigned char *buf_out,
 	ssize_t *buf_out_len)
 {
-	struct opensslcrypto_instance *instance = crypto_instance->model_instance;
-	EVP_CIPHER_CTX	*ctx;
+	EVP_CIPHER_CTX	*ctx = ctx_slot->encrypt_ctx;
 	int		tmplen = 0, offset = 0;
 	unsigned char	*salt = buf_out;
 	unsigned char	*data = buf_out + SALT_SIZE;
-	int		err = 0;
 	int		i;
 	char		sslerr[SSLERR_BUF_SIZE];
 
-	ctx = EVP_CIPHER_CTX_new();
-
 	if (!RAND_bytes(salt, SALT_SIZE)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to get random salt data: %s", sslerr);
-		err = -1;
-		goto out;
+		return -1;
 	}
+	salt[0] = crypto_instance->config_id; /* see crypto_model.h */
 
 	/*
-	 * add warning re keylength
+	 * the context is already keyed, only set the IV
 	 */
-	EVP_EncryptInit_ex(ctx, instance->crypto_cipher_type, NULL, instance->private_key, salt);
+	if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, salt)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to init encrypt: %s", sslerr);
+		return -1;
+	}
 
 	for (i=0; i<iovcnt; i++) {
 		if (!EVP_EncryptUpdate(ctx,
@@ -214,8 +423,7 @@ static int encrypt_openssl(
 				       (unsigned char *)iov[i].iov_base, iov[i].iov_len)) {
 			ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
 			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to encrypt: %s", sslerr);
-			err = -1;
-			goto out;
+			return -1;
 		}
 		offset = offset + tmplen;
 	}
@@ -223,47 +431,44 @@ static int encrypt_openssl(
 	if (!EVP_EncryptFinal_ex(ctx, data + offset, &tmplen)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to finalize encrypt: %s", sslerr);
-		err = -1;
-		goto out;
+		return -1;
 	}
 
 	*buf_out_len = offset + tmplen + SALT_SIZE;
 
-out:
-	EVP_CIPHER_CTX_free(ctx);
-	return err;
+	return 0;
 }
 
 static int decrypt_openssl (
 	knet_handle_t knet_h,
 	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
 	const unsigned char *buf_in,
 	const ssize_t buf_in_len,
 	unsigned char *buf_out,
 	ssize_t *buf_out_len,
 	uint8_t log_level)
 {
-	struct opensslcrypto_instance *instance = crypto_instance->model_instance;
-	EVP_CIPHER_CTX	*ctx = NULL;
+	EVP_CIPHER_CTX	*ctx = ctx_slot->decrypt_ctx;
 	int		tmplen1 = 0, tmplen2 = 0;
 	unsigned char	*salt = (unsigned char *)buf_in;
 	unsigned char	*data = salt + SALT_SIZE;
 	int		datalen = buf_in_len - SALT_SIZE;
-	int		err = 0;
 	char		sslerr[SSLERR_BUF_SIZE];
 
 	if (datalen <= 0) {
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Packet is too short");
-		err = -1;
-		goto out;
+		return -1;
 	}
 
-	ctx = EVP_CIPHER_CTX_new();
-
 	/*
-	 * add warning re keylength
+	 * the context is already keyed, only set the IV
 	 */
-	EVP_DecryptInit_ex(ctx, instance->crypto_cipher_type, NULL, instance->private_key, salt);
+	if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, salt)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to init decrypt: %s", sslerr);
+		return -1;
+	}
 
 	if (!EVP_DecryptUpdate(ctx, buf_out, &tmplen1, data, datalen)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
@@ -272,8 +477,7 @@ static int decrypt_openssl (
 		} else {
 			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to decrypt: %s", sslerr);
 		}
-		err = -1;
-		goto out;
+		return -1;
 	}
 
 	if (!EVP_DecryptFinal_ex(ctx, buf_out + tmplen1, &tmplen2)) {
@@ -283,17 +487,141 @@ static int decrypt_openssl (
 		} else {
 			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to finalize decrypt: %s", sslerr);
 		}
-		err = -1;
-		goto out;
+		return -1;
 	}
 
 	*buf_out_len = tmplen1 + tmplen2;
 
-out:
-	if (ctx) {
-		EVP_CIPHER_CTX_free(ctx);
+	return 0;
+}
+
+/*
+ * AEAD: nonce, ciphertext and tag in one pass, no padding
+ */
+static int encrypt_openssl_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
+	const struct iovec *iov,
+	int iovcnt,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len)
+{
+	struct opensslcrypto_instance *instance = crypto_instance->model_instance;
+	EVP_CIPHER_CTX	*ctx = ctx_slot->encrypt_ctx;
+	int		tmplen = 0, offset = 0;
+	unsigned char	*nonce = buf_out + KNET_CRYPTO_CONFIG_ID_SIZE;
+	unsigned char	*data = nonce + KNET_CRYPTO_AEAD_NONCE_SIZE;
+	int		i;
+	char		sslerr[SSLERR_BUF_SIZE];
+
+	buf_out[0] = crypto_instance->config_id;
+	crypto_aead_nonce_next(&instance->aead_nonce, nonce); /* see crypto_model.h */
+
+	if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to init encrypt: %s", sslerr);
+		return -1;
 	}
-	return err;
+
+	/*
+	 * the config id travels in clear, authenticate it as AAD
+	 */
+	if (!EVP_EncryptUpdate(ctx, NULL, &tmplen, buf_out, KNET_CRYPTO_CONFIG_ID_SIZE)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to authenticate config id: %s", sslerr);
+		return -1;
+	}
+
+	for (i=0; i<iovcnt; i++) {
+		if (!EVP_EncryptUpdate(ctx,
+				       data + offset, &tmplen,
+				       (unsigned char *)iov[i].iov_base, iov[i].iov_len)) {
+			ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to encrypt: %s", sslerr);
+			return -1;
+		}
+		offset = offset + tmplen;
+	}
+
+	if (!EVP_EncryptFinal_ex(ctx, data + offset, &tmplen)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to finalize encrypt: %s", sslerr);
+		return -1;
+	}
+	offset = offset + tmplen;
+
+	if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, KNET_CRYPTO_AEAD_TAG_SIZE, data + offset)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to get authentication tag: %s", sslerr);
+		return -1;
+	}
+
+	*buf_out_len = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE + offset + KNET_CRYPTO_AEAD_TAG_SIZE;
+
+	return 0;
+}
+
+static int decrypt_openssl_aead(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
+	const unsigned char *buf_in,
+	const ssize_t buf_in_len,
+	unsigned char *buf_out,
+	ssize_t *buf_out_len,
+	uint8_t log_level)
+{
+	EVP_CIPHER_CTX	*ctx = ctx_slot->decrypt_ctx;
+	int		tmplen1 = 0, tmplen2 = 0;
+	unsigned char	*nonce = (unsigned char *)buf_in + KNET_CRYPTO_CONFIG_ID_SIZE;
+	unsigned char	*data = nonce + KNET_CRYPTO_AEAD_NONCE_SIZE;
+	int		datalen = buf_in_len - (KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE + KNET_CRYPTO_AEAD_TAG_SIZE);
+	char		sslerr[SSLERR_BUF_SIZE];
+
+	if ((datalen <= 0) || (datalen > KNET_MAX_PACKET_SIZE)) {
+		log_debug(knet_h, KNET_SUB_OPENSSLCRYPTO, "Received incorrect packet size: %zu", buf_in_len);
+		return -1;
+	}
+
+	if ((!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, nonce)) ||
+	    (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, KNET_CRYPTO_AEAD_TAG_SIZE, data + datalen))) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to init decrypt: %s", sslerr);
+		return -1;
+	}
+
+	if (!EVP_DecryptUpdate(ctx, NULL, &tmplen1, buf_in, KNET_CRYPTO_CONFIG_ID_SIZE)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to authenticate config id: %s", sslerr);
+		return -1;
+	}
+
+	if (!EVP_DecryptUpdate(ctx, buf_out, &tmplen1, data, datalen)) {
+		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+		if (log_level == KNET_LOG_DEBUG) {
+			log_debug(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to decrypt: %s", sslerr);
+		} else {
+			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to decrypt: %s", sslerr);
+		}
+		return -1;
+	}
+
+	/*
+	 * the tag is verified here
+	 */
+	if (!EVP_DecryptFinal_ex(ctx, buf_out + tmplen1, &tmplen2)) {
+		if (log_level == KNET_LOG_DEBUG) {
+			log_debug(knet_h, KNET_SUB_OPENSSLCRYPTO, "Tag does not match. Check crypto key and configuration.");
+		} else {
+			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Tag does not match. Check crypto key and configuration.");
+		}
+		return -1;
+	}
+
+	*buf_out_len = tmplen1 + tmplen2;
+
+	return 0;
 }
 #endif
 
@@ -301,10 +629,11 @@ out:
  * hash/hmac/digest functions
  */
 
-#if (OPENSSL_VERSION_NUMBER < 0x30000000L)
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L)
 static int calculate_openssl_hash(
 	knet_handle_t knet_h,
 	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
 	const unsigned char *buf,
 	const size_t buf_len,
 	unsigned char *hash,
@@ -332,57 +661,74 @@ static int calculate_openssl_hash(
 
 	return 0;
 }
-#else
+#elif (OPENSSL_VERSION_NUMBER < 0x30000000L)
 static int calculate_openssl_hash(
 	knet_handle_t knet_h,
 	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
 	const unsigned char *buf,
 	const size_t buf_len,
 	unsigned char *hash,
 	uint8_t log_level)
 {
-	struct opensslcrypto_instance *instance = crypto_instance->model_instance;
-	EVP_MAC_CTX *ctx = NULL;
+	HMAC_CTX *ctx = ctx_slot->hash_ctx;
+	unsigned int hash_len = 0;
 	char sslerr[SSLERR_BUF_SIZE];
-	int err = 0;
-	size_t outlen = 0;
 
-	ctx = EVP_MAC_CTX_new(instance->crypto_hash_mac);
-	if (!ctx) {
+	/*
+	 * the context is already keyed, HMAC_Init_ex only resets it
+	 */
+	if ((!HMAC_Init_ex(ctx, NULL, 0, NULL, NULL)) ||
+	    (!HMAC_Update(ctx, buf, buf_len)) ||
+	    (!HMAC_Final(ctx, hash, &hash_len)) ||
+	    (hash_len != crypto_instance->sec_hash_size)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
-		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to allocate openssl context: %s", sslerr);
-		err = -1;
-		goto out_err;
+		if (log_level == KNET_LOG_DEBUG) {
+			log_debug(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to calculate hash: %s", sslerr);
+		} else {
+			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to calculate hash: %s", sslerr);
+		}
+		return -1;
 	}
 
-	if (!EVP_MAC_init(ctx, instance->private_key, instance->private_key_len, instance->params)) {
+	return 0;
+}
+#else
+static int calculate_openssl_hash(
+	knet_handle_t knet_h,
+	struct crypto_instance *crypto_instance,
+	struct opensslcrypto_ctx *ctx_slot,
+	const unsigned char *buf,
+	const size_t buf_len,
+	unsigned char *hash,
+	uint8_t log_level)
+{
+	EVP_MAC_CTX *ctx = ctx_slot->hash_ctx;
+	char sslerr[SSLERR_BUF_SIZE];
+	size_t outlen = 0;
+
+	/*
+	 * the context is already keyed, a NULL key only resets it
+	 */
+	if (!EVP_MAC_init(ctx, NULL, 0, NULL)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
-		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to set openssl context parameters: %s", sslerr);
-		err = -1;
-		goto out_err;
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to reset openssl context: %s", sslerr);
+		return -1;
 	}
 
 	if (!EVP_MAC_update(ctx, buf, buf_len)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to update hash: %s", sslerr);
-		err = -1;
-		goto out_err;
+		return -1;
 	}
 
 	if (!EVP_MAC_final(ctx, hash, &outlen, crypto_instance->sec_hash_size)) {
 		ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to finalize hash: %s", sslerr);
-		err = -1;
-		goto out_err;
-	}
-
-out_err:
-	if (ctx) {
-		EVP_MAC_CTX_free(ctx);
+		return -1;
 	}
 
-	return err;
-
+	return 0;
 }
 #endif
 
@@ -399,12 +745,26 @@ static int opensslcrypto_encrypt_and_signv (
 	ssize_t *buf_out_len)
 {
 	struct opensslcrypto_instance *instance = crypto_instance->model_instance;
-	int i;
+	struct opensslcrypto_ctx *ctx_slot = NULL;
+	int i, err = 0;
 
-	if (instance->crypto_cipher_type) {
-		if (encrypt_openssl(knet_h, crypto_instance, iov_in, iovcnt_in, buf_out, buf_out_len) < 0) {
+	if ((instance->crypto_cipher_type) || (instance->crypto_hash_type)) {
+		ctx_slot = opensslcrypto_ctx_get(knet_h, instance);
+		if (!ctx_slot) {
 			return -1;
 		}
+	}
+
+	if (instance->crypto_cipher_aead) {
+		err = encrypt_openssl_aead(knet_h, crypto_instance, ctx_slot, iov_in, iovcnt_in, buf_out, buf_out_len);
+		goto out;
+	}
+
+	if (instance->crypto_cipher_type) {
+		if (encrypt_openssl(knet_h, crypto_instance, ctx_slot, iov_in, iovcnt_in, buf_out, buf_out_len) < 0) {
+			err = -1;
+			goto out;
+		}
 	} else {
 		*buf_out_len = 0;
 		for (i=0; i<iovcnt_in; i++) {
@@ -414,13 +774,18 @@ static int opensslcrypto_encrypt_and_signv (
 	}
 
 	if (instance->crypto_hash_type) {
-		if (calculate_openssl_hash(knet_h, crypto_instance, buf_out, *buf_out_len, buf_out + *buf_out_len, KNET_LOG_ERR) < 0) {
-			return -1;
+		if (calculate_openssl_hash(knet_h, crypto_instance, ctx_slot, buf_out, *buf_out_len, buf_out + *buf_out_len, KNET_LOG_ERR) < 0) {
+			err = -1;
+			goto out;
 		}
 		*buf_out_len = *buf_out_len + crypto_instance->sec_hash_size;
 	}
 
-	return 0;
+out:
+	if (ctx_slot) {
+		opensslcrypto_ctx_put(ctx_slot);
+	}
+	return err;
 }
 
 static int opensslcrypto_encrypt_and_sign (
@@ -450,7 +815,21 @@ static int opensslcrypto_authenticate_and_decrypt (
 	uint8_t log_level)
 {
 	struct opensslcrypto_instance *instance = crypto_instance->model_instance;
+	struct opensslcrypto_ctx *ctx_slot = NULL;
 	ssize_t temp_len = buf_in_len;
+	int err = 0;
+
+	if ((instance->crypto_cipher_type) || (instance->crypto_hash_type)) {
+		ctx_slot = opensslcrypto_ctx_get(knet_h, instance);
+		if (!ctx_slot) {
+			return -1;
+		}
+	}
+
+	if (instance->crypto_cipher_aead) {
+		err = decrypt_openssl_aead(knet_h, crypto_instance, ctx_slot, buf_in, buf_in_len, buf_out, buf_out_len, log_level);
+		goto out;
+	}
 
 	if (instance->crypto_hash_type) {
 		unsigned char tmp_hash[crypto_instance->sec_hash_size];
@@ -460,11 +839,13 @@ static int opensslcrypto_authenticate_and_decrypt (
 
 		if ((temp_buf_len <= 0) || (temp_buf_len > KNET_MAX_PACKET_SIZE)) {
 			log_debug(knet_h, KNET_SUB_OPENSSLCRYPTO, "Received incorrect packet size: %zu for hash size: %zu", buf_in_len, crypto_instance->sec_hash_size);
-			return -1;
+			err = -1;
+			goto out;
 		}
 
-		if (calculate_openssl_hash(knet_h, crypto_instance, buf_in, temp_buf_len, tmp_hash, log_level) < 0) {
-			return -1;
+		if (calculate_openssl_hash(knet_h, crypto_instance, ctx_slot, buf_in, temp_buf_len, tmp_hash, log_level) < 0) {
+			err = -1;
+			goto out;
 		}
 
 		if (memcmp(tmp_hash, buf_in + temp_buf_len, crypto_instance->sec_hash_size) != 0) {
@@ -473,22 +854,28 @@ static int opensslcrypto_authenticate_and_decrypt (
 			} else {
 				log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Digest does not match. Check crypto key and configuration.");
 			}
-			return -1;
+			err = -1;
+			goto out;
 		}
 
 		temp_len = temp_len - crypto_instance->sec_hash_size;
 		*buf_out_len = temp_len;
 	}
 	if (instance->crypto_cipher_type) {
-		if (decrypt_openssl(knet_h, crypto_instance, buf_in, temp_len, buf_out, buf_out_len, log_level) < 0) {
-			return -1;
+		if (decrypt_openssl(knet_h, crypto_instance, ctx_slot, buf_in, temp_len, buf_out, buf_out_len, log_level) < 0) {
+			err = -1;
+			goto out;
 		}
 	} else {
 		memmove(buf_out, buf_in, temp_len);
 		*buf_out_len = temp_len;
 	}
 
-	return 0;
+out:
+	if (ctx_slot) {
+		opensslcrypto_ctx_put(ctx_slot);
+	}
+	return err;
 }
 
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L)
@@ -573,6 +960,13 @@ static void opensslcrypto_fini(
 	struct opensslcrypto_instance *opensslcrypto_instance = crypto_instance->model_instance;
 
 	if (opensslcrypto_instance) {
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+		int i;
+
+		for (i = 0; i < OPENSSL_CTX_SLOTS; i++) {
+			opensslcrypto_ctx_free(&opensslcrypto_instance->ctx[i]);
+		}
+#endif
 		if (opensslcrypto_instance->private_key) {
 			free(opensslcrypto_instance->private_key);
 			opensslcrypto_instance->private_key = NULL;
@@ -600,8 +994,8 @@ static int opensslcrypto_init(
 {
 	struct opensslcrypto_instance *opensslcrypto_instance = NULL;
 	int savederrno;
-#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
 	char sslerr[SSLERR_BUF_SIZE];
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
 	size_t params_n = 0;
 #endif
 
@@ -630,8 +1024,10 @@ static int opensslcrypto_init(
 		openssl_is_init = 1;
 	}
 
-	crypto_instance->model_instance = malloc(sizeof(struct opensslcrypto_instance));
-	if (!crypto_instance->model_instance) {
+	/*
+	 * the per thread contexts are cache line aligned
+	 */
+	if (posix_memalign(&crypto_instance->model_instance, KNET_CACHE_LINE_SIZE, sizeof(struct opensslcrypto_instance))) {
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to allocate memory for openssl model instance");
 		errno = ENOMEM;
 		return -1;
@@ -653,12 +1049,31 @@ static int opensslcrypto_init(
 	if (strcmp(knet_handle_crypto_cfg->crypto_cipher_type, "none") == 0) {
 		opensslcrypto_instance->crypto_cipher_type = NULL;
 	} else {
-		opensslcrypto_instance->crypto_cipher_type = EVP_get_cipherbyname(knet_handle_crypto_cfg->crypto_cipher_type);
+		opensslcrypto_instance->crypto_cipher_type = EVP_get_cipherbyname(openssl_cipher_name(knet_handle_crypto_cfg->crypto_cipher_type));
 		if (!opensslcrypto_instance->crypto_cipher_type) {
 			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "unknown crypto cipher type requested");
 			savederrno = ENXIO;
 			goto out_err;
 		}
+
+		if (EVP_CIPHER_flags(opensslcrypto_instance->crypto_cipher_type) & EVP_CIPH_FLAG_AEAD_CIPHER) {
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L)
+			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "AEAD ciphers require openssl 1.1.0 or later");
+			savederrno = ENXIO;
+			goto out_err;
+#else
+			/*
+			 * CCM and OCB need the lengths or the tag size set upfront
+			 */
+			if ((EVP_CIPHER_mode(opensslcrypto_instance->crypto_cipher_type) != EVP_CIPH_GCM_MODE) &&
+			    (EVP_CIPHER_nid(opensslcrypto_instance->crypto_cipher_type) != NID_chacha20_poly1305)) {
+				log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "unsupported AEAD cipher type requested");
+				savederrno = ENXIO;
+				goto out_err;
+			}
+			opensslcrypto_instance->crypto_cipher_aead = 1;
+#endif
+		}
 	}
 
 	if (strcmp(knet_handle_crypto_cfg->crypto_hash_type, "none") == 0) {
@@ -690,13 +1105,35 @@ static int opensslcrypto_init(
 #endif
 	}
 
+	if ((opensslcrypto_instance->crypto_cipher_aead) &&
+	    (opensslcrypto_instance->crypto_hash_type)) {
+		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "AEAD ciphers do not use a hash, set hash to none");
+		savederrno = EINVAL;
+		goto out_err;
+	}
+
 	if ((opensslcrypto_instance->crypto_cipher_type) &&
+	    (!opensslcrypto_instance->crypto_cipher_aead) &&
 	    (!opensslcrypto_instance->crypto_hash_type)) {
 		log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "crypto communication requires hash specified");
 		savederrno = EINVAL;
 		goto out_err;
 	}
 
+	if (opensslcrypto_instance->crypto_cipher_aead) {
+		if ((!RAND_bytes(opensslcrypto_instance->aead_nonce.prefix, KNET_CRYPTO_AEAD_NONCE_PREFIX_SIZE)) ||
+		    (!RAND_bytes((unsigned char *)&opensslcrypto_instance->aead_nonce.counter, sizeof(uint64_t)))) {
+			ERR_error_string_n(ERR_get_error(), sslerr, sizeof(sslerr));
+			log_err(knet_h, KNET_SUB_OPENSSLCRYPTO, "Unable to get random nonce data: %s", sslerr);
+			savederrno = EIO;
+			goto out_err;
+		}
+		crypto_instance->sec_salt_size = KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE;
+		crypto_instance->sec_hash_size = KNET_CRYPTO_AEAD_TAG_SIZE;
+		crypto_instance->sec_block_size = 0;
+		return 0;
+	}
+
 	if (opensslcrypto_instance->crypto_hash_type) {
 		crypto_instance->sec_hash_size = EVP_MD_size(opensslcrypto_instance->crypto_hash_type);
 	}
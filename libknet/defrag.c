@@ -0,0 +1,652 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "internals.h"
+#include "threads_common.h"
+#include "defrag.h"
+
+/*
+ * defrag buffers book keeping.
+ *
+ * in use buffers are indexed by pckt_seq in an open addressing
+ * hash table (linear probing, backward shift deletion) that is
+ * always at most half full, and linked in a LRU list ordered by
+ * last update. Free buffers are linked in a free list.
+ * Buffers are referenced by index since defrag_bufs can be
+ * reallocated at any time.
+ *
+ * seq_num are mostly consecutive and would end up in one long
+ * cluster with a plain mask, making each removal walk all of it.
+ * Fibonacci hashing spreads them across the table.
+ *
+ * The bookkeeping is small, allocated_defrag_bufs is the quota of
+ * reassemblies a host can have in flight. The data buffers are taken
+ * from a handle wide pool of slabs only while a buffer is in use,
+ * so that memory follows the reassemblies in flight rather than the
+ * sum of the per host high water marks.
+ *
+ * in_use_defrag_bufs, allocated_defrag_bufs and the pool counters
+ * are also read by the heartbeat thread to sample usage.
+ */
+
+static struct knet_defrag_chunk *_pool_get(knet_handle_t knet_h)
+{
+	struct knet_defrag_pool *pool = &knet_h->defrag_pool;
+	struct knet_defrag_slab *slab = pool->partial;
+	struct knet_defrag_chunk *chunk;
+	int i;
+
+	if (!slab) {
+		slab = malloc(sizeof(struct knet_defrag_slab));
+		if (!slab) {
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		slab->prev = NULL;
+		slab->next = NULL;
+		slab->in_use = 0;
+		slab->free_chunks = NULL;
+		for (i = KNET_DEFRAG_SLAB_CHUNKS - 1; i >= 0; i--) {
+			slab->chunks[i].slab = slab;
+			slab->chunks[i].next = slab->free_chunks;
+			slab->free_chunks = &slab->chunks[i];
+		}
+
+		pool->partial = slab;
+		stats_add(pool->slabs, 1);
+	}
+
+	chunk = slab->free_chunks;
+	slab->free_chunks = chunk->next;
+	slab->in_use++;
+	stats_add(pool->chunks_in_use, 1);
+
+	/*
+	 * slab is full, remove it from the partial list
+	 */
+	if (!slab->free_chunks) {
+		pool->partial = slab->next;
+		if (slab->next) {
+			slab->next->prev = NULL;
+		}
+		slab->next = NULL;
+	}
+
+	return chunk;
+}
+
+static void _pool_put(knet_handle_t knet_h, struct knet_defrag_chunk *chunk)
+{
+	struct knet_defrag_pool *pool = &knet_h->defrag_pool;
+	struct knet_defrag_slab *slab = chunk->slab;
+
+	/*
+	 * slab was full, it has free chunks again
+	 */
+	if (!slab->free_chunks) {
+		slab->prev = NULL;
+		slab->next = pool->partial;
+		if (pool->partial) {
+			pool->partial->prev = slab;
+		}
+		pool->partial = slab;
+	}
+
+	chunk->next = slab->free_chunks;
+	slab->free_chunks = chunk;
+	slab->in_use--;
+	stats_add(pool->chunks_in_use, -1);
+}
+
+/*
+ * free empty slabs, keeping at most one slab worth of free chunks
+ * around. A released chunk goes back to the head of its slab free
+ * list and is handed out again by the next _pool_get, its content
+ * must not be used once it has been returned to the pool.
+ */
+void _defrag_pool_trim(knet_handle_t knet_h)
+{
+	struct knet_defrag_pool *pool = &knet_h->defrag_pool;
+	struct knet_defrag_slab *slab, *next;
+
+	stats_set(pool->trim_pending, 0);
+
+	for (slab = pool->partial; slab != NULL; slab = next) {
+		next = slab->next;
+
+		if (slab->in_use) {
+			continue;
+		}
+
+		if (((pool->slabs - 1) * KNET_DEFRAG_SLAB_CHUNKS) - pool->chunks_in_use < KNET_DEFRAG_SLAB_CHUNKS) {
+			return;
+		}
+
+		if (slab->prev) {
+			slab->prev->next = slab->next;
+		} else {
+			pool->partial = slab->next;
+		}
+		if (slab->next) {
+			slab->next->prev = slab->prev;
+		}
+
+		free(slab);
+		stats_add(pool->slabs, -1);
+	}
+}
+
+/*
+ * all chunks must have been returned to the pool already
+ */
+void _defrag_pool_destroy(knet_handle_t knet_h)
+{
+	struct knet_defrag_pool *pool = &knet_h->defrag_pool;
+	struct knet_defrag_slab *slab;
+
+	while (pool->partial) {
+		slab = pool->partial;
+		pool->partial = slab->next;
+		free(slab);
+	}
+
+	pool->slabs = 0;
+}
+
+/*
+ * size is a power of 2
+ */
+static void _index_set_size(struct knet_host *host, uint32_t size)
+{
+	uint8_t bits = 0;
+
+	while ((1U << bits) < size) {
+		bits++;
+	}
+
+	host->defrag_index_size = size;
+	host->defrag_index_shift = 32 - bits;
+}
+
+static int _index_find_slot(struct knet_host *host, seq_num_t seq_num)
+{
+	uint32_t mask = host->defrag_index_size - 1;
+	uint32_t slot = _defrag_index_hash(host, seq_num);
+
+	while (host->defrag_index[slot] != KNET_DEFRAG_BUF_NONE) {
+		if (host->defrag_bufs[host->defrag_index[slot]].pckt_seq == seq_num) {
+			return slot;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return -1;
+}
+
+static void _index_insert(struct knet_host *host, uint16_t idx)
+{
+	uint32_t mask = host->defrag_index_size - 1;
+	uint32_t slot = _defrag_index_hash(host, host->defrag_bufs[idx].pckt_seq);
+
+	while (host->defrag_index[slot] != KNET_DEFRAG_BUF_NONE) {
+		slot = (slot + 1) & mask;
+	}
+
+	host->defrag_index[slot] = idx;
+}
+
+static void _index_remove(struct knet_host *host, uint32_t slot)
+{
+	uint32_t mask = host->defrag_index_size - 1;
+	uint32_t next = slot, home;
+
+	/*
+	 * shift back entries that would not be reachable anymore
+	 * once the slot is empty
+	 */
+	while (1) {
+		host->defrag_index[slot] = KNET_DEFRAG_BUF_NONE;
+
+		while (1) {
+			next = (next + 1) & mask;
+			if (host->defrag_index[next] == KNET_DEFRAG_BUF_NONE) {
+				return;
+			}
+			home = _defrag_index_hash(host, host->defrag_bufs[host->defrag_index[next]].pckt_seq);
+			/*
+			 * entry can stay where it is if its home slot
+			 * is cyclically in (slot, next]
+			 */
+			if (slot <= next) {
+				if ((slot < home) && (home <= next)) {
+					continue;
+				}
+			} else {
+				if ((slot < home) || (home <= next)) {
+					continue;
+				}
+			}
+			break;
+		}
+
+		host->defrag_index[slot] = host->defrag_index[next];
+		slot = next;
+	}
+}
+
+static void _lru_unlink(struct knet_host *host, uint16_t idx)
+{
+	struct knet_host_defrag_buf *buf = &host->defrag_bufs[idx];
+
+	if (buf->lru_prev != KNET_DEFRAG_BUF_NONE) {
+		host->defrag_bufs[buf->lru_prev].lru_next = buf->lru_next;
+	} else {
+		host->defrag_lru_head = buf->lru_next;
+	}
+
+	if (buf->lru_next != KNET_DEFRAG_BUF_NONE) {
+		host->defrag_bufs[buf->lru_next].lru_prev = buf->lru_prev;
+	} else {
+		host->defrag_lru_tail = buf->lru_prev;
+	}
+}
+
+static void _lru_append(struct knet_host *host, uint16_t idx)
+{
+	struct knet_host_defrag_buf *buf = &host->defrag_bufs[idx];
+
+	buf->lru_prev = host->defrag_lru_tail;
+	buf->lru_next = KNET_DEFRAG_BUF_NONE;
+
+	if (host->defrag_lru_tail != KNET_DEFRAG_BUF_NONE) {
+		host->defrag_bufs[host->defrag_lru_tail].lru_next = idx;
+	} else {
+		host->defrag_lru_head = idx;
+	}
+	host->defrag_lru_tail = idx;
+}
+
+/*
+ * link buffers from first to the end of the array in the free list
+ */
+static void _free_list_init(struct knet_host *host, uint16_t first)
+{
+	uint16_t i;
+
+	if (first >= host->allocated_defrag_bufs) {
+		host->defrag_free_head = KNET_DEFRAG_BUF_NONE;
+		return;
+	}
+
+	for (i = first; i < host->allocated_defrag_bufs; i++) {
+		host->defrag_bufs[i].in_use = 0;
+		host->defrag_bufs[i].lru_next = i + 1;
+	}
+	host->defrag_bufs[host->allocated_defrag_bufs - 1].lru_next = KNET_DEFRAG_BUF_NONE;
+	host->defrag_free_head = first;
+}
+
+static void _defrag_bufs_init(struct knet_host *host)
+{
+	memset(host->defrag_index, 0xff, host->defrag_index_size * sizeof(uint16_t));
+	host->defrag_lru_head = KNET_DEFRAG_BUF_NONE;
+	host->defrag_lru_tail = KNET_DEFRAG_BUF_NONE;
+	stats_set(host->in_use_defrag_bufs, 0);
+	_free_list_init(host, 0);
+}
+
+int _defrag_bufs_alloc(struct knet_host *host, uint16_t bufs)
+{
+	host->defrag_bufs = malloc(bufs * sizeof(struct knet_host_defrag_buf));
+	host->defrag_index = malloc(bufs * 2 * sizeof(uint16_t));
+	if ((!host->defrag_bufs) || (!host->defrag_index)) {
+		free(host->defrag_bufs);
+		host->defrag_bufs = NULL;
+		free(host->defrag_index);
+		host->defrag_index = NULL;
+		errno = ENOMEM;
+		return -1;
+	}
+
+	host->allocated_defrag_bufs = bufs;
+	_index_set_size(host, bufs * 2);
+
+	_defrag_bufs_init(host);
+
+	return 0;
+}
+
+/*
+ * in use buffers are moved at the beginning of the new array,
+ * in LRU order. bufs cannot be lower than in_use_defrag_bufs.
+ */
+int _defrag_bufs_resize(struct knet_host *host, uint16_t bufs)
+{
+	struct knet_host_defrag_buf *new_bufs;
+	uint16_t *new_index;
+	uint16_t i, x = 0;
+
+	if (bufs < host->in_use_defrag_bufs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	new_bufs = malloc(bufs * sizeof(struct knet_host_defrag_buf));
+	new_index = malloc(bufs * 2 * sizeof(uint16_t));
+	if ((!new_bufs) || (!new_index)) {
+		free(new_bufs);
+		free(new_index);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = host->defrag_lru_head; i != KNET_DEFRAG_BUF_NONE; i = host->defrag_bufs[i].lru_next) {
+		memmove(&new_bufs[x], &host->defrag_bufs[i], sizeof(struct knet_host_defrag_buf));
+		new_bufs[x].lru_prev = x ? x - 1 : KNET_DEFRAG_BUF_NONE;
+		new_bufs[x].lru_next = x + 1;
+		x++;
+	}
+
+	free(host->defrag_bufs);
+	free(host->defrag_index);
+
+	host->defrag_bufs = new_bufs;
+	host->defrag_index = new_index;
+	stats_set(host->allocated_defrag_bufs, bufs);
+	_index_set_size(host, bufs * 2);
+
+	if (x) {
+		new_bufs[x - 1].lru_next = KNET_DEFRAG_BUF_NONE;
+		host->defrag_lru_head = 0;
+		host->defrag_lru_tail = x - 1;
+	} else {
+		host->defrag_lru_head = KNET_DEFRAG_BUF_NONE;
+		host->defrag_lru_tail = KNET_DEFRAG_BUF_NONE;
+	}
+
+	_free_list_init(host, x);
+
+	memset(host->defrag_index, 0xff, host->defrag_index_size * sizeof(uint16_t));
+	for (i = 0; i < x; i++) {
+		_index_insert(host, i);
+	}
+
+	return 0;
+}
+
+/*
+ * release all buffers
+ */
+void _defrag_bufs_reset(knet_handle_t knet_h, struct knet_host *host)
+{
+	uint16_t i;
+
+	for (i = host->defrag_lru_head; i != KNET_DEFRAG_BUF_NONE; i = host->defrag_bufs[i].lru_next) {
+		_pool_put(knet_h, host->defrag_bufs[i].chunk);
+		host->defrag_bufs[i].chunk = NULL;
+	}
+
+	_defrag_bufs_init(host);
+}
+
+void _defrag_bufs_free(knet_handle_t knet_h, struct knet_host *host)
+{
+	if (!host->defrag_bufs) {
+		return;
+	}
+
+	_defrag_bufs_reset(knet_h, host);
+
+	free(host->defrag_bufs);
+	host->defrag_bufs = NULL;
+	free(host->defrag_index);
+	host->defrag_index = NULL;
+	host->allocated_defrag_bufs = 0;
+	host->defrag_index_size = 0;
+}
+
+/*
+ * return the index of the buffer handling seq_num, -1 if none
+ */
+int _defrag_buf_lookup(struct knet_host *host, seq_num_t seq_num)
+{
+	int slot;
+
+	slot = _index_find_slot(host, seq_num);
+	if (slot < 0) {
+		return -1;
+	}
+
+	return host->defrag_index[slot];
+}
+
+/*
+ * take a free buffer to handle seq_num (caller has to make sure
+ * that no other buffer is handling the same seq_num).
+ * return -1 if there are no free buffers
+ */
+int _defrag_buf_get(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_num)
+{
+	struct knet_host_defrag_buf *buf;
+	uint16_t idx = host->defrag_free_head;
+
+	if (idx == KNET_DEFRAG_BUF_NONE) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	buf = &host->defrag_bufs[idx];
+
+	buf->chunk = _pool_get(knet_h);
+	if (!buf->chunk) {
+		return -1;
+	}
+
+	host->defrag_free_head = buf->lru_next;
+
+	/*
+	 * no need to clear the chunk, fragments are always written
+	 * before the packet is reassembled
+	 */
+	buf->in_use = 1;
+	buf->pckt_seq = seq_num;
+	buf->frag_recv = 0;
+	memset(buf->frag_map, 0, sizeof(buf->frag_map));
+	buf->last_first = 0;
+	buf->frag_size = 0;
+	buf->last_frag_size = 0;
+
+	_lru_append(host, idx);
+	_index_insert(host, idx);
+	stats_add(host->in_use_defrag_bufs, 1);
+	host->defrag_reclaim_needed = 1;
+
+	return idx;
+}
+
+/*
+ * return the least recently updated buffer in use, -1 if none
+ */
+int _defrag_buf_oldest(struct knet_host *host)
+{
+	if (host->defrag_lru_head == KNET_DEFRAG_BUF_NONE) {
+		return -1;
+	}
+
+	return host->defrag_lru_head;
+}
+
+void _defrag_buf_touch(struct knet_host *host, int idx)
+{
+	if (host->defrag_lru_tail == idx) {
+		return;
+	}
+
+	_lru_unlink(host, idx);
+	_lru_append(host, idx);
+}
+
+void _defrag_buf_release(knet_handle_t knet_h, struct knet_host *host, int idx)
+{
+	struct knet_host_defrag_buf *buf = &host->defrag_bufs[idx];
+	int slot;
+
+	if (!buf->in_use) {
+		return;
+	}
+
+	slot = _index_find_slot(host, buf->pckt_seq);
+	if (slot >= 0) {
+		_index_remove(host, slot);
+	}
+
+	_lru_unlink(host, idx);
+
+	_pool_put(knet_h, buf->chunk);
+	buf->chunk = NULL;
+
+	buf->in_use = 0;
+	buf->lru_next = host->defrag_free_head;
+	host->defrag_free_head = idx;
+	stats_add(host->in_use_defrag_bufs, -1);
+}
+
+/*
+ * heartbeat thread, under global read lock.
+ *
+ * Record the % of defrag buffers in use for each host every
+ * defrag_bufs_usage_samples_timespan / defrag_bufs_usage_samples
+ * seconds. Only the counters maintained by the RX thread are read,
+ * when a host can give back buffers or the pool has spare slabs,
+ * the RX thread is asked to do it next time it touches them.
+ */
+void _defrag_bufs_sample(knet_handle_t knet_h)
+{
+	struct knet_host *host;
+	struct timespec now;
+	unsigned long long time_diff; /* nanoseconds */
+	uint16_t i, allocated, in_use;
+	uint32_t sum, spare;
+
+	/*
+	 * first run.
+	 */
+	if ((knet_h->defrag_bufs_last_run.tv_sec == 0) &&
+	    (knet_h->defrag_bufs_last_run.tv_nsec == 0)) {
+		clock_gettime(CLOCK_MONOTONIC, &knet_h->defrag_bufs_last_run);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	timespec_diff(knet_h->defrag_bufs_last_run, now, &time_diff);
+
+	if (time_diff < (((unsigned long long)knet_h->defrag_bufs_usage_samples_timespan * 1000000000) / knet_h->defrag_bufs_usage_samples)) {
+		return;
+	}
+
+	/*
+	 * record the last run
+	 */
+	memmove(&knet_h->defrag_bufs_last_run, &now, sizeof(struct timespec));
+
+	/*
+	 * more than one slab worth of free chunks, give memory back
+	 */
+	spare = (stats_get(knet_h->defrag_pool.slabs) * KNET_DEFRAG_SLAB_CHUNKS) - stats_get(knet_h->defrag_pool.chunks_in_use);
+	if (spare >= KNET_DEFRAG_SLAB_CHUNKS * 2) {
+		stats_set(knet_h->defrag_pool.trim_pending, 1);
+	}
+
+	for (host = knet_h->host_head; host != NULL; host = host->next) {
+		if (__atomic_exchange_n(&host->in_use_defrag_buffers_reset, 0, __ATOMIC_RELAXED)) {
+			memset(&host->in_use_defrag_buffers, 0, sizeof(host->in_use_defrag_buffers));
+			host->in_use_defrag_buffers_samples = 0;
+			host->in_use_defrag_buffers_index = 0;
+		}
+
+		allocated = stats_get(host->allocated_defrag_bufs);
+		if (!allocated) {
+			continue;
+		}
+
+		/*
+		 * counters are read while RX might be resizing,
+		 * don't go above 100%
+		 */
+		in_use = stats_get(host->in_use_defrag_bufs);
+		if (in_use > allocated) {
+			in_use = allocated;
+		}
+
+		/*
+		 * Update buffer usage stats. We do this for all nodes.
+		 * record only %
+		 */
+		host->in_use_defrag_buffers[host->in_use_defrag_buffers_index] = (in_use * 100 / allocated);
+		host->in_use_defrag_buffers_index++;
+
+		/*
+		 * make sure to stay within buffer
+		 */
+		if (host->in_use_defrag_buffers_index == knet_h->defrag_bufs_usage_samples) {
+			host->in_use_defrag_buffers_index = 0;
+		}
+
+		/*
+		 * only allow shrinking if we have enough samples
+		 */
+		if (host->in_use_defrag_buffers_samples < knet_h->defrag_bufs_usage_samples) {
+			host->in_use_defrag_buffers_samples++;
+			continue;
+		}
+
+		/*
+		 * only allow shrinking if in use bufs are <= knet_h->defrag_bufs_shrink_threshold%
+		 */
+		if (knet_h->defrag_bufs_reclaim_policy == RECLAIM_POLICY_AVERAGE) {
+			sum = 0;
+			for (i = 0; i < knet_h->defrag_bufs_usage_samples; i++) {
+				sum += host->in_use_defrag_buffers[i];
+			}
+			sum = sum / knet_h->defrag_bufs_usage_samples;
+
+			if (sum > knet_h->defrag_bufs_shrink_threshold) {
+				continue;
+			}
+		} else {
+			sum = 0;
+			for (i = 0; i < knet_h->defrag_bufs_usage_samples; i++) {
+				if (host->in_use_defrag_buffers[i] > knet_h->defrag_bufs_shrink_threshold) {
+					sum = 1;
+				}
+			}
+
+			if (sum) {
+				continue;
+			}
+		}
+
+		/*
+		 * only allow shrinking if allocated bufs > min_defrag_bufs
+		 */
+		if (allocated == knet_h->defrag_bufs_min) {
+			continue;
+		}
+
+		stats_set(host->defrag_bufs_shrink_pending, 1);
+	}
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under LGPL-2.0+
+ */
+
+#ifndef __KNET_DEFRAG_H__
+#define __KNET_DEFRAG_H__
+
+#include "internals.h"
+
+#define KNET_DEFRAG_BUF_NONE UINT16_MAX
+
+static inline uint32_t _defrag_index_hash(struct knet_host *host, seq_num_t seq_num)
+{
+	return ((uint32_t)seq_num * 2654435769U) >> host->defrag_index_shift;
+}
+
+int _defrag_bufs_alloc(struct knet_host *host, uint16_t bufs);
+int _defrag_bufs_resize(struct knet_host *host, uint16_t bufs);
+void _defrag_bufs_reset(knet_handle_t knet_h, struct knet_host *host);
+void _defrag_bufs_free(knet_handle_t knet_h, struct knet_host *host);
+void _defrag_pool_trim(knet_handle_t knet_h);
+void _defrag_pool_destroy(knet_handle_t knet_h);
+void _defrag_bufs_sample(knet_handle_t knet_h);
+
+int _defrag_buf_lookup(struct knet_host *host, seq_num_t seq_num);
+int _defrag_buf_get(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_num);
+int _defrag_buf_oldest(struct knet_host *host);
+void _defrag_buf_touch(struct knet_host *host, int idx);
+void _defrag_buf_release(knet_handle_t knet_h, struct knet_host *host, int idx);
+
+#endif
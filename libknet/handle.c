@@ -14,14 +14,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
-#include <math.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
 #include "internals.h"
 #include "crypto.h"
+#include "defrag.h"
 #include "links.h"
 #include "compress.h"
+#include "ring.h"
 #include "compat.h"
 #include "common.h"
 #include "threads_common.h"
@@ -30,6 +31,7 @@
 #include "threads_dsthandler.h"
 #include "threads_rx.h"
 #include "threads_tx.h"
+#include "threads_crypto.h"
 #include "transports.h"
 #include "transport_common.h"
 #include "logging.h"
@@ -87,9 +89,23 @@ static int _init_locks(knet_handle_t knet_h)
 		goto exit_fail;
 	}
 
-	savederrno = pthread_mutex_init(&knet_h->tx_mutex, NULL);
+	savederrno = pthread_mutex_init(&knet_h->tx_threads_mutex, NULL);
 	if (savederrno) {
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize tx_thread mutex: %s",
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize tx_threads mutex: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	savederrno = pthread_mutex_init(&knet_h->tx_rr_mutex, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize tx_rr mutex: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	savederrno = pthread_mutex_init(&knet_h->tx_compress_mutex, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize tx_compress mutex: %s",
 			strerror(savederrno));
 		goto exit_fail;
 	}
@@ -115,6 +131,11 @@ static int _init_locks(knet_handle_t knet_h)
 		goto exit_fail;
 	}
 
+	if (_crypto_pool_init(knet_h)) {
+		savederrno = errno;
+		goto exit_fail;
+	}
+
 	return 0;
 
 exit_fail:
@@ -129,12 +150,15 @@ static void _destroy_locks(knet_handle_t knet_h)
 	pthread_mutex_destroy(&knet_h->kmtu_mutex);
 	pthread_cond_destroy(&knet_h->pmtud_cond);
 	pthread_mutex_destroy(&knet_h->hb_mutex);
-	pthread_mutex_destroy(&knet_h->tx_mutex);
+	pthread_mutex_destroy(&knet_h->tx_threads_mutex);
+	pthread_mutex_destroy(&knet_h->tx_rr_mutex);
+	pthread_mutex_destroy(&knet_h->tx_compress_mutex);
 	pthread_mutex_destroy(&knet_h->backoff_mutex);
 	pthread_mutex_destroy(&knet_h->tx_seq_num_mutex);
 	pthread_mutex_destroy(&knet_h->threads_status_mutex);
 	pthread_mutex_destroy(&knet_h->handle_stats_mutex);
 	pthread_mutex_destroy(&knet_h->onwire_mutex);
+	_crypto_pool_destroy(knet_h);
 }
 
 static int _init_socks(knet_handle_t knet_h)
@@ -164,19 +188,6 @@ static int _init_buffers(knet_handle_t knet_h)
 {
 	int savederrno = 0;
 	int i;
-	size_t bufsize;
-
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
-		bufsize = ceil((float)KNET_MAX_PACKET_SIZE / (i + 1)) + KNET_HEADER_ALL_SIZE;
-		knet_h->send_to_links_buf[i] = malloc(bufsize);
-		if (!knet_h->send_to_links_buf[i]) {
-			savederrno = errno;
-			log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory datafd to link buffer: %s",
-				strerror(savederrno));
-			goto exit_fail;
-		}
-		memset(knet_h->send_to_links_buf[i], 0, bufsize);
-	}
 
 	for (i = 0; i < PCKT_RX_BUFS; i++) {
 		knet_h->recv_from_links_buf[i] = malloc(KNET_DATABUFSIZE);
@@ -189,15 +200,6 @@ static int _init_buffers(knet_handle_t knet_h)
 		memset(knet_h->recv_from_links_buf[i], 0, KNET_DATABUFSIZE);
 	}
 
-	knet_h->recv_from_sock_buf = malloc(KNET_DATABUFSIZE);
-	if (!knet_h->recv_from_sock_buf) {
-		savederrno = errno;
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for app to datafd buffer: %s",
-				strerror(savederrno));
-		goto exit_fail;
-	}
-	memset(knet_h->recv_from_sock_buf, 0, KNET_DATABUFSIZE);
-
 	knet_h->pingbuf = malloc(KNET_HEADER_ALL_SIZE);
 	if (!knet_h->pingbuf) {
 		savederrno = errno;
@@ -216,27 +218,17 @@ static int _init_buffers(knet_handle_t knet_h)
 	}
 	memset(knet_h->pmtudbuf, 0, KNET_PMTUD_SIZE_V6 + KNET_HEADER_ALL_SIZE);
 
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
-		bufsize = ceil((float)KNET_MAX_PACKET_SIZE / (i + 1)) + KNET_HEADER_ALL_SIZE + KNET_DATABUFSIZE_CRYPT_PAD;
-		knet_h->send_to_links_buf_crypt[i] = malloc(bufsize);
-		if (!knet_h->send_to_links_buf_crypt[i]) {
+	for (i = 0; i < KNET_RX_DECRYPT_BATCH; i++) {
+		knet_h->recv_from_links_batch.buf_decrypt[i] = malloc(KNET_DATABUFSIZE_CRYPT);
+		if (!knet_h->recv_from_links_batch.buf_decrypt[i]) {
 			savederrno = errno;
-			log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for crypto datafd to link buffer: %s",
+			log_err(knet_h, KNET_SUB_CRYPTO, "Unable to allocate memory for crypto link to datafd batch buffer: %s",
 				strerror(savederrno));
 			goto exit_fail;
 		}
-		memset(knet_h->send_to_links_buf_crypt[i], 0, bufsize);
+		memset(knet_h->recv_from_links_batch.buf_decrypt[i], 0, KNET_DATABUFSIZE_CRYPT);
 	}
 
-	knet_h->recv_from_links_buf_decrypt = malloc(KNET_DATABUFSIZE_CRYPT);
-	if (!knet_h->recv_from_links_buf_decrypt) {
-		savederrno = errno;
-		log_err(knet_h, KNET_SUB_CRYPTO, "Unable to allocate memory for crypto link to datafd buffer: %s",
-			strerror(savederrno));
-		goto exit_fail;
-	}
-	memset(knet_h->recv_from_links_buf_decrypt, 0, KNET_DATABUFSIZE_CRYPT);
-
 	knet_h->recv_from_links_buf_crypt = malloc(KNET_DATABUFSIZE_CRYPT);
 	if (!knet_h->recv_from_links_buf_crypt) {
 		savederrno = errno;
@@ -273,15 +265,6 @@ static int _init_buffers(knet_handle_t knet_h)
 	}
 	memset(knet_h->recv_from_links_buf_decompress, 0, KNET_DATABUFSIZE_COMPRESS);
 
-	knet_h->send_to_links_buf_compress = malloc(KNET_DATABUFSIZE_COMPRESS);
-	if (!knet_h->send_to_links_buf_compress) {
-		savederrno = errno;
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to allocate memory for compress buffer: %s",
-			strerror(savederrno));
-		goto exit_fail;
-	}
-	memset(knet_h->send_to_links_buf_compress, 0, KNET_DATABUFSIZE_COMPRESS);
-
 	memset(knet_h->knet_transport_fd_tracker, 0, sizeof(knet_h->knet_transport_fd_tracker));
 	for (i = 0; i < KNET_MAX_FDS; i++) {
 		knet_h->knet_transport_fd_tracker[i].transport = KNET_MAX_TRANSPORTS;
@@ -298,24 +281,20 @@ static void _destroy_buffers(knet_handle_t knet_h)
 {
 	int i;
 
-	for (i = 0; i < PCKT_FRAG_MAX; i++) {
-		free(knet_h->send_to_links_buf[i]);
-		free(knet_h->send_to_links_buf_crypt[i]);
-	}
-
 	for (i = 0; i < PCKT_RX_BUFS; i++) {
 		free(knet_h->recv_from_links_buf[i]);
 	}
 
 	free(knet_h->recv_from_links_buf_decompress);
-	free(knet_h->send_to_links_buf_compress);
-	free(knet_h->recv_from_sock_buf);
-	free(knet_h->recv_from_links_buf_decrypt);
+	for (i = 0; i < KNET_RX_DECRYPT_BATCH; i++) {
+		free(knet_h->recv_from_links_batch.buf_decrypt[i]);
+	}
 	free(knet_h->recv_from_links_buf_crypt);
 	free(knet_h->pingbuf);
 	free(knet_h->pingbuf_crypt);
 	free(knet_h->pmtudbuf);
 	free(knet_h->pmtudbuf_crypt);
+	_defrag_pool_destroy(knet_h);
 }
 
 static int _init_epolls(knet_handle_t knet_h)
@@ -323,18 +302,6 @@ static int _init_epolls(knet_handle_t knet_h)
 	struct epoll_event ev;
 	int savederrno = 0;
 
-	/*
-	 * even if the kernel does dynamic allocation with epoll_ctl
-	 * we need to reserve one extra for host to host communication
-	 */
-	knet_h->send_to_links_epollfd = epoll_create(KNET_EPOLL_MAX_EVENTS + 1);
-	if (knet_h->send_to_links_epollfd < 0) {
-		savederrno = errno;
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to create epoll datafd to link fd: %s",
-			strerror(savederrno));
-		goto exit_fail;
-	}
-
 	knet_h->recv_from_links_epollfd = epoll_create(KNET_EPOLL_MAX_EVENTS);
 	if (knet_h->recv_from_links_epollfd < 0) {
 		savederrno = errno;
@@ -351,13 +318,6 @@ static int _init_epolls(knet_handle_t knet_h)
 		goto exit_fail;
 	}
 
-	if (_fdset_cloexec(knet_h->send_to_links_epollfd)) {
-		savederrno = errno;
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to set CLOEXEC on datafd to link epoll fd: %s",
-			strerror(savederrno)); 
-		goto exit_fail;
-	}
-
 	if (_fdset_cloexec(knet_h->recv_from_links_epollfd)) {
 		savederrno = errno;
 		log_err(knet_h, KNET_SUB_HANDLE, "Unable to set CLOEXEC on link to datafd epoll fd: %s",
@@ -400,23 +360,53 @@ static void _close_epolls(knet_handle_t knet_h)
 
 	for (i = 0; i < KNET_DATAFD_MAX; i++) {
 		if (knet_h->sockfd[i].in_use) {
-			epoll_ctl(knet_h->send_to_links_epollfd, EPOLL_CTL_DEL, knet_h->sockfd[i].sockfd[knet_h->sockfd[i].is_created], &ev);
-			if  (knet_h->sockfd[i].sockfd[knet_h->sockfd[i].is_created]) {
+			if ((knet_h->tx_threads) && (!knet_h->sockfd[i].has_error)) {
+				epoll_ctl(knet_h->tx_workers[i % knet_h->tx_threads]->epollfd, EPOLL_CTL_DEL, knet_h->sockfd[i].sockfd[knet_h->sockfd[i].is_created], &ev);
+			}
+			if (knet_h->sockfd[i].tx_ring) {
+				_ring_datafd_free(&knet_h->sockfd[i]);
+			} else if  (knet_h->sockfd[i].sockfd[knet_h->sockfd[i].is_created]) {
 				 _close_socketpair(knet_h, knet_h->sockfd[i].sockfd);
 			}
 		}
 	}
 
 	epoll_ctl(knet_h->dst_link_handler_epollfd, EPOLL_CTL_DEL, knet_h->dstsockfd[0], &ev);
-	close(knet_h->send_to_links_epollfd);
 	close(knet_h->recv_from_links_epollfd);
 	close(knet_h->dst_link_handler_epollfd);
 }
 
+static int _init_tx_workers(knet_handle_t knet_h)
+{
+	uint8_t i;
+
+	for (i = 0; i < KNET_TX_THREADS_DEFAULT; i++) {
+		if (_tx_worker_init(knet_h, i)) {
+			return -1;
+		}
+	}
+
+	knet_h->tx_threads = KNET_TX_THREADS_DEFAULT;
+
+	return 0;
+}
+
+static void _destroy_tx_workers(knet_handle_t knet_h)
+{
+	uint8_t i;
+
+	for (i = 0; i < KNET_MAX_TX_THREADS; i++) {
+		_tx_worker_destroy(knet_h, i);
+	}
+
+	knet_h->tx_threads = 0;
+}
+
 static int _start_threads(knet_handle_t knet_h)
 {
 	int savederrno = 0;
 	pthread_attr_t attr;
+	uint8_t i;
 
 	set_thread_status(knet_h, KNET_THREAD_PMTUD, KNET_THREAD_REGISTERED);
 
@@ -450,12 +440,15 @@ static int _start_threads(knet_handle_t knet_h)
 		goto exit_fail;
 	}
 
-	set_thread_status(knet_h, KNET_THREAD_TX, KNET_THREAD_REGISTERED);
-	savederrno = pthread_create(&knet_h->send_to_links_thread, &attr,
-				    _handle_send_to_links_thread, (void *) knet_h);
-	if (savederrno) {
-		log_err(knet_h, KNET_SUB_HANDLE, "Unable to start datafd to link thread: %s",
-			strerror(savederrno));
+	for (i = 0; i < knet_h->tx_threads; i++) {
+		if (_tx_worker_start(knet_h, i)) {
+			savederrno = errno;
+			goto exit_fail;
+		}
+	}
+
+	if (_crypto_pool_start(knet_h, KNET_CRYPTO_THREADS_DEFAULT)) {
+		savederrno = errno;
 		goto exit_fail;
 	}
 
@@ -496,6 +489,7 @@ exit_fail:
 static void _stop_threads(knet_handle_t knet_h)
 {
 	void *retval;
+	uint8_t i;
 
 	wait_all_threads_status(knet_h, KNET_THREAD_STOPPED);
 
@@ -504,11 +498,12 @@ static void _stop_threads(knet_handle_t knet_h)
 		pthread_join(knet_h->heartbt_thread, &retval);
 	}
 
-	if (knet_h->send_to_links_thread) {
-		pthread_cancel(knet_h->send_to_links_thread);
-		pthread_join(knet_h->send_to_links_thread, &retval);
+	for (i = 0; i < KNET_MAX_TX_THREADS; i++) {
+		_tx_worker_stop(knet_h, i);
 	}
 
+	_crypto_pool_stop(knet_h);
+
 	if (knet_h->recv_from_links_thread) {
 		pthread_cancel(knet_h->recv_from_links_thread);
 		pthread_join(knet_h->recv_from_links_thread, &retval);
@@ -558,11 +553,10 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 	}
 
 	/*
-	 * allocate handle
+	 * allocate handle, stats shards need to be cache line aligned
 	 */
 
-	knet_h = malloc(sizeof(struct knet_handle));
-	if (!knet_h) {
+	if (posix_memalign((void **)&knet_h, KNET_CACHE_LINE_SIZE, sizeof(struct knet_handle))) {
 		errno = ENOMEM;
 		return NULL;
 	}
@@ -611,10 +605,7 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 	 * Set 'min' stats to the maximum value so the
 	 * first value we get is always less
 	 */
-	knet_h->stats.tx_compress_time_min = UINT64_MAX;
-	knet_h->stats.rx_compress_time_min = UINT64_MAX;
-	knet_h->stats.tx_crypt_time_min = UINT64_MAX;
-	knet_h->stats.rx_crypt_time_min = UINT64_MAX;
+	clear_handle_stats(knet_h);
 
 	/*
 	 * set onwire version. See also comments in internals.h
@@ -714,6 +705,15 @@ knet_handle_t knet_handle_new(knet_node_id_t host_id,
 		goto exit_fail;
 	}
 
+	/*
+	 * allocate TX workers
+	 */
+
+	if (_init_tx_workers(knet_h)) {
+		savederrno = errno;
+		goto exit_fail;
+	}
+
 	/*
 	 * start transports
 	 */
@@ -776,6 +776,7 @@ int knet_handle_free(knet_handle_t knet_h)
 	_stop_threads(knet_h);
 	stop_all_transports(knet_h);
 	_close_epolls(knet_h);
+	_destroy_tx_workers(knet_h);
 	_destroy_buffers(knet_h);
 	_close_socks(knet_h);
 	crypto_fini(knet_h, KNET_MAX_CRYPTO_INSTANCES + 1); /* values above MAX_CRYPTO will release all crypto resources */
@@ -21,6 +21,7 @@
 #include "host.h"
 #include "links.h"
 #include "common.h"
+#include "ring.h"
 #include "transport_common.h"
 #include "logging.h"
 
@@ -140,7 +141,18 @@ int knet_handle_add_datafd(knet_handle_t knet_h, int *datafd, int8_t *channel)
 	knet_h->sockfd[*channel].is_socket = 0;
 	knet_h->sockfd[*channel].has_error = 0;
 
-	if (*datafd > 0) {
+	if (*datafd == KNET_DATAFD_RING) {
+		if (_ring_datafd_init(&knet_h->sockfd[*channel])) {
+			savederrno = errno;
+			err = -1;
+			log_err(knet_h, KNET_SUB_HANDLE, "Unable to create datafd ring: %s",
+				strerror(savederrno));
+			goto out_unlock;
+		}
+
+		knet_h->sockfd[*channel].is_created = 1;
+		*datafd = knet_h->sockfd[*channel].sockfd[0];
+	} else if (*datafd > 0) {
 		int sockopt;
 		socklen_t sockoptlen = sizeof(sockopt);
 
@@ -182,13 +194,15 @@ int knet_handle_add_datafd(knet_handle_t knet_h, int *datafd, int8_t *channel)
 	ev.events = EPOLLIN;
 	ev.data.fd = knet_h->sockfd[*channel].sockfd[knet_h->sockfd[*channel].is_created];
 
-	if (epoll_ctl(knet_h->send_to_links_epollfd,
+	if (epoll_ctl(knet_h->tx_workers[*channel % knet_h->tx_threads]->epollfd,
 		      EPOLL_CTL_ADD, knet_h->sockfd[*channel].sockfd[knet_h->sockfd[*channel].is_created], &ev)) {
 		savederrno = errno;
 		err = -1;
 		log_err(knet_h, KNET_SUB_HANDLE, "Unable to add datafd %d to linkfd epoll pool: %s",
 			knet_h->sockfd[*channel].sockfd[knet_h->sockfd[*channel].is_created], strerror(savederrno));
-		if (knet_h->sockfd[*channel].is_created) {
+		if (knet_h->sockfd[*channel].tx_ring) {
+			_ring_datafd_free(&knet_h->sockfd[*channel]);
+		} else if (knet_h->sockfd[*channel].is_created) {
 			_close_socketpair(knet_h, knet_h->sockfd[*channel].sockfd);
 		}
 		goto out_unlock;
@@ -243,7 +257,7 @@ int knet_handle_remove_datafd(knet_handle_t knet_h, int datafd)
 	if (!knet_h->sockfd[channel].has_error) {
 		memset(&ev, 0, sizeof(struct epoll_event));
 
-		if (epoll_ctl(knet_h->send_to_links_epollfd,
+		if (epoll_ctl(knet_h->tx_workers[channel % knet_h->tx_threads]->epollfd,
 			      EPOLL_CTL_DEL, knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], &ev)) {
 			savederrno = errno;
 			err = -1;
@@ -253,7 +267,9 @@ int knet_handle_remove_datafd(knet_handle_t knet_h, int datafd)
 		}
 	}
 
-	if (knet_h->sockfd[channel].is_created) {
+	if (knet_h->sockfd[channel].tx_ring) {
+		_ring_datafd_free(&knet_h->sockfd[channel]);
+	} else if (knet_h->sockfd[channel].is_created) {
 		_close_socketpair(knet_h, knet_h->sockfd[channel].sockfd);
 	}
 
@@ -398,6 +414,7 @@ int knet_handle_enable_filter(knet_handle_t knet_h,
 int knet_handle_setfwd(knet_handle_t knet_h, unsigned int enabled)
 {
 	int savederrno = 0;
+	uint8_t i;
 
 	if (!_is_valid_handle(knet_h)) {
 		return -1;
@@ -423,8 +440,10 @@ int knet_handle_setfwd(knet_handle_t knet_h, unsigned int enabled)
 		/*
 		 * notify TX and RX threads to flush the queues
 		 */
-		if (set_thread_flush_queue(knet_h, KNET_THREAD_TX, KNET_THREAD_QUEUE_FLUSH) < 0) {
-			log_debug(knet_h, KNET_SUB_HANDLE, "Unable to request queue flushing for TX thread");
+		for (i = 0; i < knet_h->tx_threads; i++) {
+			if (set_thread_flush_queue(knet_h, knet_h->tx_workers[i]->thread_id, KNET_THREAD_QUEUE_FLUSH) < 0) {
+				log_debug(knet_h, KNET_SUB_HANDLE, "Unable to request queue flushing for TX thread %u", i);
+			}
 		}
 		if (set_thread_flush_queue(knet_h, KNET_THREAD_RX, KNET_THREAD_QUEUE_FLUSH) < 0) {
 			log_debug(knet_h, KNET_SUB_HANDLE, "Unable to request queue flushing for RX thread");
@@ -474,6 +493,7 @@ int knet_handle_setfwd(knet_handle_t knet_h, unsigned int enabled)
 int knet_handle_get_stats(knet_handle_t knet_h, struct knet_handle_stats *stats, size_t struct_size)
 {
 	int err = 0, savederrno = 0;
+	struct knet_handle_stats handle_stats;
 
 	if (!_is_valid_handle(knet_h)) {
 		return -1;
@@ -504,7 +524,8 @@ int knet_handle_get_stats(knet_handle_t knet_h, struct knet_handle_stats *stats,
 		struct_size = sizeof(struct knet_handle_stats);
 	}
 
-	memmove(stats, &knet_h->stats, struct_size);
+	get_handle_stats(knet_h, &handle_stats);
+	memmove(stats, &handle_stats, struct_size);
 
 	/*
 	 * TX crypt stats only count the data packets sent, so add in the ping/pong/pmtud figures
@@ -547,8 +568,7 @@ int knet_handle_clear_stats(knet_handle_t knet_h, int clear_option)
 		return -1;
 	}
 
-	memset(&knet_h->stats, 0, sizeof(struct knet_handle_stats));
-	memset(&knet_h->stats_extra, 0, sizeof(struct knet_handle_stats_extra));
+	clear_handle_stats(knet_h);
 	if (clear_option == KNET_CLEARSTATS_HANDLE_AND_LINK) {
 		_link_clear_stats(knet_h);
 	}
@@ -15,6 +15,7 @@
 #include <pthread.h>
 #include <stdio.h>
 
+#include "defrag.h"
 #include "host.h"
 #include "internals.h"
 #include "logging.h"
@@ -68,8 +69,7 @@ int knet_host_add(knet_handle_t knet_h, knet_node_id_t host_id)
 
 	memset(host, 0, sizeof(struct knet_host));
 
-	host->defrag_bufs = malloc(knet_h->defrag_bufs_min * sizeof(struct knet_host_defrag_buf));
-	if (!host->defrag_bufs) {
+	if (_defrag_bufs_alloc(host, knet_h->defrag_bufs_min) < 0) {
 		err = -1;
 		savederrno = errno;
 		log_err(knet_h, KNET_SUB_HOST, "Unable to allocate memory for host %u defrag buffers: %s",
@@ -77,10 +77,6 @@ int knet_host_add(knet_handle_t knet_h, knet_node_id_t host_id)
 		goto exit_unlock;
 	}
 
-	host->allocated_defrag_bufs = knet_h->defrag_bufs_min;
-
-	memset(host->defrag_bufs, 0, host->allocated_defrag_bufs * sizeof(struct knet_host_defrag_buf));
-
 	log_debug(knet_h, KNET_SUB_HOST, "Allocated %u defrag buffers for host %u",
 		  host->allocated_defrag_bufs, host_id);
 
@@ -130,7 +126,7 @@ exit_unlock:
 	pthread_rwlock_unlock(&knet_h->global_rwlock);
 	if (err < 0) {
 		if (host) {
-			free(host->defrag_bufs);
+			_defrag_bufs_free(knet_h, host);
 		}
 		free(host);
 	}
@@ -201,7 +197,7 @@ int knet_host_remove(knet_handle_t knet_h, knet_node_id_t host_id)
 	knet_h->host_index[host_id] = NULL;
 
 	if (removed) {
-		free(removed->defrag_bufs);
+		_defrag_bufs_free(knet_h, removed);
 	}
 	free(removed);
 
@@ -549,59 +545,124 @@ int knet_host_enable_status_change_notify(knet_handle_t knet_h,
 	return 0;
 }
 
+/*
+ * samples are owned by the heartbeat thread (_defrag_bufs_sample),
+ * only flag them as stale and drop any pending shrink based on them
+ */
 void _clear_defrag_bufs_stats(struct knet_host *host)
 {
-	memset(&host->in_use_defrag_buffers, 0, sizeof(host->in_use_defrag_buffers));
-	host->in_use_defrag_buffers_samples = 0;
-	host->in_use_defrag_buffers_index = 0;
+	stats_set(host->defrag_bufs_shrink_pending, 0);
+	stats_set(host->in_use_defrag_buffers_reset, 1);
 }
 
-static void _clear_cbuffers(struct knet_host *host, seq_num_t rx_seq_num)
+/*
+ * circular buffers are bitsets, one bit per seq_num
+ */
+
+static inline int _cbuffer_test(const uint64_t *cbuf, size_t bit)
 {
-	int i;
+	return (cbuf[bit / 64] >> (bit % 64)) & 1;
+}
 
-	memset(host->circular_buffer, 0, KNET_CBUFFER_SIZE);
-	host->rx_seq_num = rx_seq_num;
+static inline void _cbuffer_set(uint64_t *cbuf, size_t bit)
+{
+	cbuf[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static inline void _cbuffer_unset(uint64_t *cbuf, size_t bit)
+{
+	cbuf[bit / 64] &= ~(1ULL << (bit % 64));
+}
 
-	memset(host->circular_buffer_defrag, 0, KNET_CBUFFER_SIZE);
+/*
+ * clear bits first to last (included) of both buffers,
+ * whole words in between are cleared with memset.
+ */
+static void _cbuffers_clear_range(struct knet_host *host, size_t first, size_t last)
+{
+	size_t first_word = first / 64, last_word = last / 64;
+	uint64_t first_mask = ~0ULL << (first % 64);		/* bits >= first */
+	uint64_t last_mask = ~0ULL >> (63 - (last % 64));	/* bits <= last */
 
-	for (i = 0; i < host->allocated_defrag_bufs; i++) {
-		memset(&host->defrag_bufs[i], 0, sizeof(struct knet_host_defrag_buf));
+	if (first_word == last_word) {
+		host->circular_buffer[first_word] &= ~(first_mask & last_mask);
+		host->circular_buffer_defrag[first_word] &= ~(first_mask & last_mask);
+		return;
 	}
+
+	host->circular_buffer[first_word] &= ~first_mask;
+	host->circular_buffer_defrag[first_word] &= ~first_mask;
+
+	memset(&host->circular_buffer[first_word + 1], 0, (last_word - first_word - 1) * sizeof(uint64_t));
+	memset(&host->circular_buffer_defrag[first_word + 1], 0, (last_word - first_word - 1) * sizeof(uint64_t));
+
+	host->circular_buffer[last_word] &= ~last_mask;
+	host->circular_buffer_defrag[last_word] &= ~last_mask;
+}
+
+static void _clear_cbuffers(knet_handle_t knet_h, struct knet_host *host, seq_num_t rx_seq_num)
+{
+	memset(host->circular_buffer, 0, sizeof(host->circular_buffer));
+	host->rx_seq_num = rx_seq_num;
+
+	memset(host->circular_buffer_defrag, 0, sizeof(host->circular_buffer_defrag));
+
+	_defrag_bufs_reset(knet_h, host);
 	_clear_defrag_bufs_stats(host);
 }
 
+/*
+ * release defrag buffers that are out of the window of
+ * max(defrag_bufs_max, allocated_defrag_bufs) seq_num behind seq_num.
+ *
+ * All buffers are newer than the oldest one found by the last scan.
+ * As long as seq_num only moved forward since then, there is nothing
+ * to do until the oldest buffer falls out of the window or a new
+ * buffer is added (see _defrag_buf_get).
+ */
 static void _reclaim_old_defrag_bufs(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_num)
 {
-	seq_num_t head, tail; /* seq_num boundaries */
-	int i;
+	seq_num_t window, oldest_dist, dist;
+	uint16_t i, next;
+
+	if (!host->in_use_defrag_bufs) {
+		return;
+	}
 
-	head = seq_num + 1;
 	if (knet_h->defrag_bufs_max > host->allocated_defrag_bufs) {
-		tail = seq_num - (knet_h->defrag_bufs_max + 1);
+		window = knet_h->defrag_bufs_max;
 	} else {
-		tail = seq_num - (host->allocated_defrag_bufs + 1);
+		window = host->allocated_defrag_bufs;
+	}
+
+	if ((!host->defrag_reclaim_needed) &&
+	    ((uint32_t)(seq_num_t)(seq_num - host->defrag_reclaim_seq_num) +
+	     (seq_num_t)(host->defrag_reclaim_seq_num - host->defrag_oldest_seq_num) <= window)) {
+		return;
 	}
 
 	/*
-	 * expire old defrag buffers
+	 * expire old defrag buffers, only in use buffers are in the LRU list
 	 */
-	for (i = 0; i < host->allocated_defrag_bufs; i++) {
-		if (host->defrag_bufs[i].in_use) {
-			/*
-			 * head has done a rollover to 0+
-			 */
-			if (tail > head) {
-				if ((host->defrag_bufs[i].pckt_seq >= head) && (host->defrag_bufs[i].pckt_seq <= tail)) {
-					host->defrag_bufs[i].in_use = 0;
-				}
-			} else {
-				if ((host->defrag_bufs[i].pckt_seq >= head) || (host->defrag_bufs[i].pckt_seq <= tail)){
-					host->defrag_bufs[i].in_use = 0;
-				}
-			}
+	oldest_dist = 0;
+	for (i = host->defrag_lru_head; i != KNET_DEFRAG_BUF_NONE; i = next) {
+		next = host->defrag_bufs[i].lru_next;
+		/*
+		 * seq_num distance, also handles seq_num rollover to 0+
+		 */
+		dist = seq_num - host->defrag_bufs[i].pckt_seq;
+		if (dist > window) {
+			_defrag_buf_release(knet_h, host, i);
+			continue;
+		}
+		if (dist >= oldest_dist) {
+			oldest_dist = dist;
+			host->defrag_oldest_seq_num = host->defrag_bufs[i].pckt_seq;
 		}
 	}
+
+	host->defrag_reclaim_seq_num = seq_num;
+	host->defrag_reclaim_needed = 0;
 }
 
 /*
@@ -613,8 +674,6 @@ int _seq_num_lookup(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_
 {
 	size_t head, tail; /* circular buffer indexes */
 	seq_num_t seq_dist;
-	char *dst_cbuf = host->circular_buffer;
-	char *dst_cbuf_defrag = host->circular_buffer_defrag;
 	seq_num_t *dst_seq_num = &host->rx_seq_num;
 
 	/*
@@ -633,7 +692,7 @@ int _seq_num_lookup(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_
 	}
 
 	if (clear_buf) {
-		_clear_cbuffers(host, seq_num);
+		_clear_cbuffers(knet_h, host, seq_num);
 	}
 
 	_reclaim_old_defrag_bufs(knet_h, host, *dst_seq_num);
@@ -648,13 +707,13 @@ int _seq_num_lookup(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_
 
 	if (seq_dist < KNET_CBUFFER_SIZE) { /* seq num is in ring buffer */
 		if (!defrag_buf) {
-			return (dst_cbuf[head] == 0) ? 1 : 0;
+			return _cbuffer_test(host->circular_buffer, head) ? 0 : 1;
 		} else {
-			return (dst_cbuf_defrag[head] == 0) ? 1 : 0;
+			return _cbuffer_test(host->circular_buffer_defrag, head) ? 0 : 1;
 		}
 	} else if (seq_dist <= SEQ_MAX - KNET_CBUFFER_SIZE) {
-		memset(dst_cbuf, 0, KNET_CBUFFER_SIZE);
-		memset(dst_cbuf_defrag, 0, KNET_CBUFFER_SIZE);
+		memset(host->circular_buffer, 0, sizeof(host->circular_buffer));
+		memset(host->circular_buffer_defrag, 0, sizeof(host->circular_buffer_defrag));
 		*dst_seq_num = seq_num;
 	}
 
@@ -662,13 +721,10 @@ int _seq_num_lookup(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_
 	tail = (*dst_seq_num + 1) % KNET_CBUFFER_SIZE;
 
 	if (tail > head) {
-		memset(dst_cbuf + tail, 0, KNET_CBUFFER_SIZE - tail);
-		memset(dst_cbuf, 0, head + 1);
-		memset(dst_cbuf_defrag + tail, 0, KNET_CBUFFER_SIZE - tail);
-		memset(dst_cbuf_defrag, 0, head + 1);
+		_cbuffers_clear_range(host, tail, KNET_CBUFFER_SIZE - 1);
+		_cbuffers_clear_range(host, 0, head);
 	} else {
-		memset(dst_cbuf + tail, 0, head - tail + 1);
-		memset(dst_cbuf_defrag + tail, 0, head - tail + 1);
+		_cbuffers_clear_range(host, tail, head);
 	}
 
 	*dst_seq_num = seq_num;
@@ -678,15 +734,31 @@ int _seq_num_lookup(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_
 
 void _seq_num_set(struct knet_host *host, seq_num_t seq_num, int defrag_buf)
 {
-	if (!defrag_buf) { 
-		host->circular_buffer[seq_num % KNET_CBUFFER_SIZE] = 1;
+	if (!defrag_buf) {
+		_cbuffer_set(host->circular_buffer, seq_num % KNET_CBUFFER_SIZE);
 	} else {
-		host->circular_buffer_defrag[seq_num % KNET_CBUFFER_SIZE] = 1;
+		_cbuffer_set(host->circular_buffer_defrag, seq_num % KNET_CBUFFER_SIZE);
 	}
 
 	return;
 }
 
+/*
+ * undo _seq_num_set, if seq_num is still in the circular buffer
+ */
+void _seq_num_unset(struct knet_host *host, seq_num_t seq_num, int defrag_buf)
+{
+	if ((seq_num_t)(host->rx_seq_num - seq_num) >= KNET_CBUFFER_SIZE) {
+		return;
+	}
+
+	if (!defrag_buf) {
+		_cbuffer_unset(host->circular_buffer, seq_num % KNET_CBUFFER_SIZE);
+	} else {
+		_cbuffer_unset(host->circular_buffer_defrag, seq_num % KNET_CBUFFER_SIZE);
+	}
+}
+
 int _host_dstcache_update_async(knet_handle_t knet_h, struct knet_host *host)
 {
 	int savederrno = 0;
@@ -749,7 +821,7 @@ int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host)
 	/* no active links, we can clean the circular buffers and indexes */
 	if (!host->active_link_entries) {
 		log_warn(knet_h, KNET_SUB_HOST, "host: %u has no active links", host->host_id);
-		_clear_cbuffers(host, 0);
+		_clear_cbuffers(knet_h, host, 0);
 	} else {
 		reachable = 1;
 	}
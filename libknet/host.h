@@ -16,6 +16,7 @@ void _clear_defrag_bufs_stats(struct knet_host *host);
 
 int _seq_num_lookup(knet_handle_t knet_h, struct knet_host *host, seq_num_t seq_num, int defrag_buf, int clear_buf);
 void _seq_num_set(struct knet_host *host, seq_num_t seq_num, int defrag_buf);
+void _seq_num_unset(struct knet_host *host, seq_num_t seq_num, int defrag_buf);
 
 int _host_dstcache_update_async(knet_handle_t knet_h, struct knet_host *host);
 int _host_dstcache_update_sync(knet_handle_t knet_h, struct knet_host *host);
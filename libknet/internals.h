@@ -55,6 +55,17 @@ struct knet_mmsghdr {
 	unsigned int  msg_len;	/* Number of bytes transmitted */
 };
 
+#define KNET_LINK_ACL_CACHE_SIZE 2
+
+/*
+ * source address recently accepted by the access lists of a link
+ */
+struct knet_link_acl_cache {
+	uint32_t acl_generation;		/* link acl_generation at the time of the check */
+	sa_family_t family;			/* 0 for unused entries */
+	uint8_t addr[sizeof(struct in6_addr)];
+};
+
 struct knet_link {
 	/* required */
 	struct sockaddr_storage src_addr;
@@ -70,10 +81,11 @@ struct knet_link {
 	uint8_t pong_count;			/* how many ping/pong to send/receive before link is up */
 	uint64_t flags;
 	void *access_list_match_entry_head;	/* pointer to access list match_entry list head */
+	uint32_t acl_generation;		/* bumped on every access list change */
 	/* status */
 	struct knet_link_status status;
 	/* internals */
-	pthread_mutex_t link_stats_mutex;	/* used to update link stats */
+	pthread_mutex_t link_stats_mutex;	/* used to update link latency and up/down events */
 	uint8_t link_id;
 	uint8_t transport;                      /* #defined constant from API */
 	knet_transport_link_t transport_link;   /* link_info_t from transport */
@@ -94,12 +106,60 @@ struct knet_link {
 	uint32_t last_recv_mtu;
 	uint32_t pmtud_crypto_timeout_multiplier;/* used by PMTUd to adjust timeouts on high loads */
 	uint8_t has_valid_mtu;
+	uint8_t udp_gso;			/* set to 1 if UDP_SEGMENT can be used to send on this link, atomic (cleared by TX workers) */
+	uint8_t udp_zerocopy;			/* set to 1 if MSG_ZEROCOPY can be used to send on this link */
+	/* RX source link resolution (see _link_addr_index_lookup) */
+	struct knet_link *addr_index_next;
+	knet_node_id_t addr_index_host_id;
+	uint8_t addr_indexed;
+	/* RX access list verdict cache (see _check_rx_acl) */
+	struct knet_link_acl_cache acl_cache[KNET_LINK_ACL_CACHE_SIZE];
+	uint8_t acl_cache_next;
 };
 
+/*
+ * links are indexed by destination host and address
+ */
+#define KNET_LINK_ADDR_INDEX_BITS 12
+#define KNET_LINK_ADDR_INDEX_SIZE (1 << KNET_LINK_ADDR_INDEX_BITS)
+
+/*
+ * seq_num dedup windows are bitsets of KNET_CBUFFER_SIZE seq_num
+ */
 #define KNET_CBUFFER_SIZE 4096
+#define KNET_CBUFFER_WORDS (KNET_CBUFFER_SIZE / 64)
 
-struct knet_host_defrag_buf {
+/*
+ * defrag data buffers are allocated in slabs shared by all hosts
+ * and handed out only to in use defrag buffers (see defrag.c)
+ */
+#define KNET_DEFRAG_SLAB_CHUNKS 16
+
+struct knet_defrag_slab;
+
+struct knet_defrag_chunk {
+	struct knet_defrag_slab *slab;
+	struct knet_defrag_chunk *next;	/* slab free chunks */
 	char buf[KNET_DATABUFSIZE];
+};
+
+struct knet_defrag_slab {
+	struct knet_defrag_slab *prev;	/* pool list of slabs with free chunks */
+	struct knet_defrag_slab *next;
+	struct knet_defrag_chunk *free_chunks;
+	uint16_t in_use;
+	struct knet_defrag_chunk chunks[KNET_DEFRAG_SLAB_CHUNKS];
+};
+
+struct knet_defrag_pool {
+	struct knet_defrag_slab *partial;	/* slabs with free chunks */
+	uint32_t slabs;
+	uint32_t chunks_in_use;
+	uint8_t trim_pending;			/* set by _defrag_bufs_sample, trim is done by RX */
+};
+
+struct knet_host_defrag_buf {
+	struct knet_defrag_chunk *chunk;	/* data buffer, only when in use */
 	uint8_t in_use;			/* 0 buffer is free, 1 is in use */
 	seq_num_t pckt_seq;		/* identify the pckt we are receiving */
 	uint8_t frag_recv;		/* how many frags did we receive */
@@ -107,7 +167,8 @@ struct knet_host_defrag_buf {
 	uint8_t	last_first;		/* special case if we receive the last fragment first */
 	ssize_t frag_size;		/* normal frag size (not the last one) */
 	ssize_t last_frag_size;		/* the last fragment might not be aligned with MTU size */
-	struct timespec last_update;	/* keep time of the last pckt */
+	uint16_t lru_prev;		/* in use: LRU list, free: unused */
+	uint16_t lru_next;		/* in use: LRU list, free: free list */
 };
 
 struct knet_host {
@@ -124,7 +185,7 @@ struct knet_host {
 	uint8_t onwire_ver;		/* node current onwire version */
 	uint8_t onwire_max_ver;		/* node supports up to this version */
 	/* internals */
-	char circular_buffer[KNET_CBUFFER_SIZE];
+	uint64_t circular_buffer[KNET_CBUFFER_WORDS];
 	seq_num_t rx_seq_num;
 	seq_num_t untimed_rx_seq_num;
 	seq_num_t timed_rx_seq_num;
@@ -132,11 +193,23 @@ struct knet_host {
 	/* defrag/reassembly buffers */
 	struct knet_host_defrag_buf *defrag_bufs;
 	uint16_t allocated_defrag_bufs;
-	/* track use % of allocated defrag buffers */
+	uint16_t in_use_defrag_bufs;
+	uint16_t *defrag_index;		/* open addressing pckt_seq -> defrag_bufs index (see defrag.c) */
+	uint32_t defrag_index_size;	/* power of 2, twice allocated_defrag_bufs */
+	uint8_t defrag_index_shift;	/* 32 - log2(defrag_index_size) */
+	uint16_t defrag_lru_head;	/* least recently updated in use buffer */
+	uint16_t defrag_lru_tail;	/* most recently updated in use buffer */
+	uint16_t defrag_free_head;
+	seq_num_t defrag_reclaim_seq_num;	/* seq_num of the last expiry scan (see _reclaim_old_defrag_bufs) */
+	seq_num_t defrag_oldest_seq_num;	/* oldest pckt_seq in use at the last expiry scan */
+	uint8_t defrag_reclaim_needed;		/* buffers have been added since the last expiry scan */
+	/* track use % of allocated defrag buffers (see _defrag_bufs_sample) */
 	uint8_t in_use_defrag_buffers[UINT8_MAX];
 	uint8_t in_use_defrag_buffers_samples;
 	uint8_t in_use_defrag_buffers_index;
-	char circular_buffer_defrag[KNET_CBUFFER_SIZE];
+	uint8_t in_use_defrag_buffers_reset;	/* samples are stale, clear them on next run */
+	uint8_t defrag_bufs_shrink_pending;	/* usage is low, RX halves the buffers on next use */
+	uint64_t circular_buffer_defrag[KNET_CBUFFER_WORDS];
 	/* link stuff */
 	struct knet_link link[KNET_MAX_LINK];
 	uint8_t active_link_entries;
@@ -152,6 +225,9 @@ struct knet_sock {
 	int in_use;      /* set to 1 if it's use, 0 if free */
 	int has_error;   /* set to 1 if there were errors reading from the sock
 			  * and socket has been removed from epoll */
+	struct knet_ring *tx_ring; /* KNET_DATAFD_RING channels only. sockfd[1] is its eventfd */
+	struct knet_ring *rx_ring; /* KNET_DATAFD_RING channels only. sockfd[0] is its eventfd */
+	pthread_mutex_t rx_ring_mutex; /* RX thread and local delivery both write to rx_ring */
 };
 
 struct knet_fd_trackers {
@@ -176,11 +252,246 @@ struct knet_handle_stats_extra {
 	uint64_t tx_crypt_pong_packets;
 };
 
+#define KNET_CACHE_LINE_SIZE 64
+
+/*
+ * data path handle stats are accounted per thread (shard indexed
+ * by thread id, see threads_common.h) and aggregated on read by
+ * knet_handle_get_stats. Each shard has only one writer at a time
+ * (TX workers write under their tx_mutex), relaxed atomic loads and
+ * stores are enough to avoid torn reads without any locking.
+ * Averages are computed at read time from the total time.
+ */
+struct knet_handle_stats_shard {
+	uint64_t tx_uncompressed_packets;
+	uint64_t tx_compressed_packets;
+	uint64_t tx_compressed_original_bytes;
+	uint64_t tx_compressed_size_bytes;
+	uint64_t tx_compress_time_total;
+	uint64_t tx_compress_time_samples;
+	uint64_t tx_compress_time_min;
+	uint64_t tx_compress_time_max;
+	uint64_t tx_failed_to_compress;
+	uint64_t tx_unable_to_compress;
+	uint64_t rx_compressed_packets;
+	uint64_t rx_compressed_original_bytes;
+	uint64_t rx_compressed_size_bytes;
+	uint64_t rx_compress_time_total;
+	uint64_t rx_compress_time_min;
+	uint64_t rx_compress_time_max;
+	uint64_t rx_failed_to_decompress;
+	uint64_t tx_crypt_packets;
+	uint64_t tx_crypt_byte_overhead;
+	uint64_t tx_crypt_time_total;
+	uint64_t tx_crypt_time_min;
+	uint64_t tx_crypt_time_max;
+	uint64_t rx_crypt_packets;
+	uint64_t rx_crypt_time_total;
+	uint64_t rx_crypt_time_min;
+	uint64_t rx_crypt_time_max;
+} __attribute__((aligned(KNET_CACHE_LINE_SIZE)));
+
+#define stats_get(counter) \
+	__atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+#define stats_set(counter, value) \
+	__atomic_store_n(&(counter), (value), __ATOMIC_RELAXED)
+
+#define stats_add(counter, value) \
+	stats_set(counter, (counter) + (value))
+
+#define stats_time(total, min, max, value) \
+do { \
+	stats_add(total, value); \
+	if ((value) < (min)) \
+		stats_set(min, value); \
+	if ((value) > (max)) \
+		stats_set(max, value); \
+} while (0)
+
+/*
+ * link packet/byte/error/retry counters can be updated by several
+ * threads at the same time (TX workers, RX, heartbeat and PMTUd)
+ * and are not protected by link_stats_mutex.
+ */
+#define link_stats_add(counter, value) \
+	__atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+
 #define KNET_RX_ODD_PACKETS_THRESHOLD            20
 
 #define KNET_USAGE_SAMPLES_DEFAULT               UINT8_MAX
 #define KNET_USAGE_SAMPLES_TIMESPAN_DEFAULT      10 /* seconds */
 
+#define KNET_TX_THREADS_DEFAULT                  1
+#define KNET_TX_SEQ_NUM_BATCH                    8  /* seq_num reserved at once by each TX worker */
+#define KNET_TX_SEQ_NUM_MAX_LAG                  (KNET_MAX_TX_THREADS * KNET_TX_SEQ_NUM_BATCH) /* drop a reserved batch once tx_seq_num is further ahead */
+#define KNET_TX_INGEST_BATCH                     16 /* max packets read from a datafd for each wakeup */
+#define KNET_TX_SEND_BATCH                       (PCKT_FRAG_MAX + 1) /* max packets sent with one sendmmsg */
+
+#define KNET_CRYPTO_THREADS_DEFAULT              0
+#define KNET_CRYPTO_POOL_MIN_SIZE                8192 /* smaller fragment sets are encrypted inline */
+#define KNET_RX_DECRYPT_BATCH                    32 /* packets decrypted in parallel by the RX thread */
+#define KNET_RX_DELIVER_BATCH                    64 /* packets delivered to the datafds at once by the RX thread */
+#define KNET_API_MMSG_BATCH                      64 /* max messages moved with one syscall by knet_sendmmsg/knet_recvmmsg */
+
+#define KNET_TX_ZEROCOPY_MIN_SIZE                8192 /* smaller packets are cheaper to copy */
+#define KNET_TX_ZEROCOPY_MAX_PAGES               16 /* MAX_SKB_FRAGS - 1 */
+#define KNET_TX_ZEROCOPY_BUFS                    4  /* buffer sets per TX worker to rotate through while the kernel holds them */
+#define KNET_TX_ZEROCOPY_DRAIN_LOOPS             1000 /* threads_timer_res / 1000 waits for a retired TX worker to get its buffers back */
+#define KNET_UDP_ZEROCOPY_WINDOW                 256 /* max MSG_ZEROCOPY sends in flight per UDP socket, multiple of 64 */
+#define KNET_UDP_GSO_MAX_SEGS                    64 /* UDP_MAX_SEGMENTS on older kernels */
+#define KNET_UDP_GSO_MAX_SIZE                    65507 /* max UDP payload over IPv4 */
+
+/*
+ * fragments of the same packet sent as one UDP GSO super buffer.
+ * All segments have the same size, except the last one that
+ * can be shorter.
+ */
+struct knet_tx_gso {
+	struct knet_mmsghdr *frag_msg;		/* per fragment msgs, used to fallback to regular sends */
+	int frags;
+	struct iovec *iov;
+	int iovcnt;
+	uint16_t seg_size;
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} control;
+};
+
+/*
+ * MSG_ZEROCOPY sends on a socket that the kernel has not released yet
+ * (see transport_tx_zerocopy_end)
+ */
+struct knet_tx_zc_pending {
+	int sockfd;
+	uint8_t transport;
+	uint64_t sock_id;			/* tells the socket apart from a later one with the same fd */
+	uint32_t last;				/* id of the last send */
+};
+
+/*
+ * buffers a TX worker prepares packets in. Once a packet has been
+ * sent with MSG_ZEROCOPY they belong to the kernel until all the
+ * completions are reaped and the worker moves to another set
+ * (see _tx_bufs_rotate).
+ */
+struct knet_tx_bufs {
+	struct knet_header *send_to_links_buf[PCKT_FRAG_MAX];
+	unsigned char *send_to_links_buf_crypt[PCKT_FRAG_MAX];
+	struct knet_header *recv_from_sock_buf;	/* swapped with the ingest buffer of a packet sent with MSG_ZEROCOPY */
+	int zc_pending_entries;
+	struct knet_tx_zc_pending zc_pending[KNET_MAX_LINK];
+};
+
+/*
+ * packets queued for links sharing the same outbound socket
+ */
+struct knet_tx_batch {
+	int sockfd;
+	uint8_t transport;
+	uint8_t zerocopy;			/* send with MSG_ZEROCOPY */
+	int entries;
+	struct knet_mmsghdr msg[KNET_TX_SEND_BATCH];
+	struct knet_link *link[KNET_TX_SEND_BATCH];	/* link owning each msg, for stats */
+	struct knet_tx_gso *gso[KNET_TX_SEND_BATCH];	/* set if the msg is a GSO super buffer */
+};
+
+/*
+ * a single encrypt/decrypt operation, executed either by the
+ * caller or by one of the crypto pool threads
+ */
+struct knet_crypto_job {
+	const struct iovec *iov_in;
+	int iovcnt_in;
+	unsigned char *buf_out;
+	ssize_t buf_out_len;
+	uint64_t crypt_time;
+	int err;
+};
+
+typedef void (*knet_crypto_job_fn_t)(struct knet_handle *knet_h, struct knet_crypto_job *job);
+
+/*
+ * packets received from the links waiting to be decrypted by
+ * the crypto pool. Once the batch is decrypted, packets are parsed
+ * in the same order they have been received.
+ */
+struct knet_rx_batch {
+	int entries;
+	int inline_next;			/* next buf_decrypt to decrypt a packet inline (see _decrypt_packet) */
+	struct knet_mmsghdr msg[KNET_RX_DECRYPT_BATCH];
+	struct iovec iov[KNET_RX_DECRYPT_BATCH];
+	struct knet_crypto_job job[KNET_RX_DECRYPT_BATCH];
+	unsigned char *buf_decrypt[KNET_RX_DECRYPT_BATCH];
+};
+
+/*
+ * packets ready to be delivered to the application. They are
+ * written to each datafd, in order, with one sendmmsg once the
+ * RX thread is done with the packets it received.
+ */
+struct knet_rx_deliver {
+	int entries;
+	uint64_t channels;			/* bitmap of channels with queued packets */
+	struct iovec iov[KNET_RX_DELIVER_BATCH];
+	int8_t channel[KNET_RX_DELIVER_BATCH];
+	struct knet_host *host[KNET_RX_DELIVER_BATCH];	/* to unmark seq_num on errors */
+	seq_num_t seq_num[KNET_RX_DELIVER_BATCH];
+	struct knet_mmsghdr msg[KNET_RX_DELIVER_BATCH];	/* packets of one channel, built on flush */
+	int msg_entry[KNET_RX_DELIVER_BATCH];		/* queue entry of each msg */
+};
+
+/*
+ * threads helping TX/RX threads to process a set of crypto jobs.
+ * Only one set of jobs is processed at a time, the submitter
+ * takes jobs too and waits for all of them to complete.
+ */
+struct knet_crypto_pool {
+	pthread_t thread[KNET_MAX_CRYPTO_THREADS];
+	uint8_t threads;			/* can only change while holding global_rwlock in write mode */
+	uint8_t stop;
+	pthread_mutex_t submit_mutex;		/* one set of jobs at a time */
+	pthread_mutex_t mutex;			/* protects all the fields below */
+	pthread_cond_t work_cond;		/* new jobs or stop */
+	pthread_cond_t done_cond;		/* all jobs completed */
+	knet_crypto_job_fn_t fn;
+	struct knet_crypto_job *jobs;
+	int jobs_count;
+	int jobs_next;
+	int jobs_done;
+};
+
+/*
+ * each TX worker owns a subset of the datafds (channel % tx_threads)
+ * and all the buffers required to process a packet from the app
+ * to the links. Packets from the same channel are always handled
+ * by the same worker to preserve ordering.
+ */
+struct knet_tx_worker {
+	struct knet_handle *knet_h;
+	uint8_t worker_id;
+	uint8_t thread_id;			/* index in threads_status/threads_flush_queue */
+	pthread_t thread;
+	int epollfd;
+	uint8_t retired;			/* set to stop the worker when shrinking the pool */
+	pthread_mutex_t tx_mutex;		/* used to protect worker buffers between the worker, knet_send_sync and PMTUd */
+	struct knet_header *recv_from_sock_buf[KNET_TX_INGEST_BATCH];
+	struct knet_tx_bufs *bufs;		/* set the current packet is prepared in */
+	struct knet_tx_bufs *tx_bufs[KNET_TX_ZEROCOPY_BUFS];	/* [0] is always allocated, the others on the first MSG_ZEROCOPY send */
+	int8_t tx_bufs_next;			/* free set to move to after a MSG_ZEROCOPY send, -1 if not known */
+	uint8_t tx_bufs_failed;			/* unable to allocate the sets, don't use MSG_ZEROCOPY */
+	unsigned char *send_to_links_buf_compress;
+	struct knet_crypto_job crypto_jobs[PCKT_FRAG_MAX];
+	struct knet_tx_batch send_batch[KNET_MAX_LINK];
+	uint8_t send_batch_entries;
+	struct knet_tx_gso send_gso[PCKT_FRAG_MAX];
+	struct iovec send_gso_iov[PCKT_FRAG_MAX * 2];
+	int send_gso_entries;			/* 0 if the current packet cannot be sent with GSO */
+	seq_num_t seq_num_next;			/* next seq_num to use from the reserved batch */
+	uint8_t seq_num_avail;			/* seq_num left in the reserved batch */
+};
+
 struct knet_handle {
 	knet_node_id_t host_id;
 	unsigned int enabled:1;
@@ -188,7 +499,6 @@ struct knet_handle {
 	int logfd;
 	uint8_t log_levels[KNET_MAX_SUBSYSTEMS];
 	int dstsockfd[2];
-	int send_to_links_epollfd;
 	int recv_from_links_epollfd;
 	int dst_link_handler_epollfd;
 	uint8_t use_access_lists; /* set to 0 for disable, 1 for enable */
@@ -198,16 +508,15 @@ struct knet_handle {
 				 * without frags */
 	struct knet_host *host_head;
 	struct knet_host *host_index[KNET_MAX_HOST];
+	struct knet_link *link_addr_index[KNET_LINK_ADDR_INDEX_SIZE]; /* RX thread only, or under global write lock */
 	knet_transport_t transports[KNET_MAX_TRANSPORTS+1];
 	struct knet_fd_trackers knet_transport_fd_tracker[KNET_MAX_FDS]; /* track status for each fd handled by transports */
-	struct knet_handle_stats stats;
+	struct knet_handle_stats_shard stats_shards[KNET_THREAD_MAX];
 	struct knet_handle_stats_extra stats_extra;
-	pthread_mutex_t handle_stats_mutex;	/* used to protect handle stats */
+	pthread_mutex_t handle_stats_mutex;	/* used to protect handle stats_extra */
 	uint32_t reconnect_int;
 	knet_node_id_t host_ids[KNET_MAX_HOST];
 	size_t host_ids_entries;
-	struct knet_header *recv_from_sock_buf;
-	struct knet_header *send_to_links_buf[PCKT_FRAG_MAX];
 	struct knet_header *recv_from_links_buf[PCKT_RX_BUFS];
 	struct knet_header *pingbuf;
 	struct knet_header *pmtudbuf;
@@ -215,7 +524,12 @@ struct knet_handle {
 	uint8_t threads_flush_queue[KNET_THREAD_MAX];
 	useconds_t threads_timer_res;
 	pthread_mutex_t threads_status_mutex;
-	pthread_t send_to_links_thread;
+	struct knet_tx_worker *tx_workers[KNET_MAX_TX_THREADS];
+	uint8_t tx_threads;			/* number of active TX workers */
+	pthread_mutex_t tx_threads_mutex;	/* serialize changes to the TX workers pool */
+	pthread_mutex_t tx_rr_mutex;		/* used to protect round-robin link rotation across TX workers */
+	pthread_mutex_t tx_compress_mutex;	/* compress modules share per handle state */
+	struct knet_crypto_pool crypto_pool;
 	pthread_t recv_from_links_thread;
 	pthread_t heartbt_thread;
 	pthread_t dst_link_handler_thread;
@@ -223,7 +537,6 @@ struct knet_handle {
 	pthread_rwlock_t global_rwlock;		/* global config lock */
 	pthread_mutex_t pmtud_mutex;		/* pmtud mutex to handle conditional send/recv + timeout */
 	pthread_cond_t pmtud_cond;		/* conditional for above */
-	pthread_mutex_t tx_mutex;		/* used to protect knet_send_sync and TX thread */
 	pthread_mutex_t hb_mutex;		/* used to protect heartbeat thread and seq_num broadcasting */
 	pthread_mutex_t backoff_mutex;		/* used to protect dst_link->pong_timeout_adj */
 	pthread_mutex_t kmtu_mutex;		/* used to protect kernel_mtu */
@@ -245,9 +558,9 @@ struct knet_handle {
 	size_t sec_block_size;
 	size_t sec_hash_size;
 	size_t sec_salt_size;
-	unsigned char *send_to_links_buf_crypt[PCKT_FRAG_MAX];
 	unsigned char *recv_from_links_buf_crypt;
-	unsigned char *recv_from_links_buf_decrypt;
+	struct knet_rx_batch recv_from_links_batch;
+	struct knet_rx_deliver recv_from_links_deliver;
 	unsigned char *pingbuf_crypt;
 	unsigned char *pmtudbuf_crypt;
 	int compress_model;
@@ -255,7 +568,6 @@ struct knet_handle {
 	size_t compress_threshold;
 	void *compress_int_data[KNET_MAX_COMPRESS_METHODS]; /* for compress method private data */
 	unsigned char *recv_from_links_buf_decompress;
-	unsigned char *send_to_links_buf_compress;
 	seq_num_t tx_seq_num;
 	pthread_mutex_t tx_seq_num_mutex;
 	uint16_t defrag_bufs_min;
@@ -264,7 +576,8 @@ struct knet_handle {
 	uint8_t defrag_bufs_usage_samples;
 	uint8_t defrag_bufs_usage_samples_timespan;
 	defrag_bufs_reclaim_policy_t defrag_bufs_reclaim_policy;
-	struct timespec defrag_bufs_last_run;
+	struct timespec defrag_bufs_last_run;	/* heartbeat thread only */
+	struct knet_defrag_pool defrag_pool;	/* RX thread only, or under global write lock */
 	uint8_t has_loop_link;
 	uint8_t loop_link;
 	void *dst_host_filter_fn_private_data;
@@ -486,6 +799,26 @@ typedef struct knet_transport_ops {
  * transport the opportunity to take actions.
  */
 	int (*transport_link_is_down)(knet_handle_t knet_h, struct knet_link *link);
+
+/*
+ * MSG_ZEROCOPY support (optional, can be NULL)
+ *
+ * transport_tx_zerocopy_begin is invoked before sending a batch of
+ * msgs packets with MSG_ZEROCOPY and should return 0 if the socket can be used.
+ *
+ * transport_tx_zerocopy_end is invoked after the batch has been sent
+ * with the number of packets accepted by the kernel and fills zc
+ * with what is needed to track their completion. It must not wait
+ * for the kernel.
+ *
+ * transport_tx_zerocopy_done returns 1 once the kernel has released
+ * all the buffers tracked by zc, or if the socket has been closed.
+ *
+ * all are invoked with global_rwlock held from TX threads
+ */
+	int (*transport_tx_zerocopy_begin)(knet_handle_t knet_h, int sockfd, int msgs);
+	void (*transport_tx_zerocopy_end)(knet_handle_t knet_h, int sockfd, int sent_msgs, struct knet_tx_zc_pending *zc);
+	int (*transport_tx_zerocopy_done)(knet_handle_t knet_h, struct knet_tx_zc_pending *zc);
 } knet_transport_ops_t;
 
 struct pretty_names {
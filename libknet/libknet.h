@@ -81,6 +81,35 @@ typedef uint16_t knet_node_id_t;
 
 #define KNET_LINK_FLAG_TRAFFICHIPRIO (1ULL << 0)
 
+/*
+ * Where possible, use UDP segmentation offload (UDP_SEGMENT)
+ * to send fragmented packets to the kernel in one go.
+ * Only applies to UDP links. If the kernel or the network
+ * device cannot handle it, knet falls back to regular sends.
+ */
+
+#define KNET_LINK_FLAG_UDP_GSO (1ULL << 1)
+
+/*
+ * Where possible, enable UDP generic receive offload (UDP_GRO)
+ * so that the kernel can deliver fragments of the same packet
+ * coalesced in one buffer. Only applies to UDP links.
+ * NOTE: the option is set on the socket and affects all the
+ * links sharing the same source address.
+ */
+
+#define KNET_LINK_FLAG_UDP_GRO (1ULL << 2)
+
+/*
+ * Where possible, send large packets with MSG_ZEROCOPY to avoid
+ * copying the payload into the kernel. Only applies to UDP links
+ * and it is only useful with large MTUs (jumbo frames).
+ * knet falls back to regular sends if the kernel has to copy
+ * the data anyway.
+ */
+
+#define KNET_LINK_FLAG_ZEROCOPY (1ULL << 3)
+
 /*
  * Handle flags
  */
@@ -97,6 +126,18 @@ typedef uint16_t knet_node_id_t;
 
 #define KNET_THREADS_TIMER_RES 200000
 
+/*
+ * max number of TX threads (see knet_handle_set_tx_threads below)
+ */
+
+#define KNET_MAX_TX_THREADS 16
+
+/*
+ * max number of crypto threads (see knet_handle_set_crypto_threads below)
+ */
+
+#define KNET_MAX_CRYPTO_THREADS 16
+
 /**
  * Opaque handle for this knet connection, created with knet_handle_new() and
  * freed with knet_handle_free()
@@ -222,6 +263,96 @@ int knet_handle_set_threads_timer_res(knet_handle_t knet_h,
 int knet_handle_get_threads_timer_res(knet_handle_t knet_h,
 				      useconds_t *timeres);
 
+/**
+ * knet_handle_set_tx_threads
+ *
+ * @brief Change the number of threads processing outgoing data
+ *
+ * knet_h     - pointer to knet_handle_t
+ *
+ * tx_threads - number of TX threads (1 to KNET_MAX_TX_THREADS).
+ *              Data from the datafds is sharded across the TX threads
+ *              by channel (channel % tx_threads), each thread handling
+ *              compression, fragmentation, encryption and transmission
+ *              of the packets for the channels it owns.
+ *              Packets from the same channel are always processed by the
+ *              same thread and ordering within a channel is preserved.
+ *              There is no ordering guarantee across different channels.
+ *              Default is 1. Each TX thread allocates its own set of
+ *              packet buffers (approx. 2MB).
+ *
+ * @return
+ * knet_handle_set_tx_threads returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_set_tx_threads(knet_handle_t knet_h,
+			       uint8_t tx_threads);
+
+/**
+ * knet_handle_get_tx_threads
+ *
+ * @brief Get the number of threads processing outgoing data
+ *
+ * knet_h     - pointer to knet_handle_t
+ *
+ * tx_threads - current number of TX threads
+ *
+ * @return
+ * knet_handle_get_tx_threads returns
+ * 0 on success and tx_threads will contain the current value
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_get_tx_threads(knet_handle_t knet_h,
+			       uint8_t *tx_threads);
+
+/**
+ * knet_handle_set_crypto_threads
+ *
+ * @brief Change the number of threads helping with encryption and decryption
+ *
+ * knet_h         - pointer to knet_handle_t
+ *
+ * crypto_threads - number of crypto threads (0 to KNET_MAX_CRYPTO_THREADS).
+ *                  When crypto is enabled, large packets are split
+ *                  in many fragments that are encrypted in parallel
+ *                  by the TX thread and the crypto threads.
+ *                  Small packets are always encrypted by the TX thread.
+ *                  Packets received from the links are decrypted in
+ *                  batches by the RX thread and the crypto threads,
+ *                  and delivered in the order they have been received.
+ *                  Default is 0 (all encryption and decryption is done
+ *                  by the TX and RX threads).
+ *
+ * @return
+ * knet_handle_set_crypto_threads returns
+ * 0 on success
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_set_crypto_threads(knet_handle_t knet_h,
+				   uint8_t crypto_threads);
+
+/**
+ * knet_handle_get_crypto_threads
+ *
+ * @brief Get the number of threads helping with encryption and decryption
+ *
+ * knet_h         - pointer to knet_handle_t
+ *
+ * crypto_threads - current number of crypto threads
+ *
+ * @return
+ * knet_handle_get_crypto_threads returns
+ * 0 on success and crypto_threads will contain the current value
+ * -1 on error and errno is set.
+ */
+
+int knet_handle_get_crypto_threads(knet_handle_t knet_h,
+				   uint8_t *crypto_threads);
+
 /**
  * knet_handle_enable_sock_notify
  *
@@ -265,6 +396,12 @@ int knet_handle_enable_sock_notify(knet_handle_t knet_h,
 
 #define KNET_DATAFD_MAX 32
 
+/*
+ * knet_handle_add_datafd *datafd value to request a shared memory ring
+ * instead of a socketpair
+ */
+#define KNET_DATAFD_RING -1
+
 /**
  * knet_handle_add_datafd
  *
@@ -292,14 +429,25 @@ int knet_handle_enable_sock_notify(knet_handle_t knet_h,
  *            Please refer to handle.c on how to set up a socketpair.
  *
  *            datafd can be 0, and knet_handle_add_datafd will create a properly
- *            populated socket pair the same way as ping_test, or a value
- *            higher than 0. A negative number will return an error.
+ *            populated socket pair the same way as ping_test, a value higher
+ *            than 0, or KNET_DATAFD_RING (see below). Any other negative
+ *            number will return an error.
  *            On exit knet_handle_free will take care to cleanup the
  *            socketpair only if they have been created by knet_handle_add_datafd.
  *
  *            It is possible to pass either sockets or normal fds.
  *            User provided datafd will be marked as non-blocking and close-on-exec.
  *
+ *            datafd can also be KNET_DATAFD_RING. knet_handle_add_datafd will
+ *            then create a pair of lock-free rings in shared memory, one per
+ *            direction, and return an eventfd in *datafd that is readable
+ *            when there is data to receive. Data can only be moved with
+ *            knet_send/knet_recv and knet_sendmmsg/knet_recvmmsg, that copy
+ *            it straight from/to the rings without any syscall as long as
+ *            the other side is busy. Each direction supports one application
+ *            thread at a time (one sender and one receiver).
+ *            Returns EOPNOTSUPP on platforms without eventfd.
+ *
  * *channel - This value is analogous to the tag in VLAN tagging.
  *            A negative value will auto-allocate a channel.
  *            Setting a value between 0 and 31 will try to allocate that
@@ -407,6 +555,9 @@ int knet_handle_get_datafd(knet_handle_t knet_h, const int8_t channel, int *data
  *
  * channel  - channel number
  *
+ * knet_recv is not safe to call from more than one thread at a time
+ * on a KNET_DATAFD_RING channel, unlike on a socketpair.
+ *
  * @return
  * knet_recv is a commodity function to wrap iovec operations
  * around a socket. It returns a call to readv(2).
@@ -430,6 +581,9 @@ ssize_t knet_recv(knet_handle_t knet_h,
  *
  * channel  - channel number
  *
+ * knet_send is not safe to call from more than one thread at a time
+ * on a KNET_DATAFD_RING channel, unlike on a socketpair.
+ *
  * @return
  * knet_send is a commodity function to wrap iovec operations
  * around a socket. It returns a call to writev(2).
@@ -440,6 +594,86 @@ ssize_t knet_send(knet_handle_t knet_h,
 		  const size_t buff_len,
 		  const int8_t channel);
 
+/**
+ * A single message as passed to knet_sendmmsg() and knet_recvmmsg()
+ */
+
+struct knet_msg {
+	/** data to send, or buffer to store the received data */
+	void *buff;
+	/** length of data to send, or size of buff */
+	size_t buff_len;
+	/** channel number, messages can be spread over different channels */
+	int8_t channel;
+	/** set on return to the number of bytes sent or received */
+	ssize_t msg_len;
+};
+
+/**
+ * knet_sendmmsg
+ *
+ * @brief Send multiple messages to knet nodes
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * msgvec   - array of messages to send
+ *
+ * vlen     - number of messages in msgvec
+ *
+ * knet_sendmmsg is the vector version of knet_send. All messages
+ * are sent with a single lock acquisition and consecutive messages
+ * for the same channel are written with one sendmmsg(2) call.
+ * Messages are sent in order and knet_sendmmsg stops at the first
+ * message that cannot be sent.
+ * knet_sendmmsg is not safe to call from more than one thread at a
+ * time on a KNET_DATAFD_RING channel, unlike on a socketpair.
+ *
+ * @return
+ * knet_sendmmsg returns the number of messages sent, with msg_len
+ * set for each of them, or -1 and errno set if the first message
+ * could not be sent (see sendmmsg(2) and writev(2)).
+ *
+ * @retval EINVAL - invalid msgvec, vlen, or a message with invalid
+ *                  buff, buff_len or channel
+ */
+
+int knet_sendmmsg(knet_handle_t knet_h,
+		  struct knet_msg *msgvec,
+		  const unsigned int vlen);
+
+/**
+ * knet_recvmmsg
+ *
+ * @brief Receive multiple messages from knet nodes
+ *
+ * knet_h   - pointer to knet_handle_t
+ *
+ * msgvec   - array of messages to receive, the channel of each
+ *            entry selects where to read it from
+ *
+ * vlen     - number of messages in msgvec
+ *
+ * knet_recvmmsg is the vector version of knet_recv. All messages
+ * are received with a single lock acquisition and consecutive
+ * messages for the same channel are read with one recvmmsg(2) call.
+ * knet_recvmmsg does not block and stops at the first message that
+ * cannot be filled.
+ * knet_recvmmsg is not safe to call from more than one thread at a
+ * time on a KNET_DATAFD_RING channel, unlike on a socketpair.
+ *
+ * @return
+ * knet_recvmmsg returns the number of messages received, with
+ * msg_len set for each of them, or -1 and errno set if the first
+ * message could not be received (see recvmmsg(2) and readv(2)).
+ *
+ * @retval EINVAL - invalid msgvec, vlen, or a message with invalid
+ *                  buff, buff_len or channel
+ */
+
+int knet_recvmmsg(knet_handle_t knet_h,
+		  struct knet_msg *msgvec,
+		  const unsigned int vlen);
+
 /**
  * knet_send_sync
  *
@@ -762,6 +996,12 @@ struct knet_handle_crypto_cfg {
  *                         "openssl" model supports more modes and it strictly
  *                         depends on the openssl build. See: EVP_get_cipherbyname
  *                         openssl API call for details.
+ *                         All models also support the AEAD ciphers
+ *                         "aes128-gcm", "aes192-gcm", "aes256-gcm" and
+ *                         "chacha20-poly" (chacha20-poly1305), that encrypt
+ *                         and authenticate in a single pass with a smaller
+ *                         per packet overhead. AEAD ciphers require
+ *                         crypto_hash_type to be "none".
  *
  *            crypto_hash_type
  *                         should contain the hashing algo name.
@@ -139,6 +139,88 @@ void _link_clear_stats(knet_handle_t knet_h)
 	}
 }
 
+/*
+ * index of links by destination host and address, used by the RX thread
+ * to find the link a data packet has been received from.
+ * Addresses are compared with cmpaddr (family and ip only), when more
+ * links of a host have the same destination address, the lowest link_id
+ * wins.
+ *
+ * must be called with global write lock, or from the RX thread.
+ */
+static uint32_t _link_addr_hash(knet_node_id_t host_id, const struct sockaddr_storage *addr)
+{
+	const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+	const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+	uint32_t hash = host_id;
+
+	if (addr->ss_family == AF_INET6) {
+		hash ^= addr6->sin6_addr.s6_addr32[0] ^ addr6->sin6_addr.s6_addr32[1] ^
+			addr6->sin6_addr.s6_addr32[2] ^ addr6->sin6_addr.s6_addr32[3];
+	} else {
+		hash ^= addr4->sin_addr.s_addr;
+	}
+
+	return (hash * 2654435769U) >> (32 - KNET_LINK_ADDR_INDEX_BITS);
+}
+
+void _link_addr_index_add(knet_handle_t knet_h, knet_node_id_t host_id, struct knet_link *link)
+{
+	uint32_t hash;
+
+	if ((link->addr_indexed) ||
+	    ((link->dst_addr.ss_family != AF_INET) && (link->dst_addr.ss_family != AF_INET6))) {
+		return;
+	}
+
+	hash = _link_addr_hash(host_id, &link->dst_addr);
+
+	link->addr_index_host_id = host_id;
+	link->addr_index_next = knet_h->link_addr_index[hash];
+	knet_h->link_addr_index[hash] = link;
+	link->addr_indexed = 1;
+}
+
+/*
+ * has to be called before link->dst_addr changes
+ */
+void _link_addr_index_del(knet_handle_t knet_h, struct knet_link *link)
+{
+	struct knet_link **cur;
+
+	if (!link->addr_indexed) {
+		return;
+	}
+
+	cur = &knet_h->link_addr_index[_link_addr_hash(link->addr_index_host_id, &link->dst_addr)];
+	while (*cur) {
+		if (*cur == link) {
+			*cur = link->addr_index_next;
+			break;
+		}
+		cur = &(*cur)->addr_index_next;
+	}
+
+	link->addr_index_next = NULL;
+	link->addr_indexed = 0;
+}
+
+struct knet_link *_link_addr_index_lookup(knet_handle_t knet_h, knet_node_id_t host_id,
+					  const struct sockaddr_storage *addr)
+{
+	struct knet_link *link, *found = NULL;
+
+	for (link = knet_h->link_addr_index[_link_addr_hash(host_id, addr)]; link != NULL; link = link->addr_index_next) {
+		if ((link->addr_index_host_id == host_id) &&
+		    (cmpaddr(&link->dst_addr, addr) == 0) &&
+		    ((!found) || (link->link_id < found->link_id))) {
+			found = link;
+		}
+	}
+
+	return found;
+}
+
 int knet_link_set_config(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
 			 uint8_t transport,
 			 struct sockaddr_storage *src_addr,
@@ -357,6 +439,7 @@ int knet_link_set_config(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t l
 	 * no errors should happen after link is configured
 	 */
 	link->configured = 1;
+	_link_addr_index_add(knet_h, host_id, link);
 	log_debug(knet_h, KNET_SUB_LINK, "host: %u link: %u is configured",
 		  host_id, link_id);
 
@@ -614,6 +697,8 @@ int knet_link_clear_config(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t
 
 	pthread_mutex_destroy(&link->link_stats_mutex);
 
+	_link_addr_index_del(knet_h, link);
+
 	memset(link, 0, sizeof(struct knet_link));
 	link->link_id = link_id;
 
@@ -1216,6 +1301,38 @@ exit_unlock:
 	return err;
 }
 
+/*
+ * packet counters are updated without holding link_stats_mutex,
+ * see link_stats_add in internals.h
+ */
+static void _link_get_counters(struct knet_link_stats *dst, struct knet_link_stats *src)
+{
+	dst->tx_data_packets = stats_get(src->tx_data_packets);
+	dst->rx_data_packets = stats_get(src->rx_data_packets);
+	dst->tx_data_bytes = stats_get(src->tx_data_bytes);
+	dst->rx_data_bytes = stats_get(src->rx_data_bytes);
+	dst->rx_ping_packets = stats_get(src->rx_ping_packets);
+	dst->tx_ping_packets = stats_get(src->tx_ping_packets);
+	dst->rx_ping_bytes = stats_get(src->rx_ping_bytes);
+	dst->tx_ping_bytes = stats_get(src->tx_ping_bytes);
+	dst->rx_pong_packets = stats_get(src->rx_pong_packets);
+	dst->tx_pong_packets = stats_get(src->tx_pong_packets);
+	dst->rx_pong_bytes = stats_get(src->rx_pong_bytes);
+	dst->tx_pong_bytes = stats_get(src->tx_pong_bytes);
+	dst->rx_pmtu_packets = stats_get(src->rx_pmtu_packets);
+	dst->tx_pmtu_packets = stats_get(src->tx_pmtu_packets);
+	dst->rx_pmtu_bytes = stats_get(src->rx_pmtu_bytes);
+	dst->tx_pmtu_bytes = stats_get(src->tx_pmtu_bytes);
+	dst->tx_pmtu_errors = stats_get(src->tx_pmtu_errors);
+	dst->tx_pmtu_retries = stats_get(src->tx_pmtu_retries);
+	dst->tx_ping_errors = stats_get(src->tx_ping_errors);
+	dst->tx_ping_retries = stats_get(src->tx_ping_retries);
+	dst->tx_pong_errors = stats_get(src->tx_pong_errors);
+	dst->tx_pong_retries = stats_get(src->tx_pong_retries);
+	dst->tx_data_errors = stats_get(src->tx_data_errors);
+	dst->tx_data_retries = stats_get(src->tx_data_retries);
+}
+
 int knet_link_get_status(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t link_id,
 			 struct knet_link_status *status, size_t struct_size)
 {
@@ -1273,6 +1390,7 @@ int knet_link_get_status(knet_handle_t knet_h, knet_node_id_t host_id, uint8_t l
 	}
 
 	memmove(status, &link->status, struct_size);
+	_link_get_counters(&status->stats, &link->status.stats);
 
 	pthread_mutex_unlock(&link->link_stats_mutex);
 
@@ -45,4 +45,9 @@ int _link_updown(knet_handle_t knet_h, knet_node_id_t node_id, uint8_t link_id,
 
 void _link_clear_stats(knet_handle_t knet_h);
 
+void _link_addr_index_add(knet_handle_t knet_h, knet_node_id_t host_id, struct knet_link *link);
+void _link_addr_index_del(knet_handle_t knet_h, struct knet_link *link);
+struct knet_link *_link_addr_index_lookup(knet_handle_t knet_h, knet_node_id_t host_id,
+					  const struct sockaddr_storage *addr);
+
 #endif
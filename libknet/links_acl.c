@@ -28,7 +28,10 @@ static check_ops_t proto_check_modules_cmds[] = {
 
 /*
  * all those functions will return errno from the
- * protocol specific functions
+ * protocol specific functions.
+ *
+ * changes to the access lists invalidate the RX verdict cache
+ * of the link by bumping acl_generation
  */
 
 int check_add(knet_handle_t knet_h, struct knet_link *kn_link,
@@ -36,6 +39,7 @@ int check_add(knet_handle_t knet_h, struct knet_link *kn_link,
 	      struct sockaddr_storage *ss1, struct sockaddr_storage *ss2,
 	      check_type_t type, check_acceptreject_t acceptreject)
 {
+	kn_link->acl_generation++;
 	return proto_check_modules_cmds[transport_get_proto(knet_h, kn_link->transport)].protocheck_add(
 			&kn_link->access_list_match_entry_head, index,
 			ss1, ss2, type, acceptreject);
@@ -45,6 +49,7 @@ int check_rm(knet_handle_t knet_h, struct knet_link *kn_link,
 	     struct sockaddr_storage *ss1, struct sockaddr_storage *ss2,
 	     check_type_t type, check_acceptreject_t acceptreject)
 {
+	kn_link->acl_generation++;
 	return proto_check_modules_cmds[transport_get_proto(knet_h, kn_link->transport)].protocheck_rm(
 			&kn_link->access_list_match_entry_head,
 			ss1, ss2, type, acceptreject);
@@ -52,6 +57,7 @@ int check_rm(knet_handle_t knet_h, struct knet_link *kn_link,
 
 void check_rmall(knet_handle_t knet_h, struct knet_link *kn_link)
 {
+	kn_link->acl_generation++;
 	proto_check_modules_cmds[transport_get_proto(knet_h, kn_link->transport)].protocheck_rmall(
 		&kn_link->access_list_match_entry_head);
 }
@@ -31,131 +31,371 @@ struct ip_acl_match_entry {
 };
 
 /*
- * IPv4 See if the address we have matches the current match entry
+ * The match entries list is compiled into one trie per address
+ * family. Every rule that covers an interval of addresses (all of
+ * them except masks with holes) is stored in the slots of the trie
+ * that cover that interval, as (position in the list << 1) | accept.
+ * The lowest value found along the path of an address is then the
+ * first rule of the list that matches it, exactly as a list walk.
+ *
+ * Masks with holes are rare and are checked in order after the
+ * trie lookup, only if they come before the trie match.
  */
 
-static int ip_matches_v4(struct sockaddr_storage *checkip, struct ip_acl_match_entry *match_entry)
+#define IP_ACL_TRIE_STRIDE 4
+#define IP_ACL_TRIE_FANOUT (1 << IP_ACL_TRIE_STRIDE)
+#define IP_ACL_NO_MATCH UINT32_MAX
+
+struct ip_acl_trie_node {
+	uint32_t rule[IP_ACL_TRIE_FANOUT];
+	struct ip_acl_trie_node *child[IP_ACL_TRIE_FANOUT];
+};
+
+struct ip_acl_trie {
+	struct ip_acl_trie_node *root;
+	struct ip_acl_match_entry **slow_entry;	/* masks with holes */
+	uint32_t *slow_rule;
+	int slow_count;
+};
+
+struct ip_acl {
+	struct ip_acl_match_entry *match_entry_head;
+	int match_entry_count;
+	struct ip_acl_trie v4;
+	struct ip_acl_trie v6;
+};
+
+static size_t ip_addr_len(struct sockaddr_storage *ss)
+{
+	if (ss->ss_family == AF_INET) {
+		return sizeof(struct in_addr);
+	}
+	return sizeof(struct in6_addr);
+}
+
+static uint8_t *ip_addr_bytes(struct sockaddr_storage *ss)
 {
-	struct sockaddr_in *ip_to_check;
-	struct sockaddr_in *match1;
-	struct sockaddr_in *match2;
+	if (ss->ss_family == AF_INET) {
+		return (uint8_t *)&((struct sockaddr_in *)ss)->sin_addr;
+	}
+	return (uint8_t *)&((struct sockaddr_in6 *)ss)->sin6_addr;
+}
 
-	ip_to_check = (struct sockaddr_in *)checkip;
-	match1 = (struct sockaddr_in *)&match_entry->addr1;
-	match2 = (struct sockaddr_in *)&match_entry->addr2;
+static int ip_addr_nibble(const uint8_t *addr, int depth)
+{
+	if (depth & 1) {
+		return addr[depth >> 1] & 0x0f;
+	}
+	return addr[depth >> 1] >> 4;
+}
+
+/*
+ * match_entry is a mask with holes
+ */
+static int ip_matches_mask(struct sockaddr_storage *checkip, struct ip_acl_match_entry *match_entry)
+{
+	const uint8_t *ip_to_check = ip_addr_bytes(checkip);
+	const uint8_t *match1 = ip_addr_bytes(&match_entry->addr1);
+	const uint8_t *match2 = ip_addr_bytes(&match_entry->addr2);
+	size_t i;
+
+	for (i = 0; i < ip_addr_len(checkip); i++) {
+		if ((ip_to_check[i] & match2[i]) != match1[i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * returns 1 and the interval of addresses covered by match_entry in lo/hi,
+ * 0 if match_entry can never match and -1 if it is a mask with holes
+ */
+static int ip_acl_interval(struct ip_acl_match_entry *match_entry, uint8_t *lo, uint8_t *hi)
+{
+	size_t len = ip_addr_len(&match_entry->addr1);
+	const uint8_t *addr1 = ip_addr_bytes(&match_entry->addr1);
+	const uint8_t *addr2 = ip_addr_bytes(&match_entry->addr2);
+	int in_mask = 1;
+	uint8_t inv;
+	size_t i;
 
 	switch(match_entry->type) {
 	case CHECK_TYPE_ADDRESS:
-		if (ip_to_check->sin_addr.s_addr == match1->sin_addr.s_addr)
-			return 1;
-		break;
+		memmove(lo, addr1, len);
+		memmove(hi, addr1, len);
+		return 1;
 	case CHECK_TYPE_MASK:
-		if ((ip_to_check->sin_addr.s_addr & match2->sin_addr.s_addr) ==
-		    match1->sin_addr.s_addr)
-			return 1;
-		break;
+		for (i = 0; i < len; i++) {
+			if ((!in_mask) && (addr2[i])) {
+				return -1;
+			}
+			if (addr2[i] != 0xff) {
+				inv = ~addr2[i];
+				if (inv & (uint8_t)(inv + 1)) {
+					return -1;
+				}
+				in_mask = 0;
+			}
+			/*
+			 * bits outside the mask set in the address never match
+			 */
+			if (addr1[i] & ~addr2[i]) {
+				return 0;
+			}
+			lo[i] = addr1[i];
+			hi[i] = addr1[i] | (uint8_t)~addr2[i];
+		}
+		return 1;
 	case CHECK_TYPE_RANGE:
-		if ((ntohl(ip_to_check->sin_addr.s_addr) >= ntohl(match1->sin_addr.s_addr)) &&
-		    (ntohl(ip_to_check->sin_addr.s_addr) <= ntohl(match2->sin_addr.s_addr)))
-			return 1;
-		break;
-
+		if (memcmp(addr1, addr2, len) > 0) {
+			return 0;
+		}
+		memmove(lo, addr1, len);
+		memmove(hi, addr2, len);
+		return 1;
 	}
 	return 0;
 }
 
+static struct ip_acl_trie_node *ip_acl_trie_node_alloc(void)
+{
+	struct ip_acl_trie_node *node;
+
+	node = calloc(1, sizeof(struct ip_acl_trie_node));
+	if (!node) {
+		return NULL;
+	}
+	memset(node->rule, 0xff, sizeof(node->rule));
+
+	return node;
+}
+
+static void ip_acl_trie_node_free(struct ip_acl_trie_node *node)
+{
+	int i;
+
+	if (!node) {
+		return;
+	}
+	for (i = 0; i < IP_ACL_TRIE_FANOUT; i++) {
+		ip_acl_trie_node_free(node->child[i]);
+	}
+	free(node);
+}
+
 /*
- * Compare two IPv6 addresses
+ * store rule in all the slots below node that are fully covered by lo-hi.
+ * prefix holds the address bits of node and is used as scratch.
+ *
+ * alloc is the first pass, that only creates the missing nodes and
+ * is the only one that can fail. The second pass follows the same
+ * path and updates the slots, so that a failure never leaves a rule
+ * half inserted. Slots already holding a lower rule shadow everything
+ * below them and are skipped by both passes.
  */
-
-static int ip6addr_cmp(struct in6_addr *a, struct in6_addr *b)
+static int ip_acl_trie_insert(struct ip_acl_trie_node *node, size_t len, int depth,
+			      uint8_t *prefix, const uint8_t *lo, const uint8_t *hi,
+			      uint32_t rule, int alloc)
 {
-	uint64_t a_high, a_low;
-	uint64_t b_high, b_low;
+	uint8_t blk_lo[sizeof(struct in6_addr)], blk_hi[sizeof(struct in6_addr)];
+	size_t byte = depth >> 1;
+	int slot;
 
-	a_high = ((uint64_t)htonl(a->s6_addr32[0]) << 32) | (uint64_t)htonl(a->s6_addr32[1]);
-	a_low  = ((uint64_t)htonl(a->s6_addr32[2]) << 32) | (uint64_t)htonl(a->s6_addr32[3]);
+	for (slot = 0; slot < IP_ACL_TRIE_FANOUT; slot++) {
+		if (node->rule[slot] <= rule) {
+			continue;
+		}
 
-	b_high = ((uint64_t)htonl(b->s6_addr32[0]) << 32) | (uint64_t)htonl(b->s6_addr32[1]);
-	b_low  = ((uint64_t)htonl(b->s6_addr32[2]) << 32) | (uint64_t)htonl(b->s6_addr32[3]);
+		/*
+		 * addresses below this slot are blk_lo-blk_hi
+		 */
+		memmove(blk_lo, prefix, byte);
+		memmove(blk_hi, prefix, byte);
+		if (depth & 1) {
+			blk_lo[byte] = (prefix[byte] & 0xf0) | slot;
+			blk_hi[byte] = (prefix[byte] & 0xf0) | slot;
+		} else {
+			blk_lo[byte] = slot << 4;
+			blk_hi[byte] = (slot << 4) | 0x0f;
+		}
+		memset(blk_lo + byte + 1, 0, len - byte - 1);
+		memset(blk_hi + byte + 1, 0xff, len - byte - 1);
 
-	if (a_high > b_high)
-		return 1;
-	if (a_high < b_high)
-		return -1;
+		if ((memcmp(blk_hi, lo, len) < 0) || (memcmp(blk_lo, hi, len) > 0)) {
+			continue;
+		}
 
-	if (a_low > b_low)
-		return 1;
-	if (a_low < b_low)
-		return -1;
+		if ((memcmp(blk_lo, lo, len) >= 0) && (memcmp(blk_hi, hi, len) <= 0)) {
+			if (!alloc) {
+				node->rule[slot] = rule;
+			}
+			continue;
+		}
+
+		/*
+		 * partial overlap, never happens on the last nibble
+		 */
+		if (!node->child[slot]) {
+			if (!alloc) {
+				continue;
+			}
+			node->child[slot] = ip_acl_trie_node_alloc();
+			if (!node->child[slot]) {
+				return -1;
+			}
+		}
+
+		prefix[byte] = blk_lo[byte];
+		if (ip_acl_trie_insert(node->child[slot], len, depth + 1, prefix, lo, hi, rule, alloc) < 0) {
+			return -1;
+		}
+	}
 
 	return 0;
 }
 
-/*
- * IPv6 See if the address we have matches the current match entry
- */
+static int ip_acl_trie_add(struct ip_acl_trie *trie, struct ip_acl_match_entry *match_entry, uint32_t rule)
+{
+	uint8_t lo[sizeof(struct in6_addr)], hi[sizeof(struct in6_addr)];
+	uint8_t prefix[sizeof(struct in6_addr)];
+	size_t len = ip_addr_len(&match_entry->addr1);
+	struct ip_acl_match_entry **slow_entry;
+	uint32_t *slow_rule;
+	int res;
+
+	res = ip_acl_interval(match_entry, lo, hi);
+	if (!res) {
+		return 0;
+	}
+
+	if (res < 0) {
+		slow_entry = realloc(trie->slow_entry, sizeof(struct ip_acl_match_entry *) * (trie->slow_count + 1));
+		if (!slow_entry) {
+			return -1;
+		}
+		trie->slow_entry = slow_entry;
+		slow_rule = realloc(trie->slow_rule, sizeof(uint32_t) * (trie->slow_count + 1));
+		if (!slow_rule) {
+			return -1;
+		}
+		trie->slow_rule = slow_rule;
+		trie->slow_entry[trie->slow_count] = match_entry;
+		trie->slow_rule[trie->slow_count] = rule;
+		trie->slow_count++;
+		return 0;
+	}
+
+	if (!trie->root) {
+		trie->root = ip_acl_trie_node_alloc();
+		if (!trie->root) {
+			return -1;
+		}
+	}
+
+	memset(prefix, 0, sizeof(prefix));
+	if (ip_acl_trie_insert(trie->root, len, 0, prefix, lo, hi, rule, 1) < 0) {
+		return -1;
+	}
+	return ip_acl_trie_insert(trie->root, len, 0, prefix, lo, hi, rule, 0);
+}
 
-static int ip_matches_v6(struct sockaddr_storage *checkip, struct ip_acl_match_entry *match_entry)
+static void ip_acl_trie_free(struct ip_acl_trie *trie)
 {
-	struct sockaddr_in6 *ip_to_check;
-	struct sockaddr_in6 *match1;
-	struct sockaddr_in6 *match2;
-	int i;
+	ip_acl_trie_node_free(trie->root);
+	free(trie->slow_entry);
+	free(trie->slow_rule);
+	memset(trie, 0, sizeof(struct ip_acl_trie));
+}
 
-	ip_to_check = (struct sockaddr_in6 *)checkip;
-	match1 = (struct sockaddr_in6 *)&match_entry->addr1;
-	match2 = (struct sockaddr_in6 *)&match_entry->addr2;
+static uint32_t ip_acl_rule(struct ip_acl_match_entry *match_entry, int position)
+{
+	return ((uint32_t)position << 1) | (match_entry->acceptreject == CHECK_ACCEPT);
+}
 
-	switch(match_entry->type) {
-	case CHECK_TYPE_ADDRESS:
-		if (!memcmp(ip_to_check->sin6_addr.s6_addr32, match1->sin6_addr.s6_addr32, sizeof(struct in6_addr)))
-			return 1;
-		break;
+static struct ip_acl_trie *ip_acl_trie_get(struct ip_acl *acl, struct sockaddr_storage *ss)
+{
+	if (ss->ss_family == AF_INET) {
+		return &acl->v4;
+	}
+	return &acl->v6;
+}
 
-	case CHECK_TYPE_MASK:
-		/*
-		 * Note that this little loop will quit early if there is a non-match so the
-		 * comparison might look backwards compared to the IPv4 one
-		 */
-		for (i=sizeof(struct in6_addr)/4-1; i>=0; i--) {
-			if ((ip_to_check->sin6_addr.s6_addr32[i] & match2->sin6_addr.s6_addr32[i]) !=
-			    match1->sin6_addr.s6_addr32[i])
-				return 0;
+/*
+ * rebuild both tries from the match entries list, acl is untouched on error
+ */
+static int ip_acl_compile(struct ip_acl *acl)
+{
+	struct ip_acl new_acl;
+	struct ip_acl_match_entry *match_entry;
+	int position = 0;
+
+	memset(&new_acl, 0, sizeof(struct ip_acl));
+
+	for (match_entry = acl->match_entry_head; match_entry; match_entry = match_entry->next) {
+		if (ip_acl_trie_add(ip_acl_trie_get(&new_acl, &match_entry->addr1), match_entry,
+				    ip_acl_rule(match_entry, position)) < 0) {
+			ip_acl_trie_free(&new_acl.v4);
+			ip_acl_trie_free(&new_acl.v6);
+			errno = ENOMEM;
+			return -1;
 		}
-		return 1;
-	case CHECK_TYPE_RANGE:
-		if ((ip6addr_cmp(&ip_to_check->sin6_addr, &match1->sin6_addr) >= 0) &&
-		    (ip6addr_cmp(&ip_to_check->sin6_addr, &match2->sin6_addr) <= 0))
-			return 1;
-		break;
+		position++;
 	}
+
+	ip_acl_trie_free(&acl->v4);
+	ip_acl_trie_free(&acl->v6);
+	acl->v4 = new_acl.v4;
+	acl->v6 = new_acl.v6;
+	acl->match_entry_count = position;
+
 	return 0;
 }
 
+static uint32_t ip_acl_trie_lookup(struct ip_acl_trie *trie, struct sockaddr_storage *checkip)
+{
+	struct ip_acl_trie_node *node = trie->root;
+	const uint8_t *addr = ip_addr_bytes(checkip);
+	uint32_t rule = IP_ACL_NO_MATCH;
+	int depth = 0, nibble, i;
+
+	while (node) {
+		nibble = ip_addr_nibble(addr, depth);
+		if (node->rule[nibble] < rule) {
+			rule = node->rule[nibble];
+		}
+		node = node->child[nibble];
+		depth++;
+	}
+
+	for (i = 0; i < trie->slow_count; i++) {
+		if (trie->slow_rule[i] >= rule) {
+			break;
+		}
+		if (ip_matches_mask(checkip, trie->slow_entry[i])) {
+			rule = trie->slow_rule[i];
+			break;
+		}
+	}
+
+	return rule;
+}
 
 int ipcheck_validate(void *fd_tracker_match_entry_head, struct sockaddr_storage *checkip)
 {
-	struct ip_acl_match_entry **match_entry_head = (struct ip_acl_match_entry **)fd_tracker_match_entry_head;
-	struct ip_acl_match_entry *match_entry = *match_entry_head;
-	int (*match_fn)(struct sockaddr_storage *checkip, struct ip_acl_match_entry *match_entry);
+	struct ip_acl **acl_head = (struct ip_acl **)fd_tracker_match_entry_head;
+	struct ip_acl *acl = *acl_head;
+	uint32_t rule;
 
-	if (checkip->ss_family == AF_INET) {
-		match_fn = ip_matches_v4;
-	} else {
-		match_fn = ip_matches_v6;
+	if (!acl) {
+		return 0; /* Default reject */
 	}
 
-	while (match_entry) {
-		if (match_fn(checkip, match_entry)) {
-			if (match_entry->acceptreject == CHECK_ACCEPT)
-				return 1;
-			else
-				return 0;
-		}
-		match_entry = match_entry->next;
+	rule = ip_acl_trie_lookup(ip_acl_trie_get(acl, checkip), checkip);
+	if (rule == IP_ACL_NO_MATCH) {
+		return 0; /* Default reject */
 	}
-	return 0; /* Default reject */
+
+	return rule & 1;
 }
 
 /*
@@ -164,24 +404,38 @@ int ipcheck_validate(void *fd_tracker_match_entry_head, struct sockaddr_storage
 
 void ipcheck_rmall(void *fd_tracker_match_entry_head)
 {
-	struct ip_acl_match_entry **match_entry_head = (struct ip_acl_match_entry **)fd_tracker_match_entry_head;
+	struct ip_acl **acl_head = (struct ip_acl **)fd_tracker_match_entry_head;
+	struct ip_acl *acl = *acl_head;
 	struct ip_acl_match_entry *next_match_entry;
-	struct ip_acl_match_entry *match_entry = *match_entry_head;
+	struct ip_acl_match_entry *match_entry;
+
+	if (!acl) {
+		return;
+	}
 
+	match_entry = acl->match_entry_head;
 	while (match_entry) {
 		next_match_entry = match_entry->next;
 		free(match_entry);
 		match_entry = next_match_entry;
 	}
-	*match_entry_head = NULL;
+	ip_acl_trie_free(&acl->v4);
+	ip_acl_trie_free(&acl->v6);
+	free(acl);
+	*acl_head = NULL;
 }
 
-static struct ip_acl_match_entry *ipcheck_findmatch(struct ip_acl_match_entry **match_entry_head,
+static struct ip_acl_match_entry *ipcheck_findmatch(struct ip_acl *acl,
 						 struct sockaddr_storage *ss1, struct sockaddr_storage *ss2,
 						 check_type_t type, check_acceptreject_t acceptreject)
 {
-	struct ip_acl_match_entry *match_entry = *match_entry_head;
+	struct ip_acl_match_entry *match_entry;
+
+	if (!acl) {
+		return NULL;
+	}
 
+	match_entry = acl->match_entry_head;
 	while (match_entry) {
 		if ((!memcmp(&match_entry->addr1, ss1, sockaddr_len(ss1))) &&
 		    ((match_entry->type == CHECK_TYPE_ADDRESS) ||
@@ -196,42 +450,64 @@ static struct ip_acl_match_entry *ipcheck_findmatch(struct ip_acl_match_entry **
 	return NULL;
 }
 
+/*
+ * returns the entry before rm_match_entry, NULL if it was the list head
+ */
+static struct ip_acl_match_entry *ipcheck_unlink(struct ip_acl *acl, struct ip_acl_match_entry *rm_match_entry)
+{
+	struct ip_acl_match_entry *match_entry = acl->match_entry_head;
+
+	if (match_entry == rm_match_entry) {
+		acl->match_entry_head = rm_match_entry->next;
+		return NULL;
+	}
+
+	while (match_entry->next != rm_match_entry) {
+		match_entry = match_entry->next;
+	}
+	match_entry->next = rm_match_entry->next;
+
+	return match_entry;
+}
+
 int ipcheck_rmip(void *fd_tracker_match_entry_head,
 		 struct sockaddr_storage *ss1, struct sockaddr_storage *ss2,
 		 check_type_t type, check_acceptreject_t acceptreject)
 {
-	struct ip_acl_match_entry **match_entry_head = (struct ip_acl_match_entry **)fd_tracker_match_entry_head;
-	struct ip_acl_match_entry *next_match_entry = NULL;
+	struct ip_acl **acl_head = (struct ip_acl **)fd_tracker_match_entry_head;
+	struct ip_acl *acl = *acl_head;
+	struct ip_acl_match_entry *prev_match_entry;
 	struct ip_acl_match_entry *rm_match_entry;
-	struct ip_acl_match_entry *match_entry = *match_entry_head;
 
-	rm_match_entry = ipcheck_findmatch(match_entry_head, ss1, ss2, type, acceptreject);
+	rm_match_entry = ipcheck_findmatch(acl, ss1, ss2, type, acceptreject);
 	if (!rm_match_entry) {
 		errno = ENOENT;
 		return -1;
 	}
 
-	while (match_entry) {
-		next_match_entry = match_entry->next;
-		/*
-		 * we are removing the list head, be careful
-		 */
-		if (rm_match_entry == match_entry) {
-			*match_entry_head = next_match_entry;
-			free(match_entry);
-			break;
-		}
-		/*
-		 * the next one is the one we need to remove
-		 */
-		if (rm_match_entry == next_match_entry) {
-			match_entry->next = next_match_entry->next;
-			free(next_match_entry);
-			break;
+	prev_match_entry = ipcheck_unlink(acl, rm_match_entry);
+
+	if (!acl->match_entry_head) {
+		free(rm_match_entry);
+		ipcheck_rmall(fd_tracker_match_entry_head);
+		return 0;
+	}
+
+	/*
+	 * the positions of all the following entries change,
+	 * put the entry back if the tries cannot be rebuilt
+	 */
+	if (ip_acl_compile(acl) < 0) {
+		if (prev_match_entry) {
+			prev_match_entry->next = rm_match_entry;
+		} else {
+			acl->match_entry_head = rm_match_entry;
 		}
-		match_entry = next_match_entry;
+		return -1;
 	}
 
+	free(rm_match_entry);
+
 	return 0;
 }
 
@@ -239,19 +515,31 @@ int ipcheck_addip(void *fd_tracker_match_entry_head, int index,
 		  struct sockaddr_storage *ss1, struct sockaddr_storage *ss2,
 		  check_type_t type, check_acceptreject_t acceptreject)
 {
-	struct ip_acl_match_entry **match_entry_head = (struct ip_acl_match_entry **)fd_tracker_match_entry_head;
+	struct ip_acl **acl_head = (struct ip_acl **)fd_tracker_match_entry_head;
+	struct ip_acl *acl = *acl_head;
 	struct ip_acl_match_entry *new_match_entry;
-	struct ip_acl_match_entry *match_entry = *match_entry_head;
+	struct ip_acl_match_entry *match_entry;
+	int savederrno = 0, err = 0;
 	int i = 0;
 
-	if (ipcheck_findmatch(match_entry_head, ss1, ss2, type, acceptreject) != NULL) {
+	if (ipcheck_findmatch(acl, ss1, ss2, type, acceptreject) != NULL) {
 		errno = EEXIST;
 		return -1;
 	}
 
+	if (!acl) {
+		acl = calloc(1, sizeof(struct ip_acl));
+		if (!acl) {
+			return -1;
+		}
+		*acl_head = acl;
+	}
+	match_entry = acl->match_entry_head;
+
 	new_match_entry = malloc(sizeof(struct ip_acl_match_entry));
 	if (!new_match_entry) {
-		return -1;
+		savederrno = errno;
+		goto out_free;
 	}
 
 	copy_sockaddr(&new_match_entry->addr1, ss1);
@@ -268,7 +556,7 @@ int ipcheck_addip(void *fd_tracker_match_entry_head, int index,
 		 * the head of the list
 		 */
 		if (index == 0) {
-			*match_entry_head = new_match_entry;
+			acl->match_entry_head = new_match_entry;
 			new_match_entry->next = match_entry;
 		} else {
 			/*
@@ -298,8 +586,35 @@ int ipcheck_addip(void *fd_tracker_match_entry_head, int index,
 		/*
 		 * first entry in the list
 		 */
-		*match_entry_head = new_match_entry;
+		acl->match_entry_head = new_match_entry;
 	}
 
-	return 0;
+	/*
+	 * appending does not change the position of the other
+	 * entries and can update the tries in place
+	 */
+	if (!new_match_entry->next) {
+		err = ip_acl_trie_add(ip_acl_trie_get(acl, &new_match_entry->addr1), new_match_entry,
+				      ip_acl_rule(new_match_entry, acl->match_entry_count));
+		if (!err) {
+			acl->match_entry_count++;
+		}
+	} else {
+		err = ip_acl_compile(acl);
+	}
+
+	if (!err) {
+		return 0;
+	}
+
+	savederrno = ENOMEM;
+	ipcheck_unlink(acl, new_match_entry);
+	free(new_match_entry);
+
+out_free:
+	if (!acl->match_entry_head) {
+		ipcheck_rmall(fd_tracker_match_entry_head);
+	}
+	errno = savederrno;
+	return -1;
 }
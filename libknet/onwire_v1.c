@@ -146,7 +146,7 @@ void process_pmtud_reply_v1(knet_handle_t knet_h, struct knet_link *src_link, st
 }
 
 void prep_tx_bufs_v1(knet_handle_t knet_h,
-		     struct knet_header *inbuf, unsigned char *data, size_t inlen, uint32_t data_checksum, unsigned int temp_data_mtu,
+		     struct knet_header *inbuf, struct knet_header **outbufs, unsigned char *data, size_t inlen, uint32_t data_checksum, unsigned int temp_data_mtu,
 		     seq_num_t tx_seq_num, int8_t channel, int bcast, int data_compressed,
 		     int *msgs_to_send, struct iovec iov_out[PCKT_FRAG_MAX][2], int *iovcnt_out)
 {
@@ -185,7 +185,7 @@ void prep_tx_bufs_v1(knet_handle_t knet_h,
 			/*
 			 * set the iov_base
 			 */
-			iov_out[frag_idx][0].iov_base = (void *)knet_h->send_to_links_buf[frag_idx];
+			iov_out[frag_idx][0].iov_base = (void *)outbufs[frag_idx];
 			iov_out[frag_idx][0].iov_len = KNET_HEADER_DATA_V1_SIZE;
 			iov_out[frag_idx][1].iov_base = data + (temp_data_mtu * frag_idx);
 
@@ -201,15 +201,15 @@ void prep_tx_bufs_v1(knet_handle_t knet_h,
 			/*
 			 * copy the frag info on all buffers
 			 */
-			memmove(knet_h->send_to_links_buf[frag_idx], inbuf, KNET_HEADER_DATA_V1_SIZE);
+			memmove(outbufs[frag_idx], inbuf, KNET_HEADER_DATA_V1_SIZE);
 			/*
 			 * bump the frag
 			 */
-			knet_h->send_to_links_buf[frag_idx]->khp_data_v1_frag_seq = frag_idx + 1;
+			outbufs[frag_idx]->khp_data_v1_frag_seq = frag_idx + 1;
 
 #ifdef ONWIRE_V1_EXTRA_DEBUG
-			knet_h->send_to_links_buf[frag_idx]->kh_checksum = 0;
-			knet_h->send_to_links_buf[frag_idx]->kh_checksum = compute_chksumv(iov_out[frag_idx], 2);
+			outbufs[frag_idx]->kh_checksum = 0;
+			outbufs[frag_idx]->kh_checksum = compute_chksumv(iov_out[frag_idx], 2);
 #endif
 
 			frag_len = frag_len - temp_data_mtu;
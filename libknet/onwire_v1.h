@@ -24,7 +24,7 @@ void prep_pmtud_reply_v1(knet_handle_t knet_h, struct knet_header *inbuf, ssize_
 void process_pmtud_reply_v1(knet_handle_t knet_h, struct knet_link *src_link, struct knet_header *inbuf);
 
 void prep_tx_bufs_v1(knet_handle_t knet_h,
-		     struct knet_header *inbuf, unsigned char *data, size_t inlen, uint32_t data_checksum, unsigned int temp_data_mtu,
+		     struct knet_header *inbuf, struct knet_header **outbufs, unsigned char *data, size_t inlen, uint32_t data_checksum, unsigned int temp_data_mtu,
 		     seq_num_t tx_seq_num, int8_t channel, int bcast, int data_compressed,
 		     int *msgs_to_send, struct iovec iov_out[PCKT_FRAG_MAX][2], int *iovcnt_out);
 
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include "ring.h"
+
+/*
+ * each record is a 8 bytes header holding the data length, followed
+ * by the data padded to 8 bytes. A record never wraps around the end
+ * of the ring, the producer leaves a KNET_RING_WRAP marker instead
+ * and starts again from offset 0.
+ *
+ * wakeups: the consumer that finds the ring empty clears the eventfd,
+ * sets waiting and checks again. The producer checks waiting after
+ * publishing and only then writes the eventfd. The two full barriers
+ * guarantee that either the consumer sees the new record or the
+ * producer sees waiting, so a busy ring costs no syscalls at all.
+ */
+
+#define KNET_RING_HDR_SIZE 8
+#define KNET_RING_WRAP UINT32_MAX
+
+#define KNET_RING_REC_SIZE(len) \
+	(KNET_RING_HDR_SIZE + (((len) + 7) & ~((size_t)7)))
+
+static size_t _ring_map_size(size_t size)
+{
+	return sizeof(struct knet_ring) + size;
+}
+
+struct knet_ring *_ring_alloc(size_t size)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	int savederrno = 0;
+	struct knet_ring *ring;
+
+	if ((size & (size - 1)) ||
+	    (size < KNET_RING_REC_SIZE(KNET_MAX_PACKET_SIZE) * 2)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ring = mmap(NULL, _ring_map_size(size), PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED) {
+		return NULL;
+	}
+
+	ring->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->efd < 0) {
+		savederrno = errno;
+		munmap(ring, _ring_map_size(size));
+		errno = savederrno;
+		return NULL;
+	}
+
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->waiting = 1;
+
+	return ring;
+#else
+	errno = EOPNOTSUPP;
+	return NULL;
+#endif
+}
+
+void _ring_free(struct knet_ring *ring)
+{
+	if (!ring) {
+		return;
+	}
+
+	close(ring->efd);
+	munmap(ring, _ring_map_size(ring->size));
+}
+
+/*
+ * producer side, the record is visible to the consumer on return.
+ * Call _ring_wakeup after one or more pushes.
+ */
+int _ring_push(struct knet_ring *ring, const void *buf, size_t len)
+{
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t offset = head & (ring->size - 1);
+	size_t rec_size = KNET_RING_REC_SIZE(len);
+	size_t skip = 0;
+
+	if (offset + rec_size > ring->size) {
+		skip = ring->size - offset;
+	}
+
+	if (head + skip + rec_size - tail > ring->size) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	if (skip) {
+		*(uint32_t *)&ring->data[offset] = KNET_RING_WRAP;
+		head += skip;
+		offset = 0;
+	}
+
+	*(uint32_t *)&ring->data[offset] = len;
+	memcpy(&ring->data[offset + KNET_RING_HDR_SIZE], buf, len);
+
+	__atomic_store_n(&ring->head, head + rec_size, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void _ring_wakeup(struct knet_ring *ring)
+{
+	uint64_t evt = 1;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if ((__atomic_load_n(&ring->waiting, __ATOMIC_RELAXED)) &&
+	    (__atomic_exchange_n(&ring->waiting, 0, __ATOMIC_RELAXED))) {
+		/*
+		 * the eventfd counter cannot overflow, the consumer
+		 * clears it before setting waiting again
+		 */
+		if (write(ring->efd, &evt, sizeof(evt)) < 0) {
+			return;
+		}
+	}
+}
+
+/*
+ * consumer side, returns the record length (truncated to buf_len)
+ * or -1 and EAGAIN if the ring is empty.
+ */
+ssize_t _ring_pop(struct knet_ring *ring, void *buf, size_t buf_len)
+{
+	uint64_t tail = ring->tail;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t evt;
+	size_t offset;
+	uint32_t len;
+
+	if (head == tail) {
+		/*
+		 * clear pending wakeups, EAGAIN just means there were none
+		 */
+		if (read(ring->efd, &evt, sizeof(evt)) < 0) {
+			evt = 0;
+		}
+		__atomic_store_n(&ring->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	offset = tail & (ring->size - 1);
+	len = *(uint32_t *)&ring->data[offset];
+	if (len == KNET_RING_WRAP) {
+		tail += ring->size - offset;
+		offset = 0;
+		len = *(uint32_t *)&ring->data[offset];
+	}
+
+	if (len < buf_len) {
+		buf_len = len;
+	}
+	memcpy(buf, &ring->data[offset + KNET_RING_HDR_SIZE], buf_len);
+
+	__atomic_store_n(&ring->tail, tail + KNET_RING_REC_SIZE(len), __ATOMIC_RELEASE);
+
+	return buf_len;
+}
+
+/*
+ * KNET_DATAFD_RING channels: the application sends through tx_ring
+ * and receives from rx_ring. sockfd[] hold the eventfds so that the
+ * TX workers epoll and the datafd lookups work unchanged.
+ */
+int _ring_datafd_init(struct knet_sock *sock)
+{
+	int savederrno = 0;
+
+	sock->tx_ring = _ring_alloc(KNET_RING_SIZE);
+	if (!sock->tx_ring) {
+		return -1;
+	}
+
+	sock->rx_ring = _ring_alloc(KNET_RING_SIZE);
+	if (!sock->rx_ring) {
+		savederrno = errno;
+		goto out_tx;
+	}
+
+	savederrno = pthread_mutex_init(&sock->rx_ring_mutex, NULL);
+	if (savederrno) {
+		goto out_rx;
+	}
+
+	sock->sockfd[0] = sock->rx_ring->efd;
+	sock->sockfd[1] = sock->tx_ring->efd;
+
+	return 0;
+
+out_rx:
+	_ring_free(sock->rx_ring);
+	sock->rx_ring = NULL;
+out_tx:
+	_ring_free(sock->tx_ring);
+	sock->tx_ring = NULL;
+	errno = savederrno;
+	return -1;
+}
+
+void _ring_datafd_free(struct knet_sock *sock)
+{
+	pthread_mutex_destroy(&sock->rx_ring_mutex);
+	_ring_free(sock->rx_ring);
+	_ring_free(sock->tx_ring);
+	sock->rx_ring = NULL;
+	sock->tx_ring = NULL;
+	sock->sockfd[0] = 0;
+	sock->sockfd[1] = 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under LGPL-2.0+
+ */
+
+#ifndef __KNET_RING_H__
+#define __KNET_RING_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "internals.h"
+
+#define KNET_RING_SIZE (2 * 1024 * 1024) /* bytes of data per direction of a datafd ring */
+
+/*
+ * single producer, single consumer ring of variable size records
+ * living in a shared anonymous mapping. head and tail are free
+ * running byte counters, each written by one side only.
+ */
+struct knet_ring {
+	int efd;		/* eventfd, readable when the consumer has to wake up */
+	size_t size;		/* size of data, power of 2 */
+	uint64_t head __attribute__((aligned(KNET_CACHE_LINE_SIZE)));	/* written by the producer */
+	uint64_t tail __attribute__((aligned(KNET_CACHE_LINE_SIZE)));	/* written by the consumer */
+	uint32_t waiting __attribute__((aligned(KNET_CACHE_LINE_SIZE)));	/* consumer found the ring empty */
+	unsigned char data[] __attribute__((aligned(KNET_CACHE_LINE_SIZE)));
+};
+
+struct knet_ring *_ring_alloc(size_t size);
+void _ring_free(struct knet_ring *ring);
+
+int _ring_push(struct knet_ring *ring, const void *buf, size_t len);
+void _ring_wakeup(struct knet_ring *ring);
+
+ssize_t _ring_pop(struct knet_ring *ring, void *buf, size_t buf_len);
+
+int _ring_datafd_init(struct knet_sock *sock);
+void _ring_datafd_free(struct knet_sock *sock);
+
+#endif
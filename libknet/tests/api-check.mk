@@ -28,7 +28,9 @@ api_checks		= \
 			  api_knet_handle_set_transport_reconnect_interval_test \
 			  api_knet_handle_get_transport_reconnect_interval_test \
 			  api_knet_recv_test \
+			  api_knet_recvmmsg_test \
 			  api_knet_send_test \
+			  api_knet_sendmmsg_test \
 			  api_knet_send_crypto_test \
 			  api_knet_send_compress_test \
 			  api_knet_send_sync_test \
@@ -72,6 +74,10 @@ api_checks		= \
 			  api_knet_link_enable_status_change_notify_test \
 			  api_knet_handle_set_threads_timer_res_test \
 			  api_knet_handle_get_threads_timer_res_test \
+			  api_knet_handle_set_tx_threads_test \
+			  api_knet_handle_get_tx_threads_test \
+			  api_knet_handle_set_crypto_threads_test \
+			  api_knet_handle_get_crypto_threads_test \
 			  api_knet_link_add_acl_test \
 			  api_knet_link_insert_acl_test \
 			  api_knet_link_rm_acl_test \
@@ -151,9 +157,15 @@ api_knet_handle_get_transport_reconnect_interval_test_SOURCES = api_knet_handle_
 api_knet_recv_test_SOURCES = api_knet_recv.c \
 			     test-common.c
 
+api_knet_recvmmsg_test_SOURCES = api_knet_recvmmsg.c \
+				 test-common.c
+
 api_knet_send_test_SOURCES = api_knet_send.c \
 			     test-common.c
 
+api_knet_sendmmsg_test_SOURCES = api_knet_sendmmsg.c \
+				 test-common.c
+
 api_knet_send_compress_test_SOURCES = api_knet_send_compress.c \
 				      test-common.c
 
@@ -281,6 +293,18 @@ api_knet_handle_set_threads_timer_res_test_SOURCES = api_knet_handle_set_threads
 api_knet_handle_get_threads_timer_res_test_SOURCES = api_knet_handle_get_threads_timer_res.c \
 						     test-common.c
 
+api_knet_handle_set_tx_threads_test_SOURCES = api_knet_handle_set_tx_threads.c \
+					      test-common.c
+
+api_knet_handle_get_tx_threads_test_SOURCES = api_knet_handle_get_tx_threads.c \
+					      test-common.c
+
+api_knet_handle_set_crypto_threads_test_SOURCES = api_knet_handle_set_crypto_threads.c \
+						  test-common.c
+
+api_knet_handle_get_crypto_threads_test_SOURCES = api_knet_handle_get_crypto_threads.c \
+						  test-common.c
+
 api_knet_link_add_acl_test_SOURCES = api_knet_link_add_acl.c \
 				     test-common.c
 
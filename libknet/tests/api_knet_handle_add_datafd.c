@@ -90,6 +90,27 @@ static void test(void)
 
 	FAIL_ON_ERR(knet_handle_remove_datafd(knet_h1, datafd));
 
+#ifdef HAVE_SYS_EVENTFD_H
+	printf("Test knet_handle_add_datafd with KNET_DATAFD_RING\n");
+	datafd = KNET_DATAFD_RING;
+	channel = -1;
+
+	FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &datafd, &channel));
+	printf("got datafd: %d channel: %d\n", datafd, channel);
+
+	if ((datafd <= 0) || (!knet_h1->sockfd[channel].tx_ring) || (!knet_h1->sockfd[channel].rx_ring)) {
+		printf("knet_handle_add_datafd did not create the datafd rings\n");
+		CLEAN_EXIT(FAIL);
+	}
+
+	FAIL_ON_ERR(knet_handle_remove_datafd(knet_h1, datafd));
+
+	if ((knet_h1->sockfd[channel].tx_ring) || (knet_h1->sockfd[channel].rx_ring)) {
+		printf("knet_handle_remove_datafd did not release the datafd rings\n");
+		CLEAN_EXIT(FAIL);
+	}
+#endif
+
 	printf("Test knet_handle_add_datafd with no available channels\n");
 	for (i = 0; i < KNET_DATAFD_MAX; i++) {
 		datafdmax[i] = 0;
@@ -148,6 +148,43 @@ static void test(const char *model, const char *model2)
 
 	FAIL_ON_SUCCESS(knet_handle_crypto_set_config(knet_h1, &knet_handle_crypto_cfg, 1), EINVAL);
 
+	printf("Test knet_handle_crypto_set_config with %s/aes256-gcm/sha1 and normal key\n", model);
+	memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
+	strncpy(knet_handle_crypto_cfg.crypto_model, model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_cipher_type, "aes256-gcm", sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_hash_type, "sha1", sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
+	knet_handle_crypto_cfg.private_key_len = 2000;
+
+	FAIL_ON_SUCCESS(knet_handle_crypto_set_config(knet_h1, &knet_handle_crypto_cfg, 1), EINVAL);
+
+	printf("Test knet_handle_crypto_set_config with %s/aes256-gcm/none and normal key\n", model);
+	memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
+	strncpy(knet_handle_crypto_cfg.crypto_model, model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_cipher_type, "aes256-gcm", sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_hash_type, "none", sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
+	knet_handle_crypto_cfg.private_key_len = 2000;
+
+	FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h1, &knet_handle_crypto_cfg, 1));
+
+	if ((knet_h1->crypto_instance[1]->sec_salt_size != KNET_CRYPTO_CONFIG_ID_SIZE + KNET_CRYPTO_AEAD_NONCE_SIZE) ||
+	    (knet_h1->crypto_instance[1]->sec_hash_size != KNET_CRYPTO_AEAD_TAG_SIZE) ||
+	    (knet_h1->crypto_instance[1]->sec_block_size != 0)) {
+		printf("knet_handle_crypto_set_config installed AEAD config with wrong overhead: salt %zu hash %zu block %zu\n",
+		       knet_h1->crypto_instance[1]->sec_salt_size,
+		       knet_h1->crypto_instance[1]->sec_hash_size,
+		       knet_h1->crypto_instance[1]->sec_block_size);
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_crypto_set_config with %s/chacha20-poly/none and normal key\n", model);
+	memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
+	strncpy(knet_handle_crypto_cfg.crypto_model, model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_cipher_type, "chacha20-poly", sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_hash_type, "none", sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
+	knet_handle_crypto_cfg.private_key_len = 2000;
+
+	FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h1, &knet_handle_crypto_cfg, 1));
+
 	printf("Test knet_handle_crypto_set_config with %s/aes128/sha1 and key where (key_len %% wrap_key_block_size != 0)\n", model);
 	memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
 	strncpy(knet_handle_crypto_cfg.crypto_model, model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
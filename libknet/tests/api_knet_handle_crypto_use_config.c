@@ -73,6 +73,15 @@ static void test(const char *model, const char *model2)
 		CLEAN_EXIT(FAIL);
 	}
 
+	printf("Test crypto instances carry their config id\n");
+	if ((knet_h1->crypto_instance[1]->config_id != 1) ||
+	    (knet_h1->crypto_instance[2]->config_id != 2)) {
+		printf("crypto instances have wrong config ids: %u %u\n",
+		       knet_h1->crypto_instance[1]->config_id,
+		       knet_h1->crypto_instance[2]->config_id);
+		CLEAN_EXIT(FAIL);
+	}
+
 	printf("Shutdown crypto\n");
 
 	printf("Test knet_handle_crypto_use_config with valid data\n");
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+
+static void test(void)
+{
+	knet_handle_t knet_h1, knet_h[2];
+	int res;
+	int logfds[2];
+	uint8_t tx_threads;
+
+	printf("Test knet_handle_get_tx_threads incorrect knet_h\n");
+
+	if ((!knet_handle_get_tx_threads(NULL, &tx_threads)) || (errno != EINVAL)) {
+		printf("knet_handle_get_tx_threads accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+	knet_h1 = knet_handle_start(logfds, KNET_LOG_DEBUG, knet_h);
+
+	printf("Test knet_handle_get_tx_threads with invalid tx_threads\n");
+	FAIL_ON_SUCCESS(knet_handle_get_tx_threads(knet_h1, NULL), EINVAL);
+
+	printf("Test knet_handle_get_tx_threads with default tx_threads\n");
+	FAIL_ON_ERR(knet_handle_get_tx_threads(knet_h1, &tx_threads));
+	if (tx_threads != 1) {
+		printf("knet_handle_get_tx_threads did not get default tx_threads value: %u\n", tx_threads);
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_get_tx_threads after change\n");
+	FAIL_ON_ERR(knet_handle_set_tx_threads(knet_h1, 3));
+	FAIL_ON_ERR(knet_handle_get_tx_threads(knet_h1, &tx_threads));
+	if (tx_threads != knet_h1->tx_threads) {
+		printf("knet_handle_get_tx_threads did not get tx_threads correct value: %u\n", tx_threads);
+		CLEAN_EXIT(FAIL);
+	}
+
+	CLEAN_EXIT(CONTINUE);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
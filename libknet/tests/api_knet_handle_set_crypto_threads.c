@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+static int private_data;
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static int send_recv(knet_handle_t knet_h1, int datafd, int8_t channel, int logfd)
+{
+	char send_buff[KNET_MAX_PACKET_SIZE];
+	char recv_buff[KNET_MAX_PACKET_SIZE];
+	ssize_t send_len;
+	ssize_t recv_len;
+
+	memset(send_buff, 0x5a, sizeof(send_buff));
+
+	send_len = knet_send(knet_h1, send_buff, KNET_MAX_PACKET_SIZE, channel);
+	if (send_len != KNET_MAX_PACKET_SIZE) {
+		printf("knet_send failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (wait_for_packet(knet_h1, 10, datafd, logfd, stdout)) {
+		printf("Error waiting for packet\n");
+		return -1;
+	}
+
+	recv_len = knet_recv(knet_h1, recv_buff, KNET_MAX_PACKET_SIZE, channel);
+	if (recv_len != send_len) {
+		printf("knet_recv received only %zd bytes: %s\n", recv_len, strerror(errno));
+		if ((is_helgrind()) && (recv_len == -1) && (errno == EAGAIN)) {
+			printf("helgrind exception. this is normal due to possible timeouts\n");
+			return 0;
+		}
+		return -1;
+	}
+
+	if (memcmp(recv_buff, send_buff, KNET_MAX_PACKET_SIZE)) {
+		printf("recv and send buffers are different!\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void test(const char *model)
+{
+	knet_handle_t knet_h1, knet_h[2];
+	int res;
+	int logfds[2];
+	int datafd = 0;
+	int8_t channel = -1;
+	struct sockaddr_storage lo;
+	struct knet_handle_crypto_cfg knet_handle_crypto_cfg;
+
+	printf("Test knet_handle_set_crypto_threads incorrect knet_h\n");
+
+	if ((!knet_handle_set_crypto_threads(NULL, 1)) || (errno != EINVAL)) {
+		printf("knet_handle_set_crypto_threads accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+	knet_h1 = knet_handle_start(logfds, KNET_LOG_DEBUG, knet_h);
+
+	printf("Test knet_handle_set_crypto_threads with invalid crypto_threads (KNET_MAX_CRYPTO_THREADS + 1)\n");
+	FAIL_ON_SUCCESS(knet_handle_set_crypto_threads(knet_h1, KNET_MAX_CRYPTO_THREADS + 1), EINVAL);
+
+	printf("Test knet_handle_set_crypto_threads with valid crypto_threads\n");
+	FAIL_ON_ERR(knet_handle_set_crypto_threads(knet_h1, KNET_MAX_CRYPTO_THREADS));
+	if (knet_h1->crypto_pool.threads != KNET_MAX_CRYPTO_THREADS) {
+		printf("knet_handle_set_crypto_threads did not set crypto_threads to correct value\n");
+		CLEAN_EXIT(FAIL);
+	}
+
+	FAIL_ON_ERR(knet_handle_set_crypto_threads(knet_h1, 0));
+	if (knet_h1->crypto_pool.threads != 0) {
+		printf("knet_handle_set_crypto_threads did not release crypto threads\n");
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_set_crypto_threads with %s traffic\n", model);
+
+	memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
+	strncpy(knet_handle_crypto_cfg.crypto_model, model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_cipher_type, "aes128", sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_hash_type, "sha256", sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
+	knet_handle_crypto_cfg.private_key_len = 2000;
+
+	FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h1, &knet_handle_crypto_cfg, 1));
+	FAIL_ON_ERR(knet_handle_crypto_use_config(knet_h1, 1));
+	FAIL_ON_ERR(knet_handle_crypto_rx_clear_traffic(knet_h1, KNET_CRYPTO_RX_DISALLOW_CLEAR_TRAFFIC));
+
+	FAIL_ON_ERR(knet_handle_enable_sock_notify(knet_h1, &private_data, sock_notify));
+	FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &datafd, &channel));
+	FAIL_ON_ERR(knet_host_add(knet_h1, 1));
+	FAIL_ON_ERR(_knet_link_set_config(knet_h1, 1, 0, KNET_TRANSPORT_UDP, 0, AF_INET, 0, &lo));
+	FAIL_ON_ERR(knet_link_set_enable(knet_h1, 1, 0, 1));
+	FAIL_ON_ERR(knet_handle_setfwd(knet_h1, 1));
+	FAIL_ON_ERR(wait_for_host(knet_h1, 1, 10, logfds[0], stdout));
+
+	FAIL_ON_ERR(knet_handle_set_crypto_threads(knet_h1, 4));
+	if (send_recv(knet_h1, datafd, channel, logfds[0]) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_set_crypto_threads shrinking the pool with active traffic\n");
+	FAIL_ON_ERR(knet_handle_set_crypto_threads(knet_h1, 1));
+	if (send_recv(knet_h1, datafd, channel, logfds[0]) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_set_crypto_threads disabling the pool with active traffic\n");
+	FAIL_ON_ERR(knet_handle_set_crypto_threads(knet_h1, 0));
+	if (send_recv(knet_h1, datafd, channel, logfds[0]) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	CLEAN_EXIT(CONTINUE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct knet_crypto_info crypto_list[16];
+	size_t crypto_list_entries;
+	size_t i;
+
+#ifdef KNET_BSD
+	if (is_memcheck() || is_helgrind()) {
+		printf("valgrind-freebsd cannot run this test properly. Skipping\n");
+		return SKIP;
+	}
+#endif
+
+	memset(crypto_list, 0, sizeof(crypto_list));
+
+	if (knet_get_crypto_list(crypto_list, &crypto_list_entries) < 0) {
+		printf("knet_get_crypto_list failed: %s\n", strerror(errno));
+		return FAIL;
+	}
+
+	if (crypto_list_entries == 0) {
+		printf("no crypto modules detected. Skipping\n");
+		return SKIP;
+	}
+
+	for (i = 0; i < crypto_list_entries; i++) {
+		test(crypto_list[i].name);
+	}
+
+	return PASS;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+
+#define TEST_CHANNELS 4
+
+static int private_data;
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static int send_recv_all(knet_handle_t knet_h1, int *datafd, int8_t *channel, int logfd)
+{
+	char send_buff[KNET_MAX_PACKET_SIZE];
+	char recv_buff[KNET_MAX_PACKET_SIZE];
+	ssize_t send_len;
+	ssize_t recv_len;
+	int i;
+
+	for (i = 0; i < TEST_CHANNELS; i++) {
+		memset(send_buff, i + 1, sizeof(send_buff));
+
+		send_len = knet_send(knet_h1, send_buff, KNET_MAX_PACKET_SIZE, channel[i]);
+		if (send_len != KNET_MAX_PACKET_SIZE) {
+			printf("knet_send failed on channel %d: %s\n", channel[i], strerror(errno));
+			return -1;
+		}
+
+		if (wait_for_packet(knet_h1, 10, datafd[i], logfd, stdout)) {
+			printf("Error waiting for packet on channel %d\n", channel[i]);
+			return -1;
+		}
+
+		recv_len = knet_recv(knet_h1, recv_buff, KNET_MAX_PACKET_SIZE, channel[i]);
+		if (recv_len != send_len) {
+			printf("knet_recv received only %zd bytes on channel %d: %s\n", recv_len, channel[i], strerror(errno));
+			if ((is_helgrind()) && (recv_len == -1) && (errno == EAGAIN)) {
+				printf("helgrind exception. this is normal due to possible timeouts\n");
+				continue;
+			}
+			return -1;
+		}
+
+		if (memcmp(recv_buff, send_buff, KNET_MAX_PACKET_SIZE)) {
+			printf("recv and send buffers are different on channel %d!\n", channel[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void test(void)
+{
+	knet_handle_t knet_h1, knet_h[2];
+	int res;
+	int logfds[2];
+	int datafd[TEST_CHANNELS];
+	int8_t channel[TEST_CHANNELS];
+	struct sockaddr_storage lo;
+	int i;
+
+	printf("Test knet_handle_set_tx_threads incorrect knet_h\n");
+
+	if ((!knet_handle_set_tx_threads(NULL, 1)) || (errno != EINVAL)) {
+		printf("knet_handle_set_tx_threads accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+	knet_h1 = knet_handle_start(logfds, KNET_LOG_DEBUG, knet_h);
+
+	printf("Test knet_handle_set_tx_threads with invalid tx_threads (0)\n");
+	FAIL_ON_SUCCESS(knet_handle_set_tx_threads(knet_h1, 0), EINVAL);
+
+	printf("Test knet_handle_set_tx_threads with invalid tx_threads (KNET_MAX_TX_THREADS + 1)\n");
+	FAIL_ON_SUCCESS(knet_handle_set_tx_threads(knet_h1, KNET_MAX_TX_THREADS + 1), EINVAL);
+
+	printf("Test knet_handle_set_tx_threads with valid tx_threads and no datafd\n");
+	FAIL_ON_ERR(knet_handle_set_tx_threads(knet_h1, KNET_MAX_TX_THREADS));
+	if ((knet_h1->tx_threads != KNET_MAX_TX_THREADS) ||
+	    (!knet_h1->tx_workers[KNET_MAX_TX_THREADS - 1])) {
+		printf("knet_handle_set_tx_threads did not set tx_threads to correct value\n");
+		CLEAN_EXIT(FAIL);
+	}
+
+	FAIL_ON_ERR(knet_handle_set_tx_threads(knet_h1, 1));
+	if ((knet_h1->tx_threads != 1) ||
+	    (knet_h1->tx_workers[1])) {
+		printf("knet_handle_set_tx_threads did not release TX workers\n");
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Configuring datafds, host and link\n");
+	FAIL_ON_ERR(knet_handle_enable_sock_notify(knet_h1, &private_data, sock_notify));
+
+	for (i = 0; i < TEST_CHANNELS; i++) {
+		datafd[i] = 0;
+		channel[i] = -1;
+		FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &datafd[i], &channel[i]));
+	}
+
+	FAIL_ON_ERR(knet_host_add(knet_h1, 1));
+	FAIL_ON_ERR(_knet_link_set_config(knet_h1, 1, 0, KNET_TRANSPORT_UDP, 0, AF_INET, 0, &lo));
+	FAIL_ON_ERR(knet_link_set_enable(knet_h1, 1, 0, 1));
+	FAIL_ON_ERR(knet_handle_setfwd(knet_h1, 1));
+	FAIL_ON_ERR(wait_for_host(knet_h1, 1, 10, logfds[0], stdout));
+
+	printf("Test traffic with 1 TX thread\n");
+	if (send_recv_all(knet_h1, datafd, channel, logfds[0]) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_set_tx_threads growing the pool with active datafds\n");
+	FAIL_ON_ERR(knet_handle_set_tx_threads(knet_h1, TEST_CHANNELS));
+	if (send_recv_all(knet_h1, datafd, channel, logfds[0]) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_set_tx_threads shrinking the pool with active datafds\n");
+	FAIL_ON_ERR(knet_handle_set_tx_threads(knet_h1, 2));
+	if (send_recv_all(knet_h1, datafd, channel, logfds[0]) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	printf("Test knet_handle_setfwd with multiple TX threads\n");
+	FAIL_ON_ERR(knet_handle_setfwd(knet_h1, 0));
+
+	CLEAN_EXIT(CONTINUE);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "test-common.h"
+
+#define TEST_MSGS 4
+
+static int private_data;
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static int write_msg(knet_handle_t knet_h, int8_t channel, char *buff, size_t len)
+{
+	struct iovec iov_out[1];
+
+	iov_out[0].iov_base = (void *)buff;
+	iov_out[0].iov_len = len;
+
+	if (writev(knet_h->sockfd[channel].sockfd[1], iov_out, 1) != (ssize_t)len) {
+		printf("Unable to write data: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void test(void)
+{
+	knet_handle_t knet_h1, knet_h[2];
+	int logfds[2];
+	int datafd = 0;
+	int8_t channel = 0, channel2 = 0;
+	static char recv_buff[TEST_MSGS][KNET_MAX_PACKET_SIZE];
+	static char send_buff[TEST_MSGS][KNET_MAX_PACKET_SIZE];
+	struct knet_msg msgvec[TEST_MSGS];
+	int recv, i;
+	int res;
+
+	memset(msgvec, 0, sizeof(msgvec));
+	for (i = 0; i < TEST_MSGS; i++) {
+		msgvec[i].buff = recv_buff[i];
+		msgvec[i].buff_len = KNET_MAX_PACKET_SIZE;
+		msgvec[i].channel = channel;
+	}
+
+	printf("Test knet_recvmmsg incorrect knet_h\n");
+	if ((!knet_recvmmsg(NULL, msgvec, TEST_MSGS)) || (errno != EINVAL)) {
+		printf("knet_recvmmsg accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h1 = knet_handle_start(logfds, KNET_LOG_DEBUG, knet_h);
+
+	printf("Test knet_recvmmsg with no msgvec\n");
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, NULL, TEST_MSGS), EINVAL);
+
+	printf("Test knet_recvmmsg with no messages\n");
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, 0), EINVAL);
+
+	printf("Test knet_recvmmsg with no recv_buff\n");
+	msgvec[TEST_MSGS - 1].buff = NULL;
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+	msgvec[TEST_MSGS - 1].buff = recv_buff[TEST_MSGS - 1];
+
+	printf("Test knet_recvmmsg with invalid recv_buff len (0)\n");
+	msgvec[TEST_MSGS - 1].buff_len = 0;
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+
+	printf("Test knet_recvmmsg with invalid recv_buff len (> KNET_MAX_PACKET_SIZE)\n");
+	msgvec[TEST_MSGS - 1].buff_len = KNET_MAX_PACKET_SIZE + 1;
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+	msgvec[TEST_MSGS - 1].buff_len = KNET_MAX_PACKET_SIZE;
+
+	printf("Test knet_recvmmsg with invalid channel (-1)\n");
+	msgvec[TEST_MSGS - 1].channel = -1;
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+
+	printf("Test knet_recvmmsg with invalid channel (KNET_DATAFD_MAX)\n");
+	msgvec[TEST_MSGS - 1].channel = KNET_DATAFD_MAX;
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+	msgvec[TEST_MSGS - 1].channel = channel;
+
+	printf("Test knet_recvmmsg with unconfigured channel\n");
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+
+	FAIL_ON_ERR(knet_handle_enable_sock_notify(knet_h1, &private_data, sock_notify));
+
+	datafd = 0;
+	channel = -1;
+	FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &datafd, &channel));
+
+	datafd = 0;
+	channel2 = -1;
+	FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &datafd, &channel2));
+
+	printf("Test knet_recvmmsg with no data available\n");
+	for (i = 0; i < TEST_MSGS; i++) {
+		msgvec[i].channel = channel;
+	}
+	FAIL_ON_SUCCESS(knet_recvmmsg(knet_h1, msgvec, TEST_MSGS), EAGAIN);
+
+	printf("Test knet_recvmmsg with valid data on multiple channels\n");
+
+	/*
+	 * message 2 comes from channel2, the others from channel
+	 */
+	msgvec[2].channel = channel2;
+
+	for (i = 0; i < TEST_MSGS; i++) {
+		memset(send_buff[i], i + 1, KNET_MAX_PACKET_SIZE);
+		if (write_msg(knet_h1, msgvec[i].channel, send_buff[i], 1000 * (i + 1)) < 0) {
+			CLEAN_EXIT(FAIL);
+		}
+	}
+
+	recv = knet_recvmmsg(knet_h1, msgvec, TEST_MSGS);
+	if (recv != TEST_MSGS) {
+		printf("knet_recvmmsg received only %d messages: %s\n", recv, strerror(errno));
+		CLEAN_EXIT(FAIL);
+	}
+
+	for (i = 0; i < TEST_MSGS; i++) {
+		if (msgvec[i].msg_len != 1000 * (i + 1)) {
+			printf("knet_recvmmsg received %zd bytes for message %d\n", msgvec[i].msg_len, i);
+			CLEAN_EXIT(FAIL);
+		}
+		if (memcmp(recv_buff[i], send_buff[i], msgvec[i].msg_len)) {
+			printf("knet_recvmmsg received bad data for message %d\n", i);
+			CLEAN_EXIT(FAIL);
+		}
+	}
+
+	printf("Test knet_recvmmsg stops when a channel is drained\n");
+
+	if (write_msg(knet_h1, channel, send_buff[0], 1000) < 0) {
+		CLEAN_EXIT(FAIL);
+	}
+
+	recv = knet_recvmmsg(knet_h1, msgvec, TEST_MSGS);
+	if ((recv != 1) || (msgvec[0].msg_len != 1000)) {
+		printf("knet_recvmmsg returned %d messages, expected 1: %s\n", recv, strerror(errno));
+		CLEAN_EXIT(FAIL);
+	}
+
+	CLEAN_EXIT(CONTINUE);
+}
+
+int main(int argc, char *argv[])
+{
+	test();
+
+	return PASS;
+}
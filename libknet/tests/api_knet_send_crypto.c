@@ -34,7 +34,7 @@ static void sock_notify(void *pvt_data,
 	return;
 }
 
-static void test(const char *model)
+static void test(const char *model, const char *cipher, const char *hash)
 {
 	knet_handle_t knet_h1, knet_h[2];
 	int logfds[2];
@@ -58,12 +58,12 @@ static void test(const char *model)
 
 	flush_logs(logfds[0], stdout);
 
-	printf("Test knet_send with %s and valid data\n", model);
+	printf("Test knet_send with %s/%s/%s and valid data\n", model, cipher, hash);
 
 	memset(&knet_handle_crypto_cfg, 0, sizeof(struct knet_handle_crypto_cfg));
 	strncpy(knet_handle_crypto_cfg.crypto_model, model, sizeof(knet_handle_crypto_cfg.crypto_model) - 1);
-	strncpy(knet_handle_crypto_cfg.crypto_cipher_type, "aes128", sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
-	strncpy(knet_handle_crypto_cfg.crypto_hash_type, "sha256", sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_cipher_type, cipher, sizeof(knet_handle_crypto_cfg.crypto_cipher_type) - 1);
+	strncpy(knet_handle_crypto_cfg.crypto_hash_type, hash, sizeof(knet_handle_crypto_cfg.crypto_hash_type) - 1);
 	knet_handle_crypto_cfg.private_key_len = 2000;
 
 	FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h1, &knet_handle_crypto_cfg, 1));
@@ -161,7 +161,8 @@ int main(int argc, char *argv[])
 	}
 
 	for (i=0; i < crypto_list_entries; i++) {
-		test(crypto_list[i].name);
+		test(crypto_list[i].name, "aes128", "sha256");
+		test(crypto_list[i].name, "aes256-gcm", "none");
 	}
 
 	return PASS;
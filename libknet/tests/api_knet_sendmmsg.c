@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "libknet.h"
+
+#include "internals.h"
+#include "netutils.h"
+#include "test-common.h"
+
+#define TEST_MSGS 8
+
+static int private_data;
+
+static void sock_notify(void *pvt_data,
+			int datafd,
+			int8_t channel,
+			uint8_t tx_rx,
+			int error,
+			int errorno)
+{
+	return;
+}
+
+static void test(uint8_t transport)
+{
+	knet_handle_t knet_h1, knet_h[2];
+	int logfds[2];
+	int datafd = 0;
+	int8_t channel = 0;
+	static char send_buff[TEST_MSGS][KNET_MAX_PACKET_SIZE];
+	char recv_buff[KNET_MAX_PACKET_SIZE];
+	struct knet_msg msgvec[TEST_MSGS];
+	ssize_t recv_len = 0;
+	int sent, i;
+#ifdef HAVE_SYS_EVENTFD_H
+	int ringfd = KNET_DATAFD_RING;
+	int8_t ringchannel = -1;
+	static char ring_recv_buff[TEST_MSGS][KNET_MAX_PACKET_SIZE];
+	struct knet_msg recvvec[TEST_MSGS];
+	int recv;
+#endif
+	int savederrno;
+	int res;
+	struct sockaddr_storage lo;
+
+	memset(msgvec, 0, sizeof(msgvec));
+	for (i = 0; i < TEST_MSGS; i++) {
+		memset(send_buff[i], i, KNET_MAX_PACKET_SIZE);
+		msgvec[i].buff = send_buff[i];
+		msgvec[i].buff_len = 1024 * (i + 1);
+		msgvec[i].channel = channel;
+	}
+
+	printf("Test knet_sendmmsg incorrect knet_h\n");
+
+	if ((!knet_sendmmsg(NULL, msgvec, TEST_MSGS)) || (errno != EINVAL)) {
+		printf("knet_sendmmsg accepted invalid knet_h or returned incorrect error: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	setup_logpipes(logfds);
+
+	knet_h1 = knet_handle_start(logfds, KNET_LOG_DEBUG, knet_h);
+
+	printf("Test knet_sendmmsg with no msgvec\n");
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, NULL, TEST_MSGS), EINVAL);
+
+	printf("Test knet_sendmmsg with no messages\n");
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, 0), EINVAL);
+
+	printf("Test knet_sendmmsg with no send_buff\n");
+	msgvec[TEST_MSGS - 1].buff = NULL;
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+	msgvec[TEST_MSGS - 1].buff = send_buff[TEST_MSGS - 1];
+
+	printf("Test knet_sendmmsg with invalid send_buff len (0)\n");
+	msgvec[TEST_MSGS - 1].buff_len = 0;
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+
+	printf("Test knet_sendmmsg with invalid send_buff len (> KNET_MAX_PACKET_SIZE)\n");
+	msgvec[TEST_MSGS - 1].buff_len = KNET_MAX_PACKET_SIZE + 1;
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+	msgvec[TEST_MSGS - 1].buff_len = 1024 * TEST_MSGS;
+
+	printf("Test knet_sendmmsg with invalid channel (-1)\n");
+	msgvec[TEST_MSGS - 1].channel = -1;
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+
+	printf("Test knet_sendmmsg with invalid channel (KNET_DATAFD_MAX)\n");
+	msgvec[TEST_MSGS - 1].channel = KNET_DATAFD_MAX;
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+	msgvec[TEST_MSGS - 1].channel = channel;
+
+	printf("Test knet_sendmmsg with unconfigured channel\n");
+	FAIL_ON_SUCCESS(knet_sendmmsg(knet_h1, msgvec, TEST_MSGS), EINVAL);
+
+	printf("Test knet_sendmmsg with valid data\n");
+	FAIL_ON_ERR(knet_handle_enable_access_lists(knet_h1, 1));
+	FAIL_ON_ERR(knet_handle_enable_sock_notify(knet_h1, &private_data, sock_notify));
+
+	datafd = 0;
+	channel = -1;
+
+	FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &datafd, &channel));
+	FAIL_ON_ERR(knet_host_add(knet_h1, 1));
+	if (_knet_link_set_config(knet_h1, 1, 0, transport, 0, AF_INET, 0, &lo) < 0 ) {
+		int exit_status = transport == KNET_TRANSPORT_SCTP && errno == EPROTONOSUPPORT ? SKIP : FAIL;
+		printf("Unable to configure link: %s\n", strerror(errno));
+		CLEAN_EXIT(exit_status);
+	}
+
+	FAIL_ON_ERR(knet_link_set_enable(knet_h1, 1, 0, 1));
+	FAIL_ON_ERR(knet_handle_setfwd(knet_h1, 1));
+	FAIL_ON_ERR(wait_for_host(knet_h1, 1, 10, logfds[0], stdout));
+
+	for (i = 0; i < TEST_MSGS; i++) {
+		msgvec[i].channel = channel;
+		msgvec[i].msg_len = 0;
+	}
+
+	sent = knet_sendmmsg(knet_h1, msgvec, TEST_MSGS);
+	if (sent != TEST_MSGS) {
+		printf("knet_sendmmsg sent only %d messages: %s\n", sent, strerror(errno));
+		CLEAN_EXIT(FAIL);
+	}
+
+	for (i = 0; i < TEST_MSGS; i++) {
+		if (msgvec[i].msg_len != (ssize_t)msgvec[i].buff_len) {
+			printf("knet_sendmmsg sent only %zd bytes of message %d\n", msgvec[i].msg_len, i);
+			CLEAN_EXIT(FAIL);
+		}
+	}
+
+	for (i = 0; i < TEST_MSGS; i++) {
+		FAIL_ON_ERR(wait_for_packet(knet_h1, 10, datafd, logfds[0], stdout));
+
+		recv_len = knet_recv(knet_h1, recv_buff, KNET_MAX_PACKET_SIZE, channel);
+		savederrno = errno;
+		if (recv_len != msgvec[i].msg_len) {
+			printf("knet_recv received only %zd bytes: %s (errno: %d)\n", recv_len, strerror(errno), errno);
+			if ((is_helgrind()) && (recv_len == -1) && (savederrno == EAGAIN)) {
+				printf("helgrind exception. this is normal due to possible timeouts\n");
+				CLEAN_EXIT(PASS);
+			}
+			CLEAN_EXIT(FAIL);
+		}
+
+		if (memcmp(recv_buff, send_buff[i], recv_len)) {
+			printf("recv and send buffers are different (or out of order) for message %d!\n", i);
+			CLEAN_EXIT(FAIL);
+		}
+	}
+
+#ifdef HAVE_SYS_EVENTFD_H
+	printf("Test knet_sendmmsg and knet_recvmmsg with a ring datafd\n");
+
+	FAIL_ON_ERR(knet_handle_add_datafd(knet_h1, &ringfd, &ringchannel));
+
+	memset(recvvec, 0, sizeof(recvvec));
+	for (i = 0; i < TEST_MSGS; i++) {
+		msgvec[i].channel = ringchannel;
+		msgvec[i].msg_len = 0;
+		recvvec[i].buff = ring_recv_buff[i];
+		recvvec[i].buff_len = KNET_MAX_PACKET_SIZE;
+		recvvec[i].channel = ringchannel;
+	}
+
+	sent = knet_sendmmsg(knet_h1, msgvec, TEST_MSGS);
+	if (sent != TEST_MSGS) {
+		printf("knet_sendmmsg sent only %d messages to the ring: %s\n", sent, strerror(errno));
+		CLEAN_EXIT(FAIL);
+	}
+
+	/*
+	 * the ring eventfd can be readable after the ring has been drained,
+	 * EAGAIN clears it
+	 */
+	recv = 0;
+	while (recv < TEST_MSGS) {
+		FAIL_ON_ERR(wait_for_packet(knet_h1, 10, ringfd, logfds[0], stdout));
+
+		res = knet_recvmmsg(knet_h1, &recvvec[recv], TEST_MSGS - recv);
+		if (res < 0) {
+			if (errno == EAGAIN) {
+				continue;
+			}
+			printf("knet_recvmmsg from the ring failed: %s\n", strerror(errno));
+			CLEAN_EXIT(FAIL);
+		}
+		recv += res;
+	}
+
+	for (i = 0; i < TEST_MSGS; i++) {
+		if ((recvvec[i].msg_len != msgvec[i].msg_len) ||
+		    (memcmp(ring_recv_buff[i], send_buff[i], recvvec[i].msg_len))) {
+			printf("ring recv and send buffers are different (or out of order) for message %d!\n", i);
+			CLEAN_EXIT(FAIL);
+		}
+	}
+#endif
+
+	CLEAN_EXIT(CONTINUE);
+}
+
+int main(int argc, char *argv[])
+{
+	printf("Testing with UDP\n");
+	test(KNET_TRANSPORT_UDP);
+
+#ifdef HAVE_NETINET_SCTP_H
+	printf("Testing with SCTP\n");
+	test(KNET_TRANSPORT_SCTP);
+#endif
+
+	return PASS;
+}
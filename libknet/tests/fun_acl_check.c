@@ -26,9 +26,9 @@
 
 /*
  * Keep track of how many messages got through:
- * clean + 3xACLs + QUIT
+ * clean + 3xACLs + 2xremoved ACLs + QUIT
  */
-#define CORRECT_NUM_MSGS 5
+#define CORRECT_NUM_MSGS 7
 static int msgs_recvd = 0;
 
 #undef TESTNODES
@@ -369,6 +369,41 @@ static void test(int transport)
 	FAIL_ON_ERR_THR(knet_send_str(knet_h[2], "1Range unblocked - this should get through"));
 	FAIL_ON_ERR_THR(wait_for_reply(seconds));
 
+	// The address has been accepted (and cached by the RX thread), remove the ACL
+	knet_strtoaddr("127.0.0.1","0", &ss1, sizeof(ss1));
+	FAIL_ON_ERR_THR(knet_link_rm_acl(knet_h[1], 2, 0, &ss1, NULL, CHECK_TYPE_ADDRESS, CHECK_ACCEPT));
+
+	printf("Testing Accept removed - this should NOT get through\n");
+	FAIL_ON_ERR_THR(knet_send_str(knet_h[2], "0Accept removed - this should NOT get through"));
+
+	// Accept again and check
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[1], TESTNODES, 0, seconds, logfds[0], stdout));
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[2], TESTNODES, 0, seconds, logfds[0], stdout));
+	FAIL_ON_ERR_THR(knet_link_add_acl(knet_h[1], 2, 0, &ss1, NULL, CHECK_TYPE_ADDRESS, CHECK_ACCEPT));
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[1], TESTNODES, 1, seconds, logfds[0], stdout));
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[2], TESTNODES, 1, seconds, logfds[0], stdout));
+
+	printf("Testing Accept restored - this should get through\n");
+	FAIL_ON_ERR_THR(knet_send_str(knet_h[2], "1Accept restored - this should get through"));
+	FAIL_ON_ERR_THR(wait_for_reply(seconds));
+
+	// Same with all the ACLs cleared
+	FAIL_ON_ERR_THR(knet_link_clear_acl(knet_h[1], 2, 0));
+
+	printf("Testing ACLs cleared - this should NOT get through\n");
+	FAIL_ON_ERR_THR(knet_send_str(knet_h[2], "0ACLs cleared - this should NOT get through"));
+
+	// Accept again and check
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[1], TESTNODES, 0, seconds, logfds[0], stdout));
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[2], TESTNODES, 0, seconds, logfds[0], stdout));
+	FAIL_ON_ERR_THR(knet_link_add_acl(knet_h[1], 2, 0, &ss1, NULL, CHECK_TYPE_ADDRESS, CHECK_ACCEPT));
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[1], TESTNODES, 1, seconds, logfds[0], stdout));
+	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[2], TESTNODES, 1, seconds, logfds[0], stdout));
+
+	printf("Testing ACLs restored - this should get through\n");
+	FAIL_ON_ERR_THR(knet_send_str(knet_h[2], "1ACLs restored - this should get through"));
+	FAIL_ON_ERR_THR(wait_for_reply(seconds));
+
 	// Finish up - disable ACLS to make sure the QUIT message gets through
 	FAIL_ON_ERR_THR(knet_handle_enable_access_lists(knet_h[1], 0));
 	FAIL_ON_ERR_THR(wait_for_nodes_state(knet_h[1], TESTNODES, 1, seconds, logfds[0], stdout));
@@ -156,6 +156,159 @@ static void test(const char *model)
 	knet_handle_stop_everything(knet_h, TESTNODES);
 }
 
+/*
+ * same as flush_logs, but count the messages containing match
+ */
+static int flush_logs_count(int logfd, const char *match)
+{
+	struct knet_log_msg msg;
+	int count = 0;
+
+	while (read(logfd, &msg, sizeof(msg)) == sizeof(msg)) {
+		msg.msg[sizeof(msg.msg) - 1] = 0;
+
+		printf("[knet: %p]: [%s] %s: %.*s\n",
+		       msg.knet_h,
+		       knet_log_get_loglevel_name(msg.msglevel),
+		       knet_log_get_subsystem_name(msg.subsystem),
+		       KNET_MAX_LOG_MSG_SIZE, msg.msg);
+
+		if (strstr(msg.msg, match)) {
+			count++;
+		}
+	}
+	errno = 0;
+
+	return count;
+}
+
+/*
+ * wait for knet_h to decrypt a few more pings/pongs from host_id and
+ * return the number of times a node had to try another config than
+ * the hinted one
+ */
+static int wait_for_decrypt(knet_handle_t knet_h, knet_node_id_t host_id, int logfd, int seconds)
+{
+	struct knet_link_status status;
+	uint64_t start;
+	int fallbacks = 0;
+	int i;
+
+	if (knet_link_get_status(knet_h, host_id, 0, &status, sizeof(status)) < 0) {
+		printf("knet_link_get_status failed: %s\n", strerror(errno));
+		return -1;
+	}
+	start = status.stats.rx_ping_packets + status.stats.rx_pong_packets;
+
+	for (i = 0; i < seconds; i++) {
+		sleep(1);
+		fallbacks += flush_logs_count(logfd, "Alternative crypto configuration found");
+		if (knet_link_get_status(knet_h, host_id, 0, &status, sizeof(status)) < 0) {
+			printf("knet_link_get_status failed: %s\n", strerror(errno));
+			return -1;
+		}
+		if (status.stats.rx_ping_packets + status.stats.rx_pong_packets >= start + 3) {
+			return fallbacks;
+		}
+	}
+
+	printf("No packets received from host %u in %d seconds\n", host_id, seconds);
+	return -1;
+}
+
+/*
+ * packets carry the id of the config that encrypted them,
+ * see crypto_model.h
+ */
+static void test_config_id(const char *model)
+{
+	knet_handle_t knet_h[TESTNODES + 1];
+	int logfds[2];
+	struct knet_handle_crypto_cfg cfg_a, cfg_b;
+	int i;
+	int seconds = 10;
+	int res;
+
+	if (is_memcheck() || is_helgrind()) {
+		printf("Test suite is running under valgrind, adjusting wait_for_host timeout\n");
+		seconds = seconds * 16;
+	}
+
+	setup_logpipes(logfds);
+
+	knet_handle_start_nodes(knet_h, TESTNODES, logfds, KNET_LOG_DEBUG);
+
+	flush_logs(logfds[0], stdout);
+
+	memset(&cfg_a, 0, sizeof(struct knet_handle_crypto_cfg));
+	strncpy(cfg_a.crypto_model, model, sizeof(cfg_a.crypto_model) - 1);
+	strncpy(cfg_a.crypto_cipher_type, "aes128", sizeof(cfg_a.crypto_cipher_type) - 1);
+	strncpy(cfg_a.crypto_hash_type, "sha256", sizeof(cfg_a.crypto_hash_type) - 1);
+	memset(cfg_a.private_key, 0, KNET_MAX_KEY_LEN);
+	cfg_a.private_key_len = 2000;
+
+	memset(&cfg_b, 0, sizeof(struct knet_handle_crypto_cfg));
+	strncpy(cfg_b.crypto_model, model, sizeof(cfg_b.crypto_model) - 1);
+	strncpy(cfg_b.crypto_cipher_type, "aes256", sizeof(cfg_b.crypto_cipher_type) - 1);
+	strncpy(cfg_b.crypto_hash_type, "sha512", sizeof(cfg_b.crypto_hash_type) - 1);
+	memset(cfg_b.private_key, 1, KNET_MAX_KEY_LEN);
+	cfg_b.private_key_len = KNET_MAX_KEY_LEN;
+
+	for (i = 1; i <= TESTNODES; i++) {
+		FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h[i], &cfg_a, 1));
+		FAIL_ON_ERR(knet_handle_crypto_use_config(knet_h[i], 1));
+		FAIL_ON_ERR(knet_handle_crypto_rx_clear_traffic(knet_h[i], KNET_CRYPTO_RX_DISALLOW_CLEAR_TRAFFIC));
+	}
+
+	knet_handle_join_nodes(knet_h, TESTNODES, 1, AF_INET, KNET_TRANSPORT_UDP);
+
+	for (i = 1; i <= TESTNODES; i++) {
+		FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h[i], &cfg_b, 2));
+	}
+
+	flush_logs(logfds[0], stdout);
+
+	printf("Testing packets from the config not in use decrypt with the hinted config\n");
+
+	/*
+	 * node 1 sends with config 2, node 2 still uses config 1
+	 */
+	FAIL_ON_ERR(knet_handle_crypto_use_config(knet_h[1], 2));
+	flush_logs(logfds[0], stdout);
+
+	res = wait_for_decrypt(knet_h[2], 1, logfds[0], seconds);
+	if (res != 0) {
+		printf("Packets from config 2 did not decrypt on the first attempt (%d)\n", res);
+		clean_exit(knet_h, TESTNODES, logfds, FAIL);
+	}
+
+	printf("Testing a wrong config id falls back to the other configs\n");
+
+	/*
+	 * move config b to slot 1 on node 2 only, packets from
+	 * node 1 now point node 2 to the wrong config and viceversa
+	 */
+	FAIL_ON_ERR(knet_handle_crypto_use_config(knet_h[2], 2));
+	FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h[2], &cfg_b, 1));
+	FAIL_ON_ERR(knet_handle_crypto_use_config(knet_h[2], 1));
+	FAIL_ON_ERR(knet_handle_crypto_set_config(knet_h[2], &cfg_a, 2));
+	flush_logs(logfds[0], stdout);
+
+	res = wait_for_decrypt(knet_h[2], 1, logfds[0], seconds);
+	if (res <= 0) {
+		printf("Packets with a wrong config id did not fall back (%d)\n", res);
+		clean_exit(knet_h, TESTNODES, logfds, FAIL);
+	}
+
+	for (i = 1; i <= TESTNODES; i++) {
+		FAIL_ON_ERR(wait_for_nodes_state(knet_h[i], TESTNODES, 1, 600, knet_h[1]->logfd, stdout));
+	}
+
+	flush_logs(logfds[0], stdout);
+	close_logpipes(logfds);
+	knet_handle_stop_everything(knet_h, TESTNODES);
+}
+
 int main(int argc, char *argv[])
 {
 	struct knet_crypto_info crypto_list[16];
@@ -176,6 +329,7 @@ int main(int argc, char *argv[])
 
 	for (i=0; i < crypto_list_entries; i++) {
 		test(crypto_list[i].name);
+		test_config_id(crypto_list[i].name);
 	}
 
 	return PASS;
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "internals.h"
+#include "threads_common.h"
+#include "defrag.h"
+
+#include "test-common.h"
+
+#define BENCH_BUFS 1024
+#define BENCH_PCKTS 200000
+
+static knet_handle_t knet_h;
+static struct knet_host *host;
+
+static void check_bufs(int line, int expected_in_use)
+{
+	int i, in_use = 0, lru = 0, free_bufs = 0;
+
+	for (i = 0; i < host->allocated_defrag_bufs; i++) {
+		if (host->defrag_bufs[i].in_use) {
+			in_use++;
+			if (_defrag_buf_lookup(host, host->defrag_bufs[i].pckt_seq) != i) {
+				printf("line %d: lookup of seq %u does not return buffer %d\n",
+				       line, host->defrag_bufs[i].pckt_seq, i);
+				exit(FAIL);
+			}
+		}
+	}
+
+	for (i = host->defrag_lru_head; i != KNET_DEFRAG_BUF_NONE; i = host->defrag_bufs[i].lru_next) {
+		lru++;
+	}
+
+	for (i = host->defrag_free_head; i != KNET_DEFRAG_BUF_NONE; i = host->defrag_bufs[i].lru_next) {
+		free_bufs++;
+	}
+
+	if ((in_use != expected_in_use) ||
+	    (host->in_use_defrag_bufs != expected_in_use) ||
+	    (lru != expected_in_use) ||
+	    (free_bufs != host->allocated_defrag_bufs - expected_in_use)) {
+		printf("line %d: expected %d in use, found %d in use (counter: %u) %d in LRU %d free\n",
+		       line, expected_in_use, in_use, host->in_use_defrag_bufs, lru, free_bufs);
+		exit(FAIL);
+	}
+}
+
+static void colliding_seqs(uint32_t slot, int count, seq_num_t *seqs)
+{
+	uint32_t seq;
+	int found = 0;
+
+	for (seq = 0; (seq <= SEQ_MAX) && (found < count); seq++) {
+		if (_defrag_index_hash(host, seq) == slot) {
+			seqs[found] = seq;
+			found++;
+		}
+	}
+
+	if (found < count) {
+		printf("Unable to find %d seq numbers for slot %u\n", count, slot);
+		exit(FAIL);
+	}
+}
+
+static void test(void)
+{
+	int i, idx;
+	seq_num_t seqs[24];
+
+	printf("Test defrag buffers allocation\n");
+
+	if (_defrag_bufs_alloc(host, 32) < 0) {
+		printf("Unable to allocate defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	check_bufs(__LINE__, 0);
+
+	printf("Test filling all buffers\n");
+
+	for (i = 0; i < 32; i++) {
+		if (_defrag_buf_get(knet_h, host, i) < 0) {
+			printf("Unable to get buffer for seq %d: %s\n", i, strerror(errno));
+			exit(FAIL);
+		}
+	}
+
+	check_bufs(__LINE__, 32);
+
+	if ((_defrag_buf_get(knet_h, host, 32) >= 0) || (errno != ENOBUFS)) {
+		printf("Got a buffer with none available\n");
+		exit(FAIL);
+	}
+
+	printf("Test LRU order\n");
+
+	if (host->defrag_bufs[_defrag_buf_oldest(host)].pckt_seq != 0) {
+		printf("Oldest buffer is not seq 0\n");
+		exit(FAIL);
+	}
+
+	_defrag_buf_touch(host, _defrag_buf_lookup(host, 0));
+
+	if (host->defrag_bufs[_defrag_buf_oldest(host)].pckt_seq != 1) {
+		printf("Oldest buffer is not seq 1 after touching seq 0\n");
+		exit(FAIL);
+	}
+
+	printf("Test release\n");
+
+	_defrag_buf_release(knet_h, host, _defrag_buf_oldest(host));
+
+	if (_defrag_buf_lookup(host, 1) >= 0) {
+		printf("seq 1 still found after release\n");
+		exit(FAIL);
+	}
+
+	check_bufs(__LINE__, 31);
+
+	printf("Test colliding seq numbers (index size: %u)\n", host->defrag_index_size);
+
+	_defrag_bufs_reset(knet_h, host);
+	check_bufs(__LINE__, 0);
+
+	/* same home slot */
+	colliding_seqs(5, 16, seqs);
+	/* home slot at the end of the table, index wraps around */
+	colliding_seqs(host->defrag_index_size - 1, 8, seqs + 16);
+
+	for (i = 0; i < 24; i++) {
+		if (_defrag_buf_get(knet_h, host, seqs[i]) < 0) {
+			printf("Unable to get buffer for colliding seq: %s\n", strerror(errno));
+			exit(FAIL);
+		}
+	}
+
+	check_bufs(__LINE__, 24);
+
+	for (i = 0; i < 16; i += 2) {
+		_defrag_buf_release(knet_h, host, _defrag_buf_lookup(host, seqs[i]));
+		check_bufs(__LINE__, 24 - ((i / 2) + 1));
+	}
+	_defrag_buf_release(knet_h, host, _defrag_buf_lookup(host, seqs[16]));
+	check_bufs(__LINE__, 15);
+
+	printf("Test resize\n");
+
+	if (_defrag_bufs_resize(host, 64) < 0) {
+		printf("Unable to grow defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	check_bufs(__LINE__, 15);
+
+	if ((_defrag_bufs_resize(host, 8) >= 0) || (errno != EINVAL)) {
+		printf("Shrinking below in use buffers should fail\n");
+		exit(FAIL);
+	}
+
+	while (host->in_use_defrag_bufs > 8) {
+		_defrag_buf_release(knet_h, host, _defrag_buf_oldest(host));
+	}
+
+	idx = host->defrag_bufs[_defrag_buf_oldest(host)].pckt_seq;
+
+	if (_defrag_bufs_resize(host, 8) < 0) {
+		printf("Unable to shrink defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	check_bufs(__LINE__, 8);
+
+	if (host->defrag_bufs[_defrag_buf_oldest(host)].pckt_seq != idx) {
+		printf("LRU order not preserved by resize\n");
+		exit(FAIL);
+	}
+
+	printf("Test random operations\n");
+
+	if (_defrag_bufs_resize(host, 256) < 0) {
+		printf("Unable to grow defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+	_defrag_bufs_reset(knet_h, host);
+
+	srand(1);
+	for (i = 0; i < 100000; i++) {
+		seq_num_t seq = rand() % 1024;
+
+		idx = _defrag_buf_lookup(host, seq);
+		if (idx >= 0) {
+			if (rand() % 2) {
+				_defrag_buf_release(knet_h, host, idx);
+			} else {
+				_defrag_buf_touch(host, idx);
+			}
+			continue;
+		}
+		if (_defrag_buf_get(knet_h, host, seq) < 0) {
+			_defrag_buf_release(knet_h, host, _defrag_buf_oldest(host));
+			if (_defrag_buf_get(knet_h, host, seq) < 0) {
+				printf("Unable to get buffer after release\n");
+				exit(FAIL);
+			}
+		}
+	}
+
+	check_bufs(__LINE__, host->in_use_defrag_bufs);
+
+	if (knet_h->defrag_pool.chunks_in_use != host->in_use_defrag_bufs) {
+		printf("Pool has %u chunks in use, expected %u\n",
+		       knet_h->defrag_pool.chunks_in_use, host->in_use_defrag_bufs);
+		exit(FAIL);
+	}
+
+	printf("Test pool trim\n");
+
+	_defrag_bufs_free(knet_h, host);
+
+	if (knet_h->defrag_pool.chunks_in_use) {
+		printf("Pool has %u chunks in use after free\n", knet_h->defrag_pool.chunks_in_use);
+		exit(FAIL);
+	}
+
+	_defrag_pool_trim(knet_h);
+
+	if (knet_h->defrag_pool.slabs > 1) {
+		printf("Pool has %u slabs after trim\n", knet_h->defrag_pool.slabs);
+		exit(FAIL);
+	}
+}
+
+/*
+ * force _defrag_bufs_sample to run without waiting the sampling interval
+ */
+static void sample(void)
+{
+	knet_h->defrag_bufs_last_run.tv_sec = 1;
+	knet_h->defrag_bufs_last_run.tv_nsec = 0;
+	_defrag_bufs_sample(knet_h);
+}
+
+static void test_sample(void)
+{
+	int i;
+
+	printf("Test usage sampling\n");
+
+	knet_h->host_head = host;
+	knet_h->defrag_bufs_min = 8;
+	knet_h->defrag_bufs_usage_samples = 4;
+	knet_h->defrag_bufs_usage_samples_timespan = 1;
+	knet_h->defrag_bufs_shrink_threshold = 50;
+	knet_h->defrag_bufs_reclaim_policy = RECLAIM_POLICY_AVERAGE;
+
+	if (_defrag_bufs_alloc(host, 64) < 0) {
+		printf("Unable to allocate defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	for (i = 0; i < 64; i++) {
+		if (_defrag_buf_get(knet_h, host, i) < 0) {
+			printf("Unable to get buffer for seq %d: %s\n", i, strerror(errno));
+			exit(FAIL);
+		}
+	}
+
+	/*
+	 * samples at 100%
+	 */
+	for (i = 0; i < 5; i++) {
+		sample();
+	}
+
+	if (host->defrag_bufs_shrink_pending) {
+		printf("Shrink requested with all buffers in use\n");
+		exit(FAIL);
+	}
+
+	while (host->in_use_defrag_bufs > 8) {
+		_defrag_buf_release(knet_h, host, _defrag_buf_oldest(host));
+	}
+
+	/*
+	 * average drops below 50% only once enough samples at 12% are in
+	 */
+	sample();
+	sample();
+
+	if (host->defrag_bufs_shrink_pending) {
+		printf("Shrink requested with average usage above threshold\n");
+		exit(FAIL);
+	}
+
+	sample();
+
+	if (!host->defrag_bufs_shrink_pending) {
+		printf("Shrink not requested with average usage below threshold\n");
+		exit(FAIL);
+	}
+
+	if (!knet_h->defrag_pool.trim_pending) {
+		printf("Pool trim not requested with %u spare chunks\n",
+		       (knet_h->defrag_pool.slabs * KNET_DEFRAG_SLAB_CHUNKS) - knet_h->defrag_pool.chunks_in_use);
+		exit(FAIL);
+	}
+
+	_defrag_pool_trim(knet_h);
+
+	if (knet_h->defrag_pool.trim_pending) {
+		printf("Pool trim still pending after trim\n");
+		exit(FAIL);
+	}
+
+	printf("Test usage stats reset\n");
+
+	/*
+	 * what _clear_defrag_bufs_stats does from the RX thread
+	 */
+	host->defrag_bufs_shrink_pending = 0;
+	host->in_use_defrag_buffers_reset = 1;
+
+	sample();
+
+	if ((host->in_use_defrag_buffers_samples != 1) ||
+	    (host->in_use_defrag_buffers_index != 1) ||
+	    (host->in_use_defrag_buffers[0] != 12) ||
+	    (host->in_use_defrag_buffers[1] != 0)) {
+		printf("Samples not reset\n");
+		exit(FAIL);
+	}
+
+	_defrag_bufs_free(knet_h, host);
+	knet_h->host_head = NULL;
+}
+
+/*
+ * old implementation: linear scans for seq_num, free buffer and oldest
+ */
+static int linear_find(seq_num_t seq_num, uint64_t *last_update, uint64_t now)
+{
+	int i, oldest = 0;
+
+	for (i = 0; i < host->allocated_defrag_bufs; i++) {
+		if ((host->defrag_bufs[i].in_use) && (host->defrag_bufs[i].pckt_seq == seq_num)) {
+			last_update[i] = now;
+			return i;
+		}
+	}
+
+	for (i = 0; i < host->allocated_defrag_bufs; i++) {
+		if (!host->defrag_bufs[i].in_use) {
+			goto found;
+		}
+	}
+
+	for (i = 0; i < host->allocated_defrag_bufs; i++) {
+		if (last_update[i] < last_update[oldest]) {
+			oldest = i;
+		}
+	}
+	i = oldest;
+
+found:
+	host->defrag_bufs[i].in_use = 1;
+	host->defrag_bufs[i].pckt_seq = seq_num;
+	last_update[i] = now;
+	return i;
+}
+
+static int index_find(seq_num_t seq_num)
+{
+	int idx;
+
+	idx = _defrag_buf_lookup(host, seq_num);
+	if (idx >= 0) {
+		_defrag_buf_touch(host, idx);
+		return idx;
+	}
+
+	idx = _defrag_buf_get(knet_h, host, seq_num);
+	if (idx >= 0) {
+		return idx;
+	}
+
+	_defrag_buf_release(knet_h, host, _defrag_buf_oldest(host));
+	return _defrag_buf_get(knet_h, host, seq_num);
+}
+
+/*
+ * lossy traffic: all buffers are in use with incomplete packets,
+ * each new packet has 2 fragments and needs to reclaim a buffer
+ */
+static void bench(void)
+{
+	struct timespec start, end;
+	unsigned long long linear_time, index_time;
+	uint64_t *last_update;
+	int i;
+
+	printf("Benchmark defrag buffer lookup with %d buffers and %d packets\n", BENCH_BUFS, BENCH_PCKTS);
+
+	if (_defrag_bufs_alloc(host, BENCH_BUFS) < 0) {
+		printf("Unable to allocate defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	last_update = calloc(BENCH_BUFS, sizeof(uint64_t));
+	if (!last_update) {
+		printf("Unable to allocate memory\n");
+		exit(FAIL);
+	}
+
+	for (i = 0; i < BENCH_BUFS; i++) {
+		linear_find(i, last_update, i);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = BENCH_BUFS; i < BENCH_BUFS + BENCH_PCKTS; i++) {
+		linear_find(i, last_update, i);
+		linear_find(i, last_update, i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespec_diff(start, end, &linear_time);
+
+	_defrag_bufs_reset(knet_h, host);
+
+	for (i = 0; i < BENCH_BUFS; i++) {
+		index_find(i);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = BENCH_BUFS; i < BENCH_BUFS + BENCH_PCKTS; i++) {
+		index_find(i);
+		index_find(i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespec_diff(start, end, &index_time);
+
+	check_bufs(__LINE__, BENCH_BUFS);
+
+	printf("linear scan: %llu ns/fragment\n", linear_time / (BENCH_PCKTS * 2));
+	printf("hash index:  %llu ns/fragment\n", index_time / (BENCH_PCKTS * 2));
+
+	free(last_update);
+	_defrag_bufs_free(knet_h, host);
+}
+
+int main(int argc, char *argv[])
+{
+	if (posix_memalign((void **)&knet_h, KNET_CACHE_LINE_SIZE, sizeof(struct knet_handle))) {
+		printf("Unable to allocate memory\n");
+		return FAIL;
+	}
+	memset(knet_h, 0, sizeof(struct knet_handle));
+
+	host = calloc(1, sizeof(struct knet_host));
+	if (!host) {
+		printf("Unable to allocate memory\n");
+		return FAIL;
+	}
+
+	test();
+	test_sample();
+	bench();
+
+	_defrag_pool_destroy(knet_h);
+	free(host);
+	free(knet_h);
+
+	return PASS;
+}
@@ -16,6 +16,8 @@
 #include <string.h>
 #include <netdb.h>
 #include <errno.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include "internals.h"
 #include "links_acl.h"
@@ -336,6 +338,254 @@ int test(void)
 	return PASS;
 }
 
+/*
+ * random access lists, checked against a plain walk of the same
+ * rules. The walk is also the reference for the lookup speed.
+ */
+
+#define RANDOM_RULES 1000
+#define RANDOM_CHECKS 200000
+#define RANDOM_BITS 20
+
+struct test_rule {
+	check_type_t type;
+	check_acceptreject_t acceptreject;
+	struct sockaddr_storage addr1;
+	struct sockaddr_storage addr2;
+};
+
+static struct test_rule random_rules[RANDOM_RULES];
+static int random_rules_count;
+
+static uint8_t *addr_bytes(struct sockaddr_storage *ss, size_t *len)
+{
+	if (ss->ss_family == AF_INET) {
+		*len = sizeof(struct in_addr);
+		return (uint8_t *)&((struct sockaddr_in *)ss)->sin_addr;
+	}
+	*len = sizeof(struct in6_addr);
+	return (uint8_t *)&((struct sockaddr_in6 *)ss)->sin6_addr;
+}
+
+/*
+ * 10.x.y.z or 2001:db8::x:yz, with the lowest RANDOM_BITS random
+ */
+static void random_addr(int family, struct sockaddr_storage *ss)
+{
+	uint32_t bits = random() & ((1 << RANDOM_BITS) - 1);
+	uint8_t *addr;
+	size_t len;
+
+	memset(ss, 0, sizeof(struct sockaddr_storage));
+	ss->ss_family = family;
+	addr = addr_bytes(ss, &len);
+	if (family == AF_INET) {
+		addr[0] = 10;
+	} else {
+		addr[0] = 0x20;
+		addr[1] = 0x01;
+		addr[2] = 0x0d;
+		addr[3] = 0xb8;
+	}
+	addr[len - 3] = bits >> 16;
+	addr[len - 2] = bits >> 8;
+	addr[len - 1] = bits;
+}
+
+static void random_rule(int family, struct test_rule *rule)
+{
+	uint8_t *addr1, *addr2;
+	size_t len, i;
+	int prefix;
+
+	rule->acceptreject = (random() & 1) ? CHECK_ACCEPT : CHECK_REJECT;
+	random_addr(family, &rule->addr1);
+	memset(&rule->addr2, 0, sizeof(struct sockaddr_storage));
+	rule->addr2.ss_family = family;
+	addr1 = addr_bytes(&rule->addr1, &len);
+	addr2 = addr_bytes(&rule->addr2, &len);
+
+	switch (random() % 3) {
+		case 0:
+			rule->type = CHECK_TYPE_ADDRESS;
+			break;
+		case 1:
+			rule->type = CHECK_TYPE_MASK;
+			if (random() % 10) {
+				prefix = (len * 8) - (random() % RANDOM_BITS);
+				for (i = 0; i < len; i++) {
+					if (prefix >= 8) {
+						addr2[i] = 0xff;
+					} else if (prefix > 0) {
+						addr2[i] = 0xff << (8 - prefix);
+					}
+					prefix -= 8;
+				}
+			} else {
+				/*
+				 * mask with holes
+				 */
+				memset(addr2, 0xff, len);
+				addr2[len - 1] = random();
+				addr2[len - 2] = random();
+			}
+			/*
+			 * a few masks that never match
+			 */
+			if (random() % 20) {
+				for (i = 0; i < len; i++) {
+					addr1[i] &= addr2[i];
+				}
+			}
+			break;
+		case 2:
+			rule->type = CHECK_TYPE_RANGE;
+			memmove(addr2, addr1, len);
+			i = (random() % 4096) + addr2[len - 1] + (addr2[len - 2] << 8);
+			addr2[len - 1] = i;
+			addr2[len - 2] = i >> 8;
+			if (i > 0xffff) {
+				addr2[len - 3]++;
+			}
+			/*
+			 * a few ranges that never match
+			 */
+			if (!(random() % 20)) {
+				memmove(addr2, addr1, len);
+				addr1[len - 1]++;
+				addr1[len - 2]++;
+			}
+			break;
+	}
+}
+
+static int list_validate(struct sockaddr_storage *checkip)
+{
+	uint8_t *ip, *addr1, *addr2;
+	size_t len, i;
+	int r, match;
+
+	ip = addr_bytes(checkip, &len);
+	for (r = 0; r < random_rules_count; r++) {
+		addr1 = addr_bytes(&random_rules[r].addr1, &len);
+		addr2 = addr_bytes(&random_rules[r].addr2, &len);
+		switch (random_rules[r].type) {
+			case CHECK_TYPE_ADDRESS:
+				match = !memcmp(ip, addr1, len);
+				break;
+			case CHECK_TYPE_MASK:
+				match = 1;
+				for (i = 0; i < len; i++) {
+					if ((ip[i] & addr2[i]) != addr1[i]) {
+						match = 0;
+						break;
+					}
+				}
+				break;
+			case CHECK_TYPE_RANGE:
+				match = ((memcmp(ip, addr1, len) >= 0) && (memcmp(ip, addr2, len) <= 0));
+				break;
+			default:
+				match = 0;
+				break;
+		}
+		if (match) {
+			return random_rules[r].acceptreject == CHECK_ACCEPT;
+		}
+	}
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int random_test(int family)
+{
+	struct acl_match_entry *match_entry = NULL;
+	struct test_rule rule;
+	struct sockaddr_storage saddr;
+	uint64_t start, trie_ns = 0, list_ns = 0;
+	int i, r, trie_res, list_res;
+
+	printf("Testing %d random %s rules\n", RANDOM_RULES, family == AF_INET ? "IPv4" : "IPv6");
+
+	random_rules_count = 0;
+
+	/*
+	 * append most rules, insert the others at the top
+	 * and remove a few to rebuild the lookup tables
+	 */
+	for (i = 0; i < RANDOM_RULES; i++) {
+		random_rule(family, &rule);
+		if (i < RANDOM_RULES - (RANDOM_RULES / 10)) {
+			if (ipcheck_addip(&match_entry, -1, &rule.addr1, &rule.addr2, rule.type, rule.acceptreject) < 0) {
+				if (errno == EEXIST) {
+					continue;
+				}
+				fprintf(stderr, "Unable to append rule %d: %s\n", i, strerror(errno));
+				return FAIL;
+			}
+			random_rules[random_rules_count++] = rule;
+		} else {
+			if (ipcheck_addip(&match_entry, 0, &rule.addr1, &rule.addr2, rule.type, rule.acceptreject) < 0) {
+				if (errno == EEXIST) {
+					continue;
+				}
+				fprintf(stderr, "Unable to insert rule %d: %s\n", i, strerror(errno));
+				return FAIL;
+			}
+			memmove(&random_rules[1], &random_rules[0], sizeof(struct test_rule) * random_rules_count);
+			random_rules[0] = rule;
+			random_rules_count++;
+		}
+	}
+
+	for (i = 0; i < RANDOM_RULES / 20; i++) {
+		r = random() % random_rules_count;
+		if (ipcheck_rmip(&match_entry, &random_rules[r].addr1, &random_rules[r].addr2,
+				 random_rules[r].type, random_rules[r].acceptreject) < 0) {
+			fprintf(stderr, "Unable to remove rule %d: %s\n", r, strerror(errno));
+			return FAIL;
+		}
+		random_rules_count--;
+		memmove(&random_rules[r], &random_rules[r + 1], sizeof(struct test_rule) * (random_rules_count - r));
+	}
+
+	for (i = 0; i < RANDOM_CHECKS; i++) {
+		random_addr(family, &saddr);
+
+		start = now_ns();
+		trie_res = ipcheck_validate(&match_entry, &saddr);
+		trie_ns += now_ns() - start;
+
+		start = now_ns();
+		list_res = list_validate(&saddr);
+		list_ns += now_ns() - start;
+
+		if (trie_res != list_res) {
+			fprintf(stderr, "Access list returned %d, list walk %d for check %d\n", trie_res, list_res, i);
+			ipcheck_rmall(&match_entry);
+			return FAIL;
+		}
+	}
+
+	printf("%d rules: %" PRIu64 " ns per lookup (list walk: %" PRIu64 " ns)\n",
+	       random_rules_count, trie_ns / RANDOM_CHECKS, list_ns / RANDOM_CHECKS);
+
+	ipcheck_rmall(&match_entry);
+	if (match_entry) {
+		fprintf(stderr, "ipcheck_rmall did not release the access list\n");
+		return FAIL;
+	}
+
+	return PASS;
+}
+
 int main(int argc, char *argv[])
 {
 	struct sockaddr_storage saddr;
@@ -376,6 +626,12 @@ int main(int argc, char *argv[])
 		 * run automatic tests
 		 */
 		ret = test();
+		if (ret == PASS) {
+			ret = random_test(AF_INET);
+		}
+		if (ret == PASS) {
+			ret = random_test(AF_INET6);
+		}
 	}
 
 	/*
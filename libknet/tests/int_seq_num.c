@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under GPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "internals.h"
+#include "threads_common.h"
+#include "defrag.h"
+#include "host.h"
+
+#include "test-common.h"
+
+#define CHECK_PCKTS 1000000
+#define RECLAIM_PCKTS 200000
+#define DEFRAG_BUFS 32
+#define BENCH_HOSTS 4096
+#define BENCH_ROUNDS 1024
+#define BENCH_LOSS_EVERY 64	/* rounds */
+#define BENCH_LOSS_SEQS 2048
+
+static knet_handle_t knet_h;
+
+/*
+ * old implementation: one byte per seq_num, all defrag buffers
+ * are checked for expiry on each lookup
+ */
+struct ref_window {
+	char circular_buffer[KNET_CBUFFER_SIZE];
+	char circular_buffer_defrag[KNET_CBUFFER_SIZE];
+	seq_num_t rx_seq_num;
+	seq_num_t defrag_seqs[DEFRAG_BUFS];
+	uint8_t defrag_in_use[DEFRAG_BUFS];
+	int in_use_defrag_bufs;
+};
+
+static void ref_reclaim(struct ref_window *ref, seq_num_t seq_num)
+{
+	seq_num_t head, tail;
+	seq_num_t pckt_seq;
+	int i;
+
+	head = seq_num + 1;
+	tail = seq_num - (knet_h->defrag_bufs_max + 1);
+
+	for (i = 0; i < DEFRAG_BUFS; i++) {
+		if (!ref->defrag_in_use[i]) {
+			continue;
+		}
+		pckt_seq = ref->defrag_seqs[i];
+		if (((tail > head) && (pckt_seq >= head) && (pckt_seq <= tail)) ||
+		    ((tail <= head) && ((pckt_seq >= head) || (pckt_seq <= tail)))) {
+			ref->defrag_in_use[i] = 0;
+			ref->in_use_defrag_bufs--;
+		}
+	}
+}
+
+static int ref_lookup(struct ref_window *ref, seq_num_t seq_num, int defrag_buf)
+{
+	size_t head, tail;
+	seq_num_t seq_dist;
+	char *dst_cbuf = ref->circular_buffer;
+	char *dst_cbuf_defrag = ref->circular_buffer_defrag;
+	seq_num_t *dst_seq_num = &ref->rx_seq_num;
+
+	if (!*dst_seq_num) {
+		*dst_seq_num = seq_num;
+	}
+
+	if (ref->in_use_defrag_bufs) {
+		ref_reclaim(ref, *dst_seq_num);
+	}
+
+	if (seq_num < *dst_seq_num) {
+		seq_dist =  (SEQ_MAX - seq_num) + *dst_seq_num;
+	} else {
+		seq_dist = *dst_seq_num - seq_num;
+	}
+
+	head = seq_num % KNET_CBUFFER_SIZE;
+
+	if (seq_dist < KNET_CBUFFER_SIZE) {
+		if (!defrag_buf) {
+			return (dst_cbuf[head] == 0) ? 1 : 0;
+		} else {
+			return (dst_cbuf_defrag[head] == 0) ? 1 : 0;
+		}
+	} else if (seq_dist <= SEQ_MAX - KNET_CBUFFER_SIZE) {
+		memset(dst_cbuf, 0, KNET_CBUFFER_SIZE);
+		memset(dst_cbuf_defrag, 0, KNET_CBUFFER_SIZE);
+		*dst_seq_num = seq_num;
+	}
+
+	tail = (*dst_seq_num + 1) % KNET_CBUFFER_SIZE;
+
+	if (tail > head) {
+		memset(dst_cbuf + tail, 0, KNET_CBUFFER_SIZE - tail);
+		memset(dst_cbuf, 0, head + 1);
+		memset(dst_cbuf_defrag + tail, 0, KNET_CBUFFER_SIZE - tail);
+		memset(dst_cbuf_defrag, 0, head + 1);
+	} else {
+		memset(dst_cbuf + tail, 0, head - tail + 1);
+		memset(dst_cbuf_defrag + tail, 0, head - tail + 1);
+	}
+
+	*dst_seq_num = seq_num;
+
+	return 1;
+}
+
+static void ref_set(struct ref_window *ref, seq_num_t seq_num, int defrag_buf)
+{
+	if (!defrag_buf) {
+		ref->circular_buffer[seq_num % KNET_CBUFFER_SIZE] = 1;
+	} else {
+		ref->circular_buffer_defrag[seq_num % KNET_CBUFFER_SIZE] = 1;
+	}
+}
+
+static struct knet_host *host_new(void)
+{
+	struct knet_host *host;
+
+	host = calloc(1, sizeof(struct knet_host));
+	if (!host) {
+		printf("Unable to allocate memory\n");
+		exit(FAIL);
+	}
+
+	if (_defrag_bufs_alloc(host, knet_h->defrag_bufs_max) < 0) {
+		printf("Unable to allocate defrag buffers: %s\n", strerror(errno));
+		exit(FAIL);
+	}
+
+	return host;
+}
+
+static void host_free(struct knet_host *host)
+{
+	_defrag_bufs_free(knet_h, host);
+	free(host);
+}
+
+/*
+ * random stream with reordering, duplicates, losses and seq_num wrap around
+ */
+static void test(void)
+{
+	struct knet_host *host;
+	struct ref_window *ref;
+	seq_num_t seq_num = 1;
+	int i, defrag_buf, res, ref_res;
+
+	printf("Test bitset windows against byte windows\n");
+
+	host = host_new();
+	ref = calloc(1, sizeof(struct ref_window));
+	if (!ref) {
+		printf("Unable to allocate memory\n");
+		exit(FAIL);
+	}
+
+	srand(1);
+	for (i = 0; i < CHECK_PCKTS; i++) {
+		switch (rand() % 16) {
+			case 0:
+				seq_num += rand() % (KNET_CBUFFER_SIZE * 4);
+				break;
+			case 1:
+			case 2:
+				seq_num -= rand() % (KNET_CBUFFER_SIZE + 64);
+				break;
+			default:
+				seq_num += rand() % 64;
+				break;
+		}
+
+		defrag_buf = rand() % 2;
+
+		res = _seq_num_lookup(knet_h, host, seq_num, defrag_buf, 0);
+		ref_res = ref_lookup(ref, seq_num, defrag_buf);
+
+		if ((res != ref_res) || (host->rx_seq_num != ref->rx_seq_num)) {
+			printf("packet %d seq %u defrag %d: lookup returned %d (rx_seq_num %u), expected %d (rx_seq_num %u)\n",
+			       i, seq_num, defrag_buf, res, host->rx_seq_num, ref_res, ref->rx_seq_num);
+			exit(FAIL);
+		}
+
+		if ((res) && (rand() % 4)) {
+			_seq_num_set(host, seq_num, defrag_buf);
+			ref_set(ref, seq_num, defrag_buf);
+		}
+	}
+
+	free(ref);
+	host_free(host);
+}
+
+static void check_defrag_bufs(int pckt, struct knet_host *host, struct ref_window *ref)
+{
+	int i;
+
+	if (host->in_use_defrag_bufs != ref->in_use_defrag_bufs) {
+		printf("packet %d: %u defrag buffers in use, expected %d\n",
+		       pckt, host->in_use_defrag_bufs, ref->in_use_defrag_bufs);
+		exit(FAIL);
+	}
+
+	for (i = 0; i < DEFRAG_BUFS; i++) {
+		if ((ref->defrag_in_use[i]) && (_defrag_buf_lookup(host, ref->defrag_seqs[i]) < 0)) {
+			printf("packet %d: defrag buffer for seq %u has been released\n",
+			       pckt, ref->defrag_seqs[i]);
+			exit(FAIL);
+		}
+	}
+}
+
+/*
+ * defrag buffers are created for new seq_num and completed at random,
+ * expiry has to release the same buffers as a full scan on each lookup
+ */
+static void test_reclaim(void)
+{
+	struct knet_host *host;
+	struct ref_window *ref;
+	seq_num_t seq_num = 1;
+	int i, x, res, ref_res;
+
+	printf("Test defrag buffers expiry against full scan\n");
+
+	host = host_new();
+	ref = calloc(1, sizeof(struct ref_window));
+	if (!ref) {
+		printf("Unable to allocate memory\n");
+		exit(FAIL);
+	}
+
+	srand(2);
+	for (i = 0; i < RECLAIM_PCKTS; i++) {
+		switch (rand() % 32) {
+			case 0:
+				seq_num += rand() % (KNET_CBUFFER_SIZE * 4);
+				break;
+			case 1:
+			case 2:
+			case 3:
+				seq_num -= rand() % (DEFRAG_BUFS * 2);
+				break;
+			default:
+				seq_num += rand() % 4;
+				break;
+		}
+
+		res = _seq_num_lookup(knet_h, host, seq_num, 1, 0);
+		ref_res = ref_lookup(ref, seq_num, 1);
+
+		if (res != ref_res) {
+			printf("packet %d seq %u: lookup returned %d, expected %d\n", i, seq_num, res, ref_res);
+			exit(FAIL);
+		}
+
+		check_defrag_bufs(i, host, ref);
+
+		if ((!res) || (_defrag_buf_lookup(host, seq_num) >= 0)) {
+			continue;
+		}
+
+		/*
+		 * complete a packet
+		 */
+		if ((ref->in_use_defrag_bufs) && ((rand() % 32) == 0)) {
+			x = rand() % DEFRAG_BUFS;
+			while (!ref->defrag_in_use[x]) {
+				x = (x + 1) % DEFRAG_BUFS;
+			}
+			_defrag_buf_release(knet_h, host, _defrag_buf_lookup(host, ref->defrag_seqs[x]));
+			ref->defrag_in_use[x] = 0;
+			ref->in_use_defrag_bufs--;
+			_seq_num_set(host, ref->defrag_seqs[x], 1);
+			ref_set(ref, ref->defrag_seqs[x], 1);
+		}
+
+		/*
+		 * most packets are not fragmented
+		 */
+		if ((ref->in_use_defrag_bufs == DEFRAG_BUFS) || (rand() % 8)) {
+			continue;
+		}
+
+		if (_defrag_buf_get(knet_h, host, seq_num) < 0) {
+			printf("Unable to get buffer for seq %u: %s\n", seq_num, strerror(errno));
+			exit(FAIL);
+		}
+		for (x = 0; ref->defrag_in_use[x]; x++);
+		ref->defrag_seqs[x] = seq_num;
+		ref->defrag_in_use[x] = 1;
+		ref->in_use_defrag_bufs++;
+	}
+
+	free(ref);
+	host_free(host);
+}
+
+/*
+ * all hosts send a packet in turn, with a burst of losses every
+ * BENCH_LOSS_EVERY rounds that moves the windows forward
+ */
+static void bench(void)
+{
+	struct knet_host **hosts;
+	struct ref_window *refs;
+	struct timespec start, end;
+	unsigned long long ref_time, bitset_time;
+	seq_num_t seq_num;
+	int h, r;
+
+	printf("Benchmark seq_num lookup with %d hosts and %d packets per host\n", BENCH_HOSTS, BENCH_ROUNDS);
+
+	hosts = calloc(BENCH_HOSTS, sizeof(struct knet_host *));
+	refs = calloc(BENCH_HOSTS, sizeof(struct ref_window));
+	if ((!hosts) || (!refs)) {
+		printf("Unable to allocate memory\n");
+		exit(FAIL);
+	}
+
+	for (h = 0; h < BENCH_HOSTS; h++) {
+		hosts[h] = host_new();
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0, seq_num = 1; r < BENCH_ROUNDS; r++, seq_num++) {
+		if ((r % BENCH_LOSS_EVERY) == 0) {
+			seq_num += BENCH_LOSS_SEQS;
+		}
+		for (h = 0; h < BENCH_HOSTS; h++) {
+			if (ref_lookup(&refs[h], seq_num, 0)) {
+				ref_set(&refs[h], seq_num, 0);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespec_diff(start, end, &ref_time);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0, seq_num = 1; r < BENCH_ROUNDS; r++, seq_num++) {
+		if ((r % BENCH_LOSS_EVERY) == 0) {
+			seq_num += BENCH_LOSS_SEQS;
+		}
+		for (h = 0; h < BENCH_HOSTS; h++) {
+			if (_seq_num_lookup(knet_h, hosts[h], seq_num, 0, 0)) {
+				_seq_num_set(hosts[h], seq_num, 0);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespec_diff(start, end, &bitset_time);
+
+	for (h = 0; h < BENCH_HOSTS; h++) {
+		if (hosts[h]->rx_seq_num != refs[h].rx_seq_num) {
+			printf("host %d: rx_seq_num %u, expected %u\n", h, hosts[h]->rx_seq_num, refs[h].rx_seq_num);
+			exit(FAIL);
+		}
+	}
+
+	printf("byte windows:   %zu bytes/host %llu ns/packet\n",
+	       sizeof(refs[0].circular_buffer) + sizeof(refs[0].circular_buffer_defrag),
+	       ref_time / ((unsigned long long)BENCH_HOSTS * BENCH_ROUNDS));
+	printf("bitset windows: %zu bytes/host %llu ns/packet\n",
+	       sizeof(hosts[0]->circular_buffer) + sizeof(hosts[0]->circular_buffer_defrag),
+	       bitset_time / ((unsigned long long)BENCH_HOSTS * BENCH_ROUNDS));
+
+	for (h = 0; h < BENCH_HOSTS; h++) {
+		host_free(hosts[h]);
+	}
+	free(hosts);
+	free(refs);
+}
+
+int main(int argc, char *argv[])
+{
+	if (posix_memalign((void **)&knet_h, KNET_CACHE_LINE_SIZE, sizeof(struct knet_handle))) {
+		printf("Unable to allocate memory\n");
+		return FAIL;
+	}
+	memset(knet_h, 0, sizeof(struct knet_handle));
+
+	knet_h->defrag_bufs_max = DEFRAG_BUFS;
+
+	test();
+	test_reclaim();
+	bench();
+
+	_defrag_pool_destroy(knet_h);
+	free(knet_h);
+
+	return PASS;
+}
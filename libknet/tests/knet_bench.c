@@ -47,6 +47,7 @@ static char *cryptocfg = NULL;
 static int machine_output = 0;
 static int use_access_lists = 0;
 static int use_pckt_verification = 0;
+static uint64_t link_flags = 0;
 
 static int bench_shutdown_in_progress = 0;
 static pthread_mutex_t shutdown_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -69,6 +70,12 @@ static uint64_t perf_by_time_secs = 10;
 
 static uint32_t force_packet_size = 0;
 
+#define IO_DATAFD 0
+#define IO_KNET_SEND 1
+#define IO_KNET_MMSG 2
+
+static int io_mode = IO_DATAFD;
+
 struct node {
 	int nodeid;
 	int links;
@@ -123,6 +130,13 @@ static void print_help(void)
 	printf("                                           3: show detailed link stats\n");
 	printf(" -a                                        enable machine parsable output (default: off).\n");
 	printf(" -v                                        enable packet verification for performance tests (default: off).\n");
+	printf(" -G                                        enable UDP segmentation offload on UDP links (default: off).\n");
+	printf(" -R                                        enable UDP receive offload on UDP links (default: off).\n");
+	printf(" -Z                                        enable MSG_ZEROCOPY for large packets on UDP links (default: off).\n");
+	printf(" -M [datafd|send|mmsg]                     how performance tests move data to/from knet (default: datafd)\n");
+	printf("                                           datafd: sendmmsg/recvmmsg directly on the datafd\n");
+	printf("                                           send: knet_send/knet_recv, one packet per call\n");
+	printf("                                           mmsg: knet_sendmmsg/knet_recvmmsg\n");
 }
 
 static void parse_nodes(char *nodesinfo[MAX_NODES], int onidx, int port, struct node nodes[MAX_NODES], int *thisidx)
@@ -259,7 +273,7 @@ static void setup_knet(int argc, char *argv[])
 
 	memset(nodes, 0, sizeof(nodes));
 
-	while ((rv = getopt(argc, argv, "aCT:S:s:lvdfom:wb:t:n:c:p:x:X::P:z:h")) != EOF) {
+	while ((rv = getopt(argc, argv, "aCT:S:s:lvGRZM:dfom:wb:t:n:c:p:x:X::P:z:h")) != EOF) {
 		switch(rv) {
 			case 'h':
 				print_help();
@@ -425,6 +439,27 @@ static void setup_knet(int argc, char *argv[])
 			case 'v':
 				use_pckt_verification = 1;
 				break;
+			case 'G':
+				link_flags |= KNET_LINK_FLAG_UDP_GSO;
+				break;
+			case 'R':
+				link_flags |= KNET_LINK_FLAG_UDP_GRO;
+				break;
+			case 'Z':
+				link_flags |= KNET_LINK_FLAG_ZEROCOPY;
+				break;
+			case 'M':
+				if (!strcmp("datafd", optarg)) {
+					io_mode = IO_DATAFD;
+				} else if (!strcmp("send", optarg)) {
+					io_mode = IO_KNET_SEND;
+				} else if (!strcmp("mmsg", optarg)) {
+					io_mode = IO_KNET_MMSG;
+				} else {
+					printf("Unknown io mode: %s\n", optarg);
+					exit(FAIL);
+				}
+				break;
 			case 'C':
 				continous = 1;
 				break;
@@ -614,7 +649,7 @@ static void setup_knet(int argc, char *argv[])
 			}
 			if (knet_link_set_config(knet_h, nodes[i].nodeid, link_idx,
 						 nodes[i].transport[link_idx], src,
-						 &nodes[i].address[link_idx], 0) < 0) {
+						 &nodes[i].address[link_idx], link_flags) < 0) {
 				printf("Unable to configure link: %s\n", strerror(errno));
 				exit(FAIL);
 			}
@@ -676,6 +711,84 @@ static void setup_knet(int argc, char *argv[])
 	}
 }
 
+/*
+ * wrappers to move data with the datafd or with the knet API,
+ * both return the same values as recvmmsg/sendmmsg
+ */
+static int bench_recvmmsg(struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	struct knet_msg knet_msg[PCKT_FRAG_MAX];
+	unsigned int i;
+	ssize_t len;
+	int res;
+
+	switch (io_mode) {
+		case IO_KNET_SEND:
+			for (i = 0; i < vlen; i++) {
+				len = knet_recv(knet_h, msg[i].msg_hdr.msg_iov->iov_base, msg[i].msg_hdr.msg_iov->iov_len, channel);
+				if (len < 0) {
+					break;
+				}
+				msg[i].msg_len = len;
+			}
+			if (i > 0) {
+				errno = 0;
+				return i;
+			}
+			return -1;
+		case IO_KNET_MMSG:
+			for (i = 0; i < vlen; i++) {
+				knet_msg[i].buff = msg[i].msg_hdr.msg_iov->iov_base;
+				knet_msg[i].buff_len = msg[i].msg_hdr.msg_iov->iov_len;
+				knet_msg[i].channel = channel;
+			}
+			res = knet_recvmmsg(knet_h, knet_msg, vlen);
+			for (i = 0; (int)i < res; i++) {
+				msg[i].msg_len = knet_msg[i].msg_len;
+			}
+			return res;
+		default:
+			return _recvmmsg(datafd, msg, vlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+}
+
+static int bench_sendmmsg(struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	struct knet_msg knet_msg[PCKT_FRAG_MAX];
+	unsigned int i;
+	ssize_t len;
+	int res;
+
+	switch (io_mode) {
+		case IO_KNET_SEND:
+			for (i = 0; i < vlen; i++) {
+				len = knet_send(knet_h, msg[i].msg_hdr.msg_iov->iov_base, msg[i].msg_hdr.msg_iov->iov_len, channel);
+				if (len < 0) {
+					break;
+				}
+				msg[i].msg_len = len;
+			}
+			if (i > 0) {
+				errno = 0;
+				return i;
+			}
+			return -1;
+		case IO_KNET_MMSG:
+			for (i = 0; i < vlen; i++) {
+				knet_msg[i].buff = msg[i].msg_hdr.msg_iov->iov_base;
+				knet_msg[i].buff_len = msg[i].msg_hdr.msg_iov->iov_len;
+				knet_msg[i].channel = channel;
+			}
+			res = knet_sendmmsg(knet_h, knet_msg, vlen);
+			for (i = 0; (int)i < res; i++) {
+				msg[i].msg_len = knet_msg[i].msg_len;
+			}
+			return res;
+		default:
+			return _sendmmsg(datafd, 0, msg, vlen, MSG_NOSIGNAL);
+	}
+}
+
 static void *_rx_thread(void *args)
 {
 	int rx_epoll;
@@ -728,7 +841,7 @@ static void *_rx_thread(void *args)
 
 	while (!bench_shutdown_in_progress) {
 		if (epoll_wait(rx_epoll, events, KNET_EPOLL_MAX_EVENTS, 1) >= 1) {
-			msg_recv = _recvmmsg(datafd, &msg[0], PCKT_FRAG_MAX, MSG_DONTWAIT | MSG_NOSIGNAL);
+			msg_recv = bench_recvmmsg(&msg[0], PCKT_FRAG_MAX);
 			if (msg_recv < 0) {
 				printf("[info]: RXT: error from recvmmsg: %s\n", strerror(errno));
 			}
@@ -879,7 +992,7 @@ static int send_messages(struct knet_mmsghdr *msg, int msgs_to_send)
 
 retry:
 	errno = 0;
-	sent_msgs = _sendmmsg(datafd, 0, &msg[0], msgs_to_send, MSG_NOSIGNAL);
+	sent_msgs = bench_sendmmsg(&msg[0], msgs_to_send);
 
 	if (sent_msgs < 0) {
 		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
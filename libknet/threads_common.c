@@ -81,7 +81,22 @@ static struct pretty_names thread_names[KNET_THREAD_MAX] =
 	{ "SCTP_LISTEN", KNET_THREAD_SCTP_LISTEN },
 	{ "SCTP_CONN", KNET_THREAD_SCTP_CONN },
 #endif
-	{ "DST_LINK", KNET_THREAD_DST_LINK }
+	{ "DST_LINK", KNET_THREAD_DST_LINK },
+	{ "TX1", KNET_THREAD_TX_POOL + 0 },
+	{ "TX2", KNET_THREAD_TX_POOL + 1 },
+	{ "TX3", KNET_THREAD_TX_POOL + 2 },
+	{ "TX4", KNET_THREAD_TX_POOL + 3 },
+	{ "TX5", KNET_THREAD_TX_POOL + 4 },
+	{ "TX6", KNET_THREAD_TX_POOL + 5 },
+	{ "TX7", KNET_THREAD_TX_POOL + 6 },
+	{ "TX8", KNET_THREAD_TX_POOL + 7 },
+	{ "TX9", KNET_THREAD_TX_POOL + 8 },
+	{ "TX10", KNET_THREAD_TX_POOL + 9 },
+	{ "TX11", KNET_THREAD_TX_POOL + 10 },
+	{ "TX12", KNET_THREAD_TX_POOL + 11 },
+	{ "TX13", KNET_THREAD_TX_POOL + 12 },
+	{ "TX14", KNET_THREAD_TX_POOL + 13 },
+	{ "TX15", KNET_THREAD_TX_POOL + 14 }
 };
 
 static struct pretty_names thread_status[] =
@@ -381,3 +396,92 @@ uint32_t compute_chksumv(const struct iovec *iov_in, int iovcnt_in)
 
 	return crc;
 }
+
+/*
+ * caller must hold global_rwlock in write mode
+ */
+void clear_handle_stats(knet_handle_t knet_h)
+{
+	struct knet_handle_stats_shard *shard;
+	int i;
+
+	memset(knet_h->stats_shards, 0, sizeof(knet_h->stats_shards));
+	memset(&knet_h->stats_extra, 0, sizeof(struct knet_handle_stats_extra));
+
+	for (i = 0; i < KNET_THREAD_MAX; i++) {
+		shard = &knet_h->stats_shards[i];
+		shard->tx_compress_time_min = UINT64_MAX;
+		shard->rx_compress_time_min = UINT64_MAX;
+		shard->tx_crypt_time_min = UINT64_MAX;
+		shard->rx_crypt_time_min = UINT64_MAX;
+	}
+}
+
+#define stats_min(a, b) ((a) < (b) ? (a) : (b))
+#define stats_max(a, b) ((a) > (b) ? (a) : (b))
+
+/*
+ * shards are updated without locks, each value is consistent
+ * but the aggregate is only a snapshot
+ */
+void get_handle_stats(knet_handle_t knet_h, struct knet_handle_stats *stats)
+{
+	struct knet_handle_stats_shard *shard;
+	uint64_t tx_compress_time_total = 0, tx_compress_time_samples = 0;
+	uint64_t rx_compress_time_total = 0;
+	uint64_t tx_crypt_time_total = 0, rx_crypt_time_total = 0;
+	int i;
+
+	memset(stats, 0, sizeof(struct knet_handle_stats));
+	stats->tx_compress_time_min = UINT64_MAX;
+	stats->rx_compress_time_min = UINT64_MAX;
+	stats->tx_crypt_time_min = UINT64_MAX;
+	stats->rx_crypt_time_min = UINT64_MAX;
+
+	for (i = 0; i < KNET_THREAD_MAX; i++) {
+		shard = &knet_h->stats_shards[i];
+
+		stats->tx_uncompressed_packets += stats_get(shard->tx_uncompressed_packets);
+		stats->tx_compressed_packets += stats_get(shard->tx_compressed_packets);
+		stats->tx_compressed_original_bytes += stats_get(shard->tx_compressed_original_bytes);
+		stats->tx_compressed_size_bytes += stats_get(shard->tx_compressed_size_bytes);
+		tx_compress_time_total += stats_get(shard->tx_compress_time_total);
+		tx_compress_time_samples += stats_get(shard->tx_compress_time_samples);
+		stats->tx_compress_time_min = stats_min(stats->tx_compress_time_min, stats_get(shard->tx_compress_time_min));
+		stats->tx_compress_time_max = stats_max(stats->tx_compress_time_max, stats_get(shard->tx_compress_time_max));
+		stats->tx_failed_to_compress += stats_get(shard->tx_failed_to_compress);
+		stats->tx_unable_to_compress += stats_get(shard->tx_unable_to_compress);
+
+		stats->rx_compressed_packets += stats_get(shard->rx_compressed_packets);
+		stats->rx_compressed_original_bytes += stats_get(shard->rx_compressed_original_bytes);
+		stats->rx_compressed_size_bytes += stats_get(shard->rx_compressed_size_bytes);
+		rx_compress_time_total += stats_get(shard->rx_compress_time_total);
+		stats->rx_compress_time_min = stats_min(stats->rx_compress_time_min, stats_get(shard->rx_compress_time_min));
+		stats->rx_compress_time_max = stats_max(stats->rx_compress_time_max, stats_get(shard->rx_compress_time_max));
+		stats->rx_failed_to_decompress += stats_get(shard->rx_failed_to_decompress);
+
+		stats->tx_crypt_packets += stats_get(shard->tx_crypt_packets);
+		stats->tx_crypt_byte_overhead += stats_get(shard->tx_crypt_byte_overhead);
+		tx_crypt_time_total += stats_get(shard->tx_crypt_time_total);
+		stats->tx_crypt_time_min = stats_min(stats->tx_crypt_time_min, stats_get(shard->tx_crypt_time_min));
+		stats->tx_crypt_time_max = stats_max(stats->tx_crypt_time_max, stats_get(shard->tx_crypt_time_max));
+
+		stats->rx_crypt_packets += stats_get(shard->rx_crypt_packets);
+		rx_crypt_time_total += stats_get(shard->rx_crypt_time_total);
+		stats->rx_crypt_time_min = stats_min(stats->rx_crypt_time_min, stats_get(shard->rx_crypt_time_min));
+		stats->rx_crypt_time_max = stats_max(stats->rx_crypt_time_max, stats_get(shard->rx_crypt_time_max));
+	}
+
+	if (tx_compress_time_samples) {
+		stats->tx_compress_time_ave = tx_compress_time_total / tx_compress_time_samples;
+	}
+	if (stats->rx_compressed_packets) {
+		stats->rx_compress_time_ave = rx_compress_time_total / stats->rx_compressed_packets;
+	}
+	if (stats->tx_crypt_packets) {
+		stats->tx_crypt_time_ave = tx_crypt_time_total / stats->tx_crypt_packets;
+	}
+	if (stats->rx_crypt_packets) {
+		stats->rx_crypt_time_ave = rx_crypt_time_total / stats->rx_crypt_packets;
+	}
+}
@@ -28,8 +28,12 @@
 #define KNET_THREAD_SCTP_LISTEN	5
 #define KNET_THREAD_SCTP_CONN	6
 #endif
+#define KNET_THREAD_TX_POOL	8 /* TX workers 1 to KNET_MAX_TX_THREADS - 1. worker 0 is KNET_THREAD_TX */
 #define KNET_THREAD_MAX		32
 
+#define KNET_THREAD_TX_WORKER(worker_id) \
+	((worker_id) ? KNET_THREAD_TX_POOL + (worker_id) - 1 : KNET_THREAD_TX)
+
 #define KNET_THREAD_QUEUE_FLUSHED 0
 #define KNET_THREAD_QUEUE_FLUSH   1
 
@@ -52,5 +56,7 @@ int wait_all_threads_status(knet_handle_t knet_h, uint8_t status);
 void force_pmtud_run(knet_handle_t knet_h, uint8_t subsystem, uint8_t reset_mtu, uint8_t force_restart);
 uint32_t compute_chksum(const unsigned char *data, uint32_t data_len);
 uint32_t compute_chksumv(const struct iovec *iov_in, int iovcnt_in);
+void clear_handle_stats(knet_handle_t knet_h);
+void get_handle_stats(knet_handle_t knet_h, struct knet_handle_stats *stats);
 
 #endif
@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under LGPL-2.0+
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "internals.h"
+#include "common.h"
+#include "logging.h"
+#include "threads_common.h"
+#include "threads_crypto.h"
+
+/*
+ * jobs can run in parallel against the same crypto instance:
+ * openssl keeps a set of keyed contexts per instance and each call
+ * claims a free slot with an atomic exchange, so no two jobs ever
+ * share a context. nss and gcrypt create their contexts for each call.
+ * The instance (and its contexts) cannot be freed or reconfigured
+ * while jobs are running since the submitter holds global_rwlock
+ * in read mode until all the jobs are done.
+ */
+
+static void *_handle_crypto_thread(void *data)
+{
+	knet_handle_t knet_h = (knet_handle_t) data;
+	struct knet_crypto_pool *pool = &knet_h->crypto_pool;
+	struct knet_crypto_job *job;
+	knet_crypto_job_fn_t fn;
+
+	if (pthread_mutex_lock(&pool->mutex) != 0) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get crypto pool mutex lock");
+		return NULL;
+	}
+
+	while (!pool->stop) {
+		if ((!pool->jobs) || (pool->jobs_next >= pool->jobs_count)) {
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+			continue;
+		}
+
+		job = &pool->jobs[pool->jobs_next];
+		fn = pool->fn;
+		pool->jobs_next++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		fn(knet_h, job);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->jobs_done++;
+		if (pool->jobs_done == pool->jobs_count) {
+			pthread_cond_signal(&pool->done_cond);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+int _crypto_pool_init(knet_handle_t knet_h)
+{
+	struct knet_crypto_pool *pool = &knet_h->crypto_pool;
+	int savederrno = 0;
+
+	savederrno = pthread_mutex_init(&pool->submit_mutex, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize crypto pool submit mutex: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	savederrno = pthread_mutex_init(&pool->mutex, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize crypto pool mutex: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	savederrno = pthread_cond_init(&pool->work_cond, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize crypto pool work conditional: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	savederrno = pthread_cond_init(&pool->done_cond, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to initialize crypto pool done conditional: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	return 0;
+
+exit_fail:
+	errno = savederrno;
+	return -1;
+}
+
+void _crypto_pool_destroy(knet_handle_t knet_h)
+{
+	struct knet_crypto_pool *pool = &knet_h->crypto_pool;
+
+	pthread_mutex_destroy(&pool->submit_mutex);
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+}
+
+/*
+ * pool must be stopped before calling start
+ */
+int _crypto_pool_start(knet_handle_t knet_h, uint8_t threads)
+{
+	struct knet_crypto_pool *pool = &knet_h->crypto_pool;
+	int savederrno = 0;
+	pthread_attr_t attr;
+	uint8_t i;
+
+	if (!threads) {
+		return 0;
+	}
+
+	savederrno = pthread_attr_init(&attr);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to init pthread attributes: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	savederrno = pthread_attr_setstacksize(&attr, KNET_THREAD_STACK_SIZE);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to set stack size attribute: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	pool->stop = 0;
+
+	for (i = 0; i < threads; i++) {
+		savederrno = pthread_create(&pool->thread[i], &attr,
+					    _handle_crypto_thread, (void *) knet_h);
+		if (savederrno) {
+			log_err(knet_h, KNET_SUB_HANDLE, "Unable to start crypto thread %u: %s",
+				i, strerror(savederrno));
+			goto exit_fail;
+		}
+		pool->threads++;
+	}
+
+	log_debug(knet_h, KNET_SUB_HANDLE, "Started %u crypto threads", threads);
+
+exit_fail:
+	pthread_attr_destroy(&attr);
+	if (savederrno) {
+		_crypto_pool_stop(knet_h);
+	}
+	errno = savederrno;
+	return savederrno ? -1 : 0;
+}
+
+void _crypto_pool_stop(knet_handle_t knet_h)
+{
+	struct knet_crypto_pool *pool = &knet_h->crypto_pool;
+	void *retval;
+	uint8_t i;
+
+	if (!pool->threads) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->threads; i++) {
+		pthread_join(pool->thread[i], &retval);
+		pool->thread[i] = 0;
+	}
+
+	pool->threads = 0;
+}
+
+/*
+ * execute all jobs and return when they are completed. Caller must
+ * hold global_rwlock. If the pool is busy with another set of jobs,
+ * or there are no crypto threads, jobs are executed inline.
+ */
+void _crypto_pool_run(knet_handle_t knet_h, knet_crypto_job_fn_t fn, struct knet_crypto_job *jobs, int jobs_count)
+{
+	struct knet_crypto_pool *pool = &knet_h->crypto_pool;
+	struct knet_crypto_job *job;
+	int i;
+
+	if ((jobs_count < 2) ||
+	    (!pool->threads) ||
+	    (pthread_mutex_trylock(&pool->submit_mutex) != 0)) {
+		goto run_inline;
+	}
+
+	if (pthread_mutex_lock(&pool->mutex) != 0) {
+		pthread_mutex_unlock(&pool->submit_mutex);
+		goto run_inline;
+	}
+
+	pool->fn = fn;
+	pool->jobs = jobs;
+	pool->jobs_count = jobs_count;
+	pool->jobs_next = 0;
+	pool->jobs_done = 0;
+	pthread_cond_broadcast(&pool->work_cond);
+
+	/*
+	 * do our share of the work instead of sleeping
+	 */
+	while (pool->jobs_next < pool->jobs_count) {
+		job = &pool->jobs[pool->jobs_next];
+		pool->jobs_next++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		fn(knet_h, job);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->jobs_done++;
+	}
+
+	while (pool->jobs_done < pool->jobs_count) {
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+
+	pool->jobs = NULL;
+	pool->jobs_count = 0;
+
+	pthread_mutex_unlock(&pool->mutex);
+	pthread_mutex_unlock(&pool->submit_mutex);
+	return;
+
+run_inline:
+	for (i = 0; i < jobs_count; i++) {
+		fn(knet_h, &jobs[i]);
+	}
+}
+
+int knet_handle_set_crypto_threads(knet_handle_t knet_h,
+				   uint8_t crypto_threads)
+{
+	int savederrno = 0, err = 0;
+	uint8_t old_crypto_threads;
+
+	if (!_is_valid_handle(knet_h)) {
+		return -1;
+	}
+
+	if (crypto_threads > KNET_MAX_CRYPTO_THREADS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	/*
+	 * nobody can submit jobs while we hold the write lock,
+	 * the pool is idle.
+	 */
+	old_crypto_threads = knet_h->crypto_pool.threads;
+
+	if (crypto_threads == old_crypto_threads) {
+		goto out_unlock;
+	}
+
+	_crypto_pool_stop(knet_h);
+
+	if (_crypto_pool_start(knet_h, crypto_threads) < 0) {
+		savederrno = errno;
+		err = -1;
+		/*
+		 * try to restore the previous pool size
+		 */
+		_crypto_pool_start(knet_h, old_crypto_threads);
+		goto out_unlock;
+	}
+
+	log_debug(knet_h, KNET_SUB_HANDLE, "Crypto threads changed from %u to %u", old_crypto_threads, crypto_threads);
+
+out_unlock:
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_get_crypto_threads(knet_handle_t knet_h,
+				   uint8_t *crypto_threads)
+{
+	int savederrno = 0;
+
+	if (!_is_valid_handle(knet_h)) {
+		return -1;
+	}
+
+	if (!crypto_threads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*crypto_threads = knet_h->crypto_pool.threads;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2024 Red Hat, Inc.  All rights reserved.
+ *
+ * Authors: Fabio M. Di Nitto <fabbione@kronosnet.org>
+ *
+ * This software licensed under LGPL-2.0+
+ */
+
+#ifndef __KNET_THREADS_CRYPTO_H__
+#define __KNET_THREADS_CRYPTO_H__
+
+#include "internals.h"
+
+int _crypto_pool_init(knet_handle_t knet_h);
+void _crypto_pool_destroy(knet_handle_t knet_h);
+int _crypto_pool_start(knet_handle_t knet_h, uint8_t threads);
+void _crypto_pool_stop(knet_handle_t knet_h);
+void _crypto_pool_run(knet_handle_t knet_h, knet_crypto_job_fn_t fn, struct knet_crypto_job *jobs, int jobs_count);
+
+#endif
@@ -16,6 +16,7 @@
 #include <time.h>
 
 #include "crypto.h"
+#include "defrag.h"
 #include "host.h"
 #include "links.h"
 #include "logging.h"
@@ -39,7 +40,7 @@ static void _link_down(knet_handle_t knet_h, struct knet_host *dst_host, struct
 
 static void send_ping(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_link *dst_link, int timed)
 {
-	int err = 0, savederrno = 0, stats_err = 0;
+	int err = 0, savederrno = 0;
 	int len;
 	ssize_t outlen;
 	struct timespec clock_now, pong_last;
@@ -107,13 +108,6 @@ static void send_ping(knet_handle_t knet_h, struct knet_host *dst_host, struct k
 			pthread_mutex_unlock(&knet_h->handle_stats_mutex);
 		}
 
-		stats_err = pthread_mutex_lock(&dst_link->link_stats_mutex);
-		if (stats_err) {
-			log_err(knet_h, KNET_SUB_HEARTBEAT, "Unable to get stats mutex lock for host %u link %u: %s",
-				dst_host->host_id, dst_link->link_id, strerror(stats_err));
-			return;
-		}
-
 retry:
 		if (transport_get_connection_oriented(knet_h, dst_link->transport) == TRANSPORT_PROTO_NOT_CONNECTION_ORIENTED) {
 			len = sendto(dst_link->outsock, outbuf, outlen,	MSG_DONTWAIT | MSG_NOSIGNAL,
@@ -125,8 +119,8 @@ retry:
 		savederrno = errno;
 
 		dst_link->ping_last = clock_now;
-		dst_link->status.stats.tx_ping_packets++;
-		dst_link->status.stats.tx_ping_bytes += outlen;
+		link_stats_add(dst_link->status.stats.tx_ping_packets, 1);
+		link_stats_add(dst_link->status.stats.tx_ping_bytes, outlen);
 
 		if (len != outlen) {
 			err = transport_tx_sock_error(knet_h, dst_link->transport, dst_link->outsock, KNET_SUB_HEARTBEAT, len, savederrno);
@@ -137,19 +131,18 @@ retry:
 						  dst_link->outsock, savederrno, strerror(savederrno),
 						  dst_link->status.src_ipaddr, dst_link->status.src_port,
 						  dst_link->status.dst_ipaddr, dst_link->status.dst_port);
-					dst_link->status.stats.tx_ping_errors++;
+					link_stats_add(dst_link->status.stats.tx_ping_errors, 1);
 					break;
 				case KNET_TRANSPORT_SOCK_ERROR_IGNORE:
 					break;
 				case KNET_TRANSPORT_SOCK_ERROR_RETRY:
-					dst_link->status.stats.tx_ping_retries++;
+					link_stats_add(dst_link->status.stats.tx_ping_retries, 1);
 					goto retry;
 					break;
 			}
 		} else {
 			dst_link->last_ping_size = outlen;
 		}
-		pthread_mutex_unlock(&dst_link->link_stats_mutex);
 	}
 
 	timespec_diff(pong_last, clock_now, &diff_ping);
@@ -217,25 +210,25 @@ retry:
 						  src_link->outsock, errno, strerror(errno),
 						  src_link->status.src_ipaddr, src_link->status.src_port,
 						  src_link->status.dst_ipaddr, src_link->status.dst_port);
-					src_link->status.stats.tx_pong_errors++;
+					link_stats_add(src_link->status.stats.tx_pong_errors, 1);
 					break;
 				case KNET_TRANSPORT_SOCK_ERROR_IGNORE:
 					break;
 				case KNET_TRANSPORT_SOCK_ERROR_RETRY:
-					src_link->status.stats.tx_pong_retries++;
+					link_stats_add(src_link->status.stats.tx_pong_retries, 1);
 					goto retry;
 					break;
 			}
 		}
-		src_link->status.stats.tx_pong_packets++;
-		src_link->status.stats.tx_pong_bytes += outlen;
+		link_stats_add(src_link->status.stats.tx_pong_packets, 1);
+		link_stats_add(src_link->status.stats.tx_pong_bytes, outlen);
 	}
 }
 
 void process_ping(knet_handle_t knet_h, struct knet_host *src_host, struct knet_link *src_link, struct knet_header *inbuf, ssize_t len)
 {
-	src_link->status.stats.rx_ping_packets++;
-	src_link->status.stats.rx_ping_bytes += len;
+	link_stats_add(src_link->status.stats.rx_ping_packets, 1);
+	link_stats_add(src_link->status.stats.rx_ping_bytes, len);
 
 	if (knet_h->onwire_ver_remap) {
 		process_ping_v1(knet_h, src_host, src_link, inbuf, len);
@@ -261,8 +254,8 @@ void process_pong(knet_handle_t knet_h, struct knet_host *src_host, struct knet_
 
 	clock_gettime(CLOCK_MONOTONIC, &src_link->status.pong_last);
 
-	src_link->status.stats.rx_pong_packets++;
-	src_link->status.stats.rx_pong_bytes += len;
+	link_stats_add(src_link->status.stats.rx_pong_packets, 1);
+	link_stats_add(src_link->status.stats.rx_pong_bytes, len);
 
 
 	if (knet_h->onwire_ver_remap) {
@@ -410,6 +403,8 @@ void *_handle_heartbt_thread(void *data)
 
 		_send_pings(knet_h, 1);
 
+		_defrag_bufs_sample(knet_h);
+
 		pthread_rwlock_unlock(&knet_h->global_rwlock);
 	}
 
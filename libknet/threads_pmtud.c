@@ -21,6 +21,7 @@
 #include "transports.h"
 #include "threads_common.h"
 #include "threads_pmtud.h"
+#include "threads_tx.h"
 #include "onwire_v1.h"
 
 static int _calculate_manual_mtu(knet_handle_t knet_h, struct knet_link *dst_link)
@@ -205,22 +206,13 @@ restart:
 		return -1;
 	}
 
-	savederrno = pthread_mutex_lock(&knet_h->tx_mutex);
+	savederrno = _tx_workers_lock(knet_h);
 	if (savederrno) {
 		pthread_mutex_unlock(&knet_h->pmtud_mutex);
 		log_err(knet_h, KNET_SUB_PMTUD, "Unable to get TX mutex lock: %s", strerror(savederrno));
 		return -1;
 	}
 
-	savederrno = pthread_mutex_lock(&dst_link->link_stats_mutex);
-	if (savederrno) {
-		pthread_mutex_unlock(&knet_h->pmtud_mutex);
-		pthread_mutex_unlock(&knet_h->tx_mutex);
-		log_err(knet_h, KNET_SUB_PMTUD, "Unable to get stats mutex lock for host %u link %u: %s",
-			dst_host->host_id, dst_link->link_id, strerror(savederrno));
-		return -1;
-	}
-
 retry:
 	if (transport_get_connection_oriented(knet_h, dst_link->transport) == TRANSPORT_PROTO_NOT_CONNECTION_ORIENTED) {
 		len = sendto(dst_link->outsock, outbuf, data_len, MSG_DONTWAIT | MSG_NOSIGNAL,
@@ -251,24 +243,22 @@ retry:
 	switch(err) {
 		case KNET_TRANSPORT_SOCK_ERROR_INTERNAL:
 			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to send pmtu packet (sendto): %d %s", savederrno, strerror(savederrno));
-			pthread_mutex_unlock(&knet_h->tx_mutex);
+			_tx_workers_unlock(knet_h);
 			pthread_mutex_unlock(&knet_h->pmtud_mutex);
-			dst_link->status.stats.tx_pmtu_errors++;
-			pthread_mutex_unlock(&dst_link->link_stats_mutex);
+			link_stats_add(dst_link->status.stats.tx_pmtu_errors, 1);
 			return -1;
 			break;
 		case KNET_TRANSPORT_SOCK_ERROR_IGNORE:
 			break;
 		case KNET_TRANSPORT_SOCK_ERROR_RETRY:
-			dst_link->status.stats.tx_pmtu_retries++;
+			link_stats_add(dst_link->status.stats.tx_pmtu_retries, 1);
 			goto retry;
 			break;
 	}
 
-	pthread_mutex_unlock(&knet_h->tx_mutex);
+	_tx_workers_unlock(knet_h);
 
 	if (len != (ssize_t )data_len) {
-		pthread_mutex_unlock(&dst_link->link_stats_mutex);
 		if (savederrno == EMSGSIZE || savederrno == EPERM) {
 			/*
 			 * we cannot hold a lock on kmtu_mutex between resetting
@@ -295,9 +285,8 @@ retry:
 	} else {
 		dst_link->last_sent_mtu = onwire_len;
 		dst_link->last_recv_mtu = 0;
-		dst_link->status.stats.tx_pmtu_packets++;
-		dst_link->status.stats.tx_pmtu_bytes += data_len;
-		pthread_mutex_unlock(&dst_link->link_stats_mutex);
+		link_stats_add(dst_link->status.stats.tx_pmtu_packets, 1);
+		link_stats_add(dst_link->status.stats.tx_pmtu_bytes, data_len);
 
 		if (clock_gettime(CLOCK_REALTIME, &ts) < 0) {
 			log_debug(knet_h, KNET_SUB_PMTUD, "Unable to get current time: %s", strerror(errno));
@@ -696,7 +685,7 @@ static void send_pmtud_reply(knet_handle_t knet_h, struct knet_link *src_link, s
 		pthread_mutex_unlock(&knet_h->handle_stats_mutex);
 	}
 
-	savederrno = pthread_mutex_lock(&knet_h->tx_mutex);
+	savederrno = _tx_workers_lock(knet_h);
 	if (savederrno) {
 		log_err(knet_h, KNET_SUB_PMTUD, "Unable to get TX mutex lock: %s", strerror(savederrno));
 		return;
@@ -714,11 +703,6 @@ retry:
 		savederrno = errno;
 		if (len != outlen) {
 			err = transport_tx_sock_error(knet_h, src_link->transport, src_link->outsock, KNET_SUB_PMTUD, len, savederrno);
-			stats_err = pthread_mutex_lock(&src_link->link_stats_mutex);
-			if (stats_err < 0) {
-				log_err(knet_h, KNET_SUB_PMTUD, "Unable to get mutex lock: %s", strerror(stats_err));
-				return;
-			}
 			switch(err) {
 				case KNET_TRANSPORT_SOCK_ERROR_INTERNAL:
 					log_debug(knet_h, KNET_SUB_PMTUD,
@@ -727,21 +711,19 @@ retry:
 						  src_link->status.src_ipaddr, src_link->status.src_port,
 						  src_link->status.dst_ipaddr, src_link->status.dst_port);
 
-					src_link->status.stats.tx_pmtu_errors++;
+					link_stats_add(src_link->status.stats.tx_pmtu_errors, 1);
 					break;
 				case KNET_TRANSPORT_SOCK_ERROR_IGNORE:
-					src_link->status.stats.tx_pmtu_errors++;
+					link_stats_add(src_link->status.stats.tx_pmtu_errors, 1);
 					break;
 				case KNET_TRANSPORT_SOCK_ERROR_RETRY:
-					src_link->status.stats.tx_pmtu_retries++;
-					pthread_mutex_unlock(&src_link->link_stats_mutex);
+					link_stats_add(src_link->status.stats.tx_pmtu_retries, 1);
 					goto retry;
 					break;
 			}
-			pthread_mutex_unlock(&src_link->link_stats_mutex);
 		}
 	}
-	pthread_mutex_unlock(&knet_h->tx_mutex);
+	_tx_workers_unlock(knet_h);
 }
 
 void process_pmtud(knet_handle_t knet_h, struct knet_link *src_link, struct knet_header *inbuf)
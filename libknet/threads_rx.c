@@ -15,10 +15,13 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
 #include "compat.h"
 #include "compress.h"
 #include "crypto.h"
+#include "defrag.h"
 #include "host.h"
 #include "links.h"
 #include "links_acl.h"
@@ -26,180 +29,66 @@
 #include "transports.h"
 #include "transport_common.h"
 #include "threads_common.h"
+#include "threads_crypto.h"
 #include "threads_heartbeat.h"
 #include "threads_pmtud.h"
 #include "threads_rx.h"
 #include "netutils.h"
 #include "onwire_v1.h"
+#include "ring.h"
 
 /*
- * RECV
+ * room for the largest of the two pktinfo structs and UDP_GRO segment size
  */
+#if defined(IP_PKTINFO) || defined(IPV6_PKTINFO)
+#define KNET_RX_CONTROL_SIZE (CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(int)))
+#else
+#define KNET_RX_CONTROL_SIZE CMSG_SPACE(sizeof(int))
+#endif
 
 /*
- *  return 1 if a > b
- *  return -1 if b > a
- *  return 0 if they are equal
+ * RECV
  */
-static inline int _timecmp(struct timespec a, struct timespec b)
-{
-	if (a.tv_sec != b.tv_sec) {
-		if (a.tv_sec > b.tv_sec) {
-			return 1;
-		} else {
-			return -1;
-		}
-	} else {
-		if (a.tv_nsec > b.tv_nsec) {
-			return 1;
-		} else if (a.tv_nsec < b.tv_nsec) {
-			return -1;
-		} else {
-			return 0;
-		}
-	}
-}
 
 /*
- * calculate use % of defrag buffers per host
- * and if % is <= knet_h->defrag_bufs_shrink_threshold for the last second, then half the size
+ * _defrag_bufs_sample (heartbeat thread) found that the host has been
+ * using <= knet_h->defrag_bufs_shrink_threshold % of its buffers,
+ * half the size
  */
 
-static void _shrink_defrag_buffers(knet_handle_t knet_h)
+static void _shrink_defrag_buffers(knet_handle_t knet_h, struct knet_host *src_host)
 {
-	struct knet_host *host;
-	struct knet_host_defrag_buf *new_bufs = NULL;
-	struct timespec now;
-	unsigned long long time_diff; /* nanoseconds */
-	uint16_t i, x, in_use_bufs;
-	uint32_t sum;
+	stats_set(src_host->defrag_bufs_shrink_pending, 0);
 
 	/*
-	 * first run.
+	 * only allow shrinking if allocated bufs > min_defrag_bufs
+	 * and usage did not grow since the last sample
 	 */
-	if ((knet_h->defrag_bufs_last_run.tv_sec == 0) &&
-	    (knet_h->defrag_bufs_last_run.tv_nsec == 0)) {
-		clock_gettime(CLOCK_MONOTONIC, &knet_h->defrag_bufs_last_run);
-		return;
-	}
-
-	clock_gettime(CLOCK_MONOTONIC, &now);
-
-	timespec_diff(knet_h->defrag_bufs_last_run, now, &time_diff);
-
-	if (time_diff < (((unsigned long long)knet_h->defrag_bufs_usage_samples_timespan * 1000000000) / knet_h->defrag_bufs_usage_samples)) {
+	if ((src_host->allocated_defrag_bufs == knet_h->defrag_bufs_min) ||
+	    (src_host->in_use_defrag_bufs > src_host->allocated_defrag_bufs / 2)) {
 		return;
 	}
 
 	/*
-	 * record the last run
+	 * in_use buffers are compacted at the beginning.
+	 * with the checks above, we are 100% sure they fit.
+	 *
+	 * memory allocation is not critical. it just means the system is under
+	 * memory pressure and we will need to wait our turn to free memory... how odd :)
 	 */
-	memmove(&knet_h->defrag_bufs_last_run, &now, sizeof(struct timespec));
+	if (_defrag_bufs_resize(src_host, src_host->allocated_defrag_bufs / 2) < 0) {
+		log_err(knet_h, KNET_SUB_RX, "Unable to decrease defrag buffers for host %u: %s",
+			src_host->host_id, strerror(errno));
+		return;
+	}
 
 	/*
-	 * do the real work:
+	 * clear buffer use stats. Old ones are no good for new one
 	 */
-	for (host = knet_h->host_head; host != NULL; host = host->next) {
-
-		/*
-		 * Update buffer usage stats. We do this for all nodes.
-		 */
-		in_use_bufs = 0;
-
-		for (i = 0; i < host->allocated_defrag_bufs; i++) {
-			if (host->defrag_bufs[i].in_use) {
-				in_use_bufs++;
-			}
-		}
-
-		/*
-		 * record only %
-		 */
-		host->in_use_defrag_buffers[host->in_use_defrag_buffers_index] = (in_use_bufs * 100 / host->allocated_defrag_bufs);
-		host->in_use_defrag_buffers_index++;
-
-		/*
-		 * make sure to stay within buffer
-		 */
-		if (host->in_use_defrag_buffers_index == knet_h->defrag_bufs_usage_samples) {
-			host->in_use_defrag_buffers_index = 0;
-		}
-
-		/*
-		 * only allow shrinking if we have enough samples
-		 */
-		if (host->in_use_defrag_buffers_samples < knet_h->defrag_bufs_usage_samples) {
-			host->in_use_defrag_buffers_samples++;
-			continue;
-		}
-
-		/*
-		 * only allow shrinking if in use bufs are <= knet_h->defrag_bufs_shrink_threshold%
-		 */
-		if (knet_h->defrag_bufs_reclaim_policy == RECLAIM_POLICY_AVERAGE) {
-			sum = 0;
-			for (i = 0; i < knet_h->defrag_bufs_usage_samples; i++) {
-				sum += host->in_use_defrag_buffers[i];
-			}
-			sum = sum / knet_h->defrag_bufs_usage_samples;
-
-			if (sum > knet_h->defrag_bufs_shrink_threshold) {
-				continue;
-			}
-		} else {
-			sum = 0;
-			for (i = 0; i < knet_h->defrag_bufs_usage_samples; i++) {
-				if (host->in_use_defrag_buffers[i] > knet_h->defrag_bufs_shrink_threshold) {
-					sum = 1;
-				}
-			}
-
-			if (sum) {
-				continue;
-			}
-		}
-
-		/*
-		 * only allow shrinking if allocated bufs > min_defrag_bufs
-		 */
-		if (host->allocated_defrag_bufs == knet_h->defrag_bufs_min) {
-			continue;
-		}
+	_clear_defrag_bufs_stats(src_host);
 
-		/*
-		 * compat all the in_use buffers at the beginning.
-		 * we the checks above, we are 100% sure they fit
-		 */
-		x = 0;
-		for (i = 0; i < host->allocated_defrag_bufs; i++) {
-			if (host->defrag_bufs[i].in_use) {
-				memmove(&host->defrag_bufs[x], &host->defrag_bufs[i], sizeof(struct knet_host_defrag_buf));
-				x++;
-			}
-		}
-
-		/*
-		 * memory allocation is not critical. it just means the system is under
-		 * memory pressure and we will need to wait our turn to free memory... how odd :)
-		 */
-		new_bufs = realloc(host->defrag_bufs, sizeof(struct knet_host_defrag_buf) * (host->allocated_defrag_bufs / 2));
-		if (!new_bufs) {
-			log_err(knet_h, KNET_SUB_RX, "Unable to decrease defrag buffers for host %u: %s",
-				host->host_id, strerror(errno));
-			continue;
-		}
-
-		host->defrag_bufs = new_bufs;
-		host->allocated_defrag_bufs = host->allocated_defrag_bufs / 2;
-
-		/*
-		 * clear buffer use stats. Old ones are no good for new one
-		 */
-		_clear_defrag_bufs_stats(host);
-
-		log_debug(knet_h, KNET_SUB_RX, "Defrag buffers for host %u decreased from %u to: %u",
-			  host->host_id, host->allocated_defrag_bufs * 2, host->allocated_defrag_bufs);
-	}
+	log_debug(knet_h, KNET_SUB_RX, "Defrag buffers for host %u decreased from %u to: %u",
+		  src_host->host_id, src_host->allocated_defrag_bufs * 2, src_host->allocated_defrag_bufs);
 }
 
 /*
@@ -211,35 +100,18 @@ static void _shrink_defrag_buffers(knet_handle_t knet_h)
 
 static int _realloc_defrag_buffers(knet_handle_t knet_h, struct knet_host *src_host)
 {
-	struct knet_host_defrag_buf *new_bufs = NULL;
-	int i;
-
 	/*
 	 * max_defrag_bufs is a power of 2
 	 * allocated_defrag_bufs doubles on each iteration.
 	 * Sooner or later (and hopefully never) allocated with be == to max.
 	 */
 	if (src_host->allocated_defrag_bufs < knet_h->defrag_bufs_max) {
-		new_bufs = realloc(src_host->defrag_bufs,
-				   src_host->allocated_defrag_bufs * 2 * sizeof(struct knet_host_defrag_buf));
-		if (!new_bufs) {
+		if (_defrag_bufs_resize(src_host, src_host->allocated_defrag_bufs * 2) < 0) {
 			log_err(knet_h, KNET_SUB_RX, "Unable to increase defrag buffers for host %u: %s",
 				src_host->host_id, strerror(errno));
 			return 0;
 		}
 
-		/*
-		 * keep the math simple here between arrays, pointers and what not.
-		 * Init each buffer individually.
-		 */
-		for (i = src_host->allocated_defrag_bufs; i < src_host->allocated_defrag_bufs * 2; i++) {
-			memset(&new_bufs[i], 0, sizeof(struct knet_host_defrag_buf));
-		}
-
-		src_host->allocated_defrag_bufs = src_host->allocated_defrag_bufs * 2;
-
-		src_host->defrag_bufs = new_bufs;
-
 		/*
 		 * clear buffer use stats. Old ones are no good for new one
 		 */
@@ -261,19 +133,20 @@ static int _realloc_defrag_buffers(knet_handle_t knet_h, struct knet_host *src_h
 
 static int _find_pckt_defrag_buf(knet_handle_t knet_h, struct knet_host *src_host, seq_num_t seq_num)
 {
-	int i, oldest;
-	uint16_t cur_allocated_defrag_bufs = src_host->allocated_defrag_bufs;
+	int idx, oldest;
+
+	if (stats_get(src_host->defrag_bufs_shrink_pending)) {
+		_shrink_defrag_buffers(knet_h, src_host);
+	}
 
 	/*
 	 * check if there is a buffer already in use handling the same seq_num
 	 */
 
-	for (i = 0; i < src_host->allocated_defrag_bufs; i++) {
-		if (src_host->defrag_bufs[i].in_use) {
-			if (src_host->defrag_bufs[i].pckt_seq == seq_num) {
-				return i;
-			}
-		}
+	idx = _defrag_buf_lookup(src_host, seq_num);
+	if (idx >= 0) {
+		_defrag_buf_touch(src_host, idx);
+		return idx;
 	}
 
 	/*
@@ -299,10 +172,9 @@ static int _find_pckt_defrag_buf(knet_handle_t knet_h, struct knet_host *src_hos
 	 * see if there is a free buffer
 	 */
 
-	for (i = 0; i < src_host->allocated_defrag_bufs; i++) {
-		if (!src_host->defrag_bufs[i].in_use) {
-			return i;
-		}
+	idx = _defrag_buf_get(knet_h, src_host, seq_num);
+	if (idx >= 0) {
+		return idx;
 	}
 
 	/*
@@ -310,28 +182,31 @@ static int _find_pckt_defrag_buf(knet_handle_t knet_h, struct knet_host *src_hos
 	 */
 
 	if (_realloc_defrag_buffers(knet_h, src_host)) {
-		return cur_allocated_defrag_bufs + 1;
+		return _defrag_buf_get(knet_h, src_host, seq_num);
 	}
 
 	/*
 	 * at this point, there are no free buffers, the pckt is new
-	 * and we need to reclaim a buffer, and we will take the one
-	 * with the oldest timestamp. It's as good as any.
+	 * and we need to reclaim a buffer, and we will take the
+	 * least recently updated one. It's as good as any.
 	 */
 
-	oldest = 0;
-
-	for (i = 0; i < src_host->allocated_defrag_bufs; i++) {
-		if (_timecmp(src_host->defrag_bufs[i].last_update, src_host->defrag_bufs[oldest].last_update) < 0) {
-			oldest = i;
-		}
+	oldest = _defrag_buf_oldest(src_host);
+	if (oldest >= 0) {
+		_defrag_buf_release(knet_h, src_host, oldest);
 	}
-	src_host->defrag_bufs[oldest].in_use = 0;
 
-	return oldest;
+	return _defrag_buf_get(knet_h, src_host, seq_num);
 }
 
-static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_num_t seq_num, unsigned char *data, ssize_t *len, uint8_t frags, uint8_t frag_seq)
+/*
+ * once all fragments are received, *data is updated to point to the
+ * reassembled packet in the defrag buffer. The buffer is released and
+ * will be reused by the next fragmented packet, so the caller must
+ * deliver the data before processing another packet (_process_data
+ * flushes the deliver batch right away for reassembled packets).
+ */
+static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_num_t seq_num, unsigned char **data, ssize_t *len, uint8_t frags, uint8_t frag_seq)
 {
 	struct knet_host_defrag_buf *defrag_buf;
 	int defrag_buf_idx;
@@ -343,20 +218,6 @@ static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_nu
 
 	defrag_buf = &src_host->defrag_bufs[defrag_buf_idx];
 
-	/*
-	 * if the buf is not is use, then make sure it's clean
-	 */
-	if (!defrag_buf->in_use) {
-		memset(defrag_buf, 0, sizeof(struct knet_host_defrag_buf));
-		defrag_buf->in_use = 1;
-		defrag_buf->pckt_seq = seq_num;
-	}
-
-	/*
-	 * update timestamp on the buffer
-	 */
-	clock_gettime(CLOCK_MONOTONIC, &defrag_buf->last_update);
-
 	/*
 	 * check if we already received this fragment
 	 */
@@ -385,8 +246,8 @@ static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_nu
 		 */
 		if (!defrag_buf->frag_size) {
 			defrag_buf->last_first = 1;
-			memmove(defrag_buf->buf + (KNET_MAX_PACKET_SIZE - *len),
-			       data,
+			memmove(defrag_buf->chunk->buf + (KNET_MAX_PACKET_SIZE - *len),
+			       *data,
 			       *len);
 		}
 	} else {
@@ -394,8 +255,8 @@ static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_nu
 	}
 
 	if (defrag_buf->frag_size) {
-		memmove(defrag_buf->buf + ((frag_seq - 1) * defrag_buf->frag_size),
-			data, *len);
+		memmove(defrag_buf->chunk->buf + ((frag_seq - 1) * defrag_buf->frag_size),
+			*data, *len);
 	}
 
 	defrag_buf->frag_recv++;
@@ -410,8 +271,8 @@ static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_nu
 		 */
 
 		if (defrag_buf->last_first) {
-			memmove(defrag_buf->buf + ((frags - 1) * defrag_buf->frag_size),
-			        defrag_buf->buf + (KNET_MAX_PACKET_SIZE - defrag_buf->last_frag_size),
+			memmove(defrag_buf->chunk->buf + ((frags - 1) * defrag_buf->frag_size),
+			        defrag_buf->chunk->buf + (KNET_MAX_PACKET_SIZE - defrag_buf->last_frag_size),
 				defrag_buf->last_frag_size);
 		}
 
@@ -422,14 +283,15 @@ static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_nu
 		*len = ((frags - 1) * defrag_buf->frag_size) + defrag_buf->last_frag_size;
 
 		/*
-		 * copy the pckt back in the user data
+		 * deliver straight from the defrag buffer instead
+		 * of copying the pckt back in the user data
 		 */
-		memmove(data, defrag_buf->buf, *len);
+		*data = (unsigned char *)defrag_buf->chunk->buf;
 
 		/*
 		 * free this buffer
 		 */
-		defrag_buf->in_use = 0;
+		_defrag_buf_release(knet_h, src_host, defrag_buf_idx);
 		return 0;
 	}
 
@@ -438,38 +300,31 @@ static int _pckt_defrag(knet_handle_t knet_h, struct knet_host *src_host, seq_nu
 
 static int _handle_data_stats(knet_handle_t knet_h, struct knet_link *src_link, ssize_t len, uint64_t decrypt_time)
 {
-	int stats_err;
+	struct knet_handle_stats_shard *stats = &knet_h->stats_shards[KNET_THREAD_RX];
 
 	/* data stats at the top for consistency with TX */
-	src_link->status.stats.rx_data_packets++;
-	src_link->status.stats.rx_data_bytes += len;
+	link_stats_add(src_link->status.stats.rx_data_packets, 1);
+	link_stats_add(src_link->status.stats.rx_data_bytes, len);
 
 	if (decrypt_time) {
-		stats_err = pthread_mutex_lock(&knet_h->handle_stats_mutex);
-		if (stats_err < 0) {
-			log_err(knet_h, KNET_SUB_RX, "Unable to get mutex lock: %s", strerror(stats_err));
-			return -1;
-		}
 		/* Only update the crypto overhead for data packets. Mainly to be
 		   consistent with TX */
-		if (decrypt_time < knet_h->stats.rx_crypt_time_min) {
-			knet_h->stats.rx_crypt_time_min = decrypt_time;
-		}
-		if (decrypt_time > knet_h->stats.rx_crypt_time_max) {
-			knet_h->stats.rx_crypt_time_max = decrypt_time;
-		}
-		knet_h->stats.rx_crypt_time_ave =
-			(knet_h->stats.rx_crypt_time_ave * knet_h->stats.rx_crypt_packets +
-			 decrypt_time) / (knet_h->stats.rx_crypt_packets+1);
-		knet_h->stats.rx_crypt_packets++;
-		pthread_mutex_unlock(&knet_h->handle_stats_mutex);
+		stats_time(stats->rx_crypt_time_total,
+			   stats->rx_crypt_time_min,
+			   stats->rx_crypt_time_max,
+			   decrypt_time);
+		stats_add(stats->rx_crypt_packets, 1);
 	}
 	return 0;
 }
 
-static int _decompress_data(knet_handle_t knet_h, uint8_t decompress_type, unsigned char *data, ssize_t *len, ssize_t header_size)
+/*
+ * on success *data points to the decompressed payload
+ */
+static int _decompress_data(knet_handle_t knet_h, uint8_t decompress_type, unsigned char **data, ssize_t *len, ssize_t header_size)
 {
-	int err = 0, stats_err = 0;
+	struct knet_handle_stats_shard *stats = &knet_h->stats_shards[KNET_THREAD_RX];
+	int err = 0;
 
 	if (decompress_type) {
 		ssize_t decmp_outlen = KNET_DATABUFSIZE_COMPRESS;
@@ -479,7 +334,7 @@ static int _decompress_data(knet_handle_t knet_h, uint8_t decompress_type, unsig
 
 		clock_gettime(CLOCK_MONOTONIC, &start_time);
 		err = decompress(knet_h, decompress_type,
-				 data,
+				 *data,
 				 *len - header_size,
 				 knet_h->recv_from_links_buf_decompress,
 				 &decmp_outlen);
@@ -487,38 +342,24 @@ static int _decompress_data(knet_handle_t knet_h, uint8_t decompress_type, unsig
 		clock_gettime(CLOCK_MONOTONIC, &end_time);
 		timespec_diff(start_time, end_time, &decompress_time);
 
-		stats_err = pthread_mutex_lock(&knet_h->handle_stats_mutex);
-		if (stats_err < 0) {
-			log_err(knet_h, KNET_SUB_RX, "Unable to get mutex lock: %s", strerror(stats_err));
-			return -1;
-		}
-
 		if (!err) {
 			/* Collect stats */
-			if (decompress_time < knet_h->stats.rx_compress_time_min) {
-				knet_h->stats.rx_compress_time_min = decompress_time;
-			}
-			if (decompress_time > knet_h->stats.rx_compress_time_max) {
-				knet_h->stats.rx_compress_time_max = decompress_time;
-			}
-			knet_h->stats.rx_compress_time_ave =
-				(knet_h->stats.rx_compress_time_ave * knet_h->stats.rx_compressed_packets +
-				 decompress_time) / (knet_h->stats.rx_compressed_packets+1);
-
-			knet_h->stats.rx_compressed_packets++;
-			knet_h->stats.rx_compressed_original_bytes += decmp_outlen;
-			knet_h->stats.rx_compressed_size_bytes += *len - KNET_HEADER_SIZE;
-
-			memmove(data, knet_h->recv_from_links_buf_decompress, decmp_outlen);
+			stats_time(stats->rx_compress_time_total,
+				   stats->rx_compress_time_min,
+				   stats->rx_compress_time_max,
+				   decompress_time);
+			stats_add(stats->rx_compressed_packets, 1);
+			stats_add(stats->rx_compressed_original_bytes, decmp_outlen);
+			stats_add(stats->rx_compressed_size_bytes, *len - KNET_HEADER_SIZE);
+
+			*data = knet_h->recv_from_links_buf_decompress;
 			*len = decmp_outlen + header_size;
 		} else {
-			knet_h->stats.rx_failed_to_decompress++;
-			pthread_mutex_unlock(&knet_h->handle_stats_mutex);
+			stats_add(stats->rx_failed_to_decompress, 1);
 			log_err(knet_h, KNET_SUB_COMPRESS, "Unable to decompress packet (%d): %s",
 				err, strerror(errno));
 			return -1;
 		}
-		pthread_mutex_unlock(&knet_h->handle_stats_mutex);
 	}
 	return 0;
 }
@@ -573,47 +414,206 @@ static int _check_destination(knet_handle_t knet_h, struct knet_header *inbuf, u
 	return 0;
 }
 
-static int _deliver_data(knet_handle_t knet_h, unsigned char *data, ssize_t len, ssize_t header_size, int8_t channel)
+/*
+ * write what is left of a packet, starting at sent
+ */
+static int _deliver_data(knet_handle_t knet_h, const struct iovec *iov, size_t sent, int8_t channel)
 {
 	struct iovec iov_out[1];
-	ssize_t	outlen = 0;
+	ssize_t	outlen;
+
+	while (sent < iov->iov_len) {
+		iov_out[0].iov_base = (unsigned char *)iov->iov_base + sent;
+		iov_out[0].iov_len = iov->iov_len - sent;
+
+		outlen = writev(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], iov_out, 1);
+		if (outlen <= 0) {
+			knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
+					       knet_h->sockfd[channel].sockfd[0],
+					       channel,
+					       KNET_NOTIFY_RX,
+					       outlen,
+					       errno);
+			return -1;
+		}
 
-	memset(iov_out, 0, sizeof(iov_out));
+		if ((size_t)outlen < iov_out[0].iov_len) {
+			log_debug(knet_h, KNET_SUB_RX,
+				  "Unable to send all data to the application in one go. Expected: %zu Sent: %zd\n",
+				  iov_out[0].iov_len, outlen);
+		}
 
-retry:
-	iov_out[0].iov_base = (void *) data + outlen;
-	iov_out[0].iov_len = len - (outlen + header_size);
+		sent += outlen;
+	}
 
-	outlen = writev(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], iov_out, 1);
-	if ((outlen > 0) && (outlen < (ssize_t)iov_out[0].iov_len)) {
-		log_debug(knet_h, KNET_SUB_RX,
-			  "Unable to send all data to the application in one go. Expected: %zu Sent: %zd\n",
-			  iov_out[0].iov_len, outlen);
-		goto retry;
-	}
-
-	if (outlen <= 0) {
-		knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
-				       knet_h->sockfd[channel].sockfd[0],
-				       channel,
-				       KNET_NOTIFY_RX,
-				       outlen,
-				       errno);
-		return -1;
+	return 0;
+}
+
+/*
+ * the packet has not been delivered, allow a copy received
+ * from another link to be delivered
+ */
+static void _deliver_error(knet_handle_t knet_h, int entry)
+{
+	struct knet_rx_deliver *deliver = &knet_h->recv_from_links_deliver;
+
+	_seq_num_unset(deliver->host[entry], deliver->seq_num[entry], 0);
+}
+
+/*
+ * the TX workers can deliver to the same ring via _dispatch_to_local
+ */
+static void _deliver_to_ring(knet_handle_t knet_h, int8_t channel, int msgs)
+{
+	struct knet_rx_deliver *deliver = &knet_h->recv_from_links_deliver;
+	struct knet_ring *ring = knet_h->sockfd[channel].rx_ring;
+	int i, entry, pushed = 0;
+
+	pthread_mutex_lock(&knet_h->sockfd[channel].rx_ring_mutex);
+	for (i = 0; i < msgs; i++) {
+		entry = deliver->msg_entry[i];
+		if (_ring_push(ring, deliver->iov[entry].iov_base, deliver->iov[entry].iov_len) < 0) {
+			knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
+					       knet_h->sockfd[channel].sockfd[0],
+					       channel,
+					       KNET_NOTIFY_RX,
+					       -1,
+					       errno);
+			_deliver_error(knet_h, entry);
+			continue;
+		}
+		pushed++;
 	}
+	pthread_mutex_unlock(&knet_h->sockfd[channel].rx_ring_mutex);
 
-	if ((size_t)outlen != iov_out[0].iov_len) {
-		return -1;
+	if (pushed) {
+		_ring_wakeup(ring);
 	}
+}
 
-	return 0;
+static void _deliver_to_sock(knet_handle_t knet_h, int8_t channel, int msgs)
+{
+	struct knet_rx_deliver *deliver = &knet_h->recv_from_links_deliver;
+	int i = 0, entry;
+#ifdef HAVE_SENDMMSG
+	int x, sent;
+#endif
+
+	if (knet_h->sockfd[channel].rx_ring) {
+		_deliver_to_ring(knet_h, channel, msgs);
+		return;
+	}
+
+	while (i < msgs) {
+#ifdef HAVE_SENDMMSG
+		if (knet_h->sockfd[channel].is_socket) {
+			sent = sendmmsg(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created],
+					(struct mmsghdr *)&deliver->msg[i], msgs - i, MSG_NOSIGNAL);
+			if (sent <= 0) {
+				/*
+				 * report the error for this packet and try the next ones,
+				 * as if they were written one by one
+				 */
+				knet_h->sock_notify_fn(knet_h->sock_notify_fn_private_data,
+						       knet_h->sockfd[channel].sockfd[0],
+						       channel,
+						       KNET_NOTIFY_RX,
+						       sent,
+						       errno);
+				_deliver_error(knet_h, deliver->msg_entry[i]);
+				i++;
+				continue;
+			}
+
+			/*
+			 * stream sockets can take only part of a packet
+			 */
+			for (x = i; x < i + sent; x++) {
+				entry = deliver->msg_entry[x];
+				if ((deliver->msg[x].msg_len < deliver->iov[entry].iov_len) &&
+				    (_deliver_data(knet_h, &deliver->iov[entry], deliver->msg[x].msg_len, channel) < 0)) {
+					_deliver_error(knet_h, entry);
+				}
+			}
+
+			i += sent;
+			continue;
+		}
+#endif
+		entry = deliver->msg_entry[i];
+		if (_deliver_data(knet_h, &deliver->iov[entry], 0, channel) < 0) {
+			_deliver_error(knet_h, entry);
+		}
+		i++;
+	}
+}
+
+static void _flush_deliver_batch(knet_handle_t knet_h)
+{
+	struct knet_rx_deliver *deliver = &knet_h->recv_from_links_deliver;
+	int8_t channel;
+	int i, msgs;
+
+	knet_h->recv_from_links_batch.inline_next = 0;
+
+	if (!deliver->entries) {
+		return;
+	}
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		if (!(deliver->channels & (1ULL << channel))) {
+			continue;
+		}
+
+		msgs = 0;
+		for (i = 0; i < deliver->entries; i++) {
+			if (deliver->channel[i] != channel) {
+				continue;
+			}
+			memset(&deliver->msg[msgs], 0, sizeof(struct knet_mmsghdr));
+			deliver->msg[msgs].msg_hdr.msg_iov = &deliver->iov[i];
+			deliver->msg[msgs].msg_hdr.msg_iovlen = 1;
+			deliver->msg_entry[msgs] = i;
+			msgs++;
+		}
+
+		_deliver_to_sock(knet_h, channel, msgs);
+	}
+
+	deliver->entries = 0;
+	deliver->channels = 0;
+}
+
+/*
+ * data has to stay valid until the queue is flushed. seq_num is
+ * marked as delivered right away to drop copies received from
+ * other links in the meantime.
+ */
+static void _queue_deliver_data(knet_handle_t knet_h, struct knet_host *src_host, seq_num_t seq_num,
+				unsigned char *data, size_t len, int8_t channel)
+{
+	struct knet_rx_deliver *deliver = &knet_h->recv_from_links_deliver;
+
+	deliver->iov[deliver->entries].iov_base = data;
+	deliver->iov[deliver->entries].iov_len = len;
+	deliver->channel[deliver->entries] = channel;
+	deliver->host[deliver->entries] = src_host;
+	deliver->seq_num[deliver->entries] = seq_num;
+	deliver->channels |= 1ULL << channel;
+	deliver->entries++;
+
+	_seq_num_set(src_host, seq_num, 0);
+
+	if (deliver->entries == KNET_RX_DELIVER_BATCH) {
+		_flush_deliver_batch(knet_h);
+	}
 }
 
 static int _fast_data_up(knet_handle_t knet_h, struct knet_host *src_host, struct knet_link *src_link)
 {
 	if (src_link->received_pong) {
 		log_debug(knet_h, KNET_SUB_RX, "host: %u link: %u received data during valid ping/pong activity. Force link up.", src_host->host_id, src_link->link_id);
-		_link_updown(knet_h, src_host->host_id, src_link->link_id, src_link->status.enabled, 1, 0);
+		_link_updown(knet_h, src_host->host_id, src_link->link_id, src_link->status.enabled, 1, 1);
 		return 1;
 	}
 	// host is not eligible for fast data up
@@ -627,7 +627,7 @@ static void _process_data(knet_handle_t knet_h, struct knet_host *src_host, stru
 	ssize_t header_size;
 	seq_num_t seq_num;
 	uint8_t frags, frag_seq;
-	unsigned char *data;
+	unsigned char *data, *pckt_data;
 
 	if (_handle_data_stats(knet_h, src_link, len, decrypt_time) < 0) {
 		return;
@@ -655,6 +655,8 @@ static void _process_data(knet_handle_t knet_h, struct knet_host *src_host, stru
 		}
 	}
 
+	pckt_data = data;
+
 	if (!_seq_num_lookup(knet_h, src_host, seq_num, 0, 0)) {
 		if (src_host->link_handler_policy != KNET_LINK_POLICY_ACTIVE) {
 			log_debug(knet_h, KNET_SUB_RX, "Packet has already been delivered");
@@ -674,13 +676,13 @@ static void _process_data(knet_handle_t knet_h, struct knet_host *src_host, stru
 		 *
 		 */
 		len = len - header_size;
-		if (_pckt_defrag(knet_h, src_host, seq_num, data, &len, frags, frag_seq)) {
+		if (_pckt_defrag(knet_h, src_host, seq_num, &data, &len, frags, frag_seq)) {
 			return;
 		}
 		len = len + header_size;
 	}
 
-	if (_decompress_data(knet_h, decompress_type, data, &len, header_size) < 0) {
+	if (_decompress_data(knet_h, decompress_type, &data, &len, header_size) < 0) {
 		return;
 	}
 
@@ -716,52 +718,90 @@ static void _process_data(knet_handle_t knet_h, struct knet_host *src_host, stru
 	}
 #endif
 
-	if (_deliver_data(knet_h, data, len, header_size, channel) < 0) {
-		return;
-	}
+	_queue_deliver_data(knet_h, src_host, seq_num, data, len - header_size, channel);
 
-	_seq_num_set(src_host, seq_num, 0);
+	/*
+	 * reassembled and decompressed packets are not in the
+	 * receive buffers and are overwritten by the next ones
+	 */
+	if (data != pckt_data) {
+		_flush_deliver_batch(knet_h);
+	}
 }
 
-static struct knet_header *_decrypt_packet(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t *len, uint64_t *decrypt_time)
+static int _has_crypto_instances(knet_handle_t knet_h)
 {
-	int try_decrypt = 0;
-	int i = 0;
-	struct timespec start_time;
-	struct timespec end_time;
-	ssize_t outlen;
+	int i;
 
 	for (i = 1; i <= KNET_MAX_CRYPTO_INSTANCES; i++) {
 		if (knet_h->crypto_instance[i]) {
-			try_decrypt = 1;
-			break;
+			return 1;
 		}
 	}
 
-	if ((!try_decrypt) && (knet_h->crypto_only == KNET_CRYPTO_RX_DISALLOW_CLEAR_TRAFFIC)) {
-		log_debug(knet_h, KNET_SUB_RX, "RX thread configured to accept only crypto packets, but no crypto configs are configured!");
-		return NULL;
-	}
+	return 0;
+}
 
-	if (try_decrypt) {
-		clock_gettime(CLOCK_MONOTONIC, &start_time);
-		if (crypto_authenticate_and_decrypt(knet_h,
-						    (unsigned char *)inbuf,
-						    *len,
-						    knet_h->recv_from_links_buf_decrypt,
-						    &outlen) < 0) {
-			log_debug(knet_h, KNET_SUB_RX, "Unable to decrypt/auth packet");
-			if (knet_h->crypto_only == KNET_CRYPTO_RX_DISALLOW_CLEAR_TRAFFIC) {
-				return NULL;
-			}
-			log_debug(knet_h, KNET_SUB_RX, "Attempting to process packet as clear data");
-		} else {
-			clock_gettime(CLOCK_MONOTONIC, &end_time);
-			timespec_diff(start_time, end_time, decrypt_time);
+static void _decrypt_job(knet_handle_t knet_h, struct knet_crypto_job *job)
+{
+	struct timespec start_time;
+	struct timespec end_time;
 
-			*len = outlen;
-			inbuf = (struct knet_header *)knet_h->recv_from_links_buf_decrypt;
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	job->err = crypto_authenticate_and_decrypt(knet_h,
+						   job->iov_in->iov_base,
+						   job->iov_in->iov_len,
+						   job->buf_out,
+						   &job->buf_out_len);
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	timespec_diff(start_time, end_time, &job->crypt_time);
+}
+
+/*
+ * job is set if the packet has already been decrypted
+ * by the crypto pool (see _flush_recv_batch)
+ */
+static struct knet_header *_decrypt_packet(knet_handle_t knet_h, struct knet_header *inbuf, ssize_t *len, uint64_t *decrypt_time, struct knet_crypto_job *job)
+{
+	struct knet_rx_batch *batch = &knet_h->recv_from_links_batch;
+	struct knet_crypto_job inline_job;
+	struct iovec iov_in;
+
+	if (!_has_crypto_instances(knet_h)) {
+		if (knet_h->crypto_only == KNET_CRYPTO_RX_DISALLOW_CLEAR_TRAFFIC) {
+			log_debug(knet_h, KNET_SUB_RX, "RX thread configured to accept only crypto packets, but no crypto configs are configured!");
+			return NULL;
 		}
+		return inbuf;
+	}
+
+	if (!job) {
+		/*
+		 * the batch buffers are not used without crypto threads,
+		 * rotate through them so that queued packets stay valid
+		 */
+		if (batch->inline_next == KNET_RX_DECRYPT_BATCH) {
+			_flush_deliver_batch(knet_h);
+		}
+		iov_in.iov_base = inbuf;
+		iov_in.iov_len = *len;
+		inline_job.iov_in = &iov_in;
+		inline_job.iovcnt_in = 1;
+		inline_job.buf_out = batch->buf_decrypt[batch->inline_next++];
+		job = &inline_job;
+		_decrypt_job(knet_h, job);
+	}
+
+	if (job->err < 0) {
+		log_debug(knet_h, KNET_SUB_RX, "Unable to decrypt/auth packet");
+		if (knet_h->crypto_only == KNET_CRYPTO_RX_DISALLOW_CLEAR_TRAFFIC) {
+			return NULL;
+		}
+		log_debug(knet_h, KNET_SUB_RX, "Attempting to process packet as clear data");
+	} else {
+		*decrypt_time = job->crypt_time;
+		*len = job->buf_out_len;
+		inbuf = (struct knet_header *)job->buf_out;
 	}
 	return inbuf;
 }
@@ -842,7 +882,9 @@ static void _handle_dynip(knet_handle_t knet_h, struct knet_host *src_host, stru
 		if (cmpaddr(&src_link->dst_addr, msg->msg_hdr.msg_name) != 0) {
 			log_debug(knet_h, KNET_SUB_RX, "host: %u link: %u appears to have changed ip address",
 				  src_host->host_id, src_link->link_id);
+			_link_addr_index_del(knet_h, src_link);
 			memmove(&src_link->dst_addr, msg->msg_hdr.msg_name, sizeof(struct sockaddr_storage));
+			_link_addr_index_add(knet_h, src_host->host_id, src_link);
 			if (knet_addrtostr(&src_link->dst_addr, sockaddr_len(&src_link->dst_addr),
 					src_link->status.dst_ipaddr, KNET_MAX_HOST_LEN,
 					src_link->status.dst_port, KNET_MAX_PORT_LEN) != 0) {
@@ -864,12 +906,66 @@ static void _handle_dynip(knet_handle_t knet_h, struct knet_host *src_host, stru
 	}
 }
 
+/*
+ * access lists only look at the source address. Addresses accepted
+ * on a link are cached until the next change to its access lists,
+ * rejected packets are always checked (and logged)
+ */
+static const uint8_t *_rx_acl_cache_key(const struct sockaddr_storage *ss, size_t *len)
+{
+	switch (ss->ss_family) {
+		case AF_INET:
+			*len = sizeof(struct in_addr);
+			return (const uint8_t *)&((const struct sockaddr_in *)ss)->sin_addr;
+		case AF_INET6:
+			*len = sizeof(struct in6_addr);
+			return (const uint8_t *)&((const struct sockaddr_in6 *)ss)->sin6_addr;
+	}
+	return NULL;
+}
+
+static int _rx_acl_cache_lookup(struct knet_link *src_link, sa_family_t family, const uint8_t *key, size_t len)
+{
+	struct knet_link_acl_cache *entry;
+	int i;
+
+	for (i = 0; i < KNET_LINK_ACL_CACHE_SIZE; i++) {
+		entry = &src_link->acl_cache[i];
+		if ((entry->family == family) &&
+		    (entry->acl_generation == src_link->acl_generation) &&
+		    (!memcmp(entry->addr, key, len))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void _rx_acl_cache_store(struct knet_link *src_link, sa_family_t family, const uint8_t *key, size_t len)
+{
+	struct knet_link_acl_cache *entry = &src_link->acl_cache[src_link->acl_cache_next];
+
+	entry->family = family;
+	entry->acl_generation = src_link->acl_generation;
+	memmove(entry->addr, key, len);
+
+	src_link->acl_cache_next = (src_link->acl_cache_next + 1) % KNET_LINK_ACL_CACHE_SIZE;
+}
+
 /*
  * processing incoming packets vs access lists
  */
 static int _check_rx_acl(knet_handle_t knet_h, struct knet_link *src_link, const struct knet_mmsghdr *msg)
 {
+	const struct sockaddr_storage *src_addr = msg->msg_hdr.msg_name;
+	const uint8_t *key;
+	size_t key_len = 0;
+
 	if (knet_h->use_access_lists) {
+		key = _rx_acl_cache_key(src_addr, &key_len);
+		if ((key) && (_rx_acl_cache_lookup(src_link, src_addr->ss_family, key, key_len))) {
+			return 1;
+		}
+
 		if (!check_validate(knet_h, src_link, msg->msg_hdr.msg_name)) {
 			char src_ipaddr[KNET_MAX_HOST_LEN];
 			char src_port[KNET_MAX_PORT_LEN];
@@ -886,21 +982,24 @@ static int _check_rx_acl(knet_handle_t knet_h, struct knet_link *src_link, const
 			}
 			return 0;
 		}
+
+		if (key) {
+			_rx_acl_cache_store(src_link, src_addr->ss_family, key, key_len);
+		}
 	}
 	return 1;
 }
 
-static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg)
+static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg, struct knet_crypto_job *job)
 {
-	int savederrno = 0, stats_err = 0;
+	int stats_err = 0;
 	struct knet_host *src_host;
 	struct knet_link *src_link;
 	uint64_t decrypt_time = 0;
 	struct knet_header *inbuf = msg->msg_hdr.msg_iov->iov_base;
 	ssize_t len = msg->msg_len;
-	int i, found_link = 0;
 
-	inbuf = _decrypt_packet(knet_h, inbuf, &len, &decrypt_time);
+	inbuf = _decrypt_packet(knet_h, inbuf, &len, &decrypt_time, job);
 	if (!inbuf) {
 		char src_ipaddr[KNET_MAX_HOST_LEN];
 		char src_port[KNET_MAX_PORT_LEN];
@@ -963,14 +1062,8 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 		}
 		_handle_dynip(knet_h, src_host, src_link, sockfd, msg);
 	} else { /* all other packets */
-		for (i = 0; i < KNET_MAX_LINK; i++) {
-			src_link = &src_host->link[i];
-			if (cmpaddr(&src_link->dst_addr, msg->msg_hdr.msg_name) == 0) {
-				found_link = 1;
-				break;
-			}
-		}
-		if (found_link) {
+		src_link = _link_addr_index_lookup(knet_h, src_host->host_id, msg->msg_hdr.msg_name);
+		if (src_link) {
 			/*
 			 * this check is currently redundant.. Keep it here for now
 			 */
@@ -983,13 +1076,10 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 		}
 	}
 
-	stats_err = pthread_mutex_lock(&src_link->link_stats_mutex);
-	if (stats_err) {
-		log_err(knet_h, KNET_SUB_RX, "Unable to get stats mutex lock for host %u link %u: %s",
-			src_host->host_id, src_link->link_id, strerror(savederrno));
-		return;
-	}
-
+	/*
+	 * link counters are updated atomically, link_stats_mutex
+	 * is only needed to update latency and link state on pong
+	 */
 	switch (inbuf->kh_type) {
 		case KNET_HEADER_TYPE_DATA:
 			_process_data(knet_h, src_host, src_link, inbuf, len, decrypt_time);
@@ -998,30 +1088,138 @@ static void _parse_recv_from_links(knet_handle_t knet_h, int sockfd, const struc
 			process_ping(knet_h, src_host, src_link, inbuf, len);
 			break;
 		case KNET_HEADER_TYPE_PONG:
+			stats_err = pthread_mutex_lock(&src_link->link_stats_mutex);
+			if (stats_err) {
+				log_err(knet_h, KNET_SUB_RX, "Unable to get stats mutex lock for host %u link %u: %s",
+					src_host->host_id, src_link->link_id, strerror(stats_err));
+				return;
+			}
 			process_pong(knet_h, src_host, src_link, inbuf, len);
+			pthread_mutex_unlock(&src_link->link_stats_mutex);
 			break;
 		case KNET_HEADER_TYPE_PMTUD:
-			src_link->status.stats.rx_pmtu_packets++;
-			src_link->status.stats.rx_pmtu_bytes += len;
-			/* Unlock so we don't deadlock with tx_mutex */
-			pthread_mutex_unlock(&src_link->link_stats_mutex);
+			link_stats_add(src_link->status.stats.rx_pmtu_packets, 1);
+			link_stats_add(src_link->status.stats.rx_pmtu_bytes, len);
 			process_pmtud(knet_h, src_link, inbuf);
-			return; /* Don't need to unlock link_stats_mutex */
 			break;
 		case KNET_HEADER_TYPE_PMTUD_REPLY:
-			src_link->status.stats.rx_pmtu_packets++;
-			src_link->status.stats.rx_pmtu_bytes += len;
-			/* pmtud_mutex can't be acquired while we hold a link_stats_mutex (ordering) */
-			pthread_mutex_unlock(&src_link->link_stats_mutex);
+			link_stats_add(src_link->status.stats.rx_pmtu_packets, 1);
+			link_stats_add(src_link->status.stats.rx_pmtu_bytes, len);
 			process_pmtud_reply(knet_h, src_link, inbuf);
-			return;
 			break;
 		default:
-			pthread_mutex_unlock(&src_link->link_stats_mutex);
-			return;
 			break;
 	}
-	pthread_mutex_unlock(&src_link->link_stats_mutex);
+}
+
+/*
+ * decrypt all queued packets in parallel and parse them in order
+ */
+static void _flush_recv_batch(knet_handle_t knet_h, int sockfd)
+{
+	struct knet_rx_batch *batch = &knet_h->recv_from_links_batch;
+	int i;
+
+	if (!batch->entries) {
+		return;
+	}
+
+	for (i = 0; i < batch->entries; i++) {
+		batch->job[i].iov_in = &batch->iov[i];
+		batch->job[i].iovcnt_in = 1;
+		batch->job[i].buf_out = batch->buf_decrypt[i];
+		batch->job[i].buf_out_len = 0;
+		batch->job[i].crypt_time = 0;
+	}
+
+	_crypto_pool_run(knet_h, _decrypt_job, batch->job, batch->entries);
+
+	for (i = 0; i < batch->entries; i++) {
+		_parse_recv_from_links(knet_h, sockfd, &batch->msg[i], &batch->job[i]);
+	}
+
+	/*
+	 * decrypted packets are delivered from buf_decrypt
+	 */
+	_flush_deliver_batch(knet_h);
+
+	batch->entries = 0;
+}
+
+/*
+ * packets are parsed immediately unless there are crypto threads
+ * that can help with decryption. msg_name must stay valid until
+ * the batch is flushed.
+ */
+static void _queue_recv_from_links(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg)
+{
+	struct knet_rx_batch *batch = &knet_h->recv_from_links_batch;
+
+	if ((!knet_h->crypto_pool.threads) || (!_has_crypto_instances(knet_h))) {
+		_parse_recv_from_links(knet_h, sockfd, msg, NULL);
+		return;
+	}
+
+	memmove(&batch->msg[batch->entries], msg, sizeof(struct knet_mmsghdr));
+	batch->iov[batch->entries].iov_base = msg->msg_hdr.msg_iov->iov_base;
+	batch->iov[batch->entries].iov_len = msg->msg_len;
+	batch->msg[batch->entries].msg_hdr.msg_iov = &batch->iov[batch->entries];
+	batch->msg[batch->entries].msg_hdr.msg_iovlen = 1;
+	batch->entries++;
+
+	if (batch->entries == KNET_RX_DECRYPT_BATCH) {
+		_flush_recv_batch(knet_h, sockfd);
+	}
+}
+
+/*
+ * with UDP_GRO enabled on the socket, the kernel can coalesce
+ * multiple datagrams from the same source in one buffer.
+ * All segments have the size reported in the cmsg, except the
+ * last one that can be shorter. Split them back and parse
+ * them one by one.
+ */
+static void _parse_recv_from_links_gro(knet_handle_t knet_h, int sockfd, const struct knet_mmsghdr *msg)
+{
+#ifdef UDP_GRO
+	struct cmsghdr *cmsg;
+	struct knet_mmsghdr seg_msg;
+	struct iovec seg_iov;
+	unsigned char *buf = msg->msg_hdr.msg_iov->iov_base;
+	unsigned int offset = 0;
+	int seg_size = 0;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg->msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR((struct msghdr *)&msg->msg_hdr, cmsg)) {
+		if ((cmsg->cmsg_level == IPPROTO_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+			memmove(&seg_size, CMSG_DATA(cmsg), sizeof(int));
+			break;
+		}
+	}
+
+	if ((seg_size <= 0) || ((unsigned int)seg_size >= msg->msg_len)) {
+		_queue_recv_from_links(knet_h, sockfd, msg);
+		return;
+	}
+
+	memmove(&seg_msg, msg, sizeof(struct knet_mmsghdr));
+	seg_msg.msg_hdr.msg_iov = &seg_iov;
+	seg_msg.msg_hdr.msg_iovlen = 1;
+
+	while (offset < msg->msg_len) {
+		seg_iov.iov_base = buf + offset;
+		seg_msg.msg_len = msg->msg_len - offset;
+		if (seg_msg.msg_len > (unsigned int)seg_size) {
+			seg_msg.msg_len = seg_size;
+		}
+		seg_iov.iov_len = seg_msg.msg_len;
+
+		_queue_recv_from_links(knet_h, sockfd, &seg_msg);
+
+		offset += seg_msg.msg_len;
+	}
+#else
+	_queue_recv_from_links(knet_h, sockfd, msg);
+#endif
 }
 
 static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg)
@@ -1051,6 +1249,7 @@ static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct kne
 
 	for (i = 0; i < PCKT_RX_BUFS; i++) {
 		msg[i].msg_hdr.msg_namelen = knet_h->knet_transport_fd_tracker[sockfd].sockaddr_len;
+		msg[i].msg_hdr.msg_controllen = KNET_RX_CONTROL_SIZE;
 	}
 
 	msg_recv = _recvmmsg(sockfd, &msg[0], PCKT_RX_BUFS, MSG_DONTWAIT | MSG_NOSIGNAL);
@@ -1106,7 +1305,11 @@ static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct kne
 				goto exit_unlock;
 				break;
 			case KNET_TRANSPORT_RX_IS_DATA: /* packet is data and should be parsed as such */
-				_parse_recv_from_links(knet_h, sockfd, &msg[i]);
+				if (transport == KNET_TRANSPORT_UDP) {
+					_parse_recv_from_links_gro(knet_h, sockfd, &msg[i]);
+				} else {
+					_queue_recv_from_links(knet_h, sockfd, &msg[i]);
+				}
 				break;
 			case KNET_TRANSPORT_RX_OOB_DATA_CONTINUE:
 				log_debug(knet_h, KNET_SUB_RX, "Transport is processing sock OOB data, continue");
@@ -1119,7 +1322,15 @@ static void _handle_recv_from_links(knet_handle_t knet_h, int sockfd, struct kne
 	}
 
 exit_unlock:
-	_shrink_defrag_buffers(knet_h);
+	_flush_recv_batch(knet_h, sockfd);
+	_flush_deliver_batch(knet_h);
+	/*
+	 * after the batch has been delivered, released defrag
+	 * buffers are not referenced anymore
+	 */
+	if (stats_get(knet_h->defrag_pool.trim_pending)) {
+		_defrag_pool_trim(knet_h);
+	}
 	pthread_rwlock_unlock(&knet_h->global_rwlock);
 }
 
@@ -1131,9 +1342,7 @@ void *_handle_recv_from_links_thread(void *data)
 	struct sockaddr_storage address[PCKT_RX_BUFS];
 	struct knet_mmsghdr msg[PCKT_RX_BUFS];
 	struct iovec iov_in[PCKT_RX_BUFS];
-#if defined(IP_PKTINFO) || defined(IPV6_PKTINFO)
-	unsigned char control_in[CMSG_SPACE(sizeof(struct in6_pktinfo))][PCKT_RX_BUFS];
-#endif
+	unsigned char control_in[PCKT_RX_BUFS][KNET_RX_CONTROL_SIZE];
 
 	set_thread_status(knet_h, KNET_THREAD_RX, KNET_THREAD_STARTED);
 
@@ -1150,10 +1359,8 @@ void *_handle_recv_from_links_thread(void *data)
 		msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage); /* Real value filled in before actual use */
 		msg[i].msg_hdr.msg_iov = &iov_in[i];
 		msg[i].msg_hdr.msg_iovlen = 1;
-#if defined(IP_PKTINFO) || defined(IPV6_PKTINFO)
-		msg[i].msg_hdr.msg_control = &control_in[0][i];
-		msg[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo)); /* Largest of the two pktinfo structs */
-#endif
+		msg[i].msg_hdr.msg_control = &control_in[i][0];
+		msg[i].msg_hdr.msg_controllen = KNET_RX_CONTROL_SIZE; /* Real value filled in before actual use */
 	}
 
 	while (!shutdown_in_progress(knet_h)) {
@@ -1234,6 +1441,12 @@ ssize_t knet_recv(knet_handle_t knet_h, char *buff, const size_t buff_len, const
 		goto out_unlock;
 	}
 
+	if (knet_h->sockfd[channel].rx_ring) {
+		err = _ring_pop(knet_h->sockfd[channel].rx_ring, buff, buff_len);
+		savederrno = errno;
+		goto out_unlock;
+	}
+
 	memset(&iov_in, 0, sizeof(iov_in));
 	iov_in.iov_base = (void *)buff;
 	iov_in.iov_len = buff_len;
@@ -1246,3 +1459,136 @@ out_unlock:
 	errno = err ? savederrno : 0;
 	return err;
 }
+
+/*
+ * knet_mmsghdr has the same layout as mmsghdr. Datafds that are
+ * not sockets are read one message at a time
+ */
+static int _recv_msgs_from_datafd(knet_handle_t knet_h, int8_t channel, struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	int sockfd = knet_h->sockfd[channel].sockfd[0];
+	struct knet_ring *ring = knet_h->sockfd[channel].rx_ring;
+	ssize_t inlen;
+	unsigned int i;
+
+	if (ring) {
+		for (i = 0; i < vlen; i++) {
+			inlen = _ring_pop(ring, msg[i].msg_hdr.msg_iov->iov_base, msg[i].msg_hdr.msg_iov->iov_len);
+			if (inlen < 0) {
+				break;
+			}
+			msg[i].msg_len = inlen;
+		}
+		return ((i > 0) ? (int)i : -1);
+	}
+
+	if (knet_h->sockfd[channel].is_socket) {
+#ifdef HAVE_RECVMMSG
+		return recvmmsg(sockfd, (struct mmsghdr *)msg, vlen, MSG_DONTWAIT, NULL);
+#else
+		return _recvmmsg(sockfd, msg, vlen, MSG_DONTWAIT);
+#endif
+	}
+
+	inlen = readv(sockfd, msg[0].msg_hdr.msg_iov, 1);
+	if (inlen < 0) {
+		return -1;
+	}
+	msg[0].msg_len = inlen;
+
+	return 1;
+}
+
+int knet_recvmmsg(knet_handle_t knet_h, struct knet_msg *msgvec, const unsigned int vlen)
+{
+	int savederrno = 0;
+	int err = 0;
+	unsigned int i, recv = 0, msgs;
+	int8_t channel;
+	struct iovec iov_in[KNET_API_MMSG_BATCH];
+	struct knet_mmsghdr msg[KNET_API_MMSG_BATCH];
+
+	if (!_is_valid_handle(knet_h)) {
+		return -1;
+	}
+
+	if ((msgvec == NULL) || (vlen == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < vlen; i++) {
+		if ((msgvec[i].buff == NULL) ||
+		    (msgvec[i].buff_len <= 0) ||
+		    (msgvec[i].buff_len > KNET_MAX_PACKET_SIZE) ||
+		    (msgvec[i].channel < 0) ||
+		    (msgvec[i].channel >= KNET_DATAFD_MAX)) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	while (recv < vlen) {
+		channel = msgvec[recv].channel;
+
+		if (!knet_h->sockfd[channel].in_use) {
+			savederrno = EINVAL;
+			break;
+		}
+
+		/*
+		 * read consecutive messages for the same channel at once
+		 */
+		msgs = 0;
+		while ((recv + msgs < vlen) &&
+		       (msgs < KNET_API_MMSG_BATCH) &&
+		       (msgvec[recv + msgs].channel == channel)) {
+			iov_in[msgs].iov_base = msgvec[recv + msgs].buff;
+			iov_in[msgs].iov_len = msgvec[recv + msgs].buff_len;
+			memset(&msg[msgs], 0, sizeof(struct knet_mmsghdr));
+			msg[msgs].msg_hdr.msg_iov = &iov_in[msgs];
+			msg[msgs].msg_hdr.msg_iovlen = 1;
+			msgs++;
+		}
+
+		err = _recv_msgs_from_datafd(knet_h, channel, msg, msgs);
+		if (err <= 0) {
+			savederrno = errno;
+			break;
+		}
+
+		for (i = 0; i < (unsigned int)err; i++) {
+			msgvec[recv + i].msg_len = msg[i].msg_len;
+		}
+		recv += err;
+
+		/*
+		 * the channel has been drained, or the socket has been closed
+		 */
+		if (((unsigned int)err < msgs) &&
+		    ((knet_h->sockfd[channel].is_socket) || (knet_h->sockfd[channel].rx_ring))) {
+			break;
+		}
+		if (!msg[err - 1].msg_len) {
+			break;
+		}
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	if (recv) {
+		errno = 0;
+		return recv;
+	}
+
+	errno = savederrno;
+	return -1;
+}
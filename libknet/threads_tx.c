@@ -9,12 +9,17 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <math.h>
 #include <sys/uio.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
+#include "common.h"
 #include "compat.h"
 #include "compress.h"
 #include "crypto.h"
@@ -24,118 +29,619 @@
 #include "transports.h"
 #include "transport_common.h"
 #include "threads_common.h"
+#include "threads_crypto.h"
 #include "threads_heartbeat.h"
 #include "threads_tx.h"
 #include "netutils.h"
 #include "onwire_v1.h"
+#include "ring.h"
 
 /*
  * SEND
  */
 
-static int _dispatch_to_links(knet_handle_t knet_h, struct knet_host *dst_host, struct knet_mmsghdr *msg, int msgs_to_send)
+/*
+ * knet_mmsghdr has the same layout as mmsghdr. Connection oriented
+ * transports need msg_name to be stripped, leave it to the compat layer
+ */
+static int _send_to_sock(int sockfd, int connection_oriented, struct knet_mmsghdr *msg, unsigned int vlen, int flags)
 {
-	int link_idx, msg_idx, sent_msgs, prev_sent, progress;
-	int err = 0, savederrno = 0, locked = 0;
-	unsigned int i;
-	struct knet_mmsghdr *cur;
-	struct knet_link *cur_link;
+#ifdef HAVE_SENDMMSG
+	if (connection_oriented != TRANSPORT_PROTO_IS_CONNECTION_ORIENTED) {
+		return sendmmsg(sockfd, (struct mmsghdr *)msg, vlen, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+#endif
+	return _sendmmsg(sockfd, connection_oriented, msg, vlen, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+}
 
-	for (link_idx = 0; link_idx < dst_host->active_link_entries; link_idx++) {
-		prev_sent = 0;
-		progress = 1;
-		locked = 0;
+/*
+ * MSG_ZEROCOPY attaches every page of the buffer to the skb,
+ * the kernel refuses buffers spanning more than MAX_SKB_FRAGS
+ * pages (17 by default)
+ */
+static int _iov_zerocopy_ok(const struct iovec *iov, size_t iovcnt)
+{
+	size_t i, pages = 0;
+	uintptr_t start, end;
+	long page_size = sysconf(_SC_PAGESIZE);
 
-		cur_link = &dst_host->link[dst_host->active_links[link_idx]];
+	if (page_size <= 0) {
+		return 0;
+	}
 
-		if (cur_link->transport == KNET_TRANSPORT_LOOPBACK) {
+	for (i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_len) {
 			continue;
 		}
+		start = (uintptr_t)iov[i].iov_base / page_size;
+		end = ((uintptr_t)iov[i].iov_base + iov[i].iov_len - 1) / page_size;
+		pages += end - start + 1;
+	}
 
-		savederrno = pthread_mutex_lock(&cur_link->link_stats_mutex);
-		if (savederrno) {
-			log_err(knet_h, KNET_SUB_TX, "Unable to get stats mutex lock for host %u link %u: %s",
-				dst_host->host_id, cur_link->link_id, strerror(savederrno));
-			continue;
+	return (pages <= KNET_TX_ZEROCOPY_MAX_PAGES);
+}
+
+static size_t _iov_len(const struct iovec *iov, size_t iovcnt)
+{
+	size_t i, len = 0;
+
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+
+	return len;
+}
+
+static void _tx_bufs_free(struct knet_tx_bufs *bufs)
+{
+	int i;
+
+	if (!bufs) {
+		return;
+	}
+
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		free(bufs->send_to_links_buf[i]);
+		free(bufs->send_to_links_buf_crypt[i]);
+	}
+	free(bufs->recv_from_sock_buf);
+	free(bufs);
+}
+
+static struct knet_tx_bufs *_tx_bufs_alloc(knet_handle_t knet_h)
+{
+	int savederrno = 0;
+	int i;
+	size_t bufsize;
+	struct knet_tx_bufs *bufs;
+
+	bufs = malloc(sizeof(struct knet_tx_bufs));
+	if (!bufs) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for TX buffers: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return NULL;
+	}
+	memset(bufs, 0, sizeof(struct knet_tx_bufs));
+
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		bufsize = ceil((float)KNET_MAX_PACKET_SIZE / (i + 1)) + KNET_HEADER_ALL_SIZE;
+		bufs->send_to_links_buf[i] = malloc(bufsize);
+		if (!bufs->send_to_links_buf[i]) {
+			savederrno = errno;
+			log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory datafd to link buffer: %s",
+				strerror(savederrno));
+			goto exit_fail;
 		}
-		locked = 1;
+		memset(bufs->send_to_links_buf[i], 0, bufsize);
+	}
 
-		msg_idx = 0;
-		while (msg_idx < msgs_to_send) {
-			msg[msg_idx].msg_hdr.msg_name = &cur_link->dst_addr;
-			msg[msg_idx].msg_hdr.msg_namelen = knet_h->knet_transport_fd_tracker[cur_link->outsock].sockaddr_len;
+	for (i = 0; i < PCKT_FRAG_MAX; i++) {
+		bufsize = ceil((float)KNET_MAX_PACKET_SIZE / (i + 1)) + KNET_HEADER_ALL_SIZE + KNET_DATABUFSIZE_CRYPT_PAD;
+		bufs->send_to_links_buf_crypt[i] = malloc(bufsize);
+		if (!bufs->send_to_links_buf_crypt[i]) {
+			savederrno = errno;
+			log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for crypto datafd to link buffer: %s",
+				strerror(savederrno));
+			goto exit_fail;
+		}
+		memset(bufs->send_to_links_buf_crypt[i], 0, bufsize);
+	}
 
-			/* Cast for Linux/BSD compatibility */
-			for (i=0; i<(unsigned int)msg[msg_idx].msg_hdr.msg_iovlen; i++) {
-				cur_link->status.stats.tx_data_bytes += msg[msg_idx].msg_hdr.msg_iov[i].iov_len;
+	return bufs;
+
+exit_fail:
+	_tx_bufs_free(bufs);
+	errno = savederrno;
+	return NULL;
+}
+
+/*
+ * the extra buffer sets are only needed by workers that send
+ * with MSG_ZEROCOPY. Each set, including the first one, also
+ * needs a spare ingest buffer (see _tx_bufs_rotate).
+ */
+static int _tx_bufs_zerocopy_init(knet_handle_t knet_h, struct knet_tx_worker *worker)
+{
+	int i;
+
+	for (i = 0; i < KNET_TX_ZEROCOPY_BUFS; i++) {
+		if (!worker->tx_bufs[i]) {
+			worker->tx_bufs[i] = _tx_bufs_alloc(knet_h);
+			if (!worker->tx_bufs[i]) {
+				return -1;
+			}
+		}
+		if (!worker->tx_bufs[i]->recv_from_sock_buf) {
+			worker->tx_bufs[i]->recv_from_sock_buf = malloc(KNET_DATABUFSIZE);
+			if (!worker->tx_bufs[i]->recv_from_sock_buf) {
+				log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for app to datafd buffer: %s",
+					strerror(errno));
+				return -1;
 			}
-			cur_link->status.stats.tx_data_packets++;
-			msg_idx++;
+			memset(worker->tx_bufs[i]->recv_from_sock_buf, 0, KNET_DATABUFSIZE);
+		}
+	}
+
+	return 0;
+}
+
+static int _tx_bufs_reap(knet_handle_t knet_h, struct knet_tx_bufs *bufs)
+{
+	while (bufs->zc_pending_entries) {
+		if (!transport_tx_zerocopy_done(knet_h,
+						bufs->zc_pending[bufs->zc_pending_entries - 1].transport,
+						&bufs->zc_pending[bufs->zc_pending_entries - 1])) {
+			return -1;
+		}
+		bufs->zc_pending_entries--;
+	}
+
+	return 0;
+}
+
+/*
+ * MSG_ZEROCOPY can only be used if there is a free set
+ * to move to once the current one has been sent
+ */
+static int _tx_bufs_zerocopy_ready(knet_handle_t knet_h, struct knet_tx_worker *worker)
+{
+	int i;
+
+	if (worker->tx_bufs_next >= 0) {
+		return 1;
+	}
+
+	if (worker->tx_bufs_failed) {
+		return 0;
+	}
+
+	if (!worker->tx_bufs[KNET_TX_ZEROCOPY_BUFS - 1]) {
+		if (_tx_bufs_zerocopy_init(knet_h, worker) < 0) {
+			log_warn(knet_h, KNET_SUB_TX, "Unable to allocate MSG_ZEROCOPY buffers for TX worker %u, sending without MSG_ZEROCOPY",
+				 worker->worker_id);
+			worker->tx_bufs_failed = 1;
+			return 0;
+		}
+	}
+
+	for (i = 0; i < KNET_TX_ZEROCOPY_BUFS; i++) {
+		if (worker->tx_bufs[i] == worker->bufs) {
+			continue;
 		}
+		if (!_tx_bufs_reap(knet_h, worker->tx_bufs[i])) {
+			worker->tx_bufs_next = i;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * a set tracks the MSG_ZEROCOPY sends of one packet, one entry per socket
+ */
+static int _tx_bufs_zerocopy_room(struct knet_tx_bufs *bufs, int sockfd)
+{
+	int i;
+
+	if (bufs->zc_pending_entries < KNET_MAX_LINK) {
+		return 1;
+	}
 
-retry:
-		cur = &msg[prev_sent];
+	for (i = 0; i < bufs->zc_pending_entries; i++) {
+		if (bufs->zc_pending[i].sockfd == sockfd) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void _tx_bufs_add_pending(struct knet_tx_bufs *bufs, struct knet_tx_zc_pending *zc)
+{
+	int i;
+
+	for (i = 0; i < bufs->zc_pending_entries; i++) {
+		if (bufs->zc_pending[i].sockfd == zc->sockfd) {
+			break;
+		}
+	}
+
+	if (i == KNET_MAX_LINK) {
+		return;
+	}
+
+	memmove(&bufs->zc_pending[i], zc, sizeof(struct knet_tx_zc_pending));
+	if (i == bufs->zc_pending_entries) {
+		bufs->zc_pending_entries++;
+	}
+}
+
+/*
+ * the buffers of the packet just sent stay with the kernel until
+ * the MSG_ZEROCOPY completions are reaped, continue with a free set
+ * (_tx_bufs_zerocopy_ready made sure there is one). The ingest buffer
+ * of the packet moves to the pinned set in exchange for its spare one.
+ */
+static void _tx_bufs_rotate(struct knet_tx_worker *worker, struct knet_header *inbuf)
+{
+	struct knet_tx_bufs *bufs = worker->bufs;
+	int i;
+
+	if (!bufs->zc_pending_entries) {
+		return;
+	}
+
+	for (i = 0; i < KNET_TX_INGEST_BATCH; i++) {
+		if (worker->recv_from_sock_buf[i] == inbuf) {
+			worker->recv_from_sock_buf[i] = bufs->recv_from_sock_buf;
+			bufs->recv_from_sock_buf = inbuf;
+			break;
+		}
+	}
+
+	worker->bufs = worker->tx_bufs[worker->tx_bufs_next];
+	worker->tx_bufs_next = -1;
+}
+
+/*
+ * a worker that goes away gives the kernel a chance to release
+ * its buffers before they are freed
+ */
+static void _tx_bufs_zerocopy_drain(knet_handle_t knet_h, struct knet_tx_worker *worker)
+{
+	int i, loops;
+
+	for (i = 0; i < KNET_TX_ZEROCOPY_BUFS; i++) {
+		if (!worker->tx_bufs[i]) {
+			continue;
+		}
+		loops = 0;
+		while ((_tx_bufs_reap(knet_h, worker->tx_bufs[i]) < 0) &&
+		       (loops < KNET_TX_ZEROCOPY_DRAIN_LOOPS)) {
+			usleep(knet_h->threads_timer_res / 1000);
+			loops++;
+		}
+		if (worker->tx_bufs[i]->zc_pending_entries) {
+			log_warn(knet_h, KNET_SUB_TX, "TX worker %u exiting with MSG_ZEROCOPY sends not released by the kernel",
+				 worker->worker_id);
+		}
+	}
+}
+
+/*
+ * the kernel refused the GSO super buffer (EIO is returned when the
+ * network device cannot offload UDP checksums). Disable GSO on the
+ * link and send the fragments one by one.
+ * TX workers only hold global_rwlock in read mode, udp_gso is
+ * cleared atomically so that only one of them reports it.
+ */
+static void _send_gso_fallback(knet_handle_t knet_h, struct knet_tx_batch *batch, int msg_idx, int recv_errno)
+{
+	struct knet_link *cur_link = batch->link[msg_idx];
+	struct knet_tx_gso *gso = batch->gso[msg_idx];
+	struct knet_mmsghdr msg;
+	int frag_idx;
+
+	if (__atomic_exchange_n(&cur_link->udp_gso, 0, __ATOMIC_RELAXED)) {
+		log_info(knet_h, KNET_SUB_TX, "UDP GSO send failed on link %u (sock %d): %s. Disabling UDP GSO",
+			 cur_link->link_id, batch->sockfd, strerror(recv_errno));
+	}
+
+	for (frag_idx = 0; frag_idx < gso->frags; frag_idx++) {
+		memmove(&msg, &gso->frag_msg[frag_idx], sizeof(struct knet_mmsghdr));
+		msg.msg_hdr.msg_name = batch->msg[msg_idx].msg_hdr.msg_name;
+		msg.msg_hdr.msg_namelen = batch->msg[msg_idx].msg_hdr.msg_namelen;
+
+		if (_send_to_sock(batch->sockfd,
+				  transport_get_connection_oriented(knet_h, batch->transport),
+				  &msg, 1, 0) < 0) {
+			link_stats_add(cur_link->status.stats.tx_data_errors, 1);
+		}
+	}
+}
+
+/*
+ * send all the messages queued in a batch with as few syscalls
+ * as possible. Errors are accounted to the link owning the message
+ * that failed and the remaining messages for that link are dropped.
+ */
+static int _flush_tx_batch(knet_handle_t knet_h, struct knet_tx_worker *worker, struct knet_tx_batch *batch)
+{
+	int sent_msgs, prev_sent = 0, progress = 1;
+	int err = 0, ret = 0, savederrno = 0, retsavederrno = 0;
+	int flags = 0, zerocopy = 0, zerocopy_sent = 0;
+	struct knet_link *cur_link;
+	struct knet_tx_zc_pending zc;
 
-		sent_msgs = _sendmmsg(dst_host->link[dst_host->active_links[link_idx]].outsock,
-				      transport_get_connection_oriented(knet_h, dst_host->link[dst_host->active_links[link_idx]].transport),
-				      &cur[0], msgs_to_send - prev_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+#ifdef MSG_ZEROCOPY
+	/*
+	 * the transport can refuse zerocopy at any time (for example
+	 * if the kernel is copying the data anyway or too many sends
+	 * are in flight)
+	 */
+	if ((batch->zerocopy) &&
+	    (batch->entries) &&
+	    (_tx_bufs_zerocopy_room(worker->bufs, batch->sockfd)) &&
+	    (!transport_tx_zerocopy_begin(knet_h, batch->transport, batch->sockfd, batch->entries))) {
+		zerocopy = 1;
+		flags = MSG_ZEROCOPY;
+	}
+#endif
+
+	while (prev_sent < batch->entries) {
+		sent_msgs = _send_to_sock(batch->sockfd,
+					  transport_get_connection_oriented(knet_h, batch->transport),
+					  &batch->msg[prev_sent], batch->entries - prev_sent, flags);
 		savederrno = errno;
 
-		err = transport_tx_sock_error(knet_h, dst_host->link[dst_host->active_links[link_idx]].transport, dst_host->link[dst_host->active_links[link_idx]].outsock, KNET_SUB_TX, sent_msgs, savederrno);
+		if ((sent_msgs > 0) && (flags)) {
+			zerocopy_sent += sent_msgs;
+		}
+
+		/*
+		 * the kernel could not allocate the completion notification
+		 * (optmem_max), send the rest of the batch the old way
+		 */
+		if ((sent_msgs < 0) && (flags) && (savederrno == ENOBUFS)) {
+			flags = 0;
+			continue;
+		}
+
+		cur_link = batch->link[prev_sent];
+
+		if ((sent_msgs < 0) &&
+		    (batch->gso[prev_sent]) &&
+		    ((savederrno == EIO) || (savederrno == EINVAL))) {
+			_send_gso_fallback(knet_h, batch, prev_sent, savederrno);
+			prev_sent++;
+			progress = 1;
+			continue;
+		}
+
+		err = transport_tx_sock_error(knet_h, batch->transport, batch->sockfd, KNET_SUB_TX, sent_msgs, savederrno);
 		switch(err) {
 			case KNET_TRANSPORT_SOCK_ERROR_INTERNAL:
-				cur_link->status.stats.tx_data_errors++;
-				goto out_unlock;
+				link_stats_add(cur_link->status.stats.tx_data_errors, 1);
+				ret = -1;
+				retsavederrno = savederrno;
+				while ((prev_sent < batch->entries) &&
+				       (batch->link[prev_sent] == cur_link)) {
+					prev_sent++;
+				}
+				progress = 1;
+				continue;
 				break;
 			case KNET_TRANSPORT_SOCK_ERROR_IGNORE:
 				break;
 			case KNET_TRANSPORT_SOCK_ERROR_RETRY:
-				cur_link->status.stats.tx_data_retries++;
-				goto retry;
+				link_stats_add(cur_link->status.stats.tx_data_retries, 1);
+				continue;
 				break;
 		}
 
+		if (sent_msgs < 0) {
+			/*
+			 * error has been ignored by the transport, drop the
+			 * packets for this link and move on to the next one
+			 */
+			while ((prev_sent < batch->entries) &&
+			       (batch->link[prev_sent] == cur_link)) {
+				prev_sent++;
+			}
+			progress = 1;
+			continue;
+		}
+
 		prev_sent = prev_sent + sent_msgs;
 
-		if ((sent_msgs >= 0) && (prev_sent < msgs_to_send)) {
+		if (prev_sent < batch->entries) {
 			if ((sent_msgs) || (progress)) {
 				if (sent_msgs) {
 					progress = 1;
 				} else {
 					progress = 0;
 				}
-				log_trace(knet_h, KNET_SUB_TX, "Unable to send all (%d/%d) data packets to host %s (%u) link %s:%s (%u)",
-					  sent_msgs, msg_idx,
-					  dst_host->name, dst_host->host_id,
-					  dst_host->link[dst_host->active_links[link_idx]].status.dst_ipaddr,
-					  dst_host->link[dst_host->active_links[link_idx]].status.dst_port,
-					  dst_host->link[dst_host->active_links[link_idx]].link_id);
-				goto retry;
-			}
-			if (!progress) {
-				savederrno = EAGAIN;
-				err = -1;
-				goto out_unlock;
+				log_trace(knet_h, KNET_SUB_TX, "Unable to send all (%d/%d) data packets on sock %d",
+					  prev_sent, batch->entries, batch->sockfd);
+				continue;
 			}
+			ret = -1;
+			retsavederrno = EAGAIN;
+			break;
 		}
+	}
 
-		if ((dst_host->link_handler_policy == KNET_LINK_POLICY_RR) &&
-		    (dst_host->active_link_entries > 1)) {
-			uint8_t cur_link_id = dst_host->active_links[0];
+	/*
+	 * buffers cannot be reused before the kernel is done with them,
+	 * the current set is pinned until the completions are reaped
+	 */
+	if (zerocopy) {
+		transport_tx_zerocopy_end(knet_h, batch->transport, batch->sockfd, zerocopy_sent, &zc);
+		if (zerocopy_sent) {
+			_tx_bufs_add_pending(worker->bufs, &zc);
+		}
+	}
 
-			memmove(&dst_host->active_links[0], &dst_host->active_links[1], KNET_MAX_LINK - 1);
-			dst_host->active_links[dst_host->active_link_entries - 1] = cur_link_id;
+	batch->entries = 0;
 
-			break;
+	errno = retsavederrno;
+	return ret;
+}
+
+static int _flush_tx_batches(knet_handle_t knet_h, struct knet_tx_worker *worker)
+{
+	int err = 0, savederrno = 0;
+	uint8_t i;
+
+	for (i = 0; i < worker->send_batch_entries; i++) {
+		if ((_flush_tx_batch(knet_h, worker, &worker->send_batch[i]) < 0) && (!err)) {
+			savederrno = errno;
+			err = -1;
 		}
-		pthread_mutex_unlock(&cur_link->link_stats_mutex);
-		locked = 0;
 	}
+	worker->send_batch_entries = 0;
 
-out_unlock:
-	if (locked) {
-		pthread_mutex_unlock(&cur_link->link_stats_mutex);
+	errno = savederrno;
+	return err;
+}
+
+/*
+ * queue the packet for all the active links of dst_host. Links sharing
+ * the same outbound socket (for example UDP links with the same source
+ * address) are grouped in the same batch, so that a broadcast to N hosts
+ * is sent with one sendmmsg per socket instead of one per host/link.
+ */
+static int _queue_to_links(knet_handle_t knet_h, struct knet_tx_worker *worker, struct knet_host *dst_host, struct knet_mmsghdr *msg, int msgs_to_send)
+{
+	int link_idx, msg_idx, link_msgs;
+	int err = 0, savederrno = 0;
+	struct iovec *first_iov;
+	size_t first_iovcnt;
+	uint8_t zerocopy;
+	unsigned int i;
+	uint8_t batch_idx;
+	struct knet_tx_batch *batch;
+	struct knet_tx_gso *gso;
+	struct knet_mmsghdr *cur;
+	struct knet_link *cur_link;
+	uint8_t active_links[KNET_MAX_LINK];
+	uint8_t active_link_entries;
+
+	/*
+	 * with RR policy, multiple TX workers can send to the same host
+	 * at the same time. Pick the link and rotate the list in one go.
+	 */
+	if ((dst_host->link_handler_policy == KNET_LINK_POLICY_RR) &&
+	    (dst_host->active_link_entries > 1)) {
+		savederrno = pthread_mutex_lock(&knet_h->tx_rr_mutex);
+		if (savederrno) {
+			log_err(knet_h, KNET_SUB_TX, "Unable to get RR mutex lock for host %u: %s",
+				dst_host->host_id, strerror(savederrno));
+			errno = savederrno;
+			return -1;
+		}
+		active_links[0] = dst_host->active_links[0];
+		active_link_entries = 1;
+
+		memmove(&dst_host->active_links[0], &dst_host->active_links[1], KNET_MAX_LINK - 1);
+		dst_host->active_links[dst_host->active_link_entries - 1] = active_links[0];
+		pthread_mutex_unlock(&knet_h->tx_rr_mutex);
+	} else {
+		active_link_entries = dst_host->active_link_entries;
+		memmove(active_links, dst_host->active_links, active_link_entries);
 	}
+
+	for (link_idx = 0; link_idx < active_link_entries; link_idx++) {
+		cur_link = &dst_host->link[active_links[link_idx]];
+
+		if (cur_link->transport == KNET_TRANSPORT_LOOPBACK) {
+			continue;
+		}
+
+		if ((__atomic_load_n(&cur_link->udp_gso, __ATOMIC_RELAXED)) && (worker->send_gso_entries)) {
+			link_msgs = worker->send_gso_entries;
+			first_iov = worker->send_gso[0].iov;
+			first_iovcnt = worker->send_gso[0].iovcnt;
+		} else {
+			link_msgs = msgs_to_send;
+			first_iov = msg[0].msg_hdr.msg_iov;
+			first_iovcnt = msg[0].msg_hdr.msg_iovlen;
+		}
+
+		/*
+		 * the first message is the largest one
+		 */
+		zerocopy = ((cur_link->udp_zerocopy) &&
+			    (_iov_len(first_iov, first_iovcnt) >= KNET_TX_ZEROCOPY_MIN_SIZE) &&
+			    (_iov_zerocopy_ok(first_iov, first_iovcnt)) &&
+			    (_tx_bufs_zerocopy_ready(knet_h, worker)));
+
+		for (batch_idx = 0; batch_idx < worker->send_batch_entries; batch_idx++) {
+			if ((worker->send_batch[batch_idx].sockfd == cur_link->outsock) &&
+			    (worker->send_batch[batch_idx].zerocopy == zerocopy)) {
+				break;
+			}
+		}
+
+		if (batch_idx == worker->send_batch_entries) {
+			if (worker->send_batch_entries == KNET_MAX_LINK) {
+				if ((_flush_tx_batches(knet_h, worker) < 0) && (!err)) {
+					savederrno = errno;
+					err = -1;
+				}
+				batch_idx = 0;
+			}
+			batch = &worker->send_batch[batch_idx];
+			batch->sockfd = cur_link->outsock;
+			batch->transport = cur_link->transport;
+			batch->zerocopy = zerocopy;
+			batch->entries = 0;
+			worker->send_batch_entries++;
+		} else {
+			batch = &worker->send_batch[batch_idx];
+		}
+
+		if (batch->entries + link_msgs > KNET_TX_SEND_BATCH) {
+			if ((_flush_tx_batch(knet_h, worker, batch) < 0) && (!err)) {
+				savederrno = errno;
+				err = -1;
+			}
+		}
+
+		for (msg_idx = 0; msg_idx < link_msgs; msg_idx++) {
+			cur = &batch->msg[batch->entries];
+
+			if (link_msgs == msgs_to_send) {
+				memmove(cur, &msg[msg_idx], sizeof(struct knet_mmsghdr));
+				batch->gso[batch->entries] = NULL;
+				link_stats_add(cur_link->status.stats.tx_data_packets, 1);
+			} else {
+				gso = &worker->send_gso[msg_idx];
+				memset(cur, 0, sizeof(struct knet_mmsghdr));
+				cur->msg_hdr.msg_iov = gso->iov;
+				cur->msg_hdr.msg_iovlen = gso->iovcnt;
+				if (gso->frags > 1) {
+					cur->msg_hdr.msg_control = gso->control.buf;
+					cur->msg_hdr.msg_controllen = sizeof(gso->control.buf);
+				}
+				batch->gso[batch->entries] = gso;
+				link_stats_add(cur_link->status.stats.tx_data_packets, gso->frags);
+			}
+			cur->msg_hdr.msg_name = &cur_link->dst_addr;
+			cur->msg_hdr.msg_namelen = knet_h->knet_transport_fd_tracker[cur_link->outsock].sockaddr_len;
+			batch->link[batch->entries] = cur_link;
+			batch->entries++;
+
+			/* Cast for Linux/BSD compatibility */
+			for (i=0; i<(unsigned int)cur->msg_hdr.msg_iovlen; i++) {
+				link_stats_add(cur_link->status.stats.tx_data_bytes, cur->msg_hdr.msg_iov[i].iov_len);
+			}
+		}
+	}
+
 	errno = savederrno;
 	return err;
 }
@@ -146,32 +652,50 @@ static int _dispatch_to_local(knet_handle_t knet_h, unsigned char *data, size_t
 	const unsigned char *buf = data;
 	ssize_t buflen = inlen;
 	struct knet_link *local_link = knet_h->host_index[knet_h->host_id]->link;
+	struct knet_sock *sock = &knet_h->sockfd[channel];
+
+	if (sock->rx_ring) {
+		pthread_mutex_lock(&sock->rx_ring_mutex);
+		err = _ring_push(sock->rx_ring, data, inlen);
+		savederrno = errno;
+		pthread_mutex_unlock(&sock->rx_ring_mutex);
+		if (err < 0) {
+			log_err(knet_h, KNET_SUB_TRANSP_LOOPBACK, "send local failed. error=%s\n", strerror(savederrno));
+			link_stats_add(local_link->status.stats.tx_data_errors, 1);
+			goto out;
+		}
+		_ring_wakeup(sock->rx_ring);
+		link_stats_add(local_link->status.stats.tx_data_packets, 1);
+		link_stats_add(local_link->status.stats.tx_data_bytes, inlen);
+		err = inlen;
+		goto out;
+	}
 
 local_retry:
 	err = write(knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], buf, buflen);
 	savederrno = errno;
 	if (err < 0) {
 		log_err(knet_h, KNET_SUB_TRANSP_LOOPBACK, "send local failed. error=%s\n", strerror(errno));
-		local_link->status.stats.tx_data_errors++;
+		link_stats_add(local_link->status.stats.tx_data_errors, 1);
 		goto out;
 	}
 	if (err > 0 && err < buflen) {
 		log_debug(knet_h, KNET_SUB_TRANSP_LOOPBACK, "send local incomplete=%d bytes of %zu\n", err, inlen);
-		local_link->status.stats.tx_data_retries++;
+		link_stats_add(local_link->status.stats.tx_data_retries, 1);
 		buf += err;
 		buflen -= err;
 		goto local_retry;
 	}
 	if (err == buflen) {
-		local_link->status.stats.tx_data_packets++;
-		local_link->status.stats.tx_data_bytes += inlen;
+		link_stats_add(local_link->status.stats.tx_data_packets, 1);
+		link_stats_add(local_link->status.stats.tx_data_bytes, inlen);
 	}
 out:
 	errno = savederrno;
 	return err;
 }
 
-static int _prep_tx_bufs(knet_handle_t knet_h,
+static int _prep_tx_bufs(knet_handle_t knet_h, struct knet_tx_worker *worker,
 			  struct knet_header *inbuf, uint8_t onwire_ver,
 			  unsigned char *data, size_t inlen, uint32_t data_checksum,
 			  seq_num_t tx_seq_num, int8_t channel, int bcast, int data_compressed,
@@ -199,11 +723,11 @@ static int _prep_tx_bufs(knet_handle_t knet_h,
 	}
 
 	if (knet_h->onwire_ver_remap) {
-		prep_tx_bufs_v1(knet_h, inbuf, data, inlen, data_checksum, temp_data_mtu, tx_seq_num, channel, bcast, data_compressed, msgs_to_send, iov_out, iovcnt_out);
+		prep_tx_bufs_v1(knet_h, inbuf, worker->bufs->send_to_links_buf, data, inlen, data_checksum, temp_data_mtu, tx_seq_num, channel, bcast, data_compressed, msgs_to_send, iov_out, iovcnt_out);
 	} else {
 		switch (onwire_ver) {
 			case 1:
-				prep_tx_bufs_v1(knet_h, inbuf, data, inlen, data_checksum, temp_data_mtu, tx_seq_num, channel, bcast, data_compressed, msgs_to_send, iov_out, iovcnt_out);
+				prep_tx_bufs_v1(knet_h, inbuf, worker->bufs->send_to_links_buf, data, inlen, data_checksum, temp_data_mtu, tx_seq_num, channel, bcast, data_compressed, msgs_to_send, iov_out, iovcnt_out);
 				break;
 			default: /* this should never hit as filters are in place in the calling functions */
 				log_warn(knet_h, KNET_SUB_TX, "preparing data onwire version %u not supported", onwire_ver);
@@ -219,10 +743,10 @@ out:
 	return err;
 }
 
-static int _compress_data(knet_handle_t knet_h, unsigned char* data, size_t *inlen, int *data_compressed)
+static int _compress_data(knet_handle_t knet_h, struct knet_tx_worker *worker, unsigned char* data, size_t *inlen, int *data_compressed)
 {
 	int err = 0, savederrno = 0;
-	int stats_locked = 0, stats_err = 0;
+	struct knet_handle_stats_shard *stats = &knet_h->stats_shards[worker->thread_id];
 	size_t cmp_outlen = KNET_DATABUFSIZE_COMPRESS;
 	struct timespec start_time;
 	struct timespec end_time;
@@ -233,66 +757,47 @@ static int _compress_data(knet_handle_t knet_h, unsigned char* data, size_t *inl
 	 */
 	if (knet_h->compress_model > 0) {
 		if (*inlen > knet_h->compress_threshold) {
+			savederrno = pthread_mutex_lock(&knet_h->tx_compress_mutex);
+			if (savederrno) {
+				log_err(knet_h, KNET_SUB_TX, "Unable to get compress mutex lock: %s", strerror(savederrno));
+				err = -1;
+				goto out;
+			}
 			clock_gettime(CLOCK_MONOTONIC, &start_time);
 			err = compress(knet_h,
 				       data, *inlen,
-				       knet_h->send_to_links_buf_compress, (ssize_t *)&cmp_outlen);
+				       worker->send_to_links_buf_compress, (ssize_t *)&cmp_outlen);
 
 			savederrno = errno;
 			clock_gettime(CLOCK_MONOTONIC, &end_time);
+			pthread_mutex_unlock(&knet_h->tx_compress_mutex);
 			timespec_diff(start_time, end_time, &compress_time);
 
-			stats_err = pthread_mutex_lock(&knet_h->handle_stats_mutex);
-			if (stats_err < 0) {
-				log_err(knet_h, KNET_SUB_TX, "Unable to get mutex lock: %s", strerror(stats_err));
-				err = -1;
-				savederrno = stats_err;
-				goto out;
-			}
-			stats_locked = 1;
 			/* Collect stats */
-
-			if (compress_time < knet_h->stats.tx_compress_time_min) {
-				knet_h->stats.tx_compress_time_min = compress_time;
-			}
-			if (compress_time > knet_h->stats.tx_compress_time_max) {
-				knet_h->stats.tx_compress_time_max = compress_time;
-			}
-			knet_h->stats.tx_compress_time_ave =
-				(unsigned long long)(knet_h->stats.tx_compress_time_ave * knet_h->stats.tx_compressed_packets +
-				 compress_time) / (knet_h->stats.tx_compressed_packets+1);
+			stats_time(stats->tx_compress_time_total,
+				   stats->tx_compress_time_min,
+				   stats->tx_compress_time_max,
+				   compress_time);
+			stats_add(stats->tx_compress_time_samples, 1);
 			if (err < 0) {
-				knet_h->stats.tx_failed_to_compress++;
+				stats_add(stats->tx_failed_to_compress, 1);
 				log_warn(knet_h, KNET_SUB_COMPRESS, "Compression failed (%d): %s", err, strerror(savederrno));
 			} else {
-				knet_h->stats.tx_compressed_packets++;
-				knet_h->stats.tx_compressed_original_bytes += *inlen;
-				knet_h->stats.tx_compressed_size_bytes += cmp_outlen;
+				stats_add(stats->tx_compressed_packets, 1);
+				stats_add(stats->tx_compressed_original_bytes, *inlen);
+				stats_add(stats->tx_compressed_size_bytes, cmp_outlen);
 
 				if (cmp_outlen < *inlen) {
-					memmove(data, knet_h->send_to_links_buf_compress, cmp_outlen);
+					memmove(data, worker->send_to_links_buf_compress, cmp_outlen);
 					*inlen = cmp_outlen;
 					*data_compressed = 1;
 				} else {
-					knet_h->stats.tx_unable_to_compress++;
+					stats_add(stats->tx_unable_to_compress, 1);
 				}
 			}
 		}
 		if (!*data_compressed) {
-			if (!stats_locked) {
-				stats_err = pthread_mutex_lock(&knet_h->handle_stats_mutex);
-				if (stats_err < 0) {
-					log_err(knet_h, KNET_SUB_TX, "Unable to get mutex lock: %s", strerror(stats_err));
-					err = -1;
-					savederrno = stats_err;
-					goto out;
-				}
-				stats_locked = 1;
-			}
-			knet_h->stats.tx_uncompressed_packets++;
-		}
-		if (stats_locked) {
-			pthread_mutex_unlock(&knet_h->handle_stats_mutex);
+			stats_add(stats->tx_uncompressed_packets, 1);
 		}
 	}
 
@@ -301,107 +806,167 @@ out:
 	return err;
 }
 
-static int _encrypt_bufs(knet_handle_t knet_h, int msgs_to_send, struct iovec iov_out[PCKT_FRAG_MAX][2], int *iovcnt_out)
+static void _encrypt_job(knet_handle_t knet_h, struct knet_crypto_job *job)
 {
-	int err = 0, savederrno = 0, stats_err = 0;
 	struct timespec start_time;
 	struct timespec end_time;
-	uint64_t crypt_time;
-	uint8_t frag_idx = 0;
-	size_t outlen, uncrypted_frag_size;
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	job->err = crypto_encrypt_and_signv(knet_h,
+					    job->iov_in, job->iovcnt_in,
+					    job->buf_out, &job->buf_out_len);
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	timespec_diff(start_time, end_time, &job->crypt_time);
+}
+
+static int _encrypt_bufs(knet_handle_t knet_h, struct knet_tx_worker *worker, int msgs_to_send, struct iovec iov_out[PCKT_FRAG_MAX][2], int *iovcnt_out)
+{
+	int err = 0, savederrno = 0;
+	struct knet_handle_stats_shard *stats = &knet_h->stats_shards[worker->thread_id];
+	struct knet_crypto_job *job;
+	uint8_t frag_idx;
+	size_t uncrypted_frag_size, uncrypted_size = 0;
 	int j;
 
-	if (knet_h->crypto_in_use_config) {
-		while (frag_idx < msgs_to_send) {
-			clock_gettime(CLOCK_MONOTONIC, &start_time);
-			if (crypto_encrypt_and_signv(
-					knet_h,
-					iov_out[frag_idx], *iovcnt_out,
-					knet_h->send_to_links_buf_crypt[frag_idx],
-					(ssize_t *)&outlen) < 0) {
-				log_debug(knet_h, KNET_SUB_TX, "Unable to encrypt packet");
-				savederrno = ECHILD;
-				err = -1;
-				goto out;
-			}
-			clock_gettime(CLOCK_MONOTONIC, &end_time);
-			timespec_diff(start_time, end_time, &crypt_time);
+	if (!knet_h->crypto_in_use_config) {
+		goto out;
+	}
 
-			stats_err = pthread_mutex_lock(&knet_h->handle_stats_mutex);
-			if (stats_err < 0) {
-				log_err(knet_h, KNET_SUB_TX, "Unable to get mutex lock: %s", strerror(stats_err));
-				err = -1;
-				savederrno = stats_err;
-				goto out;
-			}
+	for (frag_idx = 0; frag_idx < msgs_to_send; frag_idx++) {
+		job = &worker->crypto_jobs[frag_idx];
+		job->iov_in = iov_out[frag_idx];
+		job->iovcnt_in = *iovcnt_out;
+		job->buf_out = worker->bufs->send_to_links_buf_crypt[frag_idx];
+		job->buf_out_len = 0;
+		for (j = 0; j < *iovcnt_out; j++) {
+			uncrypted_size += iov_out[frag_idx][j].iov_len;
+		}
+	}
+
+	/*
+	 * waking up the crypto threads is not worth it for small packets
+	 */
+	if (uncrypted_size >= KNET_CRYPTO_POOL_MIN_SIZE) {
+		_crypto_pool_run(knet_h, _encrypt_job, worker->crypto_jobs, msgs_to_send);
+	} else {
+		for (frag_idx = 0; frag_idx < msgs_to_send; frag_idx++) {
+			_encrypt_job(knet_h, &worker->crypto_jobs[frag_idx]);
+		}
+	}
+
+	for (frag_idx = 0; frag_idx < msgs_to_send; frag_idx++) {
+		if (worker->crypto_jobs[frag_idx].err < 0) {
+			log_debug(knet_h, KNET_SUB_TX, "Unable to encrypt packet");
+			savederrno = ECHILD;
+			err = -1;
+			goto out;
+		}
+	}
 
-			if (crypt_time < knet_h->stats.tx_crypt_time_min) {
-				knet_h->stats.tx_crypt_time_min = crypt_time;
-			}
-			if (crypt_time > knet_h->stats.tx_crypt_time_max) {
-				knet_h->stats.tx_crypt_time_max = crypt_time;
-			}
-			knet_h->stats.tx_crypt_time_ave =
-				(knet_h->stats.tx_crypt_time_ave * knet_h->stats.tx_crypt_packets +
-				 crypt_time) / (knet_h->stats.tx_crypt_packets+1);
+	for (frag_idx = 0; frag_idx < msgs_to_send; frag_idx++) {
+		job = &worker->crypto_jobs[frag_idx];
 
-			uncrypted_frag_size = 0;
-			for (j=0; j < *iovcnt_out; j++) {
-				uncrypted_frag_size += iov_out[frag_idx][j].iov_len;
-			}
-			knet_h->stats.tx_crypt_byte_overhead += (outlen - uncrypted_frag_size);
-			knet_h->stats.tx_crypt_packets++;
-			pthread_mutex_unlock(&knet_h->handle_stats_mutex);
+		stats_time(stats->tx_crypt_time_total,
+			   stats->tx_crypt_time_min,
+			   stats->tx_crypt_time_max,
+			   job->crypt_time);
 
-			iov_out[frag_idx][0].iov_base = knet_h->send_to_links_buf_crypt[frag_idx];
-			iov_out[frag_idx][0].iov_len = outlen;
-			frag_idx++;
+		uncrypted_frag_size = 0;
+		for (j = 0; j < *iovcnt_out; j++) {
+			uncrypted_frag_size += iov_out[frag_idx][j].iov_len;
 		}
-		*iovcnt_out = 1;
+		stats_add(stats->tx_crypt_byte_overhead, job->buf_out_len - uncrypted_frag_size);
+		stats_add(stats->tx_crypt_packets, 1);
+
+		iov_out[frag_idx][0].iov_base = job->buf_out;
+		iov_out[frag_idx][0].iov_len = job->buf_out_len;
 	}
+
+	*iovcnt_out = 1;
+
 out:
 	errno = savederrno;
 	return err;
 }
 
-static int _get_tx_seq_num(knet_handle_t knet_h, seq_num_t *tx_seq_num)
+static int _get_tx_seq_num(knet_handle_t knet_h, struct knet_tx_worker *worker, seq_num_t *tx_seq_num)
 {
-	int savederrno = 0;
+	int savederrno = 0, send_pings = 0;
+	uint8_t batch, i;
 
-	savederrno = pthread_mutex_lock(&knet_h->tx_seq_num_mutex);
-	if (savederrno) {
-		log_debug(knet_h, KNET_SUB_TX, "Unable to get seq mutex lock");
-		errno = savederrno;
-		return -1;
-	}
+	do {
+		/*
+		 * a worker sending on a slow channel can hold on to its batch
+		 * while the other workers move tx_seq_num forward. Drop it before
+		 * the RX side of other nodes would consider those seq_num too old.
+		 * tx_seq_num is read without the mutex, a stale value only delays
+		 * the check to the next packet.
+		 */
+		if ((worker->seq_num_avail) &&
+		    ((seq_num_t)(__atomic_load_n(&knet_h->tx_seq_num, __ATOMIC_RELAXED) - worker->seq_num_next) > KNET_TX_SEQ_NUM_MAX_LAG)) {
+			worker->seq_num_avail = 0;
+		}
 
-	knet_h->tx_seq_num++;
-	/*
-	 * force seq_num 0 to detect a node that has crashed and rejoining
-	 * the knet instance. seq_num 0 will clear the buffers in the RX
-	 * thread
-	 */
-	if (knet_h->tx_seq_num == 0) {
-		knet_h->tx_seq_num++;
-	}
-	/*
-	 * cache the value in locked context
-	 */
-	*tx_seq_num = knet_h->tx_seq_num;
-	pthread_mutex_unlock(&knet_h->tx_seq_num_mutex);
+		if (!worker->seq_num_avail) {
+			/*
+			 * with more than one TX worker, reserve a batch of seq_num
+			 * to reduce contention on tx_seq_num_mutex.
+			 * Unused seq_num are released when the worker goes idle
+			 * or falls too far behind.
+			 */
+			if (knet_h->tx_threads > 1) {
+				batch = KNET_TX_SEQ_NUM_BATCH;
+			} else {
+				batch = 1;
+			}
 
-	/*
-	 * forcefully broadcast a ping to all nodes every SEQ_MAX / 8
-	 * pckts.
-	 * this solves 2 problems:
-	 * 1) on TX socket overloads we generate extra pings to keep links alive
-	 * 2) in 3+ nodes setup, where all the traffic is flowing between node 1 and 2,
-	 *    node 3+ will be able to keep in sync on the TX seq_num even without
-	 *    receiving traffic or pings in betweens. This avoids issues with
-	 *    rollover of the circular buffer
-	 */
+			savederrno = pthread_mutex_lock(&knet_h->tx_seq_num_mutex);
+			if (savederrno) {
+				log_debug(knet_h, KNET_SUB_TX, "Unable to get seq mutex lock");
+				errno = savederrno;
+				return -1;
+			}
+
+			knet_h->tx_seq_num++;
+			/*
+			 * force seq_num 0 to detect a node that has crashed and rejoining
+			 * the knet instance. seq_num 0 will clear the buffers in the RX
+			 * thread
+			 */
+			if (knet_h->tx_seq_num == 0) {
+				knet_h->tx_seq_num++;
+			}
+			worker->seq_num_next = knet_h->tx_seq_num;
+			worker->seq_num_avail = batch;
+			knet_h->tx_seq_num += batch - 1;
+			pthread_mutex_unlock(&knet_h->tx_seq_num_mutex);
+
+			/*
+			 * forcefully broadcast a ping to all nodes every SEQ_MAX / 8
+			 * pckts.
+			 * this solves 2 problems:
+			 * 1) on TX socket overloads we generate extra pings to keep links alive
+			 * 2) in 3+ nodes setup, where all the traffic is flowing between node 1 and 2,
+			 *    node 3+ will be able to keep in sync on the TX seq_num even without
+			 *    receiving traffic or pings in betweens. This avoids issues with
+			 *    rollover of the circular buffer
+			 *
+			 * check the whole batch, seq_num reserved here might never
+			 * be sent.
+			 */
+			for (i = 0; i < batch; i++) {
+				if ((seq_num_t)(worker->seq_num_next + i) % (SEQ_MAX / 8) == 0) {
+					send_pings = 1;
+				}
+			}
+		}
+
+		*tx_seq_num = worker->seq_num_next;
+		worker->seq_num_next++;
+		worker->seq_num_avail--;
+	} while (*tx_seq_num == 0); /* a batch can wrap around 0 */
 
-	if (*tx_seq_num % (SEQ_MAX / 8) == 0) {
+	if (send_pings) {
 		_send_pings(knet_h, 0);
 	}
 	return 0;
@@ -522,7 +1087,90 @@ out:
 	return err;
 }
 
-static int _prep_and_send_msgs(knet_handle_t knet_h, int bcast, knet_node_id_t *dst_host_ids, size_t dst_host_ids_entries, int msgs_to_send, struct iovec iov_out[PCKT_FRAG_MAX][2], int iovcnt_out)
+/*
+ * group the fragments of the packet in UDP GSO super buffers,
+ * the kernel requires all segments but the last one to have the same size.
+ * Links with udp_gso set will send those instead of the single fragments.
+ */
+static void _prep_gso(knet_handle_t knet_h, struct knet_tx_worker *worker, struct knet_mmsghdr *msg, int msgs_to_send)
+{
+#ifdef UDP_SEGMENT
+	struct knet_tx_gso *gso = NULL;
+	struct cmsghdr *cmsg;
+	size_t frag_len, gso_len = 0;
+	int frag_idx, iov_idx = 0, closed = 0;
+	unsigned int i;
+#endif
+
+	worker->send_gso_entries = 0;
+
+#ifdef UDP_SEGMENT
+	if (msgs_to_send < 2) {
+		return;
+	}
+
+	for (frag_idx = 0; frag_idx < msgs_to_send; frag_idx++) {
+		frag_len = 0;
+		/* Cast for Linux/BSD compatibility */
+		for (i=0; i<(unsigned int)msg[frag_idx].msg_hdr.msg_iovlen; i++) {
+			frag_len += msg[frag_idx].msg_hdr.msg_iov[i].iov_len;
+		}
+
+		if ((gso) &&
+		    ((closed) ||
+		     (frag_len > gso->seg_size) ||
+		     (gso->frags >= KNET_UDP_GSO_MAX_SEGS) ||
+		     (gso_len + frag_len > KNET_UDP_GSO_MAX_SIZE))) {
+			gso = NULL;
+		}
+
+		if (!gso) {
+			gso = &worker->send_gso[worker->send_gso_entries];
+			worker->send_gso_entries++;
+			gso->frag_msg = &msg[frag_idx];
+			gso->frags = 0;
+			gso->iov = &worker->send_gso_iov[iov_idx];
+			gso->iovcnt = 0;
+			gso->seg_size = frag_len;
+			gso_len = 0;
+			closed = 0;
+		}
+
+		memmove(&worker->send_gso_iov[iov_idx], msg[frag_idx].msg_hdr.msg_iov,
+			msg[frag_idx].msg_hdr.msg_iovlen * sizeof(struct iovec));
+		iov_idx += msg[frag_idx].msg_hdr.msg_iovlen;
+		gso->iovcnt += msg[frag_idx].msg_hdr.msg_iovlen;
+		gso->frags++;
+		gso_len += frag_len;
+
+		/*
+		 * a short segment terminates the super buffer
+		 */
+		if (frag_len < gso->seg_size) {
+			closed = 1;
+		}
+	}
+
+	for (i = 0; i < (unsigned int)worker->send_gso_entries; i++) {
+		gso = &worker->send_gso[i];
+		memset(&gso->control, 0, sizeof(gso->control));
+		cmsg = (struct cmsghdr *)gso->control.buf;
+		cmsg->cmsg_level = IPPROTO_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		memmove(CMSG_DATA(cmsg), &gso->seg_size, sizeof(uint16_t));
+	}
+
+	/*
+	 * nothing to gain
+	 */
+	if (worker->send_gso_entries == msgs_to_send) {
+		worker->send_gso_entries = 0;
+	}
+#endif
+}
+
+static int _prep_and_send_msgs(knet_handle_t knet_h, struct knet_tx_worker *worker, struct knet_header *inbuf, int bcast, knet_node_id_t *dst_host_ids, size_t dst_host_ids_entries, int msgs_to_send, struct iovec iov_out[PCKT_FRAG_MAX][2], int iovcnt_out)
 {
 	int err = 0, savederrno = 0;
 	struct knet_host *dst_host;
@@ -535,17 +1183,19 @@ static int _prep_and_send_msgs(knet_handle_t knet_h, int bcast, knet_node_id_t *
 	msg_idx = 0;
 
 	while (msg_idx < msgs_to_send) {
-		msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage); /* this will set properly in _dispatch_to_links() */
+		msg[msg_idx].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage); /* this will set properly in _queue_to_links() */
 		msg[msg_idx].msg_hdr.msg_iov = &iov_out[msg_idx][0];
 		msg[msg_idx].msg_hdr.msg_iovlen = iovcnt_out;
 		msg_idx++;
 	}
 
+	_prep_gso(knet_h, worker, &msg[0], msgs_to_send);
+
 	if (!bcast) {
 		for (host_idx = 0; host_idx < dst_host_ids_entries; host_idx++) {
 			dst_host = knet_h->host_index[dst_host_ids[host_idx]];
 
-			err = _dispatch_to_links(knet_h, dst_host, &msg[0], msgs_to_send);
+			err = _queue_to_links(knet_h, worker, dst_host, &msg[0], msgs_to_send);
 			savederrno = errno;
 			if (err) {
 				goto out;
@@ -554,7 +1204,7 @@ static int _prep_and_send_msgs(knet_handle_t knet_h, int bcast, knet_node_id_t *
 	} else {
 		for (dst_host = knet_h->host_head; dst_host != NULL; dst_host = dst_host->next) {
 			if (dst_host->status.reachable) {
-				err = _dispatch_to_links(knet_h, dst_host, &msg[0], msgs_to_send);
+				err = _queue_to_links(knet_h, worker, dst_host, &msg[0], msgs_to_send);
 				savederrno = errno;
 				if (err) {
 					goto out;
@@ -564,14 +1214,23 @@ static int _prep_and_send_msgs(knet_handle_t knet_h, int bcast, knet_node_id_t *
 	}
 
 out:
+	/*
+	 * always flush what has been queued, even on error
+	 */
+	if ((_flush_tx_batches(knet_h, worker) < 0) && (!err)) {
+		savederrno = errno;
+		err = -1;
+	}
+
+	_tx_bufs_rotate(worker, inbuf);
+
 	errno = savederrno;
 	return err;
 }
 
-static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t channel, uint8_t onwire_ver, int is_sync)
+static int _parse_recv_from_sock(knet_handle_t knet_h, struct knet_tx_worker *worker, struct knet_header *inbuf, size_t inlen, int8_t channel, uint8_t onwire_ver, int is_sync)
 {
 	int err = 0, savederrno = 0;
-	struct knet_header *inbuf = knet_h->recv_from_sock_buf; /* all TX packets are stored here regardless of the onwire */
 	unsigned char *data;					/* onwire neutrual pointer to data to send */
 	int data_compressed = 0;				/* track data compression to fill the header */
 	seq_num_t tx_seq_num;
@@ -631,31 +1290,31 @@ static int _parse_recv_from_sock(knet_handle_t knet_h, size_t inlen, int8_t chan
 		}
 	}
 
-	err = _compress_data(knet_h, data, &inlen, &data_compressed);
+	err = _compress_data(knet_h, worker, data, &inlen, &data_compressed);
 	if (err < 0) {
 		savederrno = errno;
 		goto out;
 	}
 
-	err = _get_tx_seq_num(knet_h, &tx_seq_num);
+	err = _get_tx_seq_num(knet_h, worker, &tx_seq_num);
 	if (err < 0) {
 		savederrno = errno;
 		goto out;
 	}
 
-	err = _prep_tx_bufs(knet_h, inbuf, onwire_ver, data, inlen, data_checksum, tx_seq_num, channel, bcast, data_compressed, &msgs_to_send, iov_out, &iovcnt_out);
+	err = _prep_tx_bufs(knet_h, worker, inbuf, onwire_ver, data, inlen, data_checksum, tx_seq_num, channel, bcast, data_compressed, &msgs_to_send, iov_out, &iovcnt_out);
 	if (err < 0) {
 		savederrno = errno;
 		goto out;
 	}
 
-	err = _encrypt_bufs(knet_h, msgs_to_send, iov_out, &iovcnt_out);
+	err = _encrypt_bufs(knet_h, worker, msgs_to_send, iov_out, &iovcnt_out);
 	if (err < 0) {
 		savederrno = errno;
 		goto out;
 	}
 
-	err = _prep_and_send_msgs(knet_h, bcast, dst_host_ids, dst_host_ids_entries, msgs_to_send, iov_out, iovcnt_out);
+	err = _prep_and_send_msgs(knet_h, worker, inbuf, bcast, dst_host_ids, dst_host_ids_entries, msgs_to_send, iov_out, iovcnt_out);
 	if (err < 0) {
 		savederrno = errno;
 		goto out;
@@ -666,60 +1325,120 @@ out:
 	return err;
 }
 
-static void _handle_send_to_links(knet_handle_t knet_h, int sockfd, uint8_t onwire_ver, int8_t channel)
+/*
+ * knet_mmsghdr has the same layout as mmsghdr, use the real thing
+ * when available to drain the datafd with a single syscall
+ */
+static int _recv_from_sock(int sockfd, struct knet_mmsghdr *msg, unsigned int vlen)
+{
+#ifdef HAVE_RECVMMSG
+	return recvmmsg(sockfd, (struct mmsghdr *)msg, vlen, MSG_DONTWAIT | MSG_NOSIGNAL, NULL);
+#else
+	return _recvmmsg(sockfd, msg, vlen, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+}
+
+/*
+ * records are copied straight from the ring to the TX buffers.
+ * The eventfd stays readable until the ring has been drained,
+ * epoll will call us again if there is more than one batch.
+ */
+static void _handle_send_from_ring(knet_handle_t knet_h, struct knet_tx_worker *worker, uint8_t onwire_ver, int8_t channel)
+{
+	ssize_t inlen;
+	int i;
+
+	if ((!knet_h->onwire_ver_remap) && (onwire_ver != 1)) {
+		log_warn(knet_h, KNET_SUB_TX, "preparing data onwire version %u not supported", onwire_ver);
+		return;
+	}
+
+	for (i = 0; i < KNET_TX_INGEST_BATCH; i++) {
+		inlen = _ring_pop(knet_h->sockfd[channel].tx_ring,
+				  get_data_v1(knet_h, worker->recv_from_sock_buf[i]),
+				  KNET_MAX_PACKET_SIZE);
+		if (inlen < 0) {
+			break;
+		}
+		_parse_recv_from_sock(knet_h, worker, worker->recv_from_sock_buf[i], inlen, channel, onwire_ver, 0);
+	}
+}
+
+static void _handle_send_to_links(knet_handle_t knet_h, struct knet_tx_worker *worker, int sockfd, uint8_t onwire_ver, int8_t channel)
 {
 	ssize_t inlen = 0;
 	int savederrno = 0, docallback = 0;
-	struct iovec iov_in;
-	struct msghdr msg;
-	struct sockaddr_storage address;
+	int i, msg_recv, msg_max = 1;
+	struct iovec iov_in[KNET_TX_INGEST_BATCH];
+	struct knet_mmsghdr msg[KNET_TX_INGEST_BATCH];
+	struct sockaddr_storage address[KNET_TX_INGEST_BATCH];
+
+	if (knet_h->sockfd[channel].tx_ring) {
+		_handle_send_from_ring(knet_h, worker, onwire_ver, channel);
+		return;
+	}
+
+	/*
+	 * only sockets can be drained in batches, pipes and other
+	 * datafds are read one packet at a time
+	 */
+	if ((channel < 0) ||
+	    (channel >= KNET_DATAFD_MAX) ||
+	    (knet_h->sockfd[channel].is_socket)) {
+		msg_max = KNET_TX_INGEST_BATCH;
+	}
 
 	memset(&iov_in, 0, sizeof(iov_in));
+	memset(&msg, 0, sizeof(msg));
 
-	if (knet_h->onwire_ver_remap) {
-		iov_in.iov_base = (void *)get_data_v1(knet_h, knet_h->recv_from_sock_buf);
-		iov_in.iov_len = KNET_MAX_PACKET_SIZE;
-	} else {
-		switch (onwire_ver) {
-			case 1:
-				iov_in.iov_base = (void *)get_data_v1(knet_h, knet_h->recv_from_sock_buf);
-				iov_in.iov_len = KNET_MAX_PACKET_SIZE;
-				break;
-			default:
-				log_warn(knet_h, KNET_SUB_TX, "preparing data onwire version %u not supported", onwire_ver);
-				break;
+	for (i = 0; i < msg_max; i++) {
+		if (knet_h->onwire_ver_remap) {
+			iov_in[i].iov_base = (void *)get_data_v1(knet_h, worker->recv_from_sock_buf[i]);
+			iov_in[i].iov_len = KNET_MAX_PACKET_SIZE;
+		} else {
+			switch (onwire_ver) {
+				case 1:
+					iov_in[i].iov_base = (void *)get_data_v1(knet_h, worker->recv_from_sock_buf[i]);
+					iov_in[i].iov_len = KNET_MAX_PACKET_SIZE;
+					break;
+				default:
+					log_warn(knet_h, KNET_SUB_TX, "preparing data onwire version %u not supported", onwire_ver);
+					return;
+					break;
+			}
 		}
-	}
 
-	memset(&msg, 0, sizeof(struct msghdr));
-	msg.msg_name = &address;
-	msg.msg_namelen = knet_h->knet_transport_fd_tracker[sockfd].sockaddr_len;
-	msg.msg_iov = &iov_in;
-	msg.msg_iovlen = 1;
+		msg[i].msg_hdr.msg_name = &address[i];
+		msg[i].msg_hdr.msg_namelen = knet_h->knet_transport_fd_tracker[sockfd].sockaddr_len;
+		msg[i].msg_hdr.msg_iov = &iov_in[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
 
-	if ((channel >= 0) &&
-	    (channel < KNET_DATAFD_MAX) &&
-	    (!knet_h->sockfd[channel].is_socket)) {
-		inlen = readv(sockfd, msg.msg_iov, 1);
+	if (msg_max == 1) {
+		inlen = readv(sockfd, msg[0].msg_hdr.msg_iov, 1);
+		savederrno = errno;
+		msg_recv = (inlen < 0) ? -1 : 1;
+		msg[0].msg_len = (inlen < 0) ? 0 : inlen;
 	} else {
-		inlen = recvmsg(sockfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
-		if (msg.msg_flags & MSG_TRUNC) {
-			log_warn(knet_h, KNET_SUB_TX, "Received truncated message from sock %d. Discarding", sockfd);
-			return;
-		}
+		msg_recv = _recv_from_sock(sockfd, &msg[0], msg_max);
+		savederrno = errno;
 	}
 
-	if (inlen == 0) {
-		savederrno = 0;
-		docallback = 1;
-	} else if (inlen < 0) {
+	if (msg_recv < 0) {
 		struct epoll_event ev;
 
-		savederrno = errno;
+		/*
+		 * another wakeup might have drained the socket already
+		 */
+		if ((savederrno == EAGAIN) || (savederrno == EWOULDBLOCK)) {
+			return;
+		}
+
+		inlen = -1;
 		docallback = 1;
 		memset(&ev, 0, sizeof(struct epoll_event));
 
-		if (epoll_ctl(knet_h->send_to_links_epollfd,
+		if (epoll_ctl(worker->epollfd,
 			      EPOLL_CTL_DEL, knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created], &ev)) {
 			log_err(knet_h, KNET_SUB_TX, "Unable to del datafd %d from linkfd epoll pool: %s",
 				knet_h->sockfd[channel].sockfd[0], strerror(savederrno));
@@ -727,7 +1446,22 @@ static void _handle_send_to_links(knet_handle_t knet_h, int sockfd, uint8_t onwi
 			knet_h->sockfd[channel].has_error = 1;
 		}
 	} else {
-		_parse_recv_from_sock(knet_h, inlen, channel, onwire_ver, 0);
+		for (i = 0; i < msg_recv; i++) {
+			if (msg[i].msg_len == 0) {
+				/*
+				 * EOF, anything after this has no meaning
+				 */
+				inlen = 0;
+				savederrno = 0;
+				docallback = 1;
+				break;
+			}
+			if (msg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				log_warn(knet_h, KNET_SUB_TX, "Received truncated message from sock %d. Discarding", sockfd);
+				continue;
+			}
+			_parse_recv_from_sock(knet_h, worker, worker->recv_from_sock_buf[i], msg[i].msg_len, channel, onwire_ver, 0);
+		}
 	}
 
 	if (docallback) {
@@ -740,25 +1474,60 @@ static void _handle_send_to_links(knet_handle_t knet_h, int sockfd, uint8_t onwi
 	}
 }
 
+static int _tx_worker_shutdown_in_progress(struct knet_tx_worker *worker)
+{
+	knet_handle_t knet_h = worker->knet_h;
+	int savederrno = 0;
+	int ret;
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	ret = knet_h->fini_in_progress || worker->retired;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	return ret;
+}
+
+static void _tx_worker_release_seq_num(struct knet_tx_worker *worker)
+{
+	/*
+	 * seq_num_avail is also used by knet_send_sync under tx_mutex
+	 */
+	if (pthread_mutex_lock(&worker->tx_mutex) != 0) {
+		log_debug(worker->knet_h, KNET_SUB_TX, "Unable to get mutex lock");
+		return;
+	}
+	worker->seq_num_avail = 0;
+	pthread_mutex_unlock(&worker->tx_mutex);
+}
+
 void *_handle_send_to_links_thread(void *data)
 {
-	knet_handle_t knet_h = (knet_handle_t) data;
-	struct epoll_event events[KNET_EPOLL_MAX_EVENTS + 1]; /* see _init_epolls for + 1 */
+	struct knet_tx_worker *worker = (struct knet_tx_worker *) data;
+	knet_handle_t knet_h = worker->knet_h;
+	struct epoll_event events[KNET_EPOLL_MAX_EVENTS + 1]; /* see _tx_worker_init for + 1 */
 	int i, nev;
 	int flush, flush_queue_limit;
 	int8_t channel;
 	uint8_t onwire_ver;
 
-	set_thread_status(knet_h, KNET_THREAD_TX, KNET_THREAD_STARTED);
+	set_thread_status(knet_h, worker->thread_id, KNET_THREAD_STARTED);
 
 	memset(&events, 0, sizeof(events));
 
 	flush_queue_limit = 0;
 
-	while (!shutdown_in_progress(knet_h)) {
-		nev = epoll_wait(knet_h->send_to_links_epollfd, events, KNET_EPOLL_MAX_EVENTS + 1, knet_h->threads_timer_res / 1000);
+	while (!_tx_worker_shutdown_in_progress(worker)) {
+		nev = epoll_wait(worker->epollfd, events, KNET_EPOLL_MAX_EVENTS + 1, knet_h->threads_timer_res / 1000);
 
-		flush = get_thread_flush_queue(knet_h, KNET_THREAD_TX);
+		flush = get_thread_flush_queue(knet_h, worker->thread_id);
 
 		/*
 		 * we use timeout to detect if thread is shutting down
@@ -769,9 +1538,15 @@ void *_handle_send_to_links_thread(void *data)
 			 * the queue when we have an epoll timeout event
 			 */
 			if (flush == KNET_THREAD_QUEUE_FLUSH) {
-				set_thread_flush_queue(knet_h, KNET_THREAD_TX, KNET_THREAD_QUEUE_FLUSHED);
+				set_thread_flush_queue(knet_h, worker->thread_id, KNET_THREAD_QUEUE_FLUSHED);
 				flush_queue_limit = 0;
 			}
+			/*
+			 * do not hold on to reserved seq_num while idle, other workers
+			 * will move tx_seq_num forward and the RX side of other nodes
+			 * would consider them too old.
+			 */
+			_tx_worker_release_seq_num(worker);
 			continue;
 		}
 
@@ -787,7 +1562,7 @@ void *_handle_send_to_links_thread(void *data)
 		if (flush == KNET_THREAD_QUEUE_FLUSH) {
 			if (flush_queue_limit >= 100) {
 				log_debug(knet_h, KNET_SUB_TX, "Timeout flushing the TX queue, expect packet loss");
-				set_thread_flush_queue(knet_h, KNET_THREAD_TX, KNET_THREAD_QUEUE_FLUSHED);
+				set_thread_flush_queue(knet_h, worker->thread_id, KNET_THREAD_QUEUE_FLUSHED);
 				flush_queue_limit = 0;
 			} else {
 				flush_queue_limit++;
@@ -796,49 +1571,259 @@ void *_handle_send_to_links_thread(void *data)
 			flush_queue_limit = 0;
 		}
 
-		if (pthread_rwlock_rdlock(&knet_h->global_rwlock) != 0) {
-			log_debug(knet_h, KNET_SUB_TX, "Unable to get read lock");
-			continue;
-		}
+		if (pthread_rwlock_rdlock(&knet_h->global_rwlock) != 0) {
+			log_debug(knet_h, KNET_SUB_TX, "Unable to get read lock");
+			continue;
+		}
+
+		if (pthread_mutex_lock(&knet_h->onwire_mutex)) {
+			log_debug(knet_h, KNET_SUB_TX, "Unable to get onwire mutex lock");
+			goto out_unlock;
+		}
+		onwire_ver = knet_h->onwire_ver;
+		pthread_mutex_unlock(&knet_h->onwire_mutex);
+
+		for (i = 0; i < nev; i++) {
+			for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+				if ((knet_h->sockfd[channel].in_use) &&
+				    (knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created] == events[i].data.fd)) {
+					break;
+				}
+			}
+			if (channel >= KNET_DATAFD_MAX) {
+				log_debug(knet_h, KNET_SUB_TX, "No available channels");
+				continue; /* channel not found */
+			}
+			/*
+			 * the channel has been moved to another worker after
+			 * epoll_wait returned (see knet_handle_set_tx_threads)
+			 */
+			if (channel % knet_h->tx_threads != worker->worker_id) {
+				continue;
+			}
+			if (pthread_mutex_lock(&worker->tx_mutex) != 0) {
+				log_debug(knet_h, KNET_SUB_TX, "Unable to get mutex lock");
+				continue;
+			}
+			_handle_send_to_links(knet_h, worker, events[i].data.fd, onwire_ver, channel);
+			pthread_mutex_unlock(&worker->tx_mutex);
+		}
+out_unlock:
+		pthread_rwlock_unlock(&knet_h->global_rwlock);
+	}
+
+	if (worker->tx_bufs[KNET_TX_ZEROCOPY_BUFS - 1]) {
+		if (pthread_rwlock_rdlock(&knet_h->global_rwlock) == 0) {
+			_tx_bufs_zerocopy_drain(knet_h, worker);
+			pthread_rwlock_unlock(&knet_h->global_rwlock);
+		}
+	}
+
+	set_thread_status(knet_h, worker->thread_id, KNET_THREAD_STOPPED);
+
+	return NULL;
+}
+
+int _tx_worker_init(knet_handle_t knet_h, uint8_t worker_id)
+{
+	int savederrno = 0;
+	int i;
+	struct knet_tx_worker *worker;
+
+	worker = malloc(sizeof(struct knet_tx_worker));
+	if (!worker) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for TX worker %u: %s",
+			worker_id, strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+	memset(worker, 0, sizeof(struct knet_tx_worker));
+
+	worker->knet_h = knet_h;
+	worker->worker_id = worker_id;
+	worker->thread_id = KNET_THREAD_TX_WORKER(worker_id);
+	worker->epollfd = -1;
+
+	savederrno = pthread_mutex_init(&worker->tx_mutex, NULL);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to initialize TX worker %u mutex: %s",
+			worker_id, strerror(savederrno));
+		free(worker);
+		errno = savederrno;
+		return -1;
+	}
+
+	knet_h->tx_workers[worker_id] = worker;
+
+	worker->tx_bufs[0] = _tx_bufs_alloc(knet_h);
+	if (!worker->tx_bufs[0]) {
+		savederrno = errno;
+		goto exit_fail;
+	}
+	worker->bufs = worker->tx_bufs[0];
+	worker->tx_bufs_next = -1;
+
+	for (i = 0; i < KNET_TX_INGEST_BATCH; i++) {
+		worker->recv_from_sock_buf[i] = malloc(KNET_DATABUFSIZE);
+		if (!worker->recv_from_sock_buf[i]) {
+			savederrno = errno;
+			log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for app to datafd buffer: %s",
+				strerror(savederrno));
+			goto exit_fail;
+		}
+		memset(worker->recv_from_sock_buf[i], 0, KNET_DATABUFSIZE);
+	}
+
+	worker->send_to_links_buf_compress = malloc(KNET_DATABUFSIZE_COMPRESS);
+	if (!worker->send_to_links_buf_compress) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TX, "Unable to allocate memory for compress buffer: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+	memset(worker->send_to_links_buf_compress, 0, KNET_DATABUFSIZE_COMPRESS);
+
+	/*
+	 * even if the kernel does dynamic allocation with epoll_ctl
+	 * we need to reserve one extra for host to host communication
+	 */
+	worker->epollfd = epoll_create(KNET_EPOLL_MAX_EVENTS + 1);
+	if (worker->epollfd < 0) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TX, "Unable to create epoll datafd to link fd: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	if (_fdset_cloexec(worker->epollfd)) {
+		savederrno = errno;
+		log_err(knet_h, KNET_SUB_TX, "Unable to set CLOEXEC on datafd to link epoll fd: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	return 0;
+
+exit_fail:
+	_tx_worker_destroy(knet_h, worker_id);
+	errno = savederrno;
+	return -1;
+}
+
+void _tx_worker_destroy(knet_handle_t knet_h, uint8_t worker_id)
+{
+	struct knet_tx_worker *worker = knet_h->tx_workers[worker_id];
+	int i;
+
+	if (!worker) {
+		return;
+	}
+
+	for (i = 0; i < KNET_TX_ZEROCOPY_BUFS; i++) {
+		_tx_bufs_free(worker->tx_bufs[i]);
+	}
+	for (i = 0; i < KNET_TX_INGEST_BATCH; i++) {
+		free(worker->recv_from_sock_buf[i]);
+	}
+	free(worker->send_to_links_buf_compress);
+
+	if (worker->epollfd >= 0) {
+		close(worker->epollfd);
+	}
+
+	pthread_mutex_destroy(&worker->tx_mutex);
+	free(worker);
+	knet_h->tx_workers[worker_id] = NULL;
+}
+
+int _tx_worker_start(knet_handle_t knet_h, uint8_t worker_id)
+{
+	struct knet_tx_worker *worker = knet_h->tx_workers[worker_id];
+	int savederrno = 0;
+	pthread_attr_t attr;
+
+	savederrno = pthread_attr_init(&attr);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to init pthread attributes: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	savederrno = pthread_attr_setstacksize(&attr, KNET_THREAD_STACK_SIZE);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to set stack size attribute: %s",
+			strerror(savederrno));
+		goto exit_fail;
+	}
+
+	set_thread_status(knet_h, worker->thread_id, KNET_THREAD_REGISTERED);
+	savederrno = pthread_create(&worker->thread, &attr,
+				    _handle_send_to_links_thread, (void *) worker);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_TX, "Unable to start datafd to link thread %u: %s",
+			worker_id, strerror(savederrno));
+		set_thread_status(knet_h, worker->thread_id, KNET_THREAD_UNREGISTERED);
+		worker->thread = 0;
+		goto exit_fail;
+	}
 
-		if (pthread_mutex_lock(&knet_h->onwire_mutex)) {
-			log_debug(knet_h, KNET_SUB_TX, "Unable to get onwire mutex lock");
-			goto out_unlock;
-		}
-		onwire_ver = knet_h->onwire_ver;
-		pthread_mutex_unlock(&knet_h->onwire_mutex);
+exit_fail:
+	pthread_attr_destroy(&attr);
+	errno = savederrno;
+	return savederrno ? -1 : 0;
+}
 
-		for (i = 0; i < nev; i++) {
-			for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
-				if ((knet_h->sockfd[channel].in_use) &&
-				    (knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created] == events[i].data.fd)) {
-					break;
-				}
-			}
-			if (channel >= KNET_DATAFD_MAX) {
-				log_debug(knet_h, KNET_SUB_TX, "No available channels");
-				continue; /* channel not found */
-			}
-			if (pthread_mutex_lock(&knet_h->tx_mutex) != 0) {
-				log_debug(knet_h, KNET_SUB_TX, "Unable to get mutex lock");
-				continue;
+void _tx_worker_stop(knet_handle_t knet_h, uint8_t worker_id)
+{
+	struct knet_tx_worker *worker = knet_h->tx_workers[worker_id];
+	void *retval;
+
+	if ((worker) && (worker->thread)) {
+		pthread_cancel(worker->thread);
+		pthread_join(worker->thread, &retval);
+		worker->thread = 0;
+	}
+}
+
+/*
+ * lock out all TX workers. Caller must hold global_rwlock
+ * to guarantee that the pool doesn't change in between.
+ */
+int _tx_workers_lock(knet_handle_t knet_h)
+{
+	int savederrno = 0;
+	uint8_t i;
+
+	for (i = 0; i < knet_h->tx_threads; i++) {
+		savederrno = pthread_mutex_lock(&knet_h->tx_workers[i]->tx_mutex);
+		if (savederrno) {
+			while (i > 0) {
+				i--;
+				pthread_mutex_unlock(&knet_h->tx_workers[i]->tx_mutex);
 			}
-			_handle_send_to_links(knet_h, events[i].data.fd, onwire_ver, channel);
-			pthread_mutex_unlock(&knet_h->tx_mutex);
+			return savederrno;
 		}
-out_unlock:
-		pthread_rwlock_unlock(&knet_h->global_rwlock);
 	}
 
-	set_thread_status(knet_h, KNET_THREAD_TX, KNET_THREAD_STOPPED);
+	return 0;
+}
+
+void _tx_workers_unlock(knet_handle_t knet_h)
+{
+	uint8_t i;
 
-	return NULL;
+	for (i = knet_h->tx_threads; i > 0; i--) {
+		pthread_mutex_unlock(&knet_h->tx_workers[i - 1]->tx_mutex);
+	}
 }
 
 int knet_send_sync(knet_handle_t knet_h, const char *buff, const size_t buff_len, const int8_t channel)
 {
 	int savederrno = 0, err = 0;
 	uint8_t onwire_ver;
+	struct knet_tx_worker *worker;
 
 	if (!_is_valid_handle(knet_h)) {
 		return -1;
@@ -896,7 +1881,12 @@ int knet_send_sync(knet_handle_t knet_h, const char *buff, const size_t buff_len
 	onwire_ver = knet_h->onwire_ver;
 	pthread_mutex_unlock(&knet_h->onwire_mutex);
 
-	savederrno = pthread_mutex_lock(&knet_h->tx_mutex);
+	/*
+	 * use the buffers of the worker owning the channel to preserve ordering
+	 */
+	worker = knet_h->tx_workers[channel % knet_h->tx_threads];
+
+	savederrno = pthread_mutex_lock(&worker->tx_mutex);
 	if (savederrno) {
 		log_err(knet_h, KNET_SUB_TX, "Unable to get TX mutex lock: %s",
 			strerror(savederrno));
@@ -905,11 +1895,11 @@ int knet_send_sync(knet_handle_t knet_h, const char *buff, const size_t buff_len
 	}
 
 	if (knet_h->onwire_ver_remap) {
-		memmove(get_data_v1(knet_h, knet_h->recv_from_sock_buf), buff, buff_len);
+		memmove(get_data_v1(knet_h, worker->recv_from_sock_buf[0]), buff, buff_len);
 	} else {
 		switch (onwire_ver) {
 			case 1:
-				memmove(get_data_v1(knet_h, knet_h->recv_from_sock_buf), buff, buff_len);
+				memmove(get_data_v1(knet_h, worker->recv_from_sock_buf[0]), buff, buff_len);
 				break;
 			default:
 				log_warn(knet_h, KNET_SUB_TX, "preparing sync data onwire version %u not supported", onwire_ver);
@@ -918,11 +1908,11 @@ int knet_send_sync(knet_handle_t knet_h, const char *buff, const size_t buff_len
 		}
 	}
 
-	err = _parse_recv_from_sock(knet_h, buff_len, channel, onwire_ver, 1);
+	err = _parse_recv_from_sock(knet_h, worker, worker->recv_from_sock_buf[0], buff_len, channel, onwire_ver, 1);
 	savederrno = errno;
 
 out_tx:
-	pthread_mutex_unlock(&knet_h->tx_mutex);
+	pthread_mutex_unlock(&worker->tx_mutex);
 out:
 	pthread_rwlock_unlock(&knet_h->global_rwlock);
 
@@ -979,6 +1969,17 @@ ssize_t knet_send(knet_handle_t knet_h, const char *buff, const size_t buff_len,
 		goto out_unlock;
 	}
 
+	if (knet_h->sockfd[channel].tx_ring) {
+		if (_ring_push(knet_h->sockfd[channel].tx_ring, buff, buff_len) < 0) {
+			savederrno = errno;
+			err = -1;
+			goto out_unlock;
+		}
+		_ring_wakeup(knet_h->sockfd[channel].tx_ring);
+		err = buff_len;
+		goto out_unlock;
+	}
+
 	memset(iov_out, 0, sizeof(iov_out));
 
 	iov_out[0].iov_base = (void *)buff;
@@ -992,3 +1993,351 @@ out_unlock:
 	errno = err ? savederrno : 0;
 	return err;
 }
+
+/*
+ * knet_mmsghdr has the same layout as mmsghdr. Datafds that are
+ * not sockets are written one message at a time, rings are woken
+ * up once for all messages
+ */
+static int _send_msgs_to_datafd(knet_handle_t knet_h, int8_t channel, struct knet_mmsghdr *msg, unsigned int vlen)
+{
+	int sockfd = knet_h->sockfd[channel].sockfd[0];
+	struct knet_ring *ring = knet_h->sockfd[channel].tx_ring;
+	ssize_t outlen;
+	unsigned int i;
+
+	if (ring) {
+		for (i = 0; i < vlen; i++) {
+			if (_ring_push(ring, msg[i].msg_hdr.msg_iov->iov_base, msg[i].msg_hdr.msg_iov->iov_len) < 0) {
+				break;
+			}
+			msg[i].msg_len = msg[i].msg_hdr.msg_iov->iov_len;
+		}
+		if (i > 0) {
+			_ring_wakeup(ring);
+		}
+		return ((i > 0) ? (int)i : -1);
+	}
+
+	if (knet_h->sockfd[channel].is_socket) {
+#ifdef HAVE_SENDMMSG
+		return sendmmsg(sockfd, (struct mmsghdr *)msg, vlen, MSG_NOSIGNAL);
+#else
+		return _sendmmsg(sockfd, 0, msg, vlen, MSG_NOSIGNAL);
+#endif
+	}
+
+	for (i = 0; i < vlen; i++) {
+		outlen = writev(sockfd, msg[i].msg_hdr.msg_iov, 1);
+		if (outlen < 0) {
+			break;
+		}
+		msg[i].msg_len = outlen;
+	}
+
+	return ((i > 0) ? (int)i : -1);
+}
+
+int knet_sendmmsg(knet_handle_t knet_h, struct knet_msg *msgvec, const unsigned int vlen)
+{
+	int savederrno = 0;
+	int err = 0;
+	unsigned int i, sent = 0, msgs;
+	int8_t channel;
+	struct iovec iov_out[KNET_API_MMSG_BATCH];
+	struct knet_mmsghdr msg[KNET_API_MMSG_BATCH];
+
+	if (!_is_valid_handle(knet_h)) {
+		return -1;
+	}
+
+	if ((msgvec == NULL) || (vlen == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < vlen; i++) {
+		if ((msgvec[i].buff == NULL) ||
+		    (msgvec[i].buff_len <= 0) ||
+		    (msgvec[i].buff_len > KNET_MAX_PACKET_SIZE) ||
+		    (msgvec[i].channel < 0) ||
+		    (msgvec[i].channel >= KNET_DATAFD_MAX)) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	while (sent < vlen) {
+		channel = msgvec[sent].channel;
+
+		if (!knet_h->sockfd[channel].in_use) {
+			savederrno = EINVAL;
+			break;
+		}
+
+		/*
+		 * send consecutive messages for the same channel at once
+		 */
+		msgs = 0;
+		while ((sent + msgs < vlen) &&
+		       (msgs < KNET_API_MMSG_BATCH) &&
+		       (msgvec[sent + msgs].channel == channel)) {
+			iov_out[msgs].iov_base = msgvec[sent + msgs].buff;
+			iov_out[msgs].iov_len = msgvec[sent + msgs].buff_len;
+			memset(&msg[msgs], 0, sizeof(struct knet_mmsghdr));
+			msg[msgs].msg_hdr.msg_iov = &iov_out[msgs];
+			msg[msgs].msg_hdr.msg_iovlen = 1;
+			msgs++;
+		}
+
+		err = _send_msgs_to_datafd(knet_h, channel, msg, msgs);
+		if (err <= 0) {
+			savederrno = errno;
+			break;
+		}
+
+		for (i = 0; i < (unsigned int)err; i++) {
+			msgvec[sent + i].msg_len = msg[i].msg_len;
+		}
+		sent += err;
+
+		if ((unsigned int)err < msgs) {
+			break;
+		}
+	}
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	if (sent) {
+		errno = 0;
+		return sent;
+	}
+
+	errno = savederrno;
+	return -1;
+}
+
+static int _tx_workers_move_datafds(knet_handle_t knet_h, uint8_t old_tx_threads, uint8_t new_tx_threads)
+{
+	int savederrno = 0;
+	int8_t channel, i;
+	int datafd;
+	struct epoll_event ev;
+
+	/*
+	 * add all datafds to the new owners first, so that we can roll back
+	 * on errors. A datafd can be in multiple epoll sets and workers will
+	 * skip events for channels they don't own.
+	 */
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		if ((!knet_h->sockfd[channel].in_use) ||
+		    (knet_h->sockfd[channel].has_error) ||
+		    (channel % old_tx_threads == channel % new_tx_threads)) {
+			continue;
+		}
+
+		datafd = knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created];
+
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = EPOLLIN;
+		ev.data.fd = datafd;
+
+		if (epoll_ctl(knet_h->tx_workers[channel % new_tx_threads]->epollfd,
+			      EPOLL_CTL_ADD, datafd, &ev)) {
+			savederrno = errno;
+			log_err(knet_h, KNET_SUB_TX, "Unable to add datafd %d to TX worker %u epoll pool: %s",
+				datafd, channel % new_tx_threads, strerror(savederrno));
+			goto exit_fail;
+		}
+	}
+
+	for (channel = 0; channel < KNET_DATAFD_MAX; channel++) {
+		if ((!knet_h->sockfd[channel].in_use) ||
+		    (knet_h->sockfd[channel].has_error) ||
+		    (channel % old_tx_threads == channel % new_tx_threads)) {
+			continue;
+		}
+
+		datafd = knet_h->sockfd[channel].sockfd[knet_h->sockfd[channel].is_created];
+
+		memset(&ev, 0, sizeof(struct epoll_event));
+
+		if (epoll_ctl(knet_h->tx_workers[channel % old_tx_threads]->epollfd,
+			      EPOLL_CTL_DEL, datafd, &ev)) {
+			log_debug(knet_h, KNET_SUB_TX, "Unable to del datafd %d from TX worker %u epoll pool: %s",
+				  datafd, channel % old_tx_threads, strerror(errno));
+		}
+	}
+
+	return 0;
+
+exit_fail:
+	for (i = 0; i < channel; i++) {
+		if ((!knet_h->sockfd[i].in_use) ||
+		    (knet_h->sockfd[i].has_error) ||
+		    (i % old_tx_threads == i % new_tx_threads)) {
+			continue;
+		}
+
+		memset(&ev, 0, sizeof(struct epoll_event));
+
+		epoll_ctl(knet_h->tx_workers[i % new_tx_threads]->epollfd,
+			  EPOLL_CTL_DEL, knet_h->sockfd[i].sockfd[knet_h->sockfd[i].is_created], &ev);
+	}
+	errno = savederrno;
+	return -1;
+}
+
+/*
+ * workers in the range have been flagged as retired and
+ * will exit at the next loop
+ */
+static void _tx_workers_join(knet_handle_t knet_h, uint8_t first_worker, uint8_t last_worker)
+{
+	struct knet_tx_worker *worker;
+	void *retval;
+	uint8_t i;
+
+	for (i = first_worker; i < last_worker; i++) {
+		worker = knet_h->tx_workers[i];
+		if (!worker) {
+			continue;
+		}
+		if (worker->thread) {
+			pthread_join(worker->thread, &retval);
+			worker->thread = 0;
+			set_thread_status(knet_h, worker->thread_id, KNET_THREAD_UNREGISTERED);
+			set_thread_flush_queue(knet_h, worker->thread_id, KNET_THREAD_QUEUE_FLUSHED);
+		}
+		_tx_worker_destroy(knet_h, i);
+	}
+}
+
+int knet_handle_set_tx_threads(knet_handle_t knet_h,
+			       uint8_t tx_threads)
+{
+	int savederrno = 0, err = 0, locked = 0;
+	uint8_t old_tx_threads, i;
+
+	if (!_is_valid_handle(knet_h)) {
+		return -1;
+	}
+
+	if ((!tx_threads) || (tx_threads > KNET_MAX_TX_THREADS)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_mutex_lock(&knet_h->tx_threads_mutex);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get TX threads mutex lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	/*
+	 * tx_threads can only change while holding tx_threads_mutex
+	 */
+	old_tx_threads = knet_h->tx_threads;
+
+	if (tx_threads == old_tx_threads) {
+		goto out_unlock;
+	}
+
+	/*
+	 * new workers don't own any channel until datafds are moved
+	 */
+	for (i = old_tx_threads; i < tx_threads; i++) {
+		if (_tx_worker_init(knet_h, i) < 0) {
+			savederrno = errno;
+			err = -1;
+			goto out_cleanup;
+		}
+		if (_tx_worker_start(knet_h, i) < 0) {
+			savederrno = errno;
+			err = -1;
+			goto out_cleanup;
+		}
+	}
+
+	savederrno = get_global_wrlock(knet_h);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get write lock: %s",
+			strerror(savederrno));
+		err = -1;
+		goto out_cleanup;
+	}
+
+	if (_tx_workers_move_datafds(knet_h, old_tx_threads, tx_threads) < 0) {
+		savederrno = errno;
+		err = -1;
+		pthread_rwlock_unlock(&knet_h->global_rwlock);
+		goto out_cleanup;
+	}
+
+	knet_h->tx_threads = tx_threads;
+	for (i = tx_threads; i < old_tx_threads; i++) {
+		knet_h->tx_workers[i]->retired = 1;
+	}
+
+	log_debug(knet_h, KNET_SUB_HANDLE, "TX threads changed from %u to %u", old_tx_threads, tx_threads);
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+
+	_tx_workers_join(knet_h, tx_threads, old_tx_threads);
+	goto out_unlock;
+
+out_cleanup:
+	locked = !get_global_wrlock(knet_h);
+	for (i = old_tx_threads; i < tx_threads; i++) {
+		if (knet_h->tx_workers[i]) {
+			knet_h->tx_workers[i]->retired = 1;
+		}
+	}
+	if (locked) {
+		pthread_rwlock_unlock(&knet_h->global_rwlock);
+	}
+	_tx_workers_join(knet_h, old_tx_threads, tx_threads);
+
+out_unlock:
+	pthread_mutex_unlock(&knet_h->tx_threads_mutex);
+	errno = err ? savederrno : 0;
+	return err;
+}
+
+int knet_handle_get_tx_threads(knet_handle_t knet_h,
+			       uint8_t *tx_threads)
+{
+	int savederrno = 0;
+
+	if (!_is_valid_handle(knet_h)) {
+		return -1;
+	}
+
+	if (!tx_threads) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savederrno = pthread_rwlock_rdlock(&knet_h->global_rwlock);
+	if (savederrno) {
+		log_err(knet_h, KNET_SUB_HANDLE, "Unable to get read lock: %s",
+			strerror(savederrno));
+		errno = savederrno;
+		return -1;
+	}
+
+	*tx_threads = knet_h->tx_threads;
+
+	pthread_rwlock_unlock(&knet_h->global_rwlock);
+	return 0;
+}
@@ -12,4 +12,11 @@
 
 void *_handle_send_to_links_thread(void *data);
 
+int _tx_worker_init(knet_handle_t knet_h, uint8_t worker_id);
+void _tx_worker_destroy(knet_handle_t knet_h, uint8_t worker_id);
+int _tx_worker_start(knet_handle_t knet_h, uint8_t worker_id);
+void _tx_worker_stop(knet_handle_t knet_h, uint8_t worker_id);
+int _tx_workers_lock(knet_handle_t knet_h);
+void _tx_workers_unlock(knet_handle_t knet_h);
+
 #endif
@@ -964,6 +964,7 @@ static void _handle_listen_sctp_errors(knet_handle_t knet_h)
 				host->link[link_idx].status.dynconnected = 0;
 				host->link[link_idx].transport_connected = 0;
 				host->link[link_idx].outsock = 0;
+				_link_addr_index_del(knet_h, &host->link[link_idx]);
 				memset(&host->link[link_idx].dst_addr, 0, sizeof(struct sockaddr_storage));
 			}
 		}
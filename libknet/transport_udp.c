@@ -17,6 +17,7 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
+#include <netinet/udp.h>
 #include <net/if.h>
 #if defined (IP_RECVERR) || defined (IPV6_RECVERR)
 #include <linux/errqueue.h>
@@ -43,8 +44,115 @@ typedef struct udp_link_info {
 	struct sockaddr_storage local_address;
 	int socket_fd;
 	int on_epoll;
+	uint8_t zerocopy;		/* SO_ZEROCOPY is set on the socket, atomic (cleared by RX/TX threads) */
+	pthread_mutex_t zc_mutex;	/* serialize TX threads sending with MSG_ZEROCOPY */
+	uint32_t zc_next;		/* id the kernel gives to the next MSG_ZEROCOPY send, protected by zc_mutex */
+	uint64_t zc_sock_id;		/* tells this socket apart from a later one with the same fd */
+	pthread_mutex_t zc_done_mutex;	/* protects zc_done and zc_done_bits */
+	uint32_t zc_done;		/* all the sends before this id have been released */
+	uint64_t zc_done_bits[KNET_UDP_ZEROCOPY_WINDOW / 64]; /* sends released out of order, indexed by id % window */
 } udp_link_info_t;
 
+static uint64_t udp_zc_sock_id;
+
+static void udp_transport_zerocopy_drain(knet_handle_t knet_h, udp_link_info_t *info);
+
+/*
+ * how long to wait for the kernel to release MSG_ZEROCOPY buffers
+ * before closing a socket (in threads_timer_res / 1000 units)
+ */
+#define KNET_UDP_ZEROCOPY_WAIT_LOOPS 1000
+
+/*
+ * UDP_SEGMENT is passed as cmsg on each send, here we only check
+ * that the kernel knows about it. Network devices that cannot
+ * offload checksums will return EIO at send time and the TX
+ * thread will disable GSO for the link.
+ */
+static void udp_transport_link_set_gso(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+#ifdef UDP_SEGMENT
+	int value;
+	socklen_t value_len = sizeof(value);
+#endif
+
+	__atomic_store_n(&kn_link->udp_gso, 0, __ATOMIC_RELAXED);
+
+	if (!(kn_link->flags & KNET_LINK_FLAG_UDP_GSO)) {
+		return;
+	}
+
+#ifdef UDP_SEGMENT
+	if (getsockopt(kn_link->outsock, IPPROTO_UDP, UDP_SEGMENT, &value, &value_len) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP GSO not supported on socket %d: %s",
+			  kn_link->outsock, strerror(errno));
+		return;
+	}
+	__atomic_store_n(&kn_link->udp_gso, 1, __ATOMIC_RELAXED);
+	log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP GSO enabled on socket: %d", kn_link->outsock);
+#else
+	log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP GSO not available in this build/platform");
+#endif
+}
+
+/*
+ * coalesced packets are split back in the RX thread
+ * using the UDP_GRO cmsg (see _handle_recv_from_links)
+ */
+static void udp_transport_link_set_gro(knet_handle_t knet_h, struct knet_link *kn_link)
+{
+#ifdef UDP_GRO
+	int value = 1;
+#endif
+
+	if (!(kn_link->flags & KNET_LINK_FLAG_UDP_GRO)) {
+		return;
+	}
+
+#ifdef UDP_GRO
+	if (setsockopt(kn_link->outsock, IPPROTO_UDP, UDP_GRO, &value, sizeof(value)) < 0) {
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP GRO not supported on socket %d: %s",
+			  kn_link->outsock, strerror(errno));
+		return;
+	}
+	log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP GRO enabled on socket: %d", kn_link->outsock);
+#else
+	log_debug(knet_h, KNET_SUB_TRANSP_UDP, "UDP GRO not available in this build/platform");
+#endif
+}
+
+/*
+ * SO_ZEROCOPY only allows MSG_ZEROCOPY to be used on the socket,
+ * sends without the flag are not affected.
+ */
+static void udp_transport_link_set_zerocopy(knet_handle_t knet_h, struct knet_link *kn_link, udp_link_info_t *info)
+{
+#ifdef SO_ZEROCOPY
+	int value = 1;
+#endif
+
+	kn_link->udp_zerocopy = 0;
+
+	if (!(kn_link->flags & KNET_LINK_FLAG_ZEROCOPY)) {
+		return;
+	}
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+	if (!__atomic_load_n(&info->zerocopy, __ATOMIC_RELAXED)) {
+		if (setsockopt(info->socket_fd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0) {
+			log_debug(knet_h, KNET_SUB_TRANSP_UDP, "MSG_ZEROCOPY not supported on socket %d: %s",
+				  info->socket_fd, strerror(errno));
+			return;
+		}
+		__atomic_store_n(&info->zerocopy, 1, __ATOMIC_RELAXED);
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "MSG_ZEROCOPY enabled on socket: %d", info->socket_fd);
+	}
+	kn_link->udp_zerocopy = 1;
+#else
+	log_debug(knet_h, KNET_SUB_TRANSP_UDP, "MSG_ZEROCOPY not available in this build/platform");
+#endif
+}
+
 int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_link)
 {
 	int err = 0, savederrno = 0;
@@ -62,6 +170,9 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 			kn_link->outsock = info->socket_fd;
 			kn_link->transport_link = info;
 			kn_link->transport_connected = 1;
+			udp_transport_link_set_gso(knet_h, kn_link);
+			udp_transport_link_set_gro(knet_h, kn_link);
+			udp_transport_link_set_zerocopy(knet_h, kn_link, info);
 			return 0;
 		}
 	}
@@ -73,6 +184,29 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 	}
 	memset(info, 0, sizeof(udp_link_info_t));
 
+	savederrno = pthread_mutex_init(&info->zc_mutex, NULL);
+	if (savederrno) {
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to initialize zerocopy mutex: %s",
+			strerror(savederrno));
+		free(info);
+		info = NULL;
+		goto exit_error;
+	}
+
+	savederrno = pthread_mutex_init(&info->zc_done_mutex, NULL);
+	if (savederrno) {
+		err = -1;
+		log_err(knet_h, KNET_SUB_TRANSP_UDP, "Unable to initialize zerocopy done mutex: %s",
+			strerror(savederrno));
+		pthread_mutex_destroy(&info->zc_mutex);
+		free(info);
+		info = NULL;
+		goto exit_error;
+	}
+
+	info->zc_sock_id = __atomic_add_fetch(&udp_zc_sock_id, 1, __ATOMIC_RELAXED);
+
 	sock = socket(kn_link->src_addr.ss_family, SOCK_DGRAM, 0);
 	if (sock < 0) {
 		savederrno = errno;
@@ -181,6 +315,9 @@ int udp_transport_link_set_config(knet_handle_t knet_h, struct knet_link *kn_lin
 	kn_link->outsock = sock;
 	kn_link->transport_link = info;
 	kn_link->transport_connected = 1;
+	udp_transport_link_set_gso(knet_h, kn_link);
+	udp_transport_link_set_gro(knet_h, kn_link);
+	udp_transport_link_set_zerocopy(knet_h, kn_link, info);
 
 exit_error:
 	if (err) {
@@ -188,6 +325,8 @@ exit_error:
 			if (info->on_epoll) {
 				epoll_ctl(knet_h->recv_from_links_epollfd, EPOLL_CTL_DEL, sock, &ev);
 			}
+			pthread_mutex_destroy(&info->zc_done_mutex);
+			pthread_mutex_destroy(&info->zc_mutex);
 			free(info);
 		}
 		if (sock >= 0) {
@@ -249,8 +388,12 @@ int udp_transport_link_clear_config(knet_handle_t knet_h, struct knet_link *kn_l
 		goto exit_error;
 	}
 
+	udp_transport_zerocopy_drain(knet_h, info);
+
 	close(info->socket_fd);
 	qb_list_del(&info->list);
+	pthread_mutex_destroy(&info->zc_done_mutex);
+	pthread_mutex_destroy(&info->zc_mutex);
 	free(kn_link->transport_link);
 
 exit_error:
@@ -308,6 +451,56 @@ int udp_transport_init(knet_handle_t knet_h)
 }
 
 #if defined (IP_RECVERR) || defined (IPV6_RECVERR)
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+/*
+ * the kernel reports the range of MSG_ZEROCOPY sends that have been
+ * completed, not necessarily in order. If the kernel had to copy the
+ * data anyway (for example on loopback or with devices without
+ * scatter/gather support), zerocopy is only overhead, stop using it
+ * on this socket.
+ */
+static void udp_transport_zerocopy_done(knet_handle_t knet_h, int sockfd, struct sock_extended_err *sock_err)
+{
+	udp_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+	uint32_t id, ids = sock_err->ee_data - sock_err->ee_info + 1;
+
+	if ((knet_h->knet_transport_fd_tracker[sockfd].transport != KNET_TRANSPORT_UDP) || (!info)) {
+		return;
+	}
+
+	if (pthread_mutex_lock(&info->zc_done_mutex) != 0) {
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Unable to get zerocopy mutex lock");
+		return;
+	}
+	/*
+	 * udp_transport_tx_zerocopy_begin never lets more than
+	 * KNET_UDP_ZEROCOPY_WINDOW sends be in flight
+	 */
+	if (ids > KNET_UDP_ZEROCOPY_WINDOW) {
+		ids = KNET_UDP_ZEROCOPY_WINDOW;
+	}
+	for (id = sock_err->ee_info; ids > 0; id++, ids--) {
+		if ((uint32_t)(id - info->zc_done) < KNET_UDP_ZEROCOPY_WINDOW) {
+			info->zc_done_bits[(id % KNET_UDP_ZEROCOPY_WINDOW) / 64] |= 1ULL << (id % 64);
+		}
+	}
+	while (info->zc_done_bits[(info->zc_done % KNET_UDP_ZEROCOPY_WINDOW) / 64] & (1ULL << (info->zc_done % 64))) {
+		info->zc_done_bits[(info->zc_done % KNET_UDP_ZEROCOPY_WINDOW) / 64] &= ~(1ULL << (info->zc_done % 64));
+		info->zc_done++;
+	}
+	pthread_mutex_unlock(&info->zc_done_mutex);
+
+	/*
+	 * the error queue can be drained by the RX thread or any TX worker,
+	 * while the other TX workers check the flag without locks
+	 */
+	if ((sock_err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) &&
+	    (__atomic_exchange_n(&info->zerocopy, 0, __ATOMIC_RELAXED))) {
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Kernel is copying MSG_ZEROCOPY data on socket %d. Disabling MSG_ZEROCOPY", sockfd);
+	}
+}
+#endif
+
 static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 {
 	int err = 0, savederrno = 0;
@@ -333,9 +526,9 @@ static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 	msg.msg_iovlen = 1;
 	msg.msg_flags = 0;
 	msg.msg_control = buffer;
-	msg.msg_controllen = sizeof(buffer);
 
 	for (;;) {
+		msg.msg_controllen = sizeof(buffer);
 		err = recvmsg(sockfd, &msg, MSG_ERRQUEUE);
 		savederrno = errno;
 		if (err < 0) {
@@ -372,6 +565,11 @@ static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 							 * those errors are way too noisy
 							 */
 							break;
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+						case SO_EE_ORIGIN_ZEROCOPY: /* MSG_ZEROCOPY buffers released */
+							udp_transport_zerocopy_done(knet_h, sockfd, sock_err);
+							break;
+#endif
 						case SO_EE_ORIGIN_ICMP:  /* ICMP */
 						case SO_EE_ORIGIN_ICMP6: /* ICMP6 */
 							origin = (struct sockaddr_storage *)(void *)SO_EE_OFFENDER(sock_err);
@@ -445,6 +643,117 @@ static int read_errs_from_sock(knet_handle_t knet_h, int sockfd)
 }
 #endif
 
+static uint32_t udp_transport_zerocopy_in_flight(udp_link_info_t *info)
+{
+	uint32_t done;
+
+	pthread_mutex_lock(&info->zc_done_mutex);
+	done = info->zc_done;
+	pthread_mutex_unlock(&info->zc_done_mutex);
+
+	return info->zc_next - done;
+}
+
+/*
+ * the socket is going away, give the kernel a chance to release
+ * the buffers that are still in flight. TX threads consider them
+ * released as soon as the socket is gone (see udp_transport_tx_zerocopy_done).
+ */
+static void udp_transport_zerocopy_drain(knet_handle_t knet_h, udp_link_info_t *info)
+{
+	int loops = 0;
+
+	while ((udp_transport_zerocopy_in_flight(info)) &&
+	       (loops < KNET_UDP_ZEROCOPY_WAIT_LOOPS)) {
+		read_errs_from_sock(knet_h, info->socket_fd);
+		if (!udp_transport_zerocopy_in_flight(info)) {
+			break;
+		}
+		usleep(knet_h->threads_timer_res / 1000);
+		loops++;
+	}
+
+	if (udp_transport_zerocopy_in_flight(info)) {
+		log_warn(knet_h, KNET_SUB_TRANSP_UDP, "Closing socket %d with %u MSG_ZEROCOPY sends not released by the kernel",
+			 info->socket_fd, udp_transport_zerocopy_in_flight(info));
+	}
+}
+
+int udp_transport_tx_zerocopy_begin(knet_handle_t knet_h, int sockfd, int msgs)
+{
+	udp_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+	int savederrno;
+
+	if ((!info) || (!__atomic_load_n(&info->zerocopy, __ATOMIC_RELAXED))) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	savederrno = pthread_mutex_lock(&info->zc_mutex);
+	if (savederrno) {
+		log_debug(knet_h, KNET_SUB_TRANSP_UDP, "Unable to get zerocopy mutex lock");
+		errno = savederrno;
+		return -1;
+	}
+
+	if (udp_transport_zerocopy_in_flight(info) + msgs > KNET_UDP_ZEROCOPY_WINDOW) {
+		pthread_mutex_unlock(&info->zc_mutex);
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * the kernel numbers MSG_ZEROCOPY sends on each socket,
+ * zc_mutex is held between begin and end so that the
+ * ids of the batch are known
+ */
+void udp_transport_tx_zerocopy_end(knet_handle_t knet_h, int sockfd, int sent_msgs, struct knet_tx_zc_pending *zc)
+{
+	udp_link_info_t *info = knet_h->knet_transport_fd_tracker[sockfd].data;
+
+	info->zc_next += sent_msgs;
+
+	zc->sockfd = sockfd;
+	zc->transport = KNET_TRANSPORT_UDP;
+	zc->sock_id = info->zc_sock_id;
+	zc->last = info->zc_next - 1;
+
+	pthread_mutex_unlock(&info->zc_mutex);
+}
+
+/*
+ * completions are normally reaped by the RX thread, look at the
+ * error queue only if they haven't arrived yet
+ */
+int udp_transport_tx_zerocopy_done(knet_handle_t knet_h, struct knet_tx_zc_pending *zc)
+{
+	udp_link_info_t *info = knet_h->knet_transport_fd_tracker[zc->sockfd].data;
+	int i;
+
+	if ((knet_h->knet_transport_fd_tracker[zc->sockfd].transport != KNET_TRANSPORT_UDP) ||
+	    (!info) || (info->zc_sock_id != zc->sock_id)) {
+		return 1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		pthread_mutex_lock(&info->zc_done_mutex);
+		if ((int32_t)(zc->last - info->zc_done) < 0) {
+			pthread_mutex_unlock(&info->zc_done_mutex);
+			return 1;
+		}
+		pthread_mutex_unlock(&info->zc_done_mutex);
+
+		if (!i) {
+			read_errs_from_sock(knet_h, zc->sockfd);
+		}
+	}
+
+	return 0;
+}
+
 transport_sock_error_t udp_transport_rx_sock_error(knet_handle_t knet_h, int sockfd, int recv_err, int recv_errno)
 {
 	if (recv_errno == EAGAIN) {
@@ -24,5 +24,8 @@ transport_sock_error_t udp_transport_tx_sock_error(knet_handle_t knet_h, int soc
 transport_rx_isdata_t udp_transport_rx_is_data(knet_handle_t knet_h, int sockfd, struct knet_mmsghdr *msg);
 int udp_transport_link_dyn_connect(knet_handle_t knet_h, int sockfd, struct knet_link *kn_link);
 int udp_transport_link_is_down(knet_handle_t knet_h, struct knet_link *kn_link);
+int udp_transport_tx_zerocopy_begin(knet_handle_t knet_h, int sockfd, int msgs);
+void udp_transport_tx_zerocopy_end(knet_handle_t knet_h, int sockfd, int sent_msgs, struct knet_tx_zc_pending *zc);
+int udp_transport_tx_zerocopy_done(knet_handle_t knet_h, struct knet_tx_zc_pending *zc);
 
 #endif
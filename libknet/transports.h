@@ -22,5 +22,8 @@ int transport_get_proto(knet_handle_t knet_h, uint8_t transport);
 int transport_get_acl_type(knet_handle_t knet_h, uint8_t transport);
 int transport_get_connection_oriented(knet_handle_t knet_h, uint8_t transport);
 int transport_link_is_down(knet_handle_t knet_h, struct knet_link *link);
+int transport_tx_zerocopy_begin(knet_handle_t knet_h, uint8_t transport, int sockfd, int msgs);
+void transport_tx_zerocopy_end(knet_handle_t knet_h, uint8_t transport, int sockfd, int sent_msgs, struct knet_tx_zc_pending *zc);
+int transport_tx_zerocopy_done(knet_handle_t knet_h, uint8_t transport, struct knet_tx_zc_pending *zc);
 
 #endif